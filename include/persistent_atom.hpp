@@ -0,0 +1,229 @@
+#ifndef PERSISTENT_ATOM_HPP
+#define PERSISTENT_ATOM_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+// -----------------------------------------
+// --------- Атомарная ячейка версии -------
+// -----------------------------------------
+//
+// Atom<S> хранит текущую версию персистентной структуры, которую
+// читают и заменяют несколько потоков без мьютекса:
+// - load() - копия текущей версии без ожидания (wait-free): одно
+//   атомарное fetch_add, копирование и освобождение ссылки;
+// - swap(fn) применяет fn к текущей версии и устанавливает результат
+//   через CAS; при конфликте с другим писателем fn вызывается заново
+//   для новой версии, поэтому fn не должна иметь побочных эффектов.
+//   try_swap(fn) - то же, но fn может отказаться (std::nullopt);
+// - compare_and_set(expected, desired) устанавливает desired, только
+//   если текущая версия равна expected (для той же версии структуры
+//   сравнение - сравнение указателей).
+//
+// Подсчет ссылок раздельный (split reference count), без блокировок
+// std::atomic<std::shared_ptr>: в одном 64-битном слове лежат адрес
+// версии (младшие 48 бит) и счетчик "взятых" ссылок (старшие 16 бит).
+// Читатель увеличивает этот счетчик вместе с чтением адреса, а
+// отдает ссылку уменьшением внутреннего счетчика версии. Писатель,
+// заменяя версию, переносит накопленные взятые ссылки во внутренний
+// счетчик - версия освобождается последним читателем.
+//
+//   Atom<PersistentMap<std::string, int>> current;
+//   current.swap([](const auto& map) { return map.set("visits", 1); });
+//   PersistentMap<std::string, int> snapshot = current.load();
+
+template<typename S>
+class Atom {
+public:
+    Atom() : Atom(S()) {
+    }
+    explicit Atom(S initial) : word(pack(create(std::move(initial)))) {
+    }
+    Atom(const Atom&) = delete;
+    Atom& operator=(const Atom&) = delete;
+
+    // Читатели и писатели к моменту разрушения должны завершиться
+    ~Atom() {
+        uint64_t current = word.load(std::memory_order_acquire);
+        retire(address(current), borrowed(current));
+    }
+
+    // Текущая версия (wait-free, кроме редкого переноса счетчика)
+    S load() const {
+        Hold current(acquire());
+        return current.version->value;
+    }
+
+    // Установка версии; возвращает предыдущую
+    S exchange(S desired) {
+        Version* next = create(std::move(desired));
+        uint64_t current = word.load(std::memory_order_relaxed);
+        while (!word.compare_exchange_weak(current, pack(next),
+            std::memory_order_acq_rel, std::memory_order_relaxed)) {
+        }
+        // Своя ссылка на старую версию - до переноса счетчика
+        Version* previous = address(current);
+        previous->refs.fetch_add(1, std::memory_order_relaxed);
+        retire(previous, borrowed(current));
+        Hold old(previous);
+        return old.version->value;
+    }
+
+    // fn(const S&) -> S; возвращает установленную версию
+    template<typename F>
+    S swap(F&& fn) {
+        while (true) {
+            Hold current(acquire());
+            S value = fn(static_cast<const S&>(current.version->value));
+            // Установленную версию может сразу снять другой писатель -
+            // результат возвращается из своей копии
+            Version* next = create(value);
+            if (install(current.version, next)) {
+                return value;
+            }
+            delete next;
+        }
+    }
+
+    // fn(const S&) -> std::optional<S>; пустой результат - отказ:
+    // ничего не устанавливается, возвращается std::nullopt
+    template<typename F>
+    std::optional<S> try_swap(F&& fn) {
+        while (true) {
+            Hold current(acquire());
+            std::optional<S> value = fn(static_cast<const S&>(current.version->value));
+            if (!value) {
+                return std::nullopt;
+            }
+            Version* next = create(*value);
+            if (install(current.version, next)) {
+                return value;
+            }
+            delete next;
+        }
+    }
+
+    bool compare_and_set(const S& expected, S desired) {
+        Hold current(acquire());
+        if (!(current.version->value == expected)) {
+            return false;
+        }
+        Version* next = create(std::move(desired));
+        if (install(current.version, next)) {
+            return true;
+        }
+        delete next;
+        return false;
+    }
+
+private:
+    // Поправка внутреннего счетчика: пока версия установлена, он не
+    // опускается до нуля, сколько бы читателей ни отдали ссылки
+    static constexpr int64_t OWNED = int64_t(1) << 40;
+    static constexpr unsigned COUNT_SHIFT = 48;
+    static constexpr uint64_t ADDRESS_MASK = (uint64_t(1) << COUNT_SHIFT) - 1;
+    static constexpr uint64_t ONE = uint64_t(1) << COUNT_SHIFT;
+    // Взятые ссылки переносятся во внутренний счетчик задолго до
+    // переполнения 16 бит
+    static constexpr uint64_t FLUSH_AT = uint64_t(1) << 12;
+
+    struct Version {
+        S value;
+        std::atomic<int64_t> refs{ OWNED };
+
+        explicit Version(S initial) : value(std::move(initial)) {
+        }
+    };
+
+    // Ссылка на версию на время операции
+    struct Hold {
+        Version* version;
+
+        explicit Hold(Version* held) : version(held) {
+        }
+        Hold(const Hold&) = delete;
+        Hold& operator=(const Hold&) = delete;
+        ~Hold() {
+            release(version);
+        }
+    };
+
+    mutable std::atomic<uint64_t> word;
+
+    static Version* create(S value) {
+        Version* version = new Version(std::move(value));
+        if (reinterpret_cast<uintptr_t>(version) & ~ADDRESS_MASK) {
+            delete version;
+            throw std::runtime_error("Atom requires 48-bit addresses");
+        }
+        return version;
+    }
+    static uint64_t pack(Version* version) {
+        return reinterpret_cast<uintptr_t>(version);
+    }
+    static Version* address(uint64_t bits) {
+        return reinterpret_cast<Version*>(static_cast<uintptr_t>(bits & ADDRESS_MASK));
+    }
+    static int64_t borrowed(uint64_t bits) {
+        return static_cast<int64_t>(bits >> COUNT_SHIFT);
+    }
+
+    // Ссылка на текущую версию: одно fetch_add по слову
+    Version* acquire() const {
+        uint64_t bits = word.fetch_add(ONE, std::memory_order_acq_rel);
+        Version* version = address(bits);
+        if (uint64_t(borrowed(bits)) + 1 >= FLUSH_AT) {
+            flush(version);
+        }
+        return version;
+    }
+
+    static void release(Version* version) {
+        if (version->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete version;
+        }
+    }
+
+    // Перенос взятых ссылок во внутренний счетчик. Счетчик
+    // увеличивается заранее, чтобы версия не освободилась между
+    // обнулением слова и переносом; при неудаче - откат.
+    void flush(Version* version) const {
+        uint64_t current = word.load(std::memory_order_relaxed);
+        while (address(current) == version && uint64_t(borrowed(current)) >= FLUSH_AT) {
+            int64_t count = borrowed(current);
+            version->refs.fetch_add(count, std::memory_order_relaxed);
+            if (word.compare_exchange_weak(current, current & ADDRESS_MASK,
+                std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                return;
+            }
+            version->refs.fetch_sub(count, std::memory_order_relaxed);
+        }
+    }
+
+    // Замена expected на next, если expected все еще текущая.
+    // Вызывающий держит ссылку на expected - адрес не переиспользован.
+    bool install(Version* expected, Version* next) {
+        uint64_t current = word.load(std::memory_order_relaxed);
+        while (address(current) == expected) {
+            if (word.compare_exchange_weak(current, pack(next),
+                std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                retire(expected, borrowed(current));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Снятая версия: взятые ссылки переходят во внутренний счетчик,
+    // ссылка ячейки отдается
+    static void retire(Version* version, int64_t count) {
+        if (version->refs.fetch_add(count - OWNED, std::memory_order_acq_rel) == OWNED - count) {
+            delete version;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef PERSISTENT_CHECKPOINT_HPP
+#define PERSISTENT_CHECKPOINT_HPP
+
+#include "persistent_snapshot.hpp"
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+
+// -----------------------------------------
+// ------- Инкрементальные контрольные -----
+// ------------------ точки ----------------
+// -----------------------------------------
+//
+// Файл контрольных точек - снимок (persistent_snapshot.hpp),
+// который только дописывается:
+// - Checkpointer помнит, какие узлы уже лежат в файле (таблица
+//   SnapshotWriter по адресу узла), поэтому очередная точка
+//   дописывает только узлы, созданные копированием пути после
+//   предыдущей, и новую запись корня. Стоимость точки
+//   пропорциональна изменениям, а не размеру данных;
+// - При открытии существующего файла последняя версия
+//   восстанавливается, ее узлы считаются записанными - работа
+//   продолжается инкрементально и после перезапуска;
+// - Оборванная при сбое последняя запись отрезается.
+//
+// S - PersistentVector, PersistentList, PersistentMap или PersistentValue.
+
+template<typename S>
+class PersistentCheckpointer {
+public:
+    explicit PersistentCheckpointer(const std::string& path);
+
+    // Последняя версия, найденная в файле при открытии
+    const std::optional<S>& recovered() const {
+        return last;
+    }
+    uint64_t recoveredTag() const {
+        return lastTag;
+    }
+
+    // Дозапись версии; возвращает число записанных узлов
+    size_t checkpoint(const S& version, uint64_t tag = 0);
+
+    // Количество точек в файле
+    size_t checkpoints() const {
+        return writer->rootsWritten();
+    }
+    const std::string& path() const {
+        return filePath;
+    }
+
+private:
+    std::string filePath;
+    std::ofstream out;
+    std::unique_ptr<SnapshotWriter> writer;
+    std::optional<S> last;
+    uint64_t lastTag = 0;
+    size_t writtenSincePrune = 0;
+    size_t tableEstimate = 0; // Узлы, известные writer'у после последней очистки
+};
+
+#include "persistent_checkpoint_impl.hpp"
+
+#endif
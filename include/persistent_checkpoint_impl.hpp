@@ -0,0 +1,73 @@
+#ifndef PERSISTENT_CHECKPOINT_IMPL_HPP
+#define PERSISTENT_CHECKPOINT_IMPL_HPP
+
+#include "persistent_checkpoint.hpp"
+#include <filesystem>
+#include <iterator>
+
+// -----------------------------------------
+// -- Реализация контрольных точек ---------
+// -----------------------------------------
+
+// Открытие файла: восстановление последней версии и подготовка к дозаписи
+template<typename S>
+PersistentCheckpointer<S>::PersistentCheckpointer(const std::string& path) : filePath(path) {
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (in) {
+            bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+    }
+
+    // Нет файла или не успел записаться даже заголовок - начинаем заново
+    if (bytes.size() < persistent_snapshot_detail::HEADER_SIZE) {
+        out.open(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Cannot open " + path);
+        }
+        writer = std::make_unique<SnapshotWriter>(out);
+        writer->flush();
+        return;
+    }
+
+    SnapshotReader reader(std::move(bytes), true);
+    if (reader.roots() > 0) {
+        last = reader.readLast<S>();
+        lastTag = reader.root(reader.roots() - 1).tag;
+    }
+    // Отрезаем оборванную запись, чтобы дописывать после целых
+    size_t valid = reader.validBytes();
+    if (valid < static_cast<size_t>(std::filesystem::file_size(path))) {
+        std::filesystem::resize_file(path, valid);
+    }
+
+    out.open(path, std::ios::binary | std::ios::app);
+    if (!out) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    writer = std::make_unique<SnapshotWriter>(out, false);
+    writer->resume(reader);
+    tableEstimate = reader.nodes();
+}
+
+template<typename S>
+size_t PersistentCheckpointer<S>::checkpoint(const S& version, uint64_t tag) {
+    size_t before = writer->nodesWritten();
+    writer->write(version, tag);
+    writer->flush();
+    size_t written = writer->nodesWritten() - before;
+
+    // Таблица держит записанные узлы (rvalue-изменение между точками
+    // их копирует) и отпускает узлы отброшенных версий, когда новых
+    // записей накопилось сравнимо с ее размером (амортизированно O(изменений))
+    writtenSincePrune += written;
+    if (writtenSincePrune > tableEstimate) {
+        writer->prune();
+        tableEstimate = writer->nodesKnown();
+        writtenSincePrune = 0;
+    }
+    return written;
+}
+
+#endif
@@ -1,40 +1,155 @@
-#ifndef PERSISTENT_DATA_STRUCTURE_HPP
-#define PERSISTENT_DATA_STRUCTURE_HPP
-
-#include <memory>
-#include <cstddef>
-
-// -----------------------------------------
-// ---------- Единый API структур ----------
-// -----------------------------------------
-// 
-// Определяет единый API для всех реализованных 
-// структур с общими утилитами
-
-template<typename T>
-class IPersistentStructure {
-public:
-    virtual ~IPersistentStructure() = default;
-
-    // -----------------------------------------
-    // ----------- Размер структуры ------------
-    // -----------------------------------------
-    virtual size_t size() const = 0;
-
-    // -----------------------------------------
-    // ----------- Очистка структуры -----------
-    // -----------------------------------------
-    virtual std::shared_ptr<IPersistentStructure<T>> clear() const = 0;
-
-    // -----------------------------------------
-    // ----- Проверка на пустоту структуры -----
-    // -----------------------------------------
-    virtual bool empty() const = 0;
-
-    // -----------------------------------------
-    // --- Создание глубокой копии структуры ---
-    // -----------------------------------------
-    virtual std::shared_ptr<IPersistentStructure<T>> clone() const = 0;
-};
-
+#ifndef PERSISTENT_DATA_STRUCTURE_HPP
+#define PERSISTENT_DATA_STRUCTURE_HPP
+
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+// -----------------------------------------
+// ---------- Единый API структур ----------
+// -----------------------------------------
+// 
+// Определяет единый API для всех реализованных 
+// структур с общими утилитами
+
+// Сериализация снимков (persistent_snapshot.hpp, persistent_mapped.hpp) работает
+// с внутренними узлами структур напрямую
+class SnapshotWriter;
+class SnapshotReader;
+class MappedSnapshotWriter;
+class HashConsTable;
+// Репликация (persistent_replication.hpp) передает узлы массива по хешам
+template<typename S>
+class ReplicationSender;
+template<typename S>
+class ReplicationReceiver;
+
+// -----------------------------------------
+// ------- Хеширование содержимого ---------
+// -----------------------------------------
+// Хеш структуры согласован со структурным ==: равные по содержимому
+// версии дают одинаковый хеш независимо от формы дерева
+namespace persistent_hash_detail {
+    // Перемешивание битов (финализатор splitmix64)
+    inline size_t mix(uint64_t x) {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return static_cast<size_t>(x);
+    }
+
+    // Хеш последовательности: порядок элементов важен
+    inline size_t combine(size_t seed, size_t value) {
+        return mix(seed ^ (value + 0x9e3779b97f4a7c15ULL + (uint64_t(seed) << 6) + (seed >> 2)));
+    }
+
+    // Есть ли std::hash для типа. Для структур специализируется по типу
+    // элементов (persistent_vector.hpp и др.): std::hash<PersistentVector<T>>
+    // объявлен для любого T, но работает, только если хешируется T
+    template<typename T, typename = void>
+    struct hasStdHash : std::false_type {};
+
+    template<typename T>
+    struct hasStdHash<T, std::void_t<decltype(std::hash<T>()(std::declval<const T&>()))>> : std::true_type {};
+
+    template<typename T>
+    struct hashable : hasStdHash<T> {};
+
+    // -----------------------------------------
+    // ------ Кэш хеша Меркла в узле -----------
+    // -----------------------------------------
+    // Хеш содержимого поддерева. Ленивое заполнение из разных потоков
+    // безопасно: все пишут одно и то же значение. Изменяет кэш иначе
+    // только владелец узла (копия пути или узел единственной версии).
+    class NodeHash {
+    private:
+        mutable std::atomic<uint64_t> value{ 0 };
+        mutable std::atomic<bool> known{ false };
+
+    public:
+        NodeHash() = default;
+        NodeHash(const NodeHash& other) {
+            size_t hash;
+            if (other.get(hash)) {
+                set(hash);
+            }
+        }
+        NodeHash& operator=(const NodeHash&) = delete;
+
+        bool get(size_t& out) const {
+            if (!known.load(std::memory_order_acquire)) {
+                return false;
+            }
+            out = static_cast<size_t>(value.load(std::memory_order_relaxed));
+            return true;
+        }
+        void set(size_t hash) const {
+            value.store(hash, std::memory_order_relaxed);
+            known.store(true, std::memory_order_release);
+        }
+        void reset() {
+            known.store(false, std::memory_order_relaxed);
+        }
+    };
+}
+
+// -----------------------------------------
+// -------- Режим хешей Меркла -------------
+// -----------------------------------------
+// Во включенном режиме каждый узел вектора и ассоциативного массива,
+// созданный копированием пути, сразу получает хеш содержимого
+// (обновляется по разнице за O(1) на уровень). hash() любой версии
+// становится O(1), а == отбрасывает различающиеся поддеревья по хешу.
+// Выключенный режим ничего не стоит: хеши считаются лениво при вызове hash().
+class PersistentHashing {
+public:
+    static void enable() {
+        flag().store(true, std::memory_order_relaxed);
+    }
+    static void disable() {
+        flag().store(false, std::memory_order_relaxed);
+    }
+    static bool enabled() {
+        return flag().load(std::memory_order_relaxed);
+    }
+
+private:
+    static std::atomic<bool>& flag() {
+        static std::atomic<bool> value{ false };
+        return value;
+    }
+};
+
+template<typename T>
+class IPersistentStructure {
+public:
+    virtual ~IPersistentStructure() = default;
+
+    // -----------------------------------------
+    // ----------- Размер структуры ------------
+    // -----------------------------------------
+    virtual size_t size() const = 0;
+
+    // -----------------------------------------
+    // ----------- Очистка структуры -----------
+    // -----------------------------------------
+    virtual std::shared_ptr<IPersistentStructure<T>> clear() const = 0;
+
+    // -----------------------------------------
+    // ----- Проверка на пустоту структуры -----
+    // -----------------------------------------
+    virtual bool empty() const = 0;
+
+    // -----------------------------------------
+    // --- Создание глубокой копии структуры ---
+    // -----------------------------------------
+    virtual std::shared_ptr<IPersistentStructure<T>> clone() const = 0;
+};
+
 #endif 
\ No newline at end of file
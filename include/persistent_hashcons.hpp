@@ -0,0 +1,131 @@
+#ifndef PERSISTENT_HASHCONS_HPP
+#define PERSISTENT_HASHCONS_HPP
+
+#include "persistent_value.hpp"
+#include "persistent_vector.hpp"
+#include "persistent_list.hpp"
+#include "persistent_map.hpp"
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+// -----------------------------------------
+// ---------- Хеш-консинг значений ---------
+// -----------------------------------------
+//
+// Таблица канонических представителей (hash-consing): равные по
+// содержимому поддеревья сводятся к одному экземпляру.
+// - Узлы PersistentVector и PersistentMap ищутся по кэшированному
+//   хешу Меркла и сравниваются поверхностно: потомки к этому моменту
+//   уже канонические, поэтому достаточно сравнить их адреса;
+// - Вложенные значения PersistentValue (строки, векторы, массивы,
+//   списки) сводятся к одной коробке; строки интернируются в пул
+//   таблицы. У списков разделяется только коробка целиком;
+// - Узлы хранятся по weak_ptr: таблица не продлевает им жизнь.
+//   Значения таблица держит сама и отпускает те, на которые больше
+//   никто не ссылается (prune, вызывается и автоматически по мере
+//   роста таблицы).
+// После канонизации равные поддеревья - один и тот же узел, и
+// сравнение == заканчивается на сравнении указателей.
+// Таблица не потокобезопасна: один поток или внешняя блокировка.
+//
+//   HashConsTable table;
+//   PersistentValue doc = JsonReader::read(text, table); // Канонизация при сборке
+//   PersistentVector<int> shared = table.canonical(vector);
+
+class HashConsTable {
+public:
+    HashConsTable() = default;
+    HashConsTable(const HashConsTable&) = delete;
+    HashConsTable& operator=(const HashConsTable&) = delete;
+
+    // Канонический представитель: равное значение, разделяющее
+    // узлы и коробки со всеми ранее канонизированными
+    PersistentValue canonical(const PersistentValue& value);
+    template<typename T>
+    PersistentVector<T> canonical(const PersistentVector<T>& vector);
+    template<typename K, typename V>
+    PersistentMap<K, V> canonical(const PersistentMap<K, V>& map);
+
+    // Удаление освобожденных узлов и значений, на которые ссылается
+    // только таблица; возвращает число удаленных записей
+    size_t prune();
+
+    size_t nodes() const {  // Записи узлов (до prune - включая освобожденные)
+        return nodeTable.size();
+    }
+    size_t values() const { // Канонические структуры
+        return valueTable.size();
+    }
+    size_t reused() const { // Сколько раз вместо копии найден представитель
+        return reuseCount;
+    }
+
+private:
+    friend class PersistentValue;
+
+    // Автоматическая очистка - когда таблица выросла вдвое (не реже)
+    static constexpr size_t MIN_PRUNE = 1024;
+
+    struct NodeEntry {
+        const void* kind; // Тип узла (kindOf<Node>)
+        size_t level;     // Сдвиг узла вектора (у массива - 0)
+        std::weak_ptr<void> node;
+    };
+
+    std::unordered_multimap<size_t, NodeEntry> nodeTable;  // Хеш Меркла -> узлы
+    std::unordered_multimap<size_t, PersistentValue> valueTable; // hash() -> значения
+    std::unordered_set<const void*> valueBoxes; // Коробки из valueTable
+    StringPool strings;
+    size_t reuseCount = 0;
+    size_t pruneAt = MIN_PRUNE;
+
+    template<typename N>
+    static const void* kindOf() {
+        static const char tag = 0;
+        return &tag;
+    }
+
+    // Живой узел из корзины hash, для которого match(node) истинно.
+    // Освобожденные узлы по пути удаляются из таблицы.
+    template<typename N, typename Match>
+    std::shared_ptr<N> lookup(size_t hash, size_t level, Match match);
+    void remember(size_t hash, const void* kind, size_t level, std::weak_ptr<void> node);
+    void grown();
+
+    // Канонизация на месте; false - структура уже каноническая
+    template<typename T>
+    bool canonicalize(PersistentVector<T>& vector);
+    template<typename K, typename V>
+    bool canonicalize(PersistentMap<K, V>& map);
+    template<typename T>
+    bool canonicalize(PersistentList<T>&) {
+        return false; // Узлы списка не канонизируются
+    }
+
+    template<typename T>
+    std::shared_ptr<typename PersistentVector<T>::Node>
+    vectorNode(const std::shared_ptr<typename PersistentVector<T>::Node>& node, size_t shift);
+    template<typename K, typename V>
+    std::shared_ptr<typename PersistentMap<K, V>::Node>
+    mapNode(const std::shared_ptr<typename PersistentMap<K, V>::Node>& node);
+
+    // Канонизация элемента: вложенные значения - через таблицу,
+    // остальные типы не меняются. true - элемент заменен
+    template<typename T>
+    bool element(T&) {
+        return false;
+    }
+    bool element(PersistentValue& value) {
+        PersistentValue result = canonical(value);
+        if (result.identical(value)) {
+            return false;
+        }
+        value = std::move(result);
+        return true;
+    }
+};
+
+#include "persistent_hashcons_impl.hpp"
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef PERSISTENT_HASHCONS_IMPL_HPP
+#define PERSISTENT_HASHCONS_IMPL_HPP
+
+#include "persistent_hashcons.hpp"
+
+// -----------------------------------------
+// ------ Реализация хеш-консинга ----------
+// -----------------------------------------
+
+template<typename N, typename Match>
+std::shared_ptr<N> HashConsTable::lookup(size_t hash, size_t level, Match match) {
+    auto range = nodeTable.equal_range(hash);
+    for (auto it = range.first; it != range.second;) {
+        const NodeEntry& entry = it->second;
+        if (entry.kind != kindOf<N>() || entry.level != level) {
+            ++it;
+            continue;
+        }
+        auto node = std::static_pointer_cast<N>(entry.node.lock());
+        if (!node) {
+            it = nodeTable.erase(it);
+            continue;
+        }
+        if (match(static_cast<const N*>(node.get()))) {
+            return node;
+        }
+        ++it;
+    }
+    return nullptr;
+}
+
+// -----------------------------------------
+// ------------- Узлы вектора --------------
+// -----------------------------------------
+// Сверху вниз: уже канонический узел возвращается сразу, иначе
+// канонизируются потомки (узел копируется, только если какой-то
+// из них заменен) и ищется равный узел. Содержимое копии равно
+// исходному, поэтому кэшированный хеш Меркла остается верным.
+template<typename T>
+std::shared_ptr<typename PersistentVector<T>::Node>
+HashConsTable::vectorNode(const std::shared_ptr<typename PersistentVector<T>::Node>& node, size_t shift) {
+    using Vector = PersistentVector<T>;
+    using Node = typename Vector::Node;
+
+    size_t hash = persistent_hash_detail::combine(shift, Vector::nodeHash(node.get(), shift));
+    if (auto known = lookup<Node>(hash, shift, [&](const Node* other) { return other == node.get(); })) {
+        return known;
+    }
+
+    std::shared_ptr<Node> candidate = node;
+    for (size_t i = 0; i < node->slots; ++i) {
+        if (shift > 0) {
+            if (!node->children[i]) {
+                continue;
+            }
+            auto child = vectorNode<T>(node->children[i], shift - Vector::BITS_PER_LEVEL);
+            if (child != node->children[i]) {
+                if (candidate == node) {
+                    candidate = node->clone();
+                }
+                candidate->children[i] = std::move(child);
+            }
+        }
+        else if (node->values[i]) {
+            T value = *node->values[i];
+            if (element(value)) {
+                if (candidate == node) {
+                    candidate = node->clone();
+                }
+                candidate->values[i] = std::move(value);
+            }
+        }
+    }
+
+    // Потомки канонические - равные узлы ссылаются на те же потомки
+    auto equal = lookup<Node>(hash, shift, [&](const Node* other) {
+        if (other->slots != candidate->slots || other->count != candidate->count) {
+            return false;
+        }
+        for (size_t i = 0; i < other->slots; ++i) {
+            if (shift > 0) {
+                if (other->children[i] != candidate->children[i]) {
+                    return false;
+                }
+            }
+            else if (other->values[i].has_value() != candidate->values[i].has_value() ||
+                (other->values[i] && !(*other->values[i] == *candidate->values[i]))) {
+                return false;
+            }
+        }
+        return true;
+    });
+    if (equal) {
+        ++reuseCount;
+        return equal;
+    }
+    remember(hash, kindOf<Node>(), shift, candidate);
+    return candidate;
+}
+
+template<typename T>
+bool HashConsTable::canonicalize(PersistentVector<T>& vector) {
+    using Vector = PersistentVector<T>;
+    static_assert(Vector::MERKLE, "HashConsTable requires std::hash for the element type");
+
+    auto root = vectorNode<T>(vector.data->root, vector.data->shift);
+    if (root == vector.data->root) {
+        return false;
+    }
+    vector = Vector(std::make_shared<typename Vector::Data>(std::move(root),
+        vector.data->size, vector.data->shift));
+    return true;
+}
+
+template<typename T>
+PersistentVector<T> HashConsTable::canonical(const PersistentVector<T>& vector) {
+    PersistentVector<T> result = vector;
+    canonicalize(result);
+    return result;
+}
+
+// -----------------------------------------
+// ------------- Узлы массива --------------
+// -----------------------------------------
+template<typename K, typename V>
+std::shared_ptr<typename PersistentMap<K, V>::Node>
+HashConsTable::mapNode(const std::shared_ptr<typename PersistentMap<K, V>::Node>& node) {
+    using Map = PersistentMap<K, V>;
+    using Node = typename Map::Node;
+
+    if (!node) {
+        return node;
+    }
+    size_t hash = Map::nodeHash(node.get());
+    if (auto known = lookup<Node>(hash, 0, [&](const Node* other) { return other == node.get(); })) {
+        return known;
+    }
+
+    std::shared_ptr<Node> candidate = node;
+    for (size_t i = 0; i < node->children.size(); ++i) {
+        auto child = mapNode<K, V>(node->children[i]);
+        if (child != node->children[i]) {
+            if (candidate == node) {
+                candidate = node->clone();
+            }
+            candidate->children[i] = std::move(child);
+        }
+    }
+    for (size_t i = 0; i < node->entries.size(); ++i) {
+        V value = node->entries[i].second;
+        if (element(value)) {
+            if (candidate == node) {
+                candidate = node->clone();
+            }
+            candidate->entries[i].second = std::move(value);
+        }
+    }
+
+    // Порядок записей в листе входит в равенство: листы с теми же
+    // записями в другом порядке остаются разными узлами
+    auto equal = lookup<Node>(hash, 0, [&](const Node* other) {
+        return other->bitmap == candidate->bitmap &&
+            other->children == candidate->children &&
+            other->entries == candidate->entries;
+    });
+    if (equal) {
+        ++reuseCount;
+        return equal;
+    }
+    remember(hash, kindOf<Node>(), 0, candidate);
+    return candidate;
+}
+
+template<typename K, typename V>
+bool HashConsTable::canonicalize(PersistentMap<K, V>& map) {
+    using Map = PersistentMap<K, V>;
+    static_assert(Map::MERKLE, "HashConsTable requires std::hash for the key and value types");
+
+    auto root = mapNode<K, V>(map.root);
+    if (root == map.root) {
+        return false;
+    }
+    map = Map(std::move(root), map.map_size);
+    return true;
+}
+
+template<typename K, typename V>
+PersistentMap<K, V> HashConsTable::canonical(const PersistentMap<K, V>& map) {
+    PersistentMap<K, V> result = map;
+    canonicalize(result);
+    return result;
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef PERSISTENT_JSON_HPP
+#define PERSISTENT_JSON_HPP
+
+#include "persistent_value.hpp"
+#include <istream>
+#include <string>
+#include <string_view>
+
+// -----------------------------------------
+// ---------------- JSON -------------------
+// -----------------------------------------
+//
+// Потоковый (SAX) разбор и запись JSON для деревьев PersistentValue:
+// - JsonReader::parse выдает события обработчику (JsonHandler) по
+//   мере чтения, без промежуточного DOM; строки без escape-
+//   последовательностей передаются как string_view на входной буфер;
+// - JsonReader::read собирает дерево PersistentValue: объекты -
+//   PersistentMap<std::string, PersistentValue>, массивы -
+//   PersistentVector<PersistentValue>. Структуры растут на месте
+//   (rvalue-перегрузки set/append), без копирования путей;
+// - JsonWriter дописывает JSON в буфер вызывающего. Он сам является
+//   обработчиком событий, поэтому parse(text, writer) переписывает
+//   документ в компактную форму.
+//
+//   PersistentValue doc = JsonReader::read(R"({"id": 1, "tags": ["a", "b"]})");
+//   std::string out;
+//   JsonWriter(out).write(doc);
+
+// -----------------------------------------
+// ------------- События разбора -----------
+// -----------------------------------------
+class JsonHandler {
+public:
+    virtual ~JsonHandler() = default;
+
+    virtual void null() = 0;
+    virtual void boolean(bool value) = 0;
+    virtual void integer(int value) = 0;   // Целые, помещающиеся в int
+    virtual void number(double value) = 0; // Остальные числа
+    virtual void string(std::string_view value) = 0; // Действительна до возврата
+    virtual void beginObject() = 0;
+    virtual void key(std::string_view name) = 0;
+    virtual void endObject() = 0;
+    virtual void beginArray() = 0;
+    virtual void endArray() = 0;
+};
+
+// -----------------------------------------
+// ---------------- Разбор -----------------
+// -----------------------------------------
+class JsonReader {
+public:
+    static constexpr size_t MAX_DEPTH = 512; // Защита от переполнения стека
+
+    // События разбора; при ошибке - std::runtime_error со смещением
+    static void parse(std::string_view text, JsonHandler& handler);
+
+    // Дерево значений; строки-значения интернируются в pool, если он задан
+    static PersistentValue read(std::string_view text, StringPool* pool = nullptr);
+    static PersistentValue read(std::istream& in, StringPool* pool = nullptr);
+    // Дерево, собранное сразу из канонических поддеревьев (persistent_hashcons.hpp)
+    static PersistentValue read(std::string_view text, HashConsTable& table);
+    static PersistentValue read(std::istream& in, HashConsTable& table);
+};
+
+// -----------------------------------------
+// ---------------- Запись -----------------
+// -----------------------------------------
+class JsonWriter : public JsonHandler {
+public:
+    explicit JsonWriter(std::string& buffer) : out(buffer) {
+    }
+
+    // Значение целиком. Поддерживаются вложенные векторы и списки
+    // (int, int64_t, double, float, bool, std::string, PersistentValue)
+    // и массивы со строковыми ключами; иначе - std::runtime_error
+    void write(const PersistentValue& value);
+
+    void null() override;
+    void boolean(bool value) override;
+    void integer(int value) override;
+    void number(double value) override;
+    void string(std::string_view value) override;
+    void beginObject() override;
+    void key(std::string_view name) override;
+    void endObject() override;
+    void beginArray() override;
+    void endArray() override;
+
+private:
+    std::string& out;
+    bool separate = false; // Перед следующим элементом нужна запятая
+
+    void element();
+    template<typename T>
+    void writeElement(const T& value);
+    template<typename S>
+    void writeSequence(const S& sequence);
+};
+
+#endif
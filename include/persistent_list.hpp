@@ -1,192 +1,333 @@
-#ifndef PERSISTENT_LIST_HPP
-#define PERSISTENT_LIST_HPP
-
-#include "persistent_data_structure.hpp"
-#include <memory>
-#include <optional>
-#include <stack>
-
-// -----------------------------------------
-// ---------- Двухсвязный список  ----------
-// -----------------------------------------
-// Реализация через Zipper для эмуляции двунаправленности.
-// Похоже на функциональный подход.
-
-template<typename T>
-class PersistentList : public IPersistentStructure<T> {
-private:
-    // -----------------------------------------
-    // ----------- Структура Zipper ------------
-    // -----------------------------------------
-    struct Zipper {
-        PersistentList<T> left;   // Пройденные элементы в обратном порядке
-        T current;                // Текущий элемент
-        PersistentList<T> right;  // Оставшиеся элементы
-
-        Zipper(const PersistentList<T>& l, const T& c, const PersistentList<T>& r)
-            : left(l), current(c), right(r) {
-        }
-    };
-
-    // -----------------------------------------
-    // ------------ Структура узла -------------
-    // -----------------------------------------
-    struct Node {
-        T value; // Значение
-        std::shared_ptr<Node> next; // Следующий элемент
-
-        Node(const T& val, std::shared_ptr<Node> nxt = nullptr)
-            : value(val), next(nxt) {
-        }
-    };
-
-    std::shared_ptr<Node> head;
-    size_t list_size;
-
-    // Отразить список
-    PersistentList<T> reverse() const;
-    // Взять первые n элементов
-    PersistentList<T> take(size_t n) const;
-    // Отбросить первые n элементов
-    PersistentList<T> drop(size_t n) const;
-
-public:
-    // -----------------------------------------
-    // -------------- Конструкторы -------------
-    // -----------------------------------------
-    PersistentList();
-    PersistentList(const T& value);
-    PersistentList(const std::shared_ptr<Node>& node, size_t size);
-    PersistentList(const std::vector<T>& values);
-
-    // -----------------------------------------
-    // ---------- IPersistentStructure ---------
-    // -----------------------------------------
-    size_t size() const override;
-    bool empty() const override;
-    std::shared_ptr<IPersistentStructure<T>> clear() const override;
-    std::shared_ptr<IPersistentStructure<T>> clone() const override;
-
-    // -----------------------------------------
-    // ------------ Односвязный API ------------
-    // -----------------------------------------
-    const T& front() const;
-    PersistentList<T> tail() const; // Хвост списка
-    PersistentList<T> prepend(const T& value) const; // Добавление элемента в начало списка
-    PersistentList<T> append(const T& value) const; // Добавление элемента в конец списка
-    PersistentList<T> concat(const PersistentList<T>& other) const; // Объединение двух списков
-
-    // -----------------------------------------
-    // ------ Двухсвязный API через Zipper -----
-    // -----------------------------------------
-    class ZipperView {
-    private:
-        PersistentList<T> left; // Пройденные элементы в обратном порядке
-        T current; // Текущее значение
-        PersistentList<T> right; // Следующие элементы
-
-    public:
-        // -----------------------------------------
-        // -------------- Конструктор --------------
-        // -----------------------------------------
-        ZipperView(const PersistentList<T>& list, size_t position = 0);
-
-        // -----------------------------------------
-        // --------------- Навигация ---------------
-        // -----------------------------------------
-        ZipperView next() const; // Следующий элемент
-        ZipperView prev() const; // Предыдущий элемент
-        ZipperView moveTo(size_t position) const; // Сместиться на заданную позицию
-
-        // -----------------------------------------
-        // ---------- Функции через Zipper ---------
-        // -----------------------------------------
-        PersistentList<T> insertBefore(const T& value) const; // Добавить элемент до текующей позиции
-        PersistentList<T> insertAfter(const T& value) const; // Добавить элемент после текущей позиции
-        PersistentList<T> removeCurrent() const; // Удалить элемент
-        PersistentList<T> updateCurrent(const T& value) const; // Обновить текущее значение
-
-        // -----------------------------------------
-        // ----------- Получение значений ----------
-        // -----------------------------------------
-        const T& getCurrent() const { 
-            return current; 
-        }
-        bool hasNext() const { 
-            return !right.empty(); 
-        }
-        bool hasPrev() const { 
-            return !left.empty(); 
-        }
-
-        // -----------------------------------------
-        // -------- Преобразование в список --------
-        // -----------------------------------------
-        PersistentList<T> toList() const;
-    };
-
-    // Создание zipper
-    ZipperView getZipper(size_t position = 0) const;
-
-    // -----------------------------------------
-    // ---- Работа с значениями по позициям ----
-    // -----------------------------------------
-    PersistentList<T> insertAt(size_t position, const T& value) const;
-    PersistentList<T> removeAt(size_t position) const;
-    const T& at(size_t position) const;
-
-    // -----------------------------------------
-    // ----------- Итератор по списку ----------
-    // -----------------------------------------
-    class Iterator {
-    private:
-        std::shared_ptr<Node> current; // Текущее значение
-
-    public:
-        Iterator(std::shared_ptr<Node> node) : current(node) {}
-        // -----------------------------------------
-        // ---------- Перекрытие операторов --------
-        // -----------------------------------------
-        // Разыменование указателя (значение)
-        const T& operator*() const {
-            return current->value; 
-        }
-        // Следующий элемент
-        Iterator& operator++() {
-            if (current) current = current->next;
-            return *this;
-        }
-        // Оператор неравенства
-        bool operator!=(const Iterator& other) const {
-            return current != other.current;
-        }
-    };
-    // -----------------------------------------
-    // ------------ Для работы цикла -----------
-    // -----------------------------------------
-    // Итератор на первый элемент
-    Iterator begin() const {
-        return Iterator(head);
-    }
-    // Итератор за последний эелемент
-    Iterator end() const { 
-        return Iterator(nullptr); 
-    }
-
-    // -----------------------------------------
-    // ------------- Преобразования ------------
-    // -----------------------------------------
-    std::vector<T> toVector() const; // В вектор
-    template<typename Container>
-    Container toContainer() const; // В контейнер
-
-    // -----------------------------------------
-    // ------ Получение элементов с конца ------
-    // -----------------------------------------
-    const T& back() const; // Последний элемент
-    PersistentList<T> init() const;  // Все кроме последнего
-};
-
-#include "persistent_list_impl.hpp"
-
+#ifndef PERSISTENT_LIST_HPP
+#define PERSISTENT_LIST_HPP
+
+#include "persistent_data_structure.hpp"
+#include <memory>
+#include <optional>
+#include <stack>
+#include <vector>
+#include <new>
+
+// -----------------------------------------
+// ---------- Двухсвязный список  ----------
+// -----------------------------------------
+// Реализация через Zipper для эмуляции двунаправленности.
+// Похоже на функциональный подход.
+
+template<typename T>
+class PersistentList : public IPersistentStructure<T> {
+private:
+    friend class SnapshotWriter;
+    friend class SnapshotReader;
+
+    // -----------------------------------------
+    // ----------- Структура Zipper ------------
+    // -----------------------------------------
+    struct Zipper {
+        PersistentList<T> left;   // Пройденные элементы в обратном порядке
+        T current;                // Текущий элемент
+        PersistentList<T> right;  // Оставшиеся элементы
+
+        Zipper(const PersistentList<T>& l, const T& c, const PersistentList<T>& r)
+            : left(l), current(c), right(r) {
+        }
+    };
+
+    // -----------------------------------------
+    // ------------ Структура узла -------------
+    // -----------------------------------------
+    // Развернутый (unrolled) узел: неизменяемый чанк из нескольких
+    // элементов. Элементы хранятся в обратном порядке - values[count - 1]
+    // является первым элементом чанка, поэтому добавление в начало
+    // дописывает элемент в конец массива.
+    static constexpr size_t CHUNK_SIZE = 16; // Максимум элементов в узле
+
+    struct Node {
+        alignas(T) unsigned char storage[CHUNK_SIZE * sizeof(T)]; // Значения
+        size_t count = 0; // Количество заполненных ячеек
+        std::shared_ptr<Node> next; // Следующий чанк
+
+        Node(std::shared_ptr<Node> nxt = nullptr) : next(std::move(nxt)) {}
+        Node(const Node&) = delete;
+        Node& operator=(const Node&) = delete;
+
+        ~Node() {
+            for (size_t i = 0; i < count; ++i) {
+                slot(i)->~T();
+            }
+            // Итеративное освобождение цепочки, чтобы не переполнить стек
+            auto rest = std::move(next);
+            while (rest && rest.use_count() == 1) {
+                auto after = std::move(rest->next);
+                rest = std::move(after);
+            }
+        }
+
+        T* slot(size_t i) {
+            return reinterpret_cast<T*>(storage) + i;
+        }
+        const T& value(size_t i) const {
+            return reinterpret_cast<const T*>(storage)[i];
+        }
+
+        // Конструирование значения в следующей свободной ячейке
+        template<typename... Args>
+        void emplace(Args&&... args) {
+            new (slot(count)) T(std::forward<Args>(args)...);
+            ++count;
+        }
+
+        // Копия первых n ячеек (копирование при записи)
+        std::shared_ptr<Node> copyPrefix(size_t n) const {
+            auto copy = std::make_shared<Node>(next);
+            for (size_t i = 0; i < n; ++i) {
+                copy->emplace(value(i));
+            }
+            return copy;
+        }
+    };
+
+    // -----------------------------------------
+    // ------ Построитель списка с начала ------
+    // -----------------------------------------
+    // Добавляет элементы в начало, заполняя собственные (еще никому
+    // не видимые) чанки на месте. Чужой головной чанк копируется один раз.
+    struct Builder {
+        std::shared_ptr<Node> head;
+        size_t used;
+        size_t size;
+        bool owned = false; // Головной чанк создан построителем
+
+        Builder(const PersistentList<T>& base)
+            : head(base.head), used(base.head_used), size(base.list_size) {
+        }
+
+        // Забирает список целиком: если головным чанком владеет только
+        // он, чанк дописывается на месте без копирования
+        Builder(PersistentList<T>&& base)
+            : head(std::move(base.head)), used(base.head_used), size(base.list_size) {
+            owned = head && head.use_count() == 1 && used == head->count;
+        }
+
+        template<typename... Args>
+        void emplaceFront(Args&&... args) {
+            if (head && used < CHUNK_SIZE) {
+                if (!owned) {
+                    head = head->copyPrefix(used);
+                    owned = true;
+                }
+                head->emplace(std::forward<Args>(args)...);
+            }
+            else {
+                head = std::make_shared<Node>(head);
+                owned = true;
+                used = 0;
+                head->emplace(std::forward<Args>(args)...);
+            }
+            ++used;
+            ++size;
+        }
+
+        void pushFront(const T& value) {
+            emplaceFront(value);
+        }
+
+        PersistentList<T> build() const {
+            return PersistentList<T>(head, used, size);
+        }
+    };
+
+    std::shared_ptr<Node> head;
+    size_t head_used; // Видимая часть головного чанка (после tail() она меньше count)
+    size_t list_size;
+
+    PersistentList(const std::shared_ptr<Node>& node, size_t used, size_t size);
+
+    // Указатели на элементы в прямом порядке (для построения с конца)
+    std::vector<const T*> elementPointers(size_t limit) const;
+    // Поиск чанка и ячейки по позиции
+    const Node* locate(size_t position, size_t& slot) const;
+
+public:
+    // -----------------------------------------
+    // -------------- Конструкторы -------------
+    // -----------------------------------------
+    PersistentList();
+    PersistentList(const T& value);
+    PersistentList(T&& value);
+    PersistentList(const std::shared_ptr<Node>& node, size_t size);
+    PersistentList(const std::vector<T>& values);
+
+    // -----------------------------------------
+    // ---------- IPersistentStructure ---------
+    // -----------------------------------------
+    size_t size() const override;
+    bool empty() const override;
+    std::shared_ptr<IPersistentStructure<T>> clear() const override;
+    std::shared_ptr<IPersistentStructure<T>> clone() const override;
+
+    // -----------------------------------------
+    // ------------ Односвязный API ------------
+    // -----------------------------------------
+    const T& front() const;
+    PersistentList<T> tail() const; // Хвост списка
+    // Добавление элемента в начало списка. Перегрузки для rvalue
+    // (std::move(list).prepend(x)) дописывают головной чанк на месте.
+    PersistentList<T> prepend(const T& value) const&;
+    PersistentList<T> prepend(T&& value) const&;
+    PersistentList<T> prepend(const T& value) &&;
+    PersistentList<T> prepend(T&& value) &&;
+    template<typename... Args>
+    PersistentList<T> emplace_front(Args&&... args) const&; // Конструирование в начале
+    template<typename... Args>
+    PersistentList<T> emplace_front(Args&&... args) &&;
+    PersistentList<T> append(const T& value) const; // Добавление элемента в конец списка
+    PersistentList<T> append(T&& value) const;
+    PersistentList<T> concat(const PersistentList<T>& other) const; // Объединение двух списков
+    PersistentList<T> reverse() const; // Отразить список
+    PersistentList<T> take(size_t n) const; // Взять первые n элементов
+    PersistentList<T> drop(size_t n) const; // Отбросить первые n элементов (без копирования)
+
+    // -----------------------------------------
+    // ------ Двухсвязный API через Zipper -----
+    // -----------------------------------------
+    class ZipperView {
+    private:
+        PersistentList<T> left; // Пройденные элементы в обратном порядке
+        T current; // Текущее значение
+        PersistentList<T> right; // Следующие элементы
+
+    public:
+        // -----------------------------------------
+        // -------------- Конструктор --------------
+        // -----------------------------------------
+        ZipperView(const PersistentList<T>& list, size_t position = 0);
+
+        // -----------------------------------------
+        // --------------- Навигация ---------------
+        // -----------------------------------------
+        ZipperView next() const; // Следующий элемент
+        ZipperView prev() const; // Предыдущий элемент
+        ZipperView moveTo(size_t position) const; // Сместиться на заданную позицию
+
+        // -----------------------------------------
+        // ---------- Функции через Zipper ---------
+        // -----------------------------------------
+        PersistentList<T> insertBefore(const T& value) const; // Добавить элемент до текующей позиции
+        PersistentList<T> insertAfter(const T& value) const; // Добавить элемент после текущей позиции
+        PersistentList<T> removeCurrent() const; // Удалить элемент
+        PersistentList<T> updateCurrent(const T& value) const; // Обновить текущее значение
+
+        // -----------------------------------------
+        // ----------- Получение значений ----------
+        // -----------------------------------------
+        const T& getCurrent() const { 
+            return current; 
+        }
+        bool hasNext() const { 
+            return !right.empty(); 
+        }
+        bool hasPrev() const { 
+            return !left.empty(); 
+        }
+
+        // -----------------------------------------
+        // -------- Преобразование в список --------
+        // -----------------------------------------
+        PersistentList<T> toList() const;
+    };
+
+    // Создание zipper
+    ZipperView getZipper(size_t position = 0) const;
+
+    // -----------------------------------------
+    // ---- Работа с значениями по позициям ----
+    // -----------------------------------------
+    PersistentList<T> insertAt(size_t position, const T& value) const;
+    PersistentList<T> removeAt(size_t position) const;
+    const T& at(size_t position) const;
+
+    // -----------------------------------------
+    // ----------- Итератор по списку ----------
+    // -----------------------------------------
+    class Iterator {
+    private:
+        const Node* node; // Текущий чанк
+        size_t pos; // Количество непройденных элементов в чанке
+
+    public:
+        Iterator(const Node* n, size_t p) : node(n), pos(p) {}
+        // -----------------------------------------
+        // ---------- Перекрытие операторов --------
+        // -----------------------------------------
+        // Разыменование указателя (значение)
+        const T& operator*() const {
+            return node->value(pos - 1);
+        }
+        // Следующий элемент
+        Iterator& operator++() {
+            if (node && --pos == 0) {
+                node = node->next.get();
+                pos = node ? node->count : 0;
+            }
+            return *this;
+        }
+        // Оператор неравенства
+        bool operator!=(const Iterator& other) const {
+            return node != other.node || pos != other.pos;
+        }
+    };
+    // -----------------------------------------
+    // ------------ Для работы цикла -----------
+    // -----------------------------------------
+    // Итератор на первый элемент
+    Iterator begin() const {
+        return Iterator(head.get(), head_used);
+    }
+    // Итератор за последний эелемент
+    Iterator end() const { 
+        return Iterator(nullptr, 0);
+    }
+
+    // -----------------------------------------
+    // ------------- Преобразования ------------
+    // -----------------------------------------
+    std::vector<T> toVector() const; // В вектор
+    template<typename Container>
+    Container toContainer() const; // В контейнер
+
+    // -----------------------------------------
+    // ------ Получение элементов с конца ------
+    // -----------------------------------------
+    const T& back() const; // Последний элемент
+    PersistentList<T> init() const;  // Все кроме последнего
+
+    // -----------------------------------------
+    // ------- Сравнение и хеширование ---------
+    // -----------------------------------------
+    // Поэлементное сравнение до первого общего хвоста: с того же чанка
+    // и той же ячейки списки совпадают до конца
+    bool operator==(const PersistentList& other) const;
+    bool operator!=(const PersistentList& other) const {
+        return !(*this == other);
+    }
+    size_t hash() const; // Согласован с ==
+};
+
+namespace persistent_hash_detail {
+    template<typename T>
+    struct hashable<PersistentList<T>> : hashable<T> {};
+}
+
+namespace std {
+    template<typename T>
+    struct hash<PersistentList<T>> {
+        size_t operator()(const PersistentList<T>& list) const {
+            return list.hash();
+        }
+    };
+}
+
+#include "persistent_list_impl.hpp"
+
 #endif
\ No newline at end of file
@@ -1,179 +1,380 @@
-#ifndef PERSISTENT_MAP_HPP
-#define PERSISTENT_MAP_HPP
-
-#include "persistent_data_structure.hpp"
-#include <functional>
-#include <optional>
-#include <cstdint>
-#include <memory>
-#include <vector>
-
-// -----------------------------------------
-// --------- Ассоциативный массив ----------
-// -----------------------------------------
-// Hash Array Mapped Trie:
-// Хэш-таблица для бытсрого доступа;
-// Дерево для персистентности;
-// Битовые маски для хранения.
-
-template<typename K, typename V>
-class PersistentMap : public IPersistentStructure<std::pair<K, V>> {
-private:
-    // -----------------------------------------
-    // ---------- Константы массива ------------
-    // -----------------------------------------
-    static constexpr size_t BITS_PER_LEVEL = 5; // Количество битов на уровень
-    static constexpr size_t BRANCHING_FACTOR = 1 << BITS_PER_LEVEL; // Количество потомков в узле
-    static constexpr size_t BIT_MASK = BRANCHING_FACTOR - 1; // Маска 
-
-    // -----------------------------------------
-    // ------- Структура узла массива ----------
-    // -----------------------------------------
-    struct Node {
-        uint32_t bitmap = 0; // Битовая маска для существующих потомков
-        std::vector<std::shared_ptr<Node>> children; // Узлы потомков
-        std::vector<std::pair<K, V>> entries; // Пары ключ-значение
-
-        // Проверка на лист
-        bool isLeaf() const {
-            return entries.size() > 0;
-        }
-
-        // -----------------------------------------
-        // ------ Клонирование узла массива --------
-        // -----------------------------------------
-        std::shared_ptr<Node> clone() const {
-            auto new_node = std::make_shared<Node>();
-            new_node->bitmap = bitmap;
-            new_node->children = children;
-            new_node->entries = entries;
-            return new_node;
-        }
-
-        // Метод для поиска значения по ключу
-        V* findValue(const K& key) {
-            for (auto& entry : entries) {
-                if (entry.first == key) {
-                    return &entry.second;
-                }
-            }
-            return nullptr;
-        }
-
-        const V* findValue(const K& key) const {
-            for (const auto& entry : entries) {
-                if (entry.first == key) {
-                    return &entry.second;
-                }
-            }
-            return nullptr;
-        }
-
-        // Метод для обновления или добавления значения
-        bool updateOrAdd(const K& key, const V& value) {
-            for (auto& entry : entries) {
-                if (entry.first == key) {
-                    entry.second = value;
-                    return true;  // Обновлено существующее
-                }
-            }
-            entries.emplace_back(key, value);
-            return false;  // Добавлено новое
-        }
-    };
-
-    std::shared_ptr<Node> root;
-    size_t map_size;
-    std::hash<K> hasher;
-
-    // -----------------------------------------
-    // --- Вспомогательные методы для узлов ----
-    // -----------------------------------------
-    // Получение индекса по хешу
-    size_t getIndex(uint32_t bitmap, size_t hash_fragment) const;
-
-    // Вставка элемента
-    std::shared_ptr<Node> insertNode(std::shared_ptr<Node> node,
-        size_t hash, const K& key,
-        const V& value, size_t level) const;
-
-    // Поиск элемента (возвращает указатель на значение)
-    const V* findNode(std::shared_ptr<Node> node,
-        size_t hash, const K& key,
-        size_t level) const;
-
-public:
-    // -----------------------------------------
-    // -------------- Конструкторы -------------
-    // -----------------------------------------
-    PersistentMap();
-    PersistentMap(const std::vector<std::pair<K, V>>& items);
-
-    // -----------------------------------------
-    // ---------- IPersistentStructure ---------
-    // -----------------------------------------
-    size_t size() const override;
-    bool empty() const override;
-    std::shared_ptr<IPersistentStructure<std::pair<K, V>>> clear() const override;
-    std::shared_ptr<IPersistentStructure<std::pair<K, V>>> clone() const override;
-
-    // -----------------------------------------
-    // -------- Методы с ключами массива -------
-    // -----------------------------------------
-    bool contains(const K& key) const;
-    const V& at(const K& key) const;
-    std::optional<V> get(const K& key) const;
-
-    PersistentMap<K, V> set(const K& key, const V& value) const; // Установка нового значения по ключу
-    PersistentMap<K, V> insert(const K& key, const V& value) const {
-        return set(key, value);
-    }
-    PersistentMap<K, V> erase(const K& key) const; // Удаление значения по ключу
-    PersistentMap<K, V> remove(const K& key) const {
-        return erase(key);
-    }
-
-    // -----------------------------------------
-    // ----------- Итератор по массиву ---------
-    // -----------------------------------------
-    class Iterator {
-    private:
-        struct StackFrame {
-            std::shared_ptr<Node> node; // Текущий узел
-            size_t child_index; // Индекс следующего потомка для итерации
-            size_t entry_index; // Индекс следующей записи в листе
-        };
-
-        std::vector<StackFrame> stack;
-        std::pair<K, V> current_value;
-        bool has_value;
-
-        void advance(); // Метод для обхода итератором
-
-    public:
-        Iterator(std::shared_ptr<Node> root);
-        // -----------------------------------------
-        // ---------- Перекрытие операторов --------
-        // -----------------------------------------
-        // Разыменование указателя (значение)
-        const std::pair<K, V>& operator*() const {
-            return current_value;
-        }
-        // Следующий элемент
-        Iterator& operator++();
-        // Оператор неравенства
-        bool operator!=(const Iterator& other) const;
-    };
-
-    // -----------------------------------------
-    // ------------ Для работы цикла -----------
-    // -----------------------------------------
-    // Итератор на первый элемент
-    Iterator begin() const;
-    // Итератор за последний элемент
-    Iterator end() const;
-};
-
-#include "persistent_map_impl.hpp"
-
+#ifndef PERSISTENT_MAP_HPP
+#define PERSISTENT_MAP_HPP
+
+#include "persistent_data_structure.hpp"
+#include "persistent_reclaimer.hpp"
+#include "persistent_parallel.hpp"
+#include <functional>
+#include <optional>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <tuple>
+#include <utility>
+
+// -----------------------------------------
+// --------- Ассоциативный массив ----------
+// -----------------------------------------
+// Hash Array Mapped Trie:
+// Хэш-таблица для бытсрого доступа;
+// Дерево для персистентности;
+// Битовые маски для хранения.
+
+template<typename K, typename V>
+class PersistentMap : public IPersistentStructure<std::pair<K, V>> {
+private:
+    friend class SnapshotWriter;
+    friend class SnapshotReader;
+    friend class MappedSnapshotWriter;
+    friend class HashConsTable;
+    friend class ReplicationSender<PersistentMap<K, V>>;
+    friend class ReplicationReceiver<PersistentMap<K, V>>;
+
+    // -----------------------------------------
+    // ---------- Константы массива ------------
+    // -----------------------------------------
+    static constexpr size_t BITS_PER_LEVEL = 5; // Количество битов на уровень
+    static constexpr size_t BRANCHING_FACTOR = 1 << BITS_PER_LEVEL; // Количество потомков в узле
+    static constexpr size_t BIT_MASK = BRANCHING_FACTOR - 1; // Маска 
+
+    // -----------------------------------------
+    // ------- Структура узла массива ----------
+    // -----------------------------------------
+    struct Node {
+        uint32_t bitmap = 0; // Битовая маска для существующих потомков
+        std::vector<std::shared_ptr<Node>> children; // Узлы потомков
+        std::vector<std::pair<K, V>> entries; // Пары ключ-значение
+        persistent_hash_detail::NodeHash merkle; // Хеш содержимого поддерева
+
+        // Проверка на лист
+        bool isLeaf() const {
+            return entries.size() > 0;
+        }
+
+        // -----------------------------------------
+        // ------ Клонирование узла массива --------
+        // -----------------------------------------
+        std::shared_ptr<Node> clone() const {
+            auto new_node = std::make_shared<Node>();
+            new_node->bitmap = bitmap;
+            new_node->children = children;
+            new_node->entries = entries;
+            size_t hash;
+            if (merkle.get(hash)) {
+                new_node->merkle.set(hash);
+            }
+            return new_node;
+        }
+
+        // Позиция записи с ключом (entries.size(), если ее нет)
+        size_t find(const K& key) const {
+            size_t i = 0;
+            while (i < entries.size() && !(entries[i].first == key)) {
+                ++i;
+            }
+            return i;
+        }
+
+        // Метод для поиска значения по ключу
+        V* findValue(const K& key) {
+            for (auto& entry : entries) {
+                if (entry.first == key) {
+                    return &entry.second;
+                }
+            }
+            return nullptr;
+        }
+
+        const V* findValue(const K& key) const {
+            for (const auto& entry : entries) {
+                if (entry.first == key) {
+                    return &entry.second;
+                }
+            }
+            return nullptr;
+        }
+
+        // Метод для обновления или добавления значения.
+        // Значение конструируется из args прямо в записи листа.
+        template<typename KK, typename... Args>
+        bool updateOrAdd(KK&& key, Args&&... args) {
+            for (auto& entry : entries) {
+                if (entry.first == key) {
+                    entry.second = V(std::forward<Args>(args)...);
+                    return true;  // Обновлено существующее
+                }
+            }
+            entries.emplace_back(std::piecewise_construct,
+                std::forward_as_tuple(std::forward<KK>(key)),
+                std::forward_as_tuple(std::forward<Args>(args)...));
+            return false;  // Добавлено новое
+        }
+    };
+
+    std::shared_ptr<Node> root;
+    size_t map_size;
+    std::hash<K> hasher;
+
+    PersistentMap(std::shared_ptr<Node> r, size_t size) : root(std::move(r)), map_size(size) {}
+
+    // -----------------------------------------
+    // --- Вспомогательные методы для узлов ----
+    // -----------------------------------------
+    // Получение индекса по хешу
+    size_t getIndex(uint32_t bitmap, size_t hash_fragment) const;
+
+    // Вставка элемента. Значение конструируется из args в листе;
+    // при inPlace узлы, которыми владеет только эта версия, не копируются.
+    template<typename KK, typename... Args>
+    std::shared_ptr<Node> insertNode(const std::shared_ptr<Node>& node,
+        size_t hash, KK&& key, size_t level,
+        bool& added, bool inPlace, Args&&... args) const;
+
+    // Спуск к ключу с изменением через fn; путь копируется только
+    // если fn вернула новое значение, отсутствующий ключ вставляется
+    // через insertNode с того уровня, где кончился путь
+    template<typename F>
+    std::shared_ptr<Node> modifyNode(const std::shared_ptr<Node>& node,
+        size_t hash, const K& key, size_t level, F& fn, bool& added) const;
+
+    // Общая реализация set/emplace
+    template<typename KK, typename... Args>
+    PersistentMap<K, V> assoc(bool inPlace, KK&& key, Args&&... args) const;
+
+    // -----------------------------------------
+    // ---------- Пакетные изменения -----------
+    // -----------------------------------------
+    // Глубже лист не делится: фрагменты хеша закончились
+    static constexpr size_t MAX_LEVEL = sizeof(size_t) * 8 / BITS_PER_LEVEL;
+    // Часть пакета не меньше этого размера собирается параллельно
+    static constexpr size_t PARALLEL_BATCH = 4096;
+
+    // Элемент пакета; value == nullptr - удаление ключа
+    struct BatchItem {
+        size_t hash;
+        const K* key;
+        const V* value;
+    };
+
+    // Пакет раскладывается по фрагментам хеша уровня, каждый
+    // затронутый узел копируется один раз, потомки с большими частями
+    // пакета собираются на PersistentThreadPool. scratch - буфер той
+    // же длины для раскладки, delta - изменение размера.
+    std::shared_ptr<Node> updateNode(const std::shared_ptr<Node>& node, size_t level,
+        BatchItem* first, BatchItem* last, BatchItem* scratch,
+        bool inPlace, std::ptrdiff_t& delta) const;
+    std::shared_ptr<Node> updateBranch(std::shared_ptr<Node> node, size_t level,
+        BatchItem* first, BatchItem* last, BatchItem* scratch,
+        bool inPlace, std::ptrdiff_t& delta) const;
+    PersistentMap<K, V> updateMany(std::vector<BatchItem>& items, bool inPlace) const;
+    PersistentMap<K, V> updateMany(BatchItem* first, BatchItem* last, BatchItem* scratch, bool inPlace) const;
+    // Удаление одного ключа: пакет из одного элемента на стеке
+    PersistentMap<K, V> without(const K& key, bool inPlace) const;
+    template<typename Range>
+    std::vector<BatchItem> setItems(const Range& items) const;
+    template<typename Range>
+    std::vector<BatchItem> eraseItems(const Range& keys) const;
+    void hashItems(std::vector<BatchItem>& batch) const;
+
+    // Поиск элемента (возвращает указатель на значение)
+    const V* findNode(std::shared_ptr<Node> node,
+        size_t hash, const K& key,
+        size_t level) const;
+
+    // Сравнение поддеревьев одного уровня и сбор их записей
+    bool subtreeEqual(const std::shared_ptr<Node>& a, const std::shared_ptr<Node>& b, size_t level) const;
+    static void collectEntries(const Node* node, std::vector<const std::pair<K, V>*>& out);
+
+    // Хеши Меркла: хеш узла - сумма хешей записей поддерева, поэтому
+    // он не зависит ни от формы дерева, ни от порядка записей в листе,
+    // а у копии пути меняется на одну и ту же разницу на всех уровнях
+    static constexpr bool MERKLE =
+        persistent_hash_detail::hashable<K>::value && persistent_hash_detail::hashable<V>::value;
+    static bool hashing(); // Режим PersistentHashing включен и K, V хешируются
+    static size_t entryTerm(const K& key, const V& value);
+    static size_t nodeHash(const Node* node);
+
+public:
+    // -----------------------------------------
+    // -------------- Конструкторы -------------
+    // -----------------------------------------
+    PersistentMap();
+    PersistentMap(const std::vector<std::pair<K, V>>& items);
+    PersistentMap(const PersistentMap& other) = default;
+    PersistentMap(PersistentMap&& other) noexcept = default;
+    PersistentMap& operator=(PersistentMap other) noexcept;
+    // Освобождение версии (через сборщик, если он включен)
+    ~PersistentMap() override;
+
+    // -----------------------------------------
+    // ---------- IPersistentStructure ---------
+    // -----------------------------------------
+    size_t size() const override;
+    bool empty() const override;
+    std::shared_ptr<IPersistentStructure<std::pair<K, V>>> clear() const override;
+    std::shared_ptr<IPersistentStructure<std::pair<K, V>>> clone() const override;
+
+    // -----------------------------------------
+    // -------- Методы с ключами массива -------
+    // -----------------------------------------
+    bool contains(const K& key) const;
+    const V& at(const K& key) const;
+    std::optional<V> get(const K& key) const;
+
+    // Установка нового значения по ключу. Перегрузки для rvalue
+    // (std::move(map).set(k, v)) не копируют узлы, которыми владеет
+    // только эта версия.
+    PersistentMap<K, V> set(const K& key, const V& value) const& {
+        return assoc(false, key, value);
+    }
+    PersistentMap<K, V> set(const K& key, V&& value) const& {
+        return assoc(false, key, std::move(value));
+    }
+    PersistentMap<K, V> set(K&& key, const V& value) const& {
+        return assoc(false, std::move(key), value);
+    }
+    PersistentMap<K, V> set(K&& key, V&& value) const& {
+        return assoc(false, std::move(key), std::move(value));
+    }
+    PersistentMap<K, V> set(const K& key, const V& value) && {
+        return PersistentMap<K, V>(std::move(*this)).assoc(true, key, value);
+    }
+    PersistentMap<K, V> set(const K& key, V&& value) && {
+        return PersistentMap<K, V>(std::move(*this)).assoc(true, key, std::move(value));
+    }
+    PersistentMap<K, V> set(K&& key, const V& value) && {
+        return PersistentMap<K, V>(std::move(*this)).assoc(true, std::move(key), value);
+    }
+    PersistentMap<K, V> set(K&& key, V&& value) && {
+        return PersistentMap<K, V>(std::move(*this)).assoc(true, std::move(key), std::move(value));
+    }
+    // Конструирование значения на месте по ключу
+    template<typename... Args>
+    PersistentMap<K, V> emplace(const K& key, Args&&... args) const& {
+        return assoc(false, key, std::forward<Args>(args)...);
+    }
+    template<typename... Args>
+    PersistentMap<K, V> emplace(const K& key, Args&&... args) && {
+        return PersistentMap<K, V>(std::move(*this)).assoc(true, key, std::forward<Args>(args)...);
+    }
+    // Изменение значения за один спуск: fn(const V*) получает текущее
+    // значение (nullptr, если ключа нет) и возвращает std::optional<V>;
+    // пустой результат возвращает ту же версию без копирования пути
+    template<typename F>
+    PersistentMap<K, V> update(const K& key, F fn) const;
+    PersistentMap<K, V> insert(const K& key, const V& value) const {
+        return set(key, value);
+    }
+    PersistentMap<K, V> insert(K&& key, V&& value) const {
+        return set(std::move(key), std::move(value));
+    }
+    // Удаление значения по ключу (копия пути; rvalue - на месте)
+    PersistentMap<K, V> erase(const K& key) const& {
+        return without(key, false);
+    }
+    PersistentMap<K, V> erase(const K& key) && {
+        return PersistentMap<K, V>(std::move(*this)).without(key, true);
+    }
+
+    // Пакетные изменения: ключи группируются по фрагментам хеша, и
+    // каждый затронутый узел копируется один раз, а не по пути на ключ.
+    // items - диапазон пар (ключ, значение), keys - диапазон ключей;
+    // элементы читаются по ссылке. При повторе ключа действует последний.
+    template<typename Range>
+    PersistentMap<K, V> setMany(const Range& items) const& {
+        auto batch = setItems(items);
+        return updateMany(batch, false);
+    }
+    template<typename Range>
+    PersistentMap<K, V> setMany(const Range& items) && {
+        auto batch = setItems(items);
+        return PersistentMap<K, V>(std::move(*this)).updateMany(batch, true);
+    }
+    template<typename Range>
+    PersistentMap<K, V> eraseMany(const Range& keys) const& {
+        auto batch = eraseItems(keys);
+        return updateMany(batch, false);
+    }
+    template<typename Range>
+    PersistentMap<K, V> eraseMany(const Range& keys) && {
+        auto batch = eraseItems(keys);
+        return PersistentMap<K, V>(std::move(*this)).updateMany(batch, true);
+    }
+    PersistentMap<K, V> remove(const K& key) const {
+        return erase(key);
+    }
+
+    // -----------------------------------------
+    // ----------- Итератор по массиву ---------
+    // -----------------------------------------
+    class Iterator {
+    private:
+        struct StackFrame {
+            const Node* node; // Текущий узел (узлы держит owner)
+            size_t child_index; // Индекс следующего потомка для итерации
+            size_t entry_index; // Индекс следующей записи в листе
+        };
+
+        std::shared_ptr<Node> owner; // Корень обходимой версии
+        std::vector<StackFrame> stack;
+        const std::pair<K, V>* current_value = nullptr; // Запись в листе (без копирования)
+        bool has_value;
+
+        void advance(); // Метод для обхода итератором
+
+    public:
+        Iterator(std::shared_ptr<Node> root);
+        // -----------------------------------------
+        // ---------- Перекрытие операторов --------
+        // -----------------------------------------
+        // Разыменование указателя (значение)
+        const std::pair<K, V>& operator*() const {
+            return *current_value;
+        }
+        // Следующий элемент
+        Iterator& operator++();
+        // Оператор неравенства
+        bool operator!=(const Iterator& other) const;
+    };
+
+    // -----------------------------------------
+    // ------------ Для работы цикла -----------
+    // -----------------------------------------
+    // Итератор на первый элемент
+    Iterator begin() const;
+    // Итератор за последний элемент
+    Iterator end() const;
+
+    // -----------------------------------------
+    // ------- Сравнение и хеширование ---------
+    // -----------------------------------------
+    // Общие узлы пропускаются за O(1); поддеревья одинаковой формы
+    // сравниваются по потомкам, разной формы - поиском каждой записи
+    bool operator==(const PersistentMap& other) const;
+    bool operator!=(const PersistentMap& other) const {
+        return !(*this == other);
+    }
+    // Не зависит от формы дерева и порядка записей; O(1), если хеш
+    // корня уже известен (режим PersistentHashing или повторный вызов)
+    size_t hash() const;
+};
+
+namespace persistent_hash_detail {
+    template<typename K, typename V>
+    struct hashable<PersistentMap<K, V>>
+        : std::bool_constant<hashable<K>::value && hashable<V>::value> {};
+}
+
+namespace std {
+    template<typename K, typename V>
+    struct hash<PersistentMap<K, V>> {
+        size_t operator()(const PersistentMap<K, V>& map) const {
+            return map.hash();
+        }
+    };
+}
+
+#include "persistent_map_impl.hpp"
+
 #endif
\ No newline at end of file
@@ -1,397 +1,884 @@
-#ifndef PERSISTENT_MAP_IMPL_HPP
-#define PERSISTENT_MAP_IMPL_HPP
-
-#include "persistent_map.hpp"
-#include <stdexcept>
-#include <stack>
-#include <cstdint>
-
-// -----------------------------------------
-// --- Реализация ассоциативного массива ---
-// -----------------------------------------
-
-// -----------------------------------------
-// ----- Кастомная реализация смещения -----
-// -----------------------------------------
-namespace persistent_map_detail {
-    inline uint32_t popcount(uint32_t x) {
-        x = x - ((x >> 1) & 0x55555555);
-        x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
-        x = (x + (x >> 4)) & 0x0F0F0F0F;
-        x = x + (x >> 8);
-        x = x + (x >> 16);
-        return x & 0x3F;
-    }
-}
-
-// -----------------------------------------
-// -------------- Конструкторы -------------
-// -----------------------------------------
-// Пустой массив
-template<typename K, typename V>
-PersistentMap<K, V>::PersistentMap()
-    : root(std::make_shared<Node>()), map_size(0) {
-}
-
-// Конструктор из вектора пар (Ключ, Значение)
-template<typename K, typename V>
-PersistentMap<K, V>::PersistentMap(const std::vector<std::pair<K, V>>& items)
-    : root(std::make_shared<Node>()), map_size(0) {
-    PersistentMap<K, V> current;
-    for (const auto& [key, value] : items) {
-        current = current.set(key, value);
-    }
-    root = current.root;
-    map_size = current.map_size;
-}
-
-// -----------------------------------------
-// ------ Методы IPersistentStructure ------
-// -----------------------------------------
-// Размер
-template<typename K, typename V>
-size_t PersistentMap<K, V>::size() const {
-    return map_size;
-}
-
-// Проверка на пустоту
-template<typename K, typename V>
-bool PersistentMap<K, V>::empty() const {
-    return map_size == 0;
-}
-
-// Возвращение пустого массива
-template<typename K, typename V>
-std::shared_ptr<IPersistentStructure<std::pair<K, V>>>
-PersistentMap<K, V>::clear() const {
-    return std::make_shared<PersistentMap<K, V>>();
-}
-
-// Поверхностное копирование (копирование указателей)
-template<typename K, typename V>
-std::shared_ptr<IPersistentStructure<std::pair<K, V>>>
-PersistentMap<K, V>::clone() const {
-    auto result = std::make_shared<PersistentMap<K, V>>();
-    result->root = root;
-    result->map_size = map_size;
-    return result;
-}
-
-// -----------------------------------------
-// --- Вспомогательные методы для узлов ----
-// -----------------------------------------
-// Получение индекса по хешу
-template<typename K, typename V>
-size_t PersistentMap<K, V>::getIndex(uint32_t bitmap, size_t hash_fragment) const {
-    // Проверка границ
-    if (hash_fragment >= 32) {
-        return 0;  // или можно бросить исключение
-    }
-
-    // Создаем маску для битов до hash_fragment
-    uint32_t mask = (hash_fragment == 0) ? 0 : ((1u << hash_fragment) - 1);
-
-    // Применяем маску к bitmap
-    uint32_t masked = bitmap & mask;
-
-    // Подсчитываем установленные биты
-    return persistent_map_detail::popcount(masked);
-}
-
-// -----------------------------------------
-// -------- Методы с ключами массива -------
-// -----------------------------------------
-// Проверка на наличие значения по ключу
-template<typename K, typename V>
-bool PersistentMap<K, V>::contains(const K& key) const {
-    size_t hash = hasher(key);
-    return findNode(root, hash, key, 0) != nullptr;
-}
-
-// Получение значения по ключу
-template<typename K, typename V>
-const V& PersistentMap<K, V>::at(const K& key) const {
-    size_t hash = hasher(key);
-    const V* value = findNode(root, hash, key, 0);
-    if (!value) {
-        throw std::out_of_range("Key not found");
-    }
-    return *value;
-}
-
-// Получение узла по ключу
-template<typename K, typename V>
-std::optional<V> PersistentMap<K, V>::get(const K& key) const {
-    size_t hash = hasher(key);
-    const V* value = findNode(root, hash, key, 0);
-    if (value) {
-        return *value;
-    }
-    return std::nullopt;
-}
-
-// -----------------------------------------
-// --- Вспомогательные методы для узлов ----
-// -----------------------------------------
-// Поиск элемента по ключу и значению
-template<typename K, typename V>
-const V* PersistentMap<K, V>::findNode(std::shared_ptr<Node> node,
-    size_t hash, const K& key,
-    size_t level) const {
-    if (!node) {
-        return nullptr;
-    }
-
-    // Очевидные случаи
-    // Если лист, то ищем в нем значения
-    if (!node->entries.empty()) {
-        return node->findValue(key);
-    }
-
-    // Если узел пустой
-    if (node->children.empty()) {
-        return nullptr;
-    }
-
-    // Вычисляем фрагмент хэша для текущего уровня
-    size_t hash_fragment = (hash >> (level * BITS_PER_LEVEL)) & BIT_MASK;
-
-    // Если не сщуетсвует потомка с вычисленным фрагментом
-    if (!(node->bitmap & (1 << hash_fragment))) {
-        return nullptr;
-    }
-
-    // Получаем индекс потомка
-    size_t index = getIndex(node->bitmap, hash_fragment);
-
-    // Проверяем границы
-    if (index >= node->children.size()) {
-        return nullptr;
-    }
-
-    // Рекурсивно ищем в найденном потомке
-    return findNode(node->children[index], hash, key, level + 1);
-}
-
-// Утсановка нового значения с возвращением новго массива
-template<typename K, typename V>
-PersistentMap<K, V> PersistentMap<K, V>::set(const K& key, const V& value) const {
-    // Вычиление нового хэша и создание новго дерев с добавлением узла
-    size_t hash = hasher(key);
-    auto new_root = insertNode(root, hash, key, value, 0);
-
-    PersistentMap<K, V> result;
-    result.root = new_root;
-
-    // Размер увеличаваем, если ключа не было
-    const V* existing = findNode(root, hash, key, 0);
-    result.map_size = existing ? map_size : map_size + 1;
-
-    return result;
-}
-
-// -----------------------------------------
-// -------- Добавление нового узла ---------
-// -----------------------------------------
-template<typename K, typename V>
-std::shared_ptr<typename PersistentMap<K, V>::Node>
-PersistentMap<K, V>::insertNode(std::shared_ptr<Node> node,
-    size_t hash, const K& key,
-    const V& value, size_t level) const {
-    if (!node) {
-        node = std::make_shared<Node>();
-    }
-
-    auto new_node = node->clone();
-
-    // Узел является листом или не имеет записи
-    if (!new_node->entries.empty() || new_node->children.empty()) {
-        // Используем метод updateOrAdd
-        bool was_updated = new_node->updateOrAdd(key, value);
-
-        // Если ключ уже существовал, просто возвращаем обновленный узел
-        if (was_updated) {
-            return new_node;
-        }
-
-        // Проверяем, не нужно ли разделить узел
-        if (new_node->entries.size() > BRANCHING_FACTOR / 2 &&
-            level < (sizeof(size_t) * 8 / BITS_PER_LEVEL)) {
-
-            // Разделяем узел
-            auto split_node = std::make_shared<Node>();
-
-            // Создаем копии записей перед их перемещением
-            auto entries_copy = new_node->entries;
-
-            for (const auto& entry : entries_copy) {
-                const K& k = entry.first;
-                const V& v = entry.second;
-                size_t entry_hash = hasher(k);
-                size_t fragment = (entry_hash >> (level * BITS_PER_LEVEL)) & BIT_MASK;
-                // Создание нового слота для хранения нового значения
-                if (!(split_node->bitmap & (1 << fragment))) {
-                    split_node->bitmap |= (1 << fragment);
-                    size_t index = getIndex(split_node->bitmap, fragment);
-
-                    auto leaf = std::make_shared<Node>();
-                    leaf->entries.emplace_back(k, v);
-
-                    split_node->children.insert(
-                        split_node->children.begin() + index,
-                        leaf
-                    );
-                }
-                else {
-                    // Рекурсивно вставляем новое значение в соответствующий узел потомка
-                    size_t index = getIndex(split_node->bitmap, fragment);
-                    split_node->children[index] = insertNode(
-                        split_node->children[index],
-                        entry_hash, k, v, level + 1
-                    );
-                }
-            }
-            return split_node;
-        }
-        return new_node;
-    }
-
-    // Если рассматриваем внутренний узел
-    size_t hash_fragment = (hash >> (level * BITS_PER_LEVEL)) & BIT_MASK;
-
-    if (!(new_node->bitmap & (1 << hash_fragment))) {
-        // Создаем новый лист
-        new_node->bitmap |= (1 << hash_fragment);
-        size_t index = getIndex(new_node->bitmap, hash_fragment);
-
-        auto leaf = std::make_shared<Node>();
-        leaf->entries.emplace_back(key, value);
-
-        new_node->children.insert(
-            new_node->children.begin() + index,
-            leaf
-        );
-    }
-    else {
-        // Обновляем существующий узел потомка
-        size_t index = getIndex(new_node->bitmap, hash_fragment);
-
-        // Проверяем границы
-        if (index >= new_node->children.size()) {
-            return new_node;
-        }
-        // Рекурсивно обновляем существующий узел потомка
-        new_node->children[index] = insertNode(
-            new_node->children[index],
-            hash, key, value, level + 1
-        );
-    }
-
-    return new_node;
-}
-
-// -----------------------------------------
-// ------ Удаление существующего узла ------
-// -----------------------------------------
-template<typename K, typename V>
-PersistentMap<K, V> PersistentMap<K, V>::erase(const K& key) const {
-    if (!contains(key)) {
-        return *this;
-    }
-
-    // Простая реализация - создаем новую карту без удаленного ключа
-    PersistentMap<K, V> result;
-
-    for (auto it = begin(); it != end(); ++it) {
-        const auto& pair = *it;  
-        if (pair.first != key) {
-            result = result.set(pair.first, pair.second);
-        }
-    }
-
-    return result;
-}
-
-// -----------------------------------------
-// ------------ Для работы цикла -----------
-// -----------------------------------------
-
-// -----------------------------------------
-// ---------- Реализация итератора ---------
-// -----------------------------------------
-// Конструктор итератора
-template<typename K, typename V>
-PersistentMap<K, V>::Iterator::Iterator(std::shared_ptr<Node> root) {
-    if (root && (!root->children.empty() || !root->entries.empty())) {
-        stack.push_back({ root, 0, 0 });
-        advance();
-    }
-    else {
-        has_value = false;
-    }
-}
-
-// Метод для обхода итератором
-template<typename K, typename V>
-void PersistentMap<K, V>::Iterator::advance() {
-    while (!stack.empty()) {
-        auto& frame = stack.back();
-
-        // Обработка листа
-        if (!frame.node->entries.empty()) {
-            // Если существуют значения в листе, то итерируем
-            if (frame.entry_index < frame.node->entries.size()) {
-                current_value = frame.node->entries[frame.entry_index++];
-                has_value = true;
-                return;
-            }
-            stack.pop_back();
-        }
-        // Внутренний узел
-        else {
-            if (frame.child_index < frame.node->children.size()) {
-                auto child = frame.node->children[frame.child_index++];
-                if (child) {
-                    stack.push_back({ child, 0, 0 });
-                }
-            }
-            else {
-                // Иначе удаляем лист из стека
-                stack.pop_back();
-            }
-        }
-    }
-    has_value = false;
-}
-
-// -----------------------------------------
-// ---------- Перекрытие операторов --------
-// -----------------------------------------
-// Следующий элемент
-template<typename K, typename V>
-typename PersistentMap<K, V>::Iterator&
-PersistentMap<K, V>::Iterator::operator++() {
-    advance();
-    return *this;
-}
-// Оператор неравенства
-template<typename K, typename V>
-bool PersistentMap<K, V>::Iterator::operator!=(const Iterator& other) const {
-    if (has_value != other.has_value) return true;
-    if (!has_value) return false;  // оба end()
-    return current_value != other.current_value;
-}
-
-// Итератор на первый элемент
-template<typename K, typename V>
-typename PersistentMap<K, V>::Iterator PersistentMap<K, V>::begin() const {
-    return Iterator(root);
-}
-
-// Итератор за последний эелемент
-template<typename K, typename V>
-typename PersistentMap<K, V>::Iterator PersistentMap<K, V>::end() const {
-    return Iterator(nullptr);
-}
-
+#ifndef PERSISTENT_MAP_IMPL_HPP
+#define PERSISTENT_MAP_IMPL_HPP
+
+#include "persistent_map.hpp"
+#include <stdexcept>
+#include <stack>
+#include <algorithm>
+#include <cstdint>
+
+// -----------------------------------------
+// --- Реализация ассоциативного массива ---
+// -----------------------------------------
+
+// -----------------------------------------
+// ----- Кастомная реализация смещения -----
+// -----------------------------------------
+namespace persistent_map_detail {
+    inline uint32_t popcount(uint32_t x) {
+        x = x - ((x >> 1) & 0x55555555);
+        x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+        x = (x + (x >> 4)) & 0x0F0F0F0F;
+        x = x + (x >> 8);
+        x = x + (x >> 16);
+        return x & 0x3F;
+    }
+}
+
+// -----------------------------------------
+// -------------- Конструкторы -------------
+// -----------------------------------------
+// Пустой массив
+template<typename K, typename V>
+PersistentMap<K, V>::PersistentMap()
+    : root(std::make_shared<Node>()), map_size(0) {
+}
+
+// Конструктор из вектора пар (Ключ, Значение)
+// Сборка одним пакетом: пары хешируются и раскладываются по
+// фрагментам хеша, потомки корня собираются параллельно
+template<typename K, typename V>
+PersistentMap<K, V>::PersistentMap(const std::vector<std::pair<K, V>>& items)
+    : root(std::make_shared<Node>()), map_size(0) {
+    PersistentMap<K, V> built = PersistentMap<K, V>().setMany(items);
+    root = built.root;
+    map_size = built.map_size;
+}
+
+// -----------------------------------------
+// ----- Присваивание и освобождение -------
+// -----------------------------------------
+// Старая версия уходит во временный объект и освобождается в его деструкторе
+template<typename K, typename V>
+PersistentMap<K, V>& PersistentMap<K, V>::operator=(PersistentMap other) noexcept {
+    root.swap(other.root);
+    std::swap(map_size, other.map_size);
+    return *this;
+}
+
+// Последняя ссылка на версию передается сборщику
+template<typename K, typename V>
+PersistentMap<K, V>::~PersistentMap() {
+    PersistentReclaimer::instance().retire(root);
+}
+
+// -----------------------------------------
+// ------ Методы IPersistentStructure ------
+// -----------------------------------------
+// Размер
+template<typename K, typename V>
+size_t PersistentMap<K, V>::size() const {
+    return map_size;
+}
+
+// Проверка на пустоту
+template<typename K, typename V>
+bool PersistentMap<K, V>::empty() const {
+    return map_size == 0;
+}
+
+// Возвращение пустого массива
+template<typename K, typename V>
+std::shared_ptr<IPersistentStructure<std::pair<K, V>>>
+PersistentMap<K, V>::clear() const {
+    return std::make_shared<PersistentMap<K, V>>();
+}
+
+// Поверхностное копирование (копирование указателей)
+template<typename K, typename V>
+std::shared_ptr<IPersistentStructure<std::pair<K, V>>>
+PersistentMap<K, V>::clone() const {
+    auto result = std::make_shared<PersistentMap<K, V>>();
+    result->root = root;
+    result->map_size = map_size;
+    return result;
+}
+
+// -----------------------------------------
+// --- Вспомогательные методы для узлов ----
+// -----------------------------------------
+// Получение индекса по хешу
+template<typename K, typename V>
+size_t PersistentMap<K, V>::getIndex(uint32_t bitmap, size_t hash_fragment) const {
+    // Проверка границ
+    if (hash_fragment >= 32) {
+        return 0;  // или можно бросить исключение
+    }
+
+    // Создаем маску для битов до hash_fragment
+    uint32_t mask = (hash_fragment == 0) ? 0 : ((1u << hash_fragment) - 1);
+
+    // Применяем маску к bitmap
+    uint32_t masked = bitmap & mask;
+
+    // Подсчитываем установленные биты
+    return persistent_map_detail::popcount(masked);
+}
+
+// -----------------------------------------
+// -------- Методы с ключами массива -------
+// -----------------------------------------
+// Проверка на наличие значения по ключу
+template<typename K, typename V>
+bool PersistentMap<K, V>::contains(const K& key) const {
+    size_t hash = hasher(key);
+    return findNode(root, hash, key, 0) != nullptr;
+}
+
+// Получение значения по ключу
+template<typename K, typename V>
+const V& PersistentMap<K, V>::at(const K& key) const {
+    size_t hash = hasher(key);
+    const V* value = findNode(root, hash, key, 0);
+    if (!value) {
+        throw std::out_of_range("Key not found");
+    }
+    return *value;
+}
+
+// Получение узла по ключу
+template<typename K, typename V>
+std::optional<V> PersistentMap<K, V>::get(const K& key) const {
+    size_t hash = hasher(key);
+    const V* value = findNode(root, hash, key, 0);
+    if (value) {
+        return *value;
+    }
+    return std::nullopt;
+}
+
+// -----------------------------------------
+// --- Вспомогательные методы для узлов ----
+// -----------------------------------------
+// Поиск элемента по ключу и значению
+template<typename K, typename V>
+const V* PersistentMap<K, V>::findNode(std::shared_ptr<Node> node,
+    size_t hash, const K& key,
+    size_t level) const {
+    if (!node) {
+        return nullptr;
+    }
+
+    // Очевидные случаи
+    // Если лист, то ищем в нем значения
+    if (!node->entries.empty()) {
+        return node->findValue(key);
+    }
+
+    // Если узел пустой
+    if (node->children.empty()) {
+        return nullptr;
+    }
+
+    // Вычисляем фрагмент хэша для текущего уровня
+    size_t hash_fragment = (hash >> (level * BITS_PER_LEVEL)) & BIT_MASK;
+
+    // Если не сщуетсвует потомка с вычисленным фрагментом
+    if (!(node->bitmap & (1 << hash_fragment))) {
+        return nullptr;
+    }
+
+    // Получаем индекс потомка
+    size_t index = getIndex(node->bitmap, hash_fragment);
+
+    // Проверяем границы
+    if (index >= node->children.size()) {
+        return nullptr;
+    }
+
+    // Рекурсивно ищем в найденном потомке
+    return findNode(node->children[index], hash, key, level + 1);
+}
+
+// Утсановка нового значения с возвращением новго массива
+template<typename K, typename V>
+template<typename KK, typename... Args>
+PersistentMap<K, V> PersistentMap<K, V>::assoc(bool inPlace, KK&& key, Args&&... args) const {
+    // Вычиление нового хэша и создание новго дерев с добавлением узла
+    size_t hash = hasher(key);
+    bool added = false;
+    auto new_root = insertNode(root, hash, std::forward<KK>(key), 0,
+        added, inPlace, std::forward<Args>(args)...);
+
+    // Размер увеличаваем, если ключа не было
+    return PersistentMap<K, V>(std::move(new_root), added ? map_size + 1 : map_size);
+}
+
+// -----------------------------------------
+// -------- Добавление нового узла ---------
+// -----------------------------------------
+template<typename K, typename V>
+template<typename KK, typename... Args>
+std::shared_ptr<typename PersistentMap<K, V>::Node>
+PersistentMap<K, V>::insertNode(const std::shared_ptr<Node>& node,
+    size_t hash, KK&& key, size_t level,
+    bool& added, bool inPlace, Args&&... args) const {
+    // Узел, которым владеет только эта версия, изменяем без копирования
+    std::shared_ptr<Node> new_node;
+    if (!node) {
+        new_node = std::make_shared<Node>();
+    }
+    else if (inPlace && node.use_count() == 1) {
+        new_node = node;
+    }
+    else {
+        new_node = node->clone();
+    }
+
+    // Хеш копии меняется на разницу хешей старой и новой записи
+    size_t hash_sum = 0;
+    bool hashed = hashing() && new_node->merkle.get(hash_sum);
+    if (!hashed) {
+        new_node->merkle.reset();
+    }
+    auto finish = [&](const std::shared_ptr<Node>& result) {
+        if (hashed) {
+            result->merkle.set(hash_sum);
+        }
+        else if (hashing()) {
+            nodeHash(result.get());
+        }
+        return result;
+    };
+
+    // Узел является листом или не имеет записи
+    if (!new_node->entries.empty() || new_node->children.empty()) {
+        size_t at = new_node->find(key);
+        if (hashed && at < new_node->entries.size()) {
+            hash_sum -= entryTerm(new_node->entries[at].first, new_node->entries[at].second);
+        }
+        // Используем метод updateOrAdd
+        bool was_updated = new_node->updateOrAdd(std::forward<KK>(key), std::forward<Args>(args)...);
+        if (hashed) {
+            hash_sum += entryTerm(new_node->entries[at].first, new_node->entries[at].second);
+        }
+
+        // Если ключ уже существовал, просто возвращаем обновленный узел
+        if (was_updated) {
+            return finish(new_node);
+        }
+        added = true;
+
+        // Проверяем, не нужно ли разделить узел
+        if (new_node->entries.size() > BRANCHING_FACTOR / 2 &&
+            level < (sizeof(size_t) * 8 / BITS_PER_LEVEL)) {
+
+            // Разделяем узел
+            auto split_node = std::make_shared<Node>();
+
+            // Записи переносим: new_node принадлежит только этой версии
+            auto entries_moved = std::move(new_node->entries);
+            new_node->entries.clear();
+
+            for (auto& entry : entries_moved) {
+                size_t entry_hash = hasher(entry.first);
+                size_t fragment = (entry_hash >> (level * BITS_PER_LEVEL)) & BIT_MASK;
+                // Создание нового слота для хранения нового значения
+                if (!(split_node->bitmap & (1 << fragment))) {
+                    split_node->bitmap |= (1 << fragment);
+                    size_t index = getIndex(split_node->bitmap, fragment);
+
+                    auto leaf = std::make_shared<Node>();
+                    leaf->entries.push_back(std::move(entry));
+
+                    split_node->children.insert(
+                        split_node->children.begin() + index,
+                        leaf
+                    );
+                }
+                else {
+                    // Рекурсивно вставляем новое значение в соответствующий узел потомка
+                    size_t index = getIndex(split_node->bitmap, fragment);
+                    bool split_added = false;
+                    split_node->children[index] = insertNode(
+                        split_node->children[index],
+                        entry_hash, std::move(entry.first), level + 1,
+                        split_added, true, std::move(entry.second)
+                    );
+                }
+            }
+            // Сумма по записям не зависит от того, как они разложены
+            return finish(split_node);
+        }
+        return finish(new_node);
+    }
+
+    // Если рассматриваем внутренний узел
+    size_t hash_fragment = (hash >> (level * BITS_PER_LEVEL)) & BIT_MASK;
+
+    if (!(new_node->bitmap & (1 << hash_fragment))) {
+        // Создаем новый лист
+        new_node->bitmap |= (1 << hash_fragment);
+        size_t index = getIndex(new_node->bitmap, hash_fragment);
+
+        auto leaf = std::make_shared<Node>();
+        leaf->updateOrAdd(std::forward<KK>(key), std::forward<Args>(args)...);
+        added = true;
+        if (hashed) {
+            hash_sum += nodeHash(leaf.get());
+        }
+
+        new_node->children.insert(
+            new_node->children.begin() + index,
+            leaf
+        );
+    }
+    else {
+        // Обновляем существующий узел потомка
+        size_t index = getIndex(new_node->bitmap, hash_fragment);
+
+        // Проверяем границы
+        if (index >= new_node->children.size()) {
+            return finish(new_node);
+        }
+        if (hashed) {
+            hash_sum -= nodeHash(new_node->children[index].get());
+        }
+        // Рекурсивно обновляем существующий узел потомка
+        new_node->children[index] = insertNode(
+            new_node->children[index],
+            hash, std::forward<KK>(key), level + 1,
+            added, inPlace, std::forward<Args>(args)...
+        );
+        if (hashed) {
+            hash_sum += nodeHash(new_node->children[index].get());
+        }
+    }
+
+    return finish(new_node);
+}
+
+// -----------------------------------------
+// -------- Изменение через функцию --------
+// -----------------------------------------
+template<typename K, typename V>
+template<typename F>
+std::shared_ptr<typename PersistentMap<K, V>::Node>
+PersistentMap<K, V>::modifyNode(const std::shared_ptr<Node>& node,
+    size_t hash, const K& key, size_t level, F& fn, bool& added) const {
+    // Лист или пустой узел: fn видит текущее значение
+    if (!node || !node->entries.empty() || node->children.empty()) {
+        size_t at = node ? node->find(key) : 0;
+        bool found = node && at < node->entries.size();
+        std::optional<V> value = fn(found ? &node->entries[at].second : nullptr);
+        if (!value) {
+            return node;
+        }
+        if (!found) {
+            return insertNode(node, hash, key, level, added, false, std::move(*value));
+        }
+        auto new_node = node->clone();
+        size_t hash_sum = 0;
+        bool hashed = hashing() && new_node->merkle.get(hash_sum);
+        if (hashed) {
+            hash_sum -= entryTerm(new_node->entries[at].first, new_node->entries[at].second);
+        }
+        else {
+            new_node->merkle.reset();
+        }
+        new_node->entries[at].second = std::move(*value);
+
+        if (hashed) {
+            new_node->merkle.set(hash_sum + entryTerm(new_node->entries[at].first, new_node->entries[at].second));
+        }
+        else if (hashing()) {
+            nodeHash(new_node.get());
+        }
+        return new_node;
+    }
+
+    // Внутренний узел без потомка на пути: ключа нет
+    size_t hash_fragment = (hash >> (level * BITS_PER_LEVEL)) & BIT_MASK;
+    size_t index = getIndex(node->bitmap, hash_fragment);
+    if (!(node->bitmap & (1 << hash_fragment)) || index >= node->children.size()) {
+        std::optional<V> value = fn(nullptr);
+        if (!value) {
+            return node;
+        }
+        return insertNode(node, hash, key, level, added, false, std::move(*value));
+    }
+
+    // Потомок не изменился - узел остается общим с исходной версией
+    const auto& child = node->children[index];
+    auto updated = modifyNode(child, hash, key, level + 1, fn, added);
+    if (updated == child) {
+        return node;
+    }
+    auto new_node = node->clone();
+    size_t hash_sum = 0;
+    bool hashed = hashing() && new_node->merkle.get(hash_sum);
+    if (hashed) {
+        hash_sum -= nodeHash(child.get());
+    }
+    else {
+        new_node->merkle.reset();
+    }
+    new_node->children[index] = std::move(updated);
+
+    if (hashed) {
+        new_node->merkle.set(hash_sum + nodeHash(new_node->children[index].get()));
+    }
+    else if (hashing()) {
+        nodeHash(new_node.get());
+    }
+    return new_node;
+}
+
+template<typename K, typename V>
+template<typename F>
+PersistentMap<K, V> PersistentMap<K, V>::update(const K& key, F fn) const {
+    bool added = false;
+    auto new_root = modifyNode(root, hasher(key), key, 0, fn, added);
+    if (new_root == root) {
+        return *this;
+    }
+    return PersistentMap<K, V>(std::move(new_root), added ? map_size + 1 : map_size);
+}
+
+// -----------------------------------------
+// ------ Удаление существующего узла ------
+// -----------------------------------------
+// Копируется только путь до листа с ключом
+template<typename K, typename V>
+PersistentMap<K, V> PersistentMap<K, V>::without(const K& key, bool inPlace) const {
+    if (!contains(key)) {
+        return *this;
+    }
+    BatchItem item{ hasher(key), &key, nullptr };
+    BatchItem scratch;
+    return updateMany(&item, &item + 1, &scratch, inPlace);
+}
+
+// -----------------------------------------
+// ---------- Пакетные изменения -----------
+// -----------------------------------------
+template<typename K, typename V>
+template<typename Range>
+std::vector<typename PersistentMap<K, V>::BatchItem>
+PersistentMap<K, V>::setItems(const Range& items) const {
+    std::vector<BatchItem> batch;
+    for (const auto& item : items) {
+        batch.push_back({ 0, &item.first, &item.second });
+    }
+    hashItems(batch);
+    return batch;
+}
+
+template<typename K, typename V>
+template<typename Range>
+std::vector<typename PersistentMap<K, V>::BatchItem>
+PersistentMap<K, V>::eraseItems(const Range& keys) const {
+    std::vector<BatchItem> batch;
+    for (const auto& key : keys) {
+        batch.push_back({ 0, &key, nullptr });
+    }
+    hashItems(batch);
+    return batch;
+}
+
+// Большой пакет хешируется частями на всех потоках пула; небольшой -
+// на вызывающем потоке, не создавая пул
+template<typename K, typename V>
+void PersistentMap<K, V>::hashItems(std::vector<BatchItem>& batch) const {
+    if (batch.size() < PARALLEL_BATCH) {
+        for (auto& item : batch) {
+            item.hash = hasher(*item.key);
+        }
+        return;
+    }
+    PersistentThreadPool::instance().forEach(batch.size(), PARALLEL_BATCH, [&](size_t i) {
+        batch[i].hash = hasher(*batch[i].key);
+    });
+}
+
+template<typename K, typename V>
+PersistentMap<K, V> PersistentMap<K, V>::updateMany(std::vector<BatchItem>& items, bool inPlace) const {
+    if (items.empty()) {
+        return *this;
+    }
+    std::vector<BatchItem> scratch(items.size());
+    return updateMany(items.data(), items.data() + items.size(), scratch.data(), inPlace);
+}
+
+template<typename K, typename V>
+PersistentMap<K, V> PersistentMap<K, V>::updateMany(BatchItem* first, BatchItem* last,
+    BatchItem* scratch, bool inPlace) const {
+    std::ptrdiff_t delta = 0;
+    auto new_root = updateNode(root, 0, first, last, scratch, inPlace, delta);
+    // Хеши считаются один раз для всех скопированных узлов
+    if (hashing()) {
+        nodeHash(new_root.get());
+    }
+    return PersistentMap<K, V>(std::move(new_root), map_size + delta);
+}
+
+template<typename K, typename V>
+std::shared_ptr<typename PersistentMap<K, V>::Node>
+PersistentMap<K, V>::updateNode(const std::shared_ptr<Node>& node, size_t level,
+    BatchItem* first, BatchItem* last, BatchItem* scratch,
+    bool inPlace, std::ptrdiff_t& delta) const {
+    // Внутренний узел: пакет раскладывается по потомкам
+    if (node && node->entries.empty() && !node->children.empty()) {
+        return updateBranch(inPlace && node.use_count() == 1 ? node : node->clone(),
+            level, first, last, scratch, inPlace, delta);
+    }
+
+    size_t existing = node ? node->entries.size() : 0;
+    size_t added = 0;
+    bool touched = false;
+    for (BatchItem* item = first; item != last; ++item) {
+        bool found = node && node->find(*item->key) < existing;
+        touched = touched || found || item->value;
+        if (item->value && !found) {
+            ++added;
+        }
+    }
+    if (!touched) {
+        return node ? node : std::make_shared<Node>();
+    }
+
+    // Лист переполнится: его записи и пакет раскладываются по новым
+    // потомкам. Повторы ключей в пакете могут оставить записей на
+    // один лист - тогда узел снова схлопнется в лист.
+    if (existing + added > BRANCHING_FACTOR / 2 && level < MAX_LEVEL) {
+        if (existing == 0) {
+            return updateBranch(std::make_shared<Node>(), level, first, last, scratch, inPlace, delta);
+        }
+        std::vector<BatchItem> merged;
+        merged.reserve(existing + (last - first));
+        for (size_t i = 0; i < existing; ++i) {
+            const auto& entry = node->entries[i];
+            merged.push_back({ hasher(entry.first), &entry.first, &entry.second });
+        }
+        merged.insert(merged.end(), first, last);
+        std::vector<BatchItem> buffer(merged.size());
+        delta -= static_cast<std::ptrdiff_t>(existing);
+        return updateBranch(std::make_shared<Node>(), level, merged.data(),
+            merged.data() + merged.size(), buffer.data(), inPlace, delta);
+    }
+
+    std::shared_ptr<Node> leaf;
+    if (!node) {
+        leaf = std::make_shared<Node>();
+    }
+    else if (inPlace && node.use_count() == 1) {
+        leaf = node;
+    }
+    else {
+        leaf = node->clone();
+    }
+    leaf->merkle.reset();
+    for (BatchItem* item = first; item != last; ++item) {
+        size_t at = leaf->find(*item->key);
+        if (item->value) {
+            if (at < leaf->entries.size()) {
+                leaf->entries[at].second = *item->value;
+            }
+            else {
+                leaf->entries.emplace_back(*item->key, *item->value);
+                ++delta;
+            }
+        }
+        else if (at < leaf->entries.size()) {
+            leaf->entries.erase(leaf->entries.begin() + at);
+            --delta;
+        }
+    }
+    return leaf;
+}
+
+template<typename K, typename V>
+std::shared_ptr<typename PersistentMap<K, V>::Node>
+PersistentMap<K, V>::updateBranch(std::shared_ptr<Node> node, size_t level,
+    BatchItem* first, BatchItem* last, BatchItem* scratch,
+    bool inPlace, std::ptrdiff_t& delta) const {
+    node->merkle.reset();
+
+    // Устойчивая раскладка подсчетом: элементы с одним ключом
+    // сохраняют порядок, и последний из них побеждает
+    auto fragmentOf = [level](const BatchItem& item) {
+        return (item.hash >> (level * BITS_PER_LEVEL)) & BIT_MASK;
+    };
+    size_t bounds[BRANCHING_FACTOR + 1] = {};
+    for (BatchItem* item = first; item != last; ++item) {
+        ++bounds[fragmentOf(*item) + 1];
+    }
+    for (size_t f = 0; f < BRANCHING_FACTOR; ++f) {
+        bounds[f + 1] += bounds[f];
+    }
+    size_t next[BRANCHING_FACTOR];
+    std::copy(bounds, bounds + BRANCHING_FACTOR, next);
+    for (BatchItem* item = first; item != last; ++item) {
+        scratch[next[fragmentOf(*item)]++] = *item;
+    }
+    std::copy(scratch, scratch + (last - first), first);
+
+    // Потомки собираются независимо, большие части пакета - параллельно
+    // (каждая задача пишет только свои built[g] и deltas[g]); хеши
+    // поддеревьев считаются там же
+    size_t fragments[BRANCHING_FACTOR];
+    size_t groups = 0;
+    for (size_t fragment = 0; fragment < BRANCHING_FACTOR; ++fragment) {
+        if (bounds[fragment] != bounds[fragment + 1]) {
+            fragments[groups++] = fragment;
+        }
+    }
+    std::shared_ptr<Node> built[BRANCHING_FACTOR];
+    std::ptrdiff_t deltas[BRANCHING_FACTOR] = {};
+    const std::shared_ptr<Node> missing;
+    auto rebuild = [&](size_t g) {
+        size_t fragment = fragments[g];
+        bool present = (node->bitmap & (1u << fragment)) != 0;
+        const auto& child = present ? node->children[getIndex(node->bitmap, fragment)] : missing;
+        built[g] = updateNode(child, level + 1, first + bounds[fragment], first + bounds[fragment + 1],
+            scratch + bounds[fragment], inPlace, deltas[g]);
+        if (hashing()) {
+            nodeHash(built[g].get());
+        }
+    };
+    if (groups > 1 && static_cast<size_t>(last - first) >= PARALLEL_BATCH) {
+        PersistentThreadPool::instance().parallelFor(groups, rebuild);
+    }
+    else {
+        for (size_t g = 0; g < groups; ++g) {
+            rebuild(g);
+        }
+    }
+
+    for (size_t g = 0; g < groups; ++g) {
+        delta += deltas[g];
+        uint32_t bit = 1u << fragments[g];
+        size_t index = getIndex(node->bitmap, fragments[g]);
+        bool present = (node->bitmap & bit) != 0;
+        bool empty = built[g]->entries.empty() && built[g]->children.empty();
+        if (present && empty) {
+            node->children.erase(node->children.begin() + index);
+            node->bitmap &= ~bit;
+        }
+        else if (present) {
+            node->children[index] = std::move(built[g]);
+        }
+        else if (!empty) {
+            node->children.insert(node->children.begin() + index, std::move(built[g]));
+            node->bitmap |= bit;
+        }
+    }
+
+    // Поддерево, записи которого помещаются в один лист, схлопывается
+    // в лист: внутренние узлы всегда содержат больше BRANCHING_FACTOR / 2
+    // записей, как после вставок по одной
+    size_t total = 0;
+    for (const auto& child : node->children) {
+        if (!child->children.empty()) {
+            return node;
+        }
+        total += child->entries.size();
+    }
+    if (total > BRANCHING_FACTOR / 2) {
+        return node;
+    }
+    auto leaf = std::make_shared<Node>();
+    for (const auto& child : node->children) {
+        leaf->entries.insert(leaf->entries.end(), child->entries.begin(), child->entries.end());
+    }
+    return leaf;
+}
+
+// -----------------------------------------
+// ------------ Для работы цикла -----------
+// -----------------------------------------
+
+// -----------------------------------------
+// ---------- Реализация итератора ---------
+// -----------------------------------------
+// Конструктор итератора
+template<typename K, typename V>
+PersistentMap<K, V>::Iterator::Iterator(std::shared_ptr<Node> root) : owner(std::move(root)) {
+    if (owner && (!owner->children.empty() || !owner->entries.empty())) {
+        stack.push_back({ owner.get(), 0, 0 });
+        advance();
+    }
+    else {
+        has_value = false;
+    }
+}
+
+// Метод для обхода итератором
+template<typename K, typename V>
+void PersistentMap<K, V>::Iterator::advance() {
+    while (!stack.empty()) {
+        auto& frame = stack.back();
+
+        // Обработка листа
+        if (!frame.node->entries.empty()) {
+            // Если существуют значения в листе, то итерируем
+            if (frame.entry_index < frame.node->entries.size()) {
+                current_value = &frame.node->entries[frame.entry_index++];
+                has_value = true;
+                return;
+            }
+            stack.pop_back();
+        }
+        // Внутренний узел
+        else {
+            if (frame.child_index < frame.node->children.size()) {
+                const Node* child = frame.node->children[frame.child_index++].get();
+                if (child) {
+                    stack.push_back({ child, 0, 0 });
+                }
+            }
+            else {
+                // Иначе удаляем лист из стека
+                stack.pop_back();
+            }
+        }
+    }
+    has_value = false;
+}
+
+// -----------------------------------------
+// ---------- Перекрытие операторов --------
+// -----------------------------------------
+// Следующий элемент
+template<typename K, typename V>
+typename PersistentMap<K, V>::Iterator&
+PersistentMap<K, V>::Iterator::operator++() {
+    advance();
+    return *this;
+}
+// Оператор неравенства
+template<typename K, typename V>
+bool PersistentMap<K, V>::Iterator::operator!=(const Iterator& other) const {
+    if (has_value != other.has_value) return true;
+    if (!has_value) return false;  // оба end()
+    return current_value != other.current_value;
+}
+
+// Итератор на первый элемент
+template<typename K, typename V>
+typename PersistentMap<K, V>::Iterator PersistentMap<K, V>::begin() const {
+    return Iterator(root);
+}
+
+// Итератор за последний эелемент
+template<typename K, typename V>
+typename PersistentMap<K, V>::Iterator PersistentMap<K, V>::end() const {
+    return Iterator(nullptr);
+}
+
+// -----------------------------------------
+// ------- Сравнение и хеширование ---------
+// -----------------------------------------
+template<typename K, typename V>
+void PersistentMap<K, V>::collectEntries(const Node* node, std::vector<const std::pair<K, V>*>& out) {
+    if (!node) {
+        return;
+    }
+    for (const auto& entry : node->entries) {
+        out.push_back(&entry);
+    }
+    for (const auto& child : node->children) {
+        collectEntries(child.get(), out);
+    }
+}
+
+// Форма HAMT зависит от истории вставок (лист делится на 17-й записи,
+// порядок записей в листе - порядок вставки), поэтому при расхождении
+// формы поддеревья сравниваются как множества записей
+template<typename K, typename V>
+bool PersistentMap<K, V>::subtreeEqual(const std::shared_ptr<Node>& a,
+    const std::shared_ptr<Node>& b, size_t level) const {
+    if (a == b) {
+        return true;
+    }
+    // Поддеревья на одной позиции содержат ключи с одним префиксом хеша:
+    // известные различные хеши - различное содержимое
+    size_t hashA;
+    size_t hashB;
+    if (a && b && a->merkle.get(hashA) && b->merkle.get(hashB) && hashA != hashB) {
+        return false;
+    }
+    if (a && b && a->entries.empty() && b->entries.empty() &&
+        a->bitmap == b->bitmap && a->children.size() == b->children.size()) {
+        for (size_t i = 0; i < a->children.size(); ++i) {
+            if (!subtreeEqual(a->children[i], b->children[i], level + 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<const std::pair<K, V>*> left;
+    std::vector<const std::pair<K, V>*> right;
+    collectEntries(a.get(), left);
+    collectEntries(b.get(), right);
+    if (left.size() != right.size()) {
+        return false;
+    }
+    for (const auto* entry : left) {
+        const V* found = findNode(b, hasher(entry->first), entry->first, level);
+        if (!found || !(*found == entry->second)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename K, typename V>
+bool PersistentMap<K, V>::operator==(const PersistentMap& other) const {
+    if (root == other.root) {
+        return true;
+    }
+    if (map_size != other.map_size) {
+        return false;
+    }
+    return subtreeEqual(root, other.root, 0);
+}
+
+// -----------------------------------------
+// ------------- Хеши Меркла ---------------
+// -----------------------------------------
+template<typename K, typename V>
+bool PersistentMap<K, V>::hashing() {
+    if constexpr (MERKLE) {
+        return PersistentHashing::enabled();
+    }
+    else {
+        return false;
+    }
+}
+
+template<typename K, typename V>
+size_t PersistentMap<K, V>::entryTerm(const K& key, const V& value) {
+    if constexpr (MERKLE) {
+        return persistent_hash_detail::combine(std::hash<K>()(key), std::hash<V>()(value));
+    }
+    else {
+        return 0;
+    }
+}
+
+// Хеш поддерева; известные хеши потомков не пересчитываются
+template<typename K, typename V>
+size_t PersistentMap<K, V>::nodeHash(const Node* node) {
+    size_t hash = 0;
+    if (!node || node->merkle.get(hash)) {
+        return hash;
+    }
+    for (const auto& entry : node->entries) {
+        hash += entryTerm(entry.first, entry.second);
+    }
+    for (const auto& child : node->children) {
+        hash += nodeHash(child.get());
+    }
+    node->merkle.set(hash);
+    return hash;
+}
+
+template<typename K, typename V>
+size_t PersistentMap<K, V>::hash() const {
+    static_assert(MERKLE, "PersistentMap::hash requires std::hash for the key and value types");
+    return persistent_hash_detail::combine(map_size, nodeHash(root.get()));
+}
+
 #endif 
\ No newline at end of file
@@ -0,0 +1,290 @@
+#ifndef PERSISTENT_MAPPED_HPP
+#define PERSISTENT_MAPPED_HPP
+
+#include "persistent_vector.hpp"
+#include "persistent_map.hpp"
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <optional>
+#include <functional>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// -----------------------------------------
+// ------ Снимки, отображаемые в память ----
+// -----------------------------------------
+//
+// Формат для сервисов, которые только читают данные:
+// - Файл отображается в память (mmap), get/at/contains
+//   выполняются прямо по нему, без десериализации;
+// - Узлы HAMT и дерева вектора хранятся с фиксированной
+//   разметкой, ссылки на потомков - смещения от начала файла;
+// - Строки лежат в файле и возвращаются как std::string_view;
+// - Страницы файла разделяются всеми процессами, открывшими его.
+//
+// Разметка (порядок байт платформы, выравнивание 8 байт):
+//   MappedHeader | узлы (потомки раньше родителей) | MappedTrailer
+//   Узел вектора: u64 n | n смещений потомков или n значений
+//   Узел массива: u32 bitmap | u32 потомков | u32 записей | u32 0 |
+//                 смещения потомков | записи (ключ, значение)
+//
+//   MappedSnapshotWriter::write("ref.map", bigMap);
+//   MappedMapView<std::string, int> view("ref.map");
+//   int id = view.at("key");
+
+// -----------------------------------------
+// ----------- Служебные записи ------------
+// -----------------------------------------
+struct MappedHeader {
+    char magic[8];      // "PDSMMAP"
+    uint32_t version;   // Версия формата
+    uint32_t kind;      // 1 - вектор, 2 - ассоциативный массив
+    uint32_t keyTag;    // Код типа ключа (0 у вектора)
+    uint32_t valueTag;  // Код типа значения
+    uint64_t size;      // Количество элементов
+    uint64_t shift;     // Смещение корня вектора
+    uint64_t hashProbe; // std::hash<K>()(K()) - проверка совместимости хеша
+};
+
+struct MappedTrailer {
+    uint64_t root;      // Смещение корневого узла
+    char magic[8];      // "PDSMEND"
+};
+
+namespace persistent_mapped_detail {
+    constexpr char HEADER_MAGIC[8] = { 'P', 'D', 'S', 'M', 'M', 'A', 'P', 0 };
+    constexpr char TRAILER_MAGIC[8] = { 'P', 'D', 'S', 'M', 'E', 'N', 'D', 0 };
+    constexpr uint32_t FORMAT_VERSION = 1;
+    constexpr uint32_t VECTOR_KIND = 1;
+    constexpr uint32_t MAP_KIND = 2;
+    constexpr size_t ALIGNMENT = 8;
+
+    // Размер заголовка узла массива
+    constexpr size_t MAP_NODE_HEADER = 16;
+}
+
+static_assert(sizeof(MappedHeader) == 48, "Unexpected MappedHeader layout");
+static_assert(sizeof(MappedTrailer) == 16, "Unexpected MappedTrailer layout");
+
+// -----------------------------------------
+// ---------- Отображаемый файл ------------
+// -----------------------------------------
+// Только чтение; отображение снимается в деструкторе
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+        return base;
+    }
+    size_t size() const {
+        return length;
+    }
+
+    // Диапазон байт с проверкой границ
+    const char* range(uint64_t offset, uint64_t bytes) const {
+        if (offset > length || bytes > length - offset) {
+            throw std::runtime_error("Corrupted mapped snapshot");
+        }
+        return base + offset;
+    }
+
+private:
+    const char* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#else
+    int descriptor = -1;
+#endif
+};
+
+// -----------------------------------------
+// ---------- Буфер записи снимка ----------
+// -----------------------------------------
+class MappedOutput {
+public:
+    explicit MappedOutput(std::ostream& out) : stream(out) {}
+
+    uint64_t position() const {
+        return pos;
+    }
+    void write(const void* bytes, size_t count);
+    // Дополнение нулями до границы выравнивания
+    void align();
+    // Данные вне узла (строки); возвращает их смещение
+    uint64_t blob(const void* bytes, size_t count) {
+        align();
+        uint64_t offset = pos;
+        write(bytes, count);
+        return offset;
+    }
+
+private:
+    std::ostream& stream;
+    uint64_t pos = 0;
+};
+
+// -----------------------------------------
+// ------ Кодеки значений фиксированной ----
+// ------------------ длины ----------------
+// -----------------------------------------
+// stage пишет данные вне узла (если нужны) и добавляет ячейку
+// фиксированного размера SLOT; load читает значение из ячейки.
+template<typename T, typename Enable = void>
+struct MappedCodec;
+
+template<typename T>
+struct MappedCodec<T, std::enable_if_t<std::is_arithmetic_v<T>>> {
+    using View = T;
+    static constexpr uint32_t TAG =
+        ((std::is_same_v<T, bool> ? 4u : std::is_floating_point_v<T> ? 3u : std::is_signed_v<T> ? 2u : 1u) << 8) |
+        static_cast<uint32_t>(sizeof(T));
+    static constexpr size_t SLOT = 8;
+    static_assert(sizeof(T) <= SLOT, "Arithmetic type is too wide");
+
+    static void stage(MappedOutput&, const T& value, std::string& slots) {
+        char raw[SLOT] = {};
+        std::memcpy(raw, &value, sizeof(T));
+        slots.append(raw, SLOT);
+    }
+    static View load(const MappedFile&, const char* slot) {
+        T value;
+        std::memcpy(&value, slot, sizeof(T));
+        return value;
+    }
+};
+
+template<>
+struct MappedCodec<std::string> {
+    using View = std::string_view;
+    static constexpr uint32_t TAG = 0x500;
+    static constexpr size_t SLOT = 16;
+
+    static void stage(MappedOutput& out, const std::string& value, std::string& slots) {
+        uint64_t location[2] = { out.blob(value.data(), value.size()), value.size() };
+        slots.append(reinterpret_cast<const char*>(location), SLOT);
+    }
+    static View load(const MappedFile& file, const char* slot) {
+        uint64_t location[2];
+        std::memcpy(location, slot, SLOT);
+        return View(file.range(location[0], location[1]), static_cast<size_t>(location[1]));
+    }
+};
+
+// -----------------------------------------
+// ------------- Запись снимка -------------
+// -----------------------------------------
+class MappedSnapshotWriter {
+public:
+    template<typename T>
+    static void write(std::ostream& out, const PersistentVector<T>& vector);
+    template<typename K, typename V>
+    static void write(std::ostream& out, const PersistentMap<K, V>& map);
+    // Запись в файл (существующий файл перезаписывается)
+    template<typename S>
+    static void write(const std::string& path, const S& structure);
+
+private:
+    static void begin(MappedOutput& out, uint32_t kind, uint32_t keyTag, uint32_t valueTag,
+        uint64_t size, uint64_t shift, uint64_t hashProbe);
+    static void finish(MappedOutput& out, uint64_t root);
+
+    template<typename T>
+    static uint64_t vectorNode(MappedOutput& out,
+        const std::shared_ptr<typename PersistentVector<T>::Node>& node, size_t shift);
+    template<typename K, typename V>
+    static uint64_t mapNode(MappedOutput& out,
+        const std::shared_ptr<typename PersistentMap<K, V>::Node>& node);
+};
+
+// -----------------------------------------
+// --------- Общая часть представлений -----
+// -----------------------------------------
+class MappedViewBase {
+public:
+    size_t size() const {
+        return static_cast<size_t>(header.size);
+    }
+    bool empty() const {
+        return header.size == 0;
+    }
+    const std::shared_ptr<const MappedFile>& mappedFile() const {
+        return file;
+    }
+
+protected:
+    // Проверка заголовка, типов и завершающей записи
+    MappedViewBase(std::shared_ptr<const MappedFile> mapped, uint32_t kind,
+        uint32_t keyTag, uint32_t valueTag, uint64_t hashProbe);
+
+    std::shared_ptr<const MappedFile> file;
+    MappedHeader header;
+    uint64_t root;
+
+    uint64_t readU64(uint64_t offset) const {
+        uint64_t value;
+        std::memcpy(&value, file->range(offset, sizeof(value)), sizeof(value));
+        return value;
+    }
+    uint32_t readU32(uint64_t offset) const {
+        uint32_t value;
+        std::memcpy(&value, file->range(offset, sizeof(value)), sizeof(value));
+        return value;
+    }
+};
+
+// -----------------------------------------
+// ------ Вектор только для чтения ---------
+// -----------------------------------------
+template<typename T>
+class MappedVectorView : public MappedViewBase {
+public:
+    using Value = typename MappedCodec<T>::View;
+
+    explicit MappedVectorView(const std::string& path);
+    explicit MappedVectorView(std::shared_ptr<const MappedFile> mapped);
+
+    Value get(size_t index) const;
+    Value at(size_t index) const {
+        return get(index);
+    }
+    Value operator[](size_t index) const {
+        return get(index);
+    }
+};
+
+// -----------------------------------------
+// - Ассоциативный массив только для чтения -
+// -----------------------------------------
+template<typename K, typename V>
+class MappedMapView : public MappedViewBase {
+public:
+    using Key = typename MappedCodec<K>::View;
+    using Value = typename MappedCodec<V>::View;
+
+    explicit MappedMapView(const std::string& path);
+    explicit MappedMapView(std::shared_ptr<const MappedFile> mapped);
+
+    bool contains(const Key& key) const;
+    Value at(const Key& key) const;
+    std::optional<Value> get(const Key& key) const;
+
+private:
+    static constexpr size_t ENTRY_SIZE = MappedCodec<K>::SLOT + MappedCodec<V>::SLOT;
+
+    // Смещение ячейки значения (0 - ключ не найден)
+    uint64_t find(const Key& key) const;
+};
+
+#include "persistent_mapped_impl.hpp"
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef PERSISTENT_MAPPED_IMPL_HPP
+#define PERSISTENT_MAPPED_IMPL_HPP
+
+#include "persistent_mapped.hpp"
+#include <fstream>
+
+// -----------------------------------------
+// --- Реализация отображаемых снимков -----
+// -----------------------------------------
+
+// -----------------------------------------
+// ------------- Запись снимка -------------
+// -----------------------------------------
+template<typename T>
+void MappedSnapshotWriter::write(std::ostream& stream, const PersistentVector<T>& vector) {
+    MappedOutput out(stream);
+    begin(out, persistent_mapped_detail::VECTOR_KIND, 0, MappedCodec<T>::TAG,
+        vector.data->size, vector.data->shift, 0);
+    finish(out, vectorNode<T>(out, vector.data->root, vector.data->shift));
+}
+
+template<typename K, typename V>
+void MappedSnapshotWriter::write(std::ostream& stream, const PersistentMap<K, V>& map) {
+    MappedOutput out(stream);
+    begin(out, persistent_mapped_detail::MAP_KIND, MappedCodec<K>::TAG, MappedCodec<V>::TAG,
+        map.map_size, 0, std::hash<K>()(K()));
+    finish(out, mapNode<K, V>(out, map.root));
+}
+
+template<typename S>
+void MappedSnapshotWriter::write(const std::string& path, const S& structure) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    write(file, structure);
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Snapshot write failed");
+    }
+}
+
+// Узел вектора: потомки записываются раньше, узел ссылается на их смещения
+template<typename T>
+uint64_t MappedSnapshotWriter::vectorNode(MappedOutput& out,
+    const std::shared_ptr<typename PersistentVector<T>::Node>& node, size_t shift) {
+    uint64_t count = node ? node->slots : 0;
+    std::string body;
+
+    if (shift > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t child = node->children[i]
+                ? vectorNode<T>(out, node->children[i], shift - PersistentVector<T>::BITS_PER_LEVEL)
+                : 0;
+            body.append(reinterpret_cast<const char*>(&child), sizeof(child));
+        }
+    }
+    else {
+        for (size_t i = 0; i < count; ++i) {
+            if (node->values[i]) {
+                MappedCodec<T>::stage(out, *node->values[i], body);
+            }
+            else {
+                body.append(MappedCodec<T>::SLOT, '\0');
+            }
+        }
+    }
+
+    out.align();
+    uint64_t offset = out.position();
+    out.write(&count, sizeof(count));
+    out.write(body.data(), body.size());
+    return offset;
+}
+
+// Узел HAMT: разметка повторяет Node (bitmap, потомки, записи)
+template<typename K, typename V>
+uint64_t MappedSnapshotWriter::mapNode(MappedOutput& out,
+    const std::shared_ptr<typename PersistentMap<K, V>::Node>& node) {
+    std::string body;
+    for (const auto& child : node->children) {
+        uint64_t offset = child ? mapNode<K, V>(out, child) : 0;
+        body.append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    }
+    for (const auto& entry : node->entries) {
+        MappedCodec<K>::stage(out, entry.first, body);
+        MappedCodec<V>::stage(out, entry.second, body);
+    }
+
+    uint32_t header[4] = {
+        node->bitmap,
+        static_cast<uint32_t>(node->children.size()),
+        static_cast<uint32_t>(node->entries.size()),
+        0
+    };
+    out.align();
+    uint64_t offset = out.position();
+    out.write(header, sizeof(header));
+    out.write(body.data(), body.size());
+    return offset;
+}
+
+// -----------------------------------------
+// ------ Вектор только для чтения ---------
+// -----------------------------------------
+template<typename T>
+MappedVectorView<T>::MappedVectorView(const std::string& path)
+    : MappedVectorView(std::make_shared<const MappedFile>(path)) {
+}
+
+template<typename T>
+MappedVectorView<T>::MappedVectorView(std::shared_ptr<const MappedFile> mapped)
+    : MappedViewBase(std::move(mapped), persistent_mapped_detail::VECTOR_KIND,
+        0, MappedCodec<T>::TAG, 0) {
+}
+
+// Спуск по дереву: 5 бит индекса на уровень, как в PersistentVector
+template<typename T>
+typename MappedVectorView<T>::Value MappedVectorView<T>::get(size_t index) const {
+    if (index >= size()) {
+        throw std::out_of_range("Index out of range");
+    }
+    uint64_t node = root;
+    for (uint64_t shift = header.shift; shift > 0; shift -= 5) {
+        size_t pos = (index >> shift) & 31;
+        if (pos >= readU64(node)) {
+            throw std::runtime_error("Corrupted mapped snapshot");
+        }
+        node = readU64(node + sizeof(uint64_t) * (pos + 1));
+    }
+    size_t pos = index & 31;
+    if (pos >= readU64(node)) {
+        throw std::runtime_error("Corrupted mapped snapshot");
+    }
+    const char* slot = file->range(node + sizeof(uint64_t) + pos * MappedCodec<T>::SLOT, MappedCodec<T>::SLOT);
+    return MappedCodec<T>::load(*file, slot);
+}
+
+// -----------------------------------------
+// - Ассоциативный массив только для чтения -
+// -----------------------------------------
+template<typename K, typename V>
+MappedMapView<K, V>::MappedMapView(const std::string& path)
+    : MappedMapView(std::make_shared<const MappedFile>(path)) {
+}
+
+template<typename K, typename V>
+MappedMapView<K, V>::MappedMapView(std::shared_ptr<const MappedFile> mapped)
+    : MappedViewBase(std::move(mapped), persistent_mapped_detail::MAP_KIND,
+        MappedCodec<K>::TAG, MappedCodec<V>::TAG, std::hash<K>()(K())) {
+}
+
+// Тот же обход, что и в PersistentMap::findNode
+template<typename K, typename V>
+uint64_t MappedMapView<K, V>::find(const Key& key) const {
+    using persistent_mapped_detail::MAP_NODE_HEADER;
+    size_t hash = std::hash<Key>()(key);
+    uint64_t node = root;
+
+    for (size_t level = 0; node != 0; ++level) {
+        uint32_t bitmap = readU32(node);
+        uint32_t childCount = readU32(node + 4);
+        uint32_t entryCount = readU32(node + 8);
+        uint64_t children = node + MAP_NODE_HEADER;
+
+        // Лист: линейный поиск по записям
+        if (entryCount > 0) {
+            uint64_t entry = children + uint64_t(childCount) * sizeof(uint64_t);
+            for (uint32_t i = 0; i < entryCount; ++i, entry += ENTRY_SIZE) {
+                const char* slot = file->range(entry, ENTRY_SIZE);
+                if (MappedCodec<K>::load(*file, slot) == key) {
+                    return entry + MappedCodec<K>::SLOT;
+                }
+            }
+            return 0;
+        }
+        if (childCount == 0 || level * 5 >= sizeof(size_t) * 8) {
+            return 0;
+        }
+
+        size_t fragment = (hash >> (level * 5)) & 31;
+        if (!(bitmap & (1u << fragment))) {
+            return 0;
+        }
+        uint32_t mask = fragment == 0 ? 0 : ((1u << fragment) - 1);
+        size_t index = persistent_map_detail::popcount(bitmap & mask);
+        if (index >= childCount) {
+            return 0;
+        }
+        node = readU64(children + index * sizeof(uint64_t));
+    }
+    return 0;
+}
+
+template<typename K, typename V>
+bool MappedMapView<K, V>::contains(const Key& key) const {
+    return find(key) != 0;
+}
+
+template<typename K, typename V>
+typename MappedMapView<K, V>::Value MappedMapView<K, V>::at(const Key& key) const {
+    uint64_t slot = find(key);
+    if (!slot) {
+        throw std::out_of_range("Key not found");
+    }
+    return MappedCodec<V>::load(*file, file->range(slot, MappedCodec<V>::SLOT));
+}
+
+template<typename K, typename V>
+std::optional<typename MappedMapView<K, V>::Value> MappedMapView<K, V>::get(const Key& key) const {
+    uint64_t slot = find(key);
+    if (!slot) {
+        return std::nullopt;
+    }
+    return MappedCodec<V>::load(*file, file->range(slot, MappedCodec<V>::SLOT));
+}
+
+#endif
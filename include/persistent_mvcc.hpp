@@ -0,0 +1,143 @@
+#ifndef PERSISTENT_MVCC_HPP
+#define PERSISTENT_MVCC_HPP
+
+#include "persistent_map.hpp"
+#include "persistent_atom.hpp"
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <unordered_set>
+
+// -----------------------------------------
+// ------ Транзакции над PersistentMap -----
+// -----------------------------------------
+//
+// Многоверсионное хранилище ключ-значение (MVCC):
+// - begin() фиксирует текущую версию; чтения транзакции видят ее
+//   и собственные записи, не блокируясь и не блокируя других;
+// - Записи копятся в рабочей копии (rvalue-перегрузки изменяют
+//   собственные узлы транзакции на месте);
+// - commit() проверяет множества чтения и записи по последней
+//   версии и устанавливает новую через CAS (Atom::try_swap). Если
+//   после begin() коммитов не было, устанавливается рабочая копия
+//   целиком; иначе записи переносятся на последнюю версию. Записи
+//   в разные ключи не конфликтуют и не сериализуются общей блокировкой.
+//
+// Уровни изоляции:
+// - SNAPSHOT - проверяются только записанные ключи (выигрывает
+//   первый зафиксировавший); возможна аномалия write skew;
+// - SERIALIZABLE - проверяются и прочитанные ключи.
+// Ключ считается измененным, если его значение в последней версии
+// отличается от значения в снимке транзакции (сравнение ==).
+//
+//   TransactionalMap<std::string, int> accounts;
+//   auto tx = accounts.begin();
+//   tx.set("alice", tx.get("alice").value_or(0) - 10);
+//   tx.set("bob", tx.get("bob").value_or(0) + 10);
+//   bool committed = tx.commit(); // false - конфликт, можно повторить
+
+enum class IsolationLevel {
+    SNAPSHOT,
+    SERIALIZABLE
+};
+
+template<typename K, typename V>
+class TransactionalMap {
+public:
+    using Map = PersistentMap<K, V>;
+
+private:
+    // Зафиксированная версия и ее номер
+    struct Version {
+        Map map;
+        uint64_t number;
+    };
+
+public:
+    // -----------------------------------------
+    // -------------- Транзакция ---------------
+    // -----------------------------------------
+    class Transaction {
+    public:
+        Transaction(Transaction&&) noexcept = default;
+        Transaction& operator=(Transaction&&) noexcept = default;
+        Transaction(const Transaction&) = delete;
+        Transaction& operator=(const Transaction&) = delete;
+
+        // Чтения запоминаются для проверки при фиксации
+        std::optional<V> get(const K& key);
+        bool contains(const K& key);
+
+        void set(const K& key, V value);
+        void erase(const K& key);
+
+        // false - конфликт с зафиксированной после begin() транзакцией.
+        // После вызова транзакция завершена.
+        bool commit();
+        void rollback();
+
+        bool active() const {
+            return !finished;
+        }
+        uint64_t version() const { // Номер версии снимка
+            return base.number;
+        }
+
+    private:
+        friend class TransactionalMap;
+
+        TransactionalMap* owner;
+        IsolationLevel isolation;
+        Version base;        // Снимок на момент begin()
+        Map working;         // Снимок с записями транзакции
+        std::unordered_set<K> reads;
+        std::unordered_set<K> writes;
+        bool finished = false;
+        bool conflicted = false; // commit() завершил транзакцию отказом
+
+        Transaction(TransactionalMap* map, IsolationLevel level, Version snapshot)
+            : owner(map), isolation(level), base(std::move(snapshot)), working(base.map) {
+        }
+
+        void ensureActive() const;
+        // Значение ключа не менялось с момента снимка
+        bool unchanged(const Map& latest, const K& key) const;
+    };
+
+    explicit TransactionalMap(Map initial = Map()) : current(Version{ std::move(initial), 0 }) {
+    }
+
+    Transaction begin(IsolationLevel isolation = IsolationLevel::SERIALIZABLE) {
+        return Transaction(this, isolation, current.load());
+    }
+
+    // Последняя зафиксированная версия (без ожидания)
+    Map snapshot() const {
+        return current.load().map;
+    }
+    uint64_t version() const {
+        return current.load().number;
+    }
+
+    // fn(Transaction&) с повтором до успешной фиксации; если fn
+    // откатила транзакцию, повтора нет. fn может зафиксировать
+    // транзакцию сама: при конфликте она тоже повторяется
+    template<typename F>
+    void atomically(F&& fn, IsolationLevel isolation = IsolationLevel::SERIALIZABLE);
+
+    size_t commits() const {
+        return committed.load(std::memory_order_relaxed);
+    }
+    size_t conflicts() const {
+        return rejected.load(std::memory_order_relaxed);
+    }
+
+private:
+    Atom<Version> current;
+    std::atomic<size_t> committed{ 0 };
+    std::atomic<size_t> rejected{ 0 };
+};
+
+#include "persistent_mvcc_impl.hpp"
+
+#endif
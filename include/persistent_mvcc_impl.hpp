@@ -0,0 +1,135 @@
+#ifndef PERSISTENT_MVCC_IMPL_HPP
+#define PERSISTENT_MVCC_IMPL_HPP
+
+#include "persistent_mvcc.hpp"
+#include <stdexcept>
+
+// -----------------------------------------
+// -------- Реализация транзакций ----------
+// -----------------------------------------
+
+template<typename K, typename V>
+void TransactionalMap<K, V>::Transaction::ensureActive() const {
+    if (finished) {
+        throw std::runtime_error("Transaction is already finished");
+    }
+}
+
+template<typename K, typename V>
+std::optional<V> TransactionalMap<K, V>::Transaction::get(const K& key) {
+    ensureActive();
+    reads.insert(key);
+    return working.get(key);
+}
+
+template<typename K, typename V>
+bool TransactionalMap<K, V>::Transaction::contains(const K& key) {
+    ensureActive();
+    reads.insert(key);
+    return working.contains(key);
+}
+
+// Узлы, скопированные транзакцией, принадлежат только ей и
+// изменяются на месте; общие со снимком узлы копируются
+template<typename K, typename V>
+void TransactionalMap<K, V>::Transaction::set(const K& key, V value) {
+    ensureActive();
+    writes.insert(key);
+    working = std::move(working).set(key, std::move(value));
+}
+
+template<typename K, typename V>
+void TransactionalMap<K, V>::Transaction::erase(const K& key) {
+    ensureActive();
+    writes.insert(key);
+    working = working.erase(key);
+}
+
+template<typename K, typename V>
+bool TransactionalMap<K, V>::Transaction::unchanged(const Map& latest, const K& key) const {
+    return latest.get(key) == base.map.get(key);
+}
+
+// -----------------------------------------
+// --------------- Фиксация ----------------
+// -----------------------------------------
+// Транзакция без записей видит согласованный снимок и фиксируется
+// сразу. Функция для try_swap может вызываться повторно (другой
+// писатель успел раньше), поэтому она не меняет состояние транзакции.
+template<typename K, typename V>
+bool TransactionalMap<K, V>::Transaction::commit() {
+    ensureActive();
+    finished = true;
+    if (writes.empty()) {
+        owner->committed.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    auto installed = owner->current.try_swap([this](const Version& latest) -> std::optional<Version> {
+        // Номера версий растут монотонно: тот же номер - тот же снимок
+        if (latest.number == base.number) {
+            return Version{ working, latest.number + 1 };
+        }
+
+        for (const K& key : writes) {
+            if (!unchanged(latest.map, key)) {
+                return std::nullopt;
+            }
+        }
+        if (isolation == IsolationLevel::SERIALIZABLE) {
+            for (const K& key : reads) {
+                if (!writes.count(key) && !unchanged(latest.map, key)) {
+                    return std::nullopt;
+                }
+            }
+        }
+
+        // Перенос записей на последнюю версию
+        Map merged = latest.map;
+        for (const K& key : writes) {
+            std::optional<V> value = working.get(key);
+            if (value) {
+                merged = std::move(merged).set(key, std::move(*value));
+            }
+            else {
+                merged = merged.erase(key);
+            }
+        }
+        return Version{ std::move(merged), latest.number + 1 };
+    });
+
+    if (!installed) {
+        conflicted = true;
+        owner->rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    owner->committed.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+template<typename K, typename V>
+void TransactionalMap<K, V>::Transaction::rollback() {
+    ensureActive();
+    finished = true;
+    working = base.map;
+    reads.clear();
+    writes.clear();
+}
+
+template<typename K, typename V>
+template<typename F>
+void TransactionalMap<K, V>::atomically(F&& fn, IsolationLevel isolation) {
+    while (true) {
+        Transaction transaction = begin(isolation);
+        fn(transaction);
+        if (transaction.active()) {
+            transaction.commit();
+        }
+        // Повтор только после отказа при фиксации, не после отката
+        if (!transaction.conflicted) {
+            return;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef PERSISTENT_OPLOG_HPP
+#define PERSISTENT_OPLOG_HPP
+
+#include "persistent_snapshot.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+// -----------------------------------------
+// ----------- Журнал операций -------------
+// -----------------------------------------
+//
+// Журнал упреждающей записи (WAL) для персистентных структур:
+// - Каждая операция (set, erase, append, pop_back) - компактная
+//   двоичная запись с номером (LSN) и контрольной суммой;
+// - Групповая фиксация: commit(lsn) ждет, пока запись попадет
+//   на диск; один поток-лидер записывает и синхронизирует (fsync)
+//   все накопленные записи разом, остальные ждут его результат;
+// - Восстановление: последний снимок (метка корня = LSN) плюс
+//   хвост журнала. Операции (и set, и erase/pop_back) применяются
+//   через rvalue-перегрузки (std::move(state).set(...)), которые
+//   изменяют собственные узлы на месте, без копирования пути на
+//   каждую операцию; файл читается блоками, а не целиком;
+// - Оборванная при сбое последняя запись отрезается при открытии.
+//
+//   OperationLog<PersistentMap<std::string, int>> log("state.log");
+//   uint64_t lsn = log.set("visits", 42);
+//   log.commit(lsn);  // Запись на диске
+//
+//   auto state = OperationLog<PersistentMap<std::string, int>>::recover("state.snap", "state.log");
+
+// Коды операций
+enum class LogOp : uint8_t {
+    SET = 1,
+    ERASE = 2,
+    APPEND = 3,
+    POP_BACK = 4
+};
+
+struct OperationLogOptions {
+    bool fsync = true; // false - только передача ОС (для тестов и временных данных)
+};
+
+// -----------------------------------------
+// ------ Файл журнала и фиксация ----------
+// -----------------------------------------
+class OperationLogBase {
+public:
+    // Запись журнала при чтении
+    struct Record {
+        uint64_t lsn;
+        LogOp op;
+        persistent_snapshot_detail::Cursor args; // Аргументы операции
+        std::string_view nested; // Мини-снимок узлов вложенных структур (может быть пуст)
+    };
+
+    OperationLogBase(const OperationLogBase&) = delete;
+    OperationLogBase& operator=(const OperationLogBase&) = delete;
+
+    uint64_t lastLsn() const;    // Последняя добавленная запись
+    uint64_t durableLsn() const; // Последняя записанная на диск
+    size_t syncs() const;        // Количество выполненных синхронизаций
+
+    // Ожидание, пока записи до lsn включительно не окажутся на диске
+    void commit(uint64_t lsn);
+    void sync() {
+        commit(lastLsn());
+    }
+
+    const std::string& path() const {
+        return filePath;
+    }
+
+    // Обход целых записей журнала в памяти; возвращает длину корректной части
+    static size_t scan(const std::string& bytes, const std::function<void(const Record&)>& visit);
+    // То же для файла, читаемого блоками (0 - файла нет или нет заголовка)
+    static size_t scanFile(const std::string& path, const std::function<void(const Record&)>& visit);
+
+protected:
+    OperationLogBase(const std::string& path, OperationLogOptions options);
+    ~OperationLogBase();
+
+    // Кодирование аргументов и добавление записи (без ожидания диска).
+    // Узлы вложенных структур попадают в мини-снимок внутри записи.
+    template<typename... Args>
+    uint64_t record(LogOp op, const Args&... args);
+    uint64_t appendRecord(LogOp op, const std::string& args, const std::string& nested);
+
+    // Узлы вложенных структур записи; storage - место для reader'а,
+    // если в записи есть мини-снимок
+    static SnapshotReader& nestedReader(const Record& record, std::optional<SnapshotReader>& storage);
+
+private:
+    std::string filePath;
+    OperationLogOptions settings;
+    int descriptor = -1;
+
+    mutable std::mutex mutex;
+    std::condition_variable flushed;
+    std::string pending; // Записи, еще не переданные в файл
+    uint64_t appended = 0;
+    uint64_t durable = 0;
+    size_t syncCount = 0;
+    bool leaderActive = false; // Лидер группы пишет на диск
+
+    void writeAll(const std::string& bytes, size_t& offset);
+    void syncFile();
+};
+
+// -----------------------------------------
+// ---------- Типизированный журнал --------
+// -----------------------------------------
+template<typename S>
+class OperationLog;
+
+// Журнал ассоциативного массива
+template<typename K, typename V>
+class OperationLog<PersistentMap<K, V>> : public OperationLogBase {
+public:
+    using Structure = PersistentMap<K, V>;
+
+    explicit OperationLog(const std::string& path, OperationLogOptions options = {})
+        : OperationLogBase(path, options) {
+    }
+
+    uint64_t set(const K& key, const V& value);
+    uint64_t erase(const K& key);
+
+    // Применение записи к состоянию (на месте, если оно уникально)
+    static void apply(Structure& state, const Record& record);
+
+    // Восстановление: base - состояние на момент baseLsn
+    static Structure replay(const std::string& logPath, Structure base, uint64_t baseLsn = 0);
+    // Последний снимок (метка корня - LSN) плюс хвост журнала
+    static Structure recover(const std::string& snapshotPath, const std::string& logPath);
+};
+
+// Журнал вектора
+template<typename T>
+class OperationLog<PersistentVector<T>> : public OperationLogBase {
+public:
+    using Structure = PersistentVector<T>;
+
+    explicit OperationLog(const std::string& path, OperationLogOptions options = {})
+        : OperationLogBase(path, options) {
+    }
+
+    uint64_t append(const T& value);
+    uint64_t set(size_t index, const T& value);
+    uint64_t pop_back();
+
+    static void apply(Structure& state, const Record& record);
+    static Structure replay(const std::string& logPath, Structure base, uint64_t baseLsn = 0);
+    static Structure recover(const std::string& snapshotPath, const std::string& logPath);
+};
+
+#include "persistent_oplog_impl.hpp"
+
+#endif
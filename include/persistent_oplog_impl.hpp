@@ -0,0 +1,181 @@
+#ifndef PERSISTENT_OPLOG_IMPL_HPP
+#define PERSISTENT_OPLOG_IMPL_HPP
+
+#include "persistent_oplog.hpp"
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <sstream>
+
+// -----------------------------------------
+// ------ Реализация журнала операций ------
+// -----------------------------------------
+
+namespace persistent_oplog_detail {
+    // Кодировщик записей потока. Пока аргументы - скаляры, writer не
+    // пишет узлов и переиспользуется; после записи с вложенными узлами
+    // создается заново (мини-снимок каждой записи самодостаточен)
+    struct Encoder {
+        std::ostringstream side;
+        SnapshotWriter nested{ side };
+    };
+
+    inline std::unique_ptr<Encoder>& encoder() {
+        thread_local std::unique_ptr<Encoder> current;
+        if (!current) {
+            current = std::make_unique<Encoder>();
+        }
+        return current;
+    }
+}
+
+template<typename... Args>
+uint64_t OperationLogBase::record(LogOp op, const Args&... args) {
+    auto& encoder = persistent_oplog_detail::encoder();
+    std::string bytes;
+    try {
+        (SnapshotCodec<Args>::write(encoder->nested, bytes, args), ...);
+    }
+    catch (...) {
+        encoder.reset(); // Таблица могла запомнить узлы, не попавшие в запись
+        throw;
+    }
+    if (encoder->nested.nodesWritten() == 0) {
+        return appendRecord(op, bytes, std::string());
+    }
+    encoder->nested.flush();
+    std::string side = encoder->side.str();
+    encoder.reset();
+    return appendRecord(op, bytes, side);
+}
+
+// -----------------------------------------
+// ------ Журнал ассоциативного массива ----
+// -----------------------------------------
+template<typename K, typename V>
+uint64_t OperationLog<PersistentMap<K, V>>::set(const K& key, const V& value) {
+    return record(LogOp::SET, key, value);
+}
+
+template<typename K, typename V>
+uint64_t OperationLog<PersistentMap<K, V>>::erase(const K& key) {
+    return record(LogOp::ERASE, key);
+}
+
+template<typename K, typename V>
+void OperationLog<PersistentMap<K, V>>::apply(Structure& state, const Record& entry) {
+    std::optional<SnapshotReader> storage;
+    SnapshotReader& nested = nestedReader(entry, storage);
+    auto in = entry.args;
+    switch (entry.op) {
+    case LogOp::SET: {
+        K key = SnapshotCodec<K>::read(nested, in);
+        V value = SnapshotCodec<V>::read(nested, in);
+        state = std::move(state).set(std::move(key), std::move(value));
+        break;
+    }
+    case LogOp::ERASE:
+        state = std::move(state).erase(SnapshotCodec<K>::read(nested, in));
+        break;
+    default:
+        throw std::runtime_error("Unexpected operation in map log");
+    }
+}
+
+template<typename K, typename V>
+PersistentMap<K, V> OperationLog<PersistentMap<K, V>>::replay(const std::string& logPath,
+    Structure base, uint64_t baseLsn) {
+    scanFile(logPath, [&](const Record& entry) {
+        if (entry.lsn > baseLsn) {
+            apply(base, entry);
+        }
+    });
+    return base;
+}
+
+// -----------------------------------------
+// ------------ Журнал вектора -------------
+// -----------------------------------------
+template<typename T>
+uint64_t OperationLog<PersistentVector<T>>::append(const T& value) {
+    return record(LogOp::APPEND, value);
+}
+
+template<typename T>
+uint64_t OperationLog<PersistentVector<T>>::set(size_t index, const T& value) {
+    return record(LogOp::SET, static_cast<uint64_t>(index), value);
+}
+
+template<typename T>
+uint64_t OperationLog<PersistentVector<T>>::pop_back() {
+    return record(LogOp::POP_BACK);
+}
+
+template<typename T>
+void OperationLog<PersistentVector<T>>::apply(Structure& state, const Record& entry) {
+    std::optional<SnapshotReader> storage;
+    SnapshotReader& nested = nestedReader(entry, storage);
+    auto in = entry.args;
+    switch (entry.op) {
+    case LogOp::APPEND:
+        state = std::move(state).append(SnapshotCodec<T>::read(nested, in));
+        break;
+    case LogOp::SET: {
+        size_t index = static_cast<size_t>(SnapshotCodec<uint64_t>::read(nested, in));
+        state = std::move(state).set(index, SnapshotCodec<T>::read(nested, in));
+        break;
+    }
+    case LogOp::POP_BACK:
+        state = std::move(state).pop_back();
+        break;
+    default:
+        throw std::runtime_error("Unexpected operation in vector log");
+    }
+}
+
+template<typename T>
+PersistentVector<T> OperationLog<PersistentVector<T>>::replay(const std::string& logPath,
+    Structure base, uint64_t baseLsn) {
+    scanFile(logPath, [&](const Record& entry) {
+        if (entry.lsn > baseLsn) {
+            apply(base, entry);
+        }
+    });
+    return base;
+}
+
+// -----------------------------------------
+// ------ Восстановление после сбоя --------
+// -----------------------------------------
+namespace persistent_oplog_detail {
+    // Последняя версия из снимка и ее LSN (метка корня)
+    template<typename S>
+    std::pair<S, uint64_t> lastSnapshot(const std::string& snapshotPath) {
+        std::ifstream in(snapshotPath, std::ios::binary);
+        if (!in) {
+            return { S(), 0 };
+        }
+        SnapshotReader reader(in, true);
+        if (reader.roots() == 0) {
+            return { S(), 0 };
+        }
+        uint64_t lsn = reader.root(reader.roots() - 1).tag;
+        return { reader.readLast<S>(), lsn };
+    }
+}
+
+template<typename K, typename V>
+PersistentMap<K, V> OperationLog<PersistentMap<K, V>>::recover(const std::string& snapshotPath,
+    const std::string& logPath) {
+    auto [base, lsn] = persistent_oplog_detail::lastSnapshot<Structure>(snapshotPath);
+    return replay(logPath, std::move(base), lsn);
+}
+
+template<typename T>
+PersistentVector<T> OperationLog<PersistentVector<T>>::recover(const std::string& snapshotPath,
+    const std::string& logPath) {
+    auto [base, lsn] = persistent_oplog_detail::lastSnapshot<Structure>(snapshotPath);
+    return replay(logPath, std::move(base), lsn);
+}
+
+#endif
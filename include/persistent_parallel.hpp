@@ -0,0 +1,205 @@
+#ifndef PERSISTENT_PARALLEL_HPP
+#define PERSISTENT_PARALLEL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// -----------------------------------------
+// ------- Пул потоков для структур --------
+// -----------------------------------------
+//
+// Общий пул для параллельной сборки независимых поддеревьев
+// (пакетные изменения, построение больших структур):
+// - parallelFor(count, fn) вызывает fn(i) для каждого i из [0, count)
+//   на рабочих потоках и на вызывающем и ждет завершения всех;
+// - Вызывающий поток сам выполняет задачи, которые никто не взял,
+//   поэтому вложенные parallelFor (рекурсивная сборка) не блокируются
+//   даже при занятых рабочих потоках;
+// - Первое исключение из fn передается вызывающему;
+// - forEach(count, grain, fn) делит диапазон на части по потокам.
+//
+// По умолчанию рабочих потоков на один меньше числа ядер; при одном
+// ядре задачи выполняются на вызывающем потоке.
+
+class PersistentThreadPool {
+public:
+    // Единственный экземпляр (намеренно не разрушается, как и сборщик)
+    static PersistentThreadPool& instance() {
+        static PersistentThreadPool* pool = new PersistentThreadPool(defaultWorkers());
+        return *pool;
+    }
+
+    static size_t defaultWorkers() {
+        unsigned cores = std::thread::hardware_concurrency();
+        return cores > 1 ? cores - 1 : 0;
+    }
+
+    explicit PersistentThreadPool(size_t threads) {
+        start(threads);
+    }
+    PersistentThreadPool(const PersistentThreadPool&) = delete;
+    PersistentThreadPool& operator=(const PersistentThreadPool&) = delete;
+
+    ~PersistentThreadPool() {
+        stop();
+    }
+
+    // Смена числа рабочих потоков; не вызывается во время parallelFor
+    void resize(size_t threads) {
+        stop();
+        start(threads);
+    }
+
+    // Число потоков, выполняющих parallelFor (с вызывающим)
+    size_t concurrency() const {
+        return workers.size() + 1;
+    }
+
+    template<typename F>
+    void parallelFor(size_t count, F&& fn) {
+        if (count == 0) {
+            return;
+        }
+        if (count == 1 || workers.empty()) {
+            for (size_t i = 0; i < count; ++i) {
+                fn(i);
+            }
+            return;
+        }
+
+        auto batch = std::make_shared<Batch>();
+        batch->body = [&fn](size_t i) { fn(i); };
+        batch->count = count;
+        size_t helpers = count - 1 < workers.size() ? count - 1 : workers.size();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < helpers; ++i) {
+                queue.push_back(batch);
+            }
+        }
+        if (helpers == workers.size()) {
+            wakeup.notify_all();
+        }
+        else {
+            for (size_t i = 0; i < helpers; ++i) {
+                wakeup.notify_one();
+            }
+        }
+
+        execute(*batch);
+        std::unique_lock<std::mutex> lock(batch->mutex);
+        batch->finished.wait(lock, [&] { return batch->done == batch->count; });
+        if (batch->error) {
+            std::rethrow_exception(batch->error);
+        }
+    }
+
+    // fn(i) для каждого i из [0, count), частями не меньше grain
+    // элементов; короткий диапазон обходится на вызывающем потоке
+    template<typename F>
+    void forEach(size_t count, size_t grain, F&& fn) {
+        size_t parts = grain > 0 ? count / grain : count;
+        if (parts > concurrency()) {
+            parts = concurrency();
+        }
+        if (parts < 1) {
+            parts = 1;
+        }
+        parallelFor(parts, [&](size_t part) {
+            size_t end = count * (part + 1) / parts;
+            for (size_t i = count * part / parts; i < end; ++i) {
+                fn(i);
+            }
+        });
+    }
+
+private:
+    // Задачи одного вызова parallelFor; помощник, взявший пакет после
+    // его завершения, сразу возвращается
+    struct Batch {
+        std::function<void(size_t)> body; // Ссылается на fn вызывающего
+        size_t count = 0;
+        std::atomic<size_t> next{ 0 };
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t done = 0;
+        std::exception_ptr error;
+    };
+
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<std::shared_ptr<Batch>> queue;
+    std::vector<std::thread> workers;
+    bool stopping = false;
+
+    static void execute(Batch& batch) {
+        size_t finished = 0;
+        std::exception_ptr error;
+        for (size_t i = batch.next.fetch_add(1); i < batch.count; i = batch.next.fetch_add(1)) {
+            try {
+                batch.body(i);
+            }
+            catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+            ++finished;
+        }
+        if (finished == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(batch.mutex);
+        if (error && !batch.error) {
+            batch.error = error;
+        }
+        batch.done += finished;
+        if (batch.done == batch.count) {
+            batch.finished.notify_all();
+        }
+    }
+
+    void start(size_t threads) {
+        stopping = false;
+        for (size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wakeup.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            std::shared_ptr<Batch> batch = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            execute(*batch);
+            lock.lock();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef PERSISTENT_RECLAIMER_HPP
+#define PERSISTENT_RECLAIMER_HPP
+
+#include <memory>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstddef>
+
+// -----------------------------------------
+// ------ Отложенное освобождение версий ---
+// -----------------------------------------
+//
+// Опциональный режим освобождения памяти:
+// - Когда исчезает последний дескриптор версии, неразделяемое
+//   поддерево не удаляется на вызывающем потоке, а передается
+//   фоновому потоку-сборщику (O(1) на горячем пути);
+// - Очередь ограничена: при переполнении версия освобождается
+//   синхронно, как и без сборщика;
+// - Ведется статистика для мониторинга.
+//
+// По умолчанию режим выключен и структуры освобождаются как раньше.
+
+// -----------------------------------------
+// --------- Статистика сборщика -----------
+// -----------------------------------------
+struct ReclaimerStats {
+    size_t retired = 0;      // Передано фоновому потоку
+    size_t reclaimed = 0;    // Освобождено фоновым потоком
+    size_t inlined = 0;      // Освобождено синхронно из-за переполнения очереди
+    size_t backlog = 0;      // Текущий размер очереди
+    size_t peakBacklog = 0;  // Максимальный размер очереди
+};
+
+class PersistentReclaimer {
+public:
+    static constexpr size_t DEFAULT_MAX_BACKLOG = 1024; // Ограничение очереди по умолчанию
+
+    // Единственный экземпляр (намеренно не разрушается, чтобы
+    // статические структуры могли безопасно освобождаться при выходе)
+    static PersistentReclaimer& instance() {
+        static PersistentReclaimer* reclaimer = new PersistentReclaimer();
+        return *reclaimer;
+    }
+
+    // -----------------------------------------
+    // --------- Управление режимом ------------
+    // -----------------------------------------
+    // Включение фонового освобождения
+    void enable(size_t maxBacklog = DEFAULT_MAX_BACKLOG) {
+        std::lock_guard<std::mutex> lock(mutex);
+        limit = maxBacklog;
+        if (!worker.joinable()) {
+            stopping = false;
+            worker = std::thread([this] { run(); });
+        }
+        active.store(true, std::memory_order_release);
+    }
+
+    // Выключение: оставшаяся очередь освобождается, поток завершается
+    void disable() {
+        std::thread finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active.store(false, std::memory_order_release);
+            stopping = true;
+            finished = std::move(worker);
+        }
+        wakeup.notify_all();
+        if (finished.joinable()) {
+            finished.join();
+        }
+    }
+
+    bool enabled() const {
+        return active.load(std::memory_order_relaxed);
+    }
+
+    // -----------------------------------------
+    // -------- Передача версии сборщику -------
+    // -----------------------------------------
+    // Забирает ссылку у вызывающего. Если это последняя ссылка и
+    // сборщик включен, освобождение выполнит фоновый поток.
+    template<typename P>
+    void retire(std::shared_ptr<P>& ptr) {
+        if (!ptr) {
+            return;
+        }
+        // Разделяемые версии и вложенные структуры, освобождаемые
+        // самим сборщиком, отпускаем сразу - это дешево
+        if (!enabled() || onReclaimerThread() || ptr.use_count() != 1) {
+            ptr.reset();
+            return;
+        }
+
+        std::shared_ptr<void> garbage = std::move(ptr);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (active.load(std::memory_order_relaxed) && queue.size() < limit) {
+                queue.push_back(std::move(garbage));
+                ++counters.retired;
+                if (queue.size() > counters.peakBacklog) {
+                    counters.peakBacklog = queue.size();
+                }
+            }
+            else {
+                ++counters.inlined;
+            }
+        }
+        if (garbage) {
+            // Очередь переполнена - освобождаем синхронно вне блокировки
+            garbage.reset();
+            return;
+        }
+        wakeup.notify_one();
+    }
+
+    // Ожидание, пока фоновый поток не освободит всю очередь
+    void drain() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return queue.empty() && processing == 0; });
+    }
+
+    // Снимок статистики
+    ReclaimerStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        ReclaimerStats result = counters;
+        result.backlog = queue.size() + processing;
+        return result;
+    }
+
+private:
+    PersistentReclaimer() = default;
+    PersistentReclaimer(const PersistentReclaimer&) = delete;
+    PersistentReclaimer& operator=(const PersistentReclaimer&) = delete;
+
+    // Признак того, что текущий поток - сборщик
+    static bool& onReclaimerThread() {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+    // Цикл фонового потока: забираем очередь пачкой и освобождаем вне блокировки
+    void run() {
+        onReclaimerThread() = true;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wakeup.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                break;
+            }
+
+            std::deque<std::shared_ptr<void>> batch;
+            batch.swap(queue);
+            processing = batch.size();
+            lock.unlock();
+
+            batch.clear();
+
+            lock.lock();
+            counters.reclaimed += processing;
+            processing = 0;
+            idle.notify_all();
+        }
+        idle.notify_all();
+    }
+
+    mutable std::mutex mutex;
+    std::condition_variable wakeup; // Появилась работа или запрошена остановка
+    std::condition_variable idle;   // Очередь опустела
+    std::deque<std::shared_ptr<void>> queue; // Версии, ожидающие освобождения
+    std::thread worker;
+    std::atomic<bool> active{ false };
+    bool stopping = false;
+    size_t limit = DEFAULT_MAX_BACKLOG;
+    size_t processing = 0; // Освобождаются прямо сейчас
+    ReclaimerStats counters;
+};
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef PERSISTENT_REPLICATION_HPP
+#define PERSISTENT_REPLICATION_HPP
+
+#include "persistent_snapshot.hpp"
+#include <condition_variable>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// -----------------------------------------
+// ------ Репликация по хешам узлов --------
+// -----------------------------------------
+//
+// Передача новой версии ассоциативного массива с основного узла на
+// реплику. Стороны сравнивают хеши Меркла поддеревьев (п. 15 README)
+// уровень за уровнем:
+// - Отправитель спрашивает, есть ли у реплики корень нового хеша;
+// - Для каждого отсутствующего узла отправитель передает его тело
+//   (записи и хеши потомков), реплика отвечает, каких потомков у нее нет;
+// - Спуск останавливается на поддеревьях, которые у реплики уже есть,
+//   поэтому передаются только узлы, созданные после ее версии, а новая
+//   версия реплики разделяет с прежней все остальные узлы.
+//
+// Число обменов - глубина дерева (5-7 для миллионов записей).
+// Протокол не зависит от транспорта: ReplicationSender/ReplicationReceiver
+// обрабатывают сообщения, а канал их доставляет.
+//
+//   ReplicationSender<PersistentMap<std::string, int>> sender(primaryVersion);
+//   sender.run(channel);                       // Основной узел
+//
+//   replica.serve(channel);                    // Реплика
+//   auto current = replica.version();
+
+// -----------------------------------------
+// ---------------- Каналы -----------------
+// -----------------------------------------
+class ReplicationChannel {
+public:
+    virtual ~ReplicationChannel() = default;
+    virtual void send(const std::string& message) = 0;
+    virtual std::string receive() = 0;
+};
+
+// Сообщения в потоке (pipe, сокет, файл): длина (4 байта) и данные
+class StreamChannel : public ReplicationChannel {
+public:
+    StreamChannel(std::istream& input, std::ostream& output) : in(input), out(output) {}
+
+    void send(const std::string& message) override;
+    std::string receive() override;
+
+private:
+    std::istream& in;
+    std::ostream& out;
+};
+
+// Канал внутри процесса: две очереди сообщений между потоками
+class ReplicationPipe {
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<std::string> messages;
+    };
+
+    struct End : ReplicationChannel {
+        Queue& incoming;
+        Queue& outgoing;
+
+        End(Queue& in, Queue& out) : incoming(in), outgoing(out) {}
+        void send(const std::string& message) override;
+        std::string receive() override;
+    };
+
+    Queue toReplica;
+    Queue toPrimary;
+    End primaryEnd{ toPrimary, toReplica };
+    End replicaEnd{ toReplica, toPrimary };
+
+public:
+    ReplicationPipe() = default;
+    ReplicationPipe(const ReplicationPipe&) = delete;
+    ReplicationPipe& operator=(const ReplicationPipe&) = delete;
+
+    ReplicationChannel& primary() {
+        return primaryEnd;
+    }
+    ReplicationChannel& replica() {
+        return replicaEnd;
+    }
+};
+
+// -----------------------------------------
+// ------------ Отправитель ----------------
+// -----------------------------------------
+template<typename S>
+class ReplicationSender;
+
+template<typename K, typename V>
+class ReplicationSender<PersistentMap<K, V>> {
+public:
+    using Structure = PersistentMap<K, V>;
+
+    explicit ReplicationSender(const Structure& version);
+
+    // Первое сообщение и ответ на очередное сообщение реплики;
+    // пустая строка - синхронизация завершена
+    std::string start();
+    std::string handle(const std::string& reply);
+
+    // Полная синхронизация через канал
+    void run(ReplicationChannel& channel);
+
+    size_t bytesSent() const {
+        return sent;
+    }
+    size_t nodesSent() const {
+        return nodes;
+    }
+    size_t rounds() const {
+        return exchanges;
+    }
+
+private:
+    using Node = typename Structure::Node;
+
+    enum class Stage { START, DESCEND, FINISH, DONE };
+
+    Structure version;
+    Stage stage = Stage::START;
+    std::vector<const Node*> asked; // Узлы последнего вопроса
+    size_t askedLevel = 0;
+    size_t sent = 0;
+    size_t nodes = 0;
+    size_t exchanges = 0;
+
+    std::string emit(std::string message);
+};
+
+// -----------------------------------------
+// ---------------- Реплика ----------------
+// -----------------------------------------
+template<typename S>
+class ReplicationReceiver;
+
+template<typename K, typename V>
+class ReplicationReceiver<PersistentMap<K, V>> {
+public:
+    using Structure = PersistentMap<K, V>;
+
+    explicit ReplicationReceiver(const Structure& initial = Structure());
+
+    // Ответ на сообщение отправителя
+    std::string handle(const std::string& message);
+
+    // Одна синхронизация через канал
+    void serve(ReplicationChannel& channel);
+
+    // Текущая версия (после последней завершенной синхронизации)
+    const Structure& version() const {
+        return current;
+    }
+    size_t nodesReceived() const {
+        return received;
+    }
+    size_t nodesReused() const {
+        return reused;
+    }
+
+private:
+    using Node = typename Structure::Node;
+
+    // Узел, тело которого пришло, а потомки еще не связаны
+    struct Pending {
+        std::shared_ptr<Node> node;
+        std::vector<size_t> childHashes;
+        bool linked = false;
+    };
+
+    Structure current;
+    // Узлы, известные реплике, по (уровень, хеш). Слабые ссылки:
+    // узлы прежних версий освобождаются вместе с ними
+    std::unordered_map<size_t, std::weak_ptr<Node>> index;
+    std::unordered_map<size_t, Pending> pending;
+    size_t indexedSincePrune = 0;
+    size_t received = 0;
+    size_t reused = 0;
+    bool finished = false;
+
+    static size_t key(size_t level, size_t hash) {
+        return persistent_hash_detail::combine(level, hash);
+    }
+    std::shared_ptr<Node> indexed(size_t level, size_t hash) const;
+    bool known(size_t level, size_t hash) const;
+    void indexNodes(const std::shared_ptr<Node>& node, size_t level);
+    std::shared_ptr<Node> link(size_t level, size_t hash);
+    std::string haveBits(const std::vector<std::pair<size_t, size_t>>& queried) const;
+};
+
+#include "persistent_replication_impl.hpp"
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef PERSISTENT_REPLICATION_IMPL_HPP
+#define PERSISTENT_REPLICATION_IMPL_HPP
+
+#include "persistent_replication.hpp"
+#include <sstream>
+
+// -----------------------------------------
+// ------- Реализация репликации -----------
+// -----------------------------------------
+//
+// Сообщения (первый байт - тип):
+//   'Q' версия протокола, хеш корня      - есть ли корень у реплики
+//   'H' битовая маска                     - какие из спрошенных узлов есть
+//   'N' уровень, узлы, мини-снимок       - тела отсутствующих узлов;
+//                                           их потомки - следующий вопрос
+//   'E' размер, хеш корня                - сборка новой версии
+//   'A'                                   - версия собрана
+namespace persistent_replication_detail {
+    constexpr uint8_t PROTOCOL_VERSION = 1;
+    constexpr char QUERY = 'Q';
+    constexpr char HAVE = 'H';
+    constexpr char NODES = 'N';
+    constexpr char END = 'E';
+    constexpr char ACK = 'A';
+
+    inline persistent_snapshot_detail::Cursor open(const std::string& message, char type) {
+        if (message.empty() || message[0] != type) {
+            throw std::runtime_error("Unexpected replication message");
+        }
+        return persistent_snapshot_detail::Cursor(message.data() + 1, message.data() + message.size());
+    }
+}
+
+// -----------------------------------------
+// ------------ Отправитель ----------------
+// -----------------------------------------
+template<typename K, typename V>
+ReplicationSender<PersistentMap<K, V>>::ReplicationSender(const Structure& structure) : version(structure) {
+    static_assert(Structure::MERKLE, "Replication requires std::hash for the key and value types");
+}
+
+template<typename K, typename V>
+std::string ReplicationSender<PersistentMap<K, V>>::emit(std::string message) {
+    sent += message.size();
+    return message;
+}
+
+template<typename K, typename V>
+std::string ReplicationSender<PersistentMap<K, V>>::start() {
+    using namespace persistent_replication_detail;
+    asked.assign(1, version.root.get());
+    askedLevel = 0;
+    stage = Stage::DESCEND;
+
+    std::string message(1, QUERY);
+    message.push_back(static_cast<char>(PROTOCOL_VERSION));
+    persistent_snapshot_detail::putFixed(message, Structure::nodeHash(version.root.get()), 8);
+    return emit(std::move(message));
+}
+
+template<typename K, typename V>
+std::string ReplicationSender<PersistentMap<K, V>>::handle(const std::string& reply) {
+    using namespace persistent_replication_detail;
+    ++exchanges;
+    if (stage == Stage::FINISH) {
+        open(reply, ACK);
+        stage = Stage::DONE;
+        return std::string();
+    }
+    if (stage != Stage::DESCEND) {
+        throw std::logic_error("Replication is not in progress");
+    }
+
+    // Узлы, которых у реплики нет
+    auto in = open(reply, HAVE);
+    std::vector<const Node*> missing;
+    for (size_t i = 0; i < asked.size(); i += 8) {
+        uint8_t bits = in.byte();
+        for (size_t j = i; j < asked.size() && j < i + 8; ++j) {
+            if (!(bits & (1u << (j - i)))) {
+                missing.push_back(asked[j]);
+            }
+        }
+    }
+
+    if (missing.empty()) {
+        stage = Stage::FINISH;
+        std::string message(1, END);
+        persistent_snapshot_detail::putVarint(message, version.map_size);
+        persistent_snapshot_detail::putFixed(message, Structure::nodeHash(version.root.get()), 8);
+        return emit(std::move(message));
+    }
+
+    // Тела узлов; вложенные структуры в записях - в мини-снимке в конце
+    std::ostringstream side;
+    SnapshotWriter nested(side);
+    std::string bodies;
+    std::vector<const Node*> children;
+    for (const Node* node : missing) {
+        persistent_snapshot_detail::putFixed(bodies, Structure::nodeHash(node), 8);
+        persistent_snapshot_detail::putVarint(bodies, node->bitmap);
+        persistent_snapshot_detail::putVarint(bodies, node->children.size());
+        for (const auto& child : node->children) {
+            persistent_snapshot_detail::putFixed(bodies, Structure::nodeHash(child.get()), 8);
+            children.push_back(child.get());
+        }
+        persistent_snapshot_detail::putVarint(bodies, node->entries.size());
+        for (const auto& entry : node->entries) {
+            SnapshotCodec<K>::write(nested, bodies, entry.first);
+            SnapshotCodec<V>::write(nested, bodies, entry.second);
+        }
+    }
+    nested.flush();
+    nodes += missing.size();
+
+    std::string message(1, NODES);
+    persistent_snapshot_detail::putVarint(message, askedLevel);
+    persistent_snapshot_detail::putVarint(message, missing.size());
+    persistent_snapshot_detail::putVarint(message, bodies.size());
+    message += bodies;
+    message += side.str();
+
+    asked = std::move(children);
+    ++askedLevel;
+    return emit(std::move(message));
+}
+
+template<typename K, typename V>
+void ReplicationSender<PersistentMap<K, V>>::run(ReplicationChannel& channel) {
+    for (std::string message = start(); !message.empty(); message = handle(channel.receive())) {
+        channel.send(message);
+    }
+}
+
+// -----------------------------------------
+// ---------------- Реплика ----------------
+// -----------------------------------------
+template<typename K, typename V>
+ReplicationReceiver<PersistentMap<K, V>>::ReplicationReceiver(const Structure& initial) : current(initial) {
+    static_assert(Structure::MERKLE, "Replication requires std::hash for the key and value types");
+    indexNodes(current.root, 0);
+}
+
+// Регистрация узлов версии; уже известные поддеревья не обходятся
+template<typename K, typename V>
+void ReplicationReceiver<PersistentMap<K, V>>::indexNodes(const std::shared_ptr<Node>& node, size_t level) {
+    if (!node) {
+        return;
+    }
+    auto& slot = index[key(level, Structure::nodeHash(node.get()))];
+    if (slot.lock() == node) {
+        return;
+    }
+    slot = node;
+    ++indexedSincePrune;
+    for (const auto& child : node->children) {
+        indexNodes(child, level + 1);
+    }
+}
+
+// Узел из индекса, если он жив и все еще имеет хеш, под которым
+// записан: версию, полученную от реплики, пользователь может изменить
+// на месте (std::move(v).set), и тогда узел с тем же адресом хранит
+// другое содержимое. Кэш хеша при таком изменении сбрасывается или
+// обновляется, поэтому проверка стоит O(1) для неизмененных узлов
+template<typename K, typename V>
+std::shared_ptr<typename PersistentMap<K, V>::Node>
+ReplicationReceiver<PersistentMap<K, V>>::indexed(size_t level, size_t hash) const {
+    auto it = index.find(key(level, hash));
+    if (it == index.end()) {
+        return nullptr;
+    }
+    std::shared_ptr<Node> node = it->second.lock();
+    if (!node || Structure::nodeHash(node.get()) != hash) {
+        return nullptr;
+    }
+    return node;
+}
+
+template<typename K, typename V>
+bool ReplicationReceiver<PersistentMap<K, V>>::known(size_t level, size_t hash) const {
+    if (pending.count(key(level, hash))) {
+        return true;
+    }
+    return indexed(level, hash) != nullptr;
+}
+
+template<typename K, typename V>
+std::string ReplicationReceiver<PersistentMap<K, V>>::haveBits(
+    const std::vector<std::pair<size_t, size_t>>& queried) const {
+    std::string reply(1, persistent_replication_detail::HAVE);
+    reply.append((queried.size() + 7) / 8, '\0');
+    for (size_t i = 0; i < queried.size(); ++i) {
+        if (known(queried[i].first, queried[i].second)) {
+            reply[1 + i / 8] = static_cast<char>(reply[1 + i / 8] | (1 << (i % 8)));
+        }
+    }
+    return reply;
+}
+
+// Связывание узла новой версии: известный узел используется как есть,
+// пришедший получает потомков по их хешам
+template<typename K, typename V>
+std::shared_ptr<typename PersistentMap<K, V>::Node>
+ReplicationReceiver<PersistentMap<K, V>>::link(size_t level, size_t hash) {
+    size_t k = key(level, hash);
+    auto it = pending.find(k);
+    if (it == pending.end()) {
+        std::shared_ptr<Node> node = indexed(level, hash);
+        if (!node) {
+            throw std::runtime_error("Replication: node is missing on the replica");
+        }
+        ++reused;
+        return node;
+    }
+
+    Pending& entry = it->second;
+    if (!entry.linked) {
+        for (size_t childHash : entry.childHashes) {
+            entry.node->children.push_back(link(level + 1, childHash));
+        }
+        entry.linked = true;
+        // Проверка целостности: хеш собранного узла совпадает с заявленным
+        if (Structure::nodeHash(entry.node.get()) != hash) {
+            throw std::runtime_error("Replication: node does not match its hash");
+        }
+    }
+    return entry.node;
+}
+
+template<typename K, typename V>
+std::string ReplicationReceiver<PersistentMap<K, V>>::handle(const std::string& message) {
+    using namespace persistent_replication_detail;
+    if (message.empty()) {
+        throw std::runtime_error("Unexpected replication message");
+    }
+
+    switch (message[0]) {
+    case QUERY: {
+        auto in = open(message, QUERY);
+        if (in.byte() != PROTOCOL_VERSION) {
+            throw std::runtime_error("Unsupported replication protocol version");
+        }
+        pending.clear();
+        received = 0;
+        reused = 0;
+        finished = false;
+        return haveBits({ { 0, static_cast<size_t>(in.fixed(8)) } });
+    }
+    case NODES: {
+        auto in = open(message, NODES);
+        size_t level = static_cast<size_t>(in.varint());
+        size_t count = static_cast<size_t>(in.varint());
+        auto bodies = in.take(in.varint());
+        SnapshotReader nested(std::string(in.position(), message.data() + message.size()));
+
+        std::vector<std::pair<size_t, size_t>> queried;
+        for (size_t i = 0; i < count; ++i) {
+            size_t hash = static_cast<size_t>(bodies.fixed(8));
+            Pending entry;
+            entry.node = std::make_shared<Node>();
+            entry.node->bitmap = static_cast<uint32_t>(bodies.varint());
+            size_t childCount = static_cast<size_t>(bodies.varint());
+            if (childCount > Structure::BRANCHING_FACTOR) {
+                throw std::runtime_error("Corrupted replication message");
+            }
+            for (size_t c = 0; c < childCount; ++c) {
+                entry.childHashes.push_back(static_cast<size_t>(bodies.fixed(8)));
+                queried.emplace_back(level + 1, entry.childHashes.back());
+            }
+            size_t entryCount = static_cast<size_t>(bodies.varint());
+            for (size_t e = 0; e < entryCount; ++e) {
+                K k = SnapshotCodec<K>::read(nested, bodies);
+                V v = SnapshotCodec<V>::read(nested, bodies);
+                entry.node->entries.emplace_back(std::move(k), std::move(v));
+            }
+            pending.emplace(key(level, hash), std::move(entry));
+            ++received;
+        }
+        return haveBits(queried);
+    }
+    case END: {
+        auto in = open(message, END);
+        size_t size = static_cast<size_t>(in.varint());
+        size_t hash = static_cast<size_t>(in.fixed(8));
+        auto root = link(0, hash);
+        current = Structure(root, size);
+        pending.clear();
+        finished = true;
+
+        // Новые узлы - в индекс; освобожденные узлы прежних версий
+        // вычищаются, когда записей накопилось вдвое больше живых
+        indexNodes(current.root, 0);
+        if (indexedSincePrune > index.size() / 2) {
+            for (auto it = index.begin(); it != index.end();) {
+                it = it->second.expired() ? index.erase(it) : std::next(it);
+            }
+            indexedSincePrune = 0;
+        }
+        return std::string(1, ACK);
+    }
+    default:
+        throw std::runtime_error("Unexpected replication message");
+    }
+}
+
+template<typename K, typename V>
+void ReplicationReceiver<PersistentMap<K, V>>::serve(ReplicationChannel& channel) {
+    finished = false;
+    while (!finished) {
+        channel.send(handle(channel.receive()));
+    }
+}
+
+#endif
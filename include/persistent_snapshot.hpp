@@ -0,0 +1,478 @@
+#ifndef PERSISTENT_SNAPSHOT_HPP
+#define PERSISTENT_SNAPSHOT_HPP
+
+#include "persistent_vector.hpp"
+#include "persistent_list.hpp"
+#include "persistent_map.hpp"
+#include "persistent_value.hpp"
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// -----------------------------------------
+// --------- Двоичные снимки версий --------
+// -----------------------------------------
+//
+// Формат сохранения структур на диск:
+// - Заголовок: сигнатура и версия формата;
+// - Далее записи двух видов: узел и корень версии.
+//   Узел записывается один раз, даже если на него ссылается
+//   множество сохраненных версий: повторно записываются только
+//   узлы, созданные копированием пути;
+// - Потомки записываются раньше родителей, ссылки на них -
+//   порядковые номера узлов (0 - пустая ссылка);
+// - Корень хранит вид структуры, имя типа элементов, метку
+//   пользователя и дескриптор (размер, глубина, номер корня).
+//
+// Чтение восстанавливает узлы напрямую, без повторных вставок,
+// и разделяет их между прочитанными версиями так же, как в памяти.
+//
+//   std::ofstream out("data.snap", std::ios::binary);
+//   SnapshotWriter writer(out);
+//   writer.write(v1, 1);
+//   writer.write(v2, 2);  // Дописаны только измененные узлы
+//
+//   std::ifstream in("data.snap", std::ios::binary);
+//   SnapshotReader reader(in);
+//   auto v2 = reader.read<PersistentMap<std::string, int>>(1);
+
+// Вид структуры в записи корня
+enum class SnapshotKind : uint8_t {
+    VECTOR = 1,
+    LIST = 2,
+    MAP = 3,
+    VALUE = 4
+};
+
+namespace persistent_snapshot_detail {
+    constexpr char MAGIC[6] = { 'P', 'D', 'S', 'N', 'A', 'P' }; // Сигнатура файла
+    constexpr uint16_t FORMAT_VERSION = 1; // Версия формата
+    constexpr size_t HEADER_SIZE = sizeof(MAGIC) + sizeof(FORMAT_VERSION);
+
+    constexpr char NODE_RECORD = 'N'; // Запись узла
+    constexpr char ROOT_RECORD = 'R'; // Запись корня версии
+
+    // Виды узлов
+    constexpr uint8_t VECTOR_NODE = 1;
+    constexpr uint8_t LIST_NODE = 2;
+    constexpr uint8_t MAP_NODE = 3;
+
+    // -----------------------------------------
+    // ---------- Кодирование чисел ------------
+    // -----------------------------------------
+    // Беззнаковое число переменной длины (LEB128)
+    inline void putVarint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    // Знаковое число: zigzag, чтобы малые отрицательные были короткими
+    inline void putSigned(std::string& out, int64_t value) {
+        putVarint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    // Число фиксированной длины в порядке little-endian
+    inline void putFixed(std::string& out, uint64_t value, size_t bytes) {
+        for (size_t i = 0; i < bytes; ++i) {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+        }
+    }
+
+    inline void putString(std::string& out, const std::string& value) {
+        putVarint(out, value.size());
+        out.append(value);
+    }
+
+    // -----------------------------------------
+    // ----------- Чтение из буфера ------------
+    // -----------------------------------------
+    // Курсор по байтам записи с проверкой границ
+    class Cursor {
+    private:
+        const char* pos;
+        const char* end;
+
+        static void corrupted() {
+            throw std::runtime_error("Corrupted snapshot");
+        }
+
+    public:
+        Cursor(const char* begin, const char* finish) : pos(begin), end(finish) {}
+
+        bool atEnd() const {
+            return pos == end;
+        }
+        const char* position() const {
+            return pos;
+        }
+
+        uint8_t byte() {
+            if (pos == end) {
+                corrupted();
+            }
+            return static_cast<uint8_t>(*pos++);
+        }
+
+        uint64_t varint() {
+            uint64_t value = 0;
+            for (unsigned shift = 0; shift < 64; shift += 7) {
+                uint8_t b = byte();
+                value |= static_cast<uint64_t>(b & 0x7F) << shift;
+                if (!(b & 0x80)) {
+                    return value;
+                }
+            }
+            corrupted();
+            return 0;
+        }
+
+        int64_t signedVarint() {
+            uint64_t raw = varint();
+            return static_cast<int64_t>((raw >> 1) ^ (~(raw & 1) + 1));
+        }
+
+        uint64_t fixed(size_t bytes) {
+            uint64_t value = 0;
+            for (size_t i = 0; i < bytes; ++i) {
+                value |= static_cast<uint64_t>(byte()) << (8 * i);
+            }
+            return value;
+        }
+
+        // Подпоследовательность из n байт
+        Cursor take(uint64_t n) {
+            if (static_cast<uint64_t>(end - pos) < n) {
+                corrupted();
+            }
+            Cursor part(pos, pos + n);
+            pos += n;
+            return part;
+        }
+
+        std::string string() {
+            Cursor part = take(varint());
+            return std::string(part.pos, part.end);
+        }
+    };
+}
+
+// -----------------------------------------
+// ------- Кодеки для типов элементов ------
+// -----------------------------------------
+// Специализация описывает имя типа (проверяется при чтении),
+// запись в буфер узла и чтение из него. Вложенные структуры
+// записывают свои узлы в поток до узла-владельца.
+template<typename T, typename Enable = void>
+struct SnapshotCodec;
+
+// Целые числа и bool
+template<typename T>
+struct SnapshotCodec<T, std::enable_if_t<std::is_integral_v<T>>> {
+    static std::string name() {
+        if constexpr (std::is_same_v<T, bool>) {
+            return "bool";
+        }
+        else {
+            return (std::is_signed_v<T> ? "i" : "u") + std::to_string(sizeof(T) * 8);
+        }
+    }
+    static void write(SnapshotWriter&, std::string& out, const T& value) {
+        if constexpr (std::is_signed_v<T>) {
+            persistent_snapshot_detail::putSigned(out, static_cast<int64_t>(value));
+        }
+        else {
+            persistent_snapshot_detail::putVarint(out, static_cast<uint64_t>(value));
+        }
+    }
+    static T read(SnapshotReader&, persistent_snapshot_detail::Cursor& in) {
+        if constexpr (std::is_signed_v<T>) {
+            return static_cast<T>(in.signedVarint());
+        }
+        else {
+            return static_cast<T>(in.varint());
+        }
+    }
+};
+
+// Числа с плавающей точкой (побитово, little-endian)
+template<typename T>
+struct SnapshotCodec<T, std::enable_if_t<std::is_floating_point_v<T> && (sizeof(T) == 4 || sizeof(T) == 8)>> {
+    using Bits = std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>;
+
+    static std::string name() {
+        return "f" + std::to_string(sizeof(T) * 8);
+    }
+    static void write(SnapshotWriter&, std::string& out, const T& value) {
+        Bits bits;
+        std::memcpy(&bits, &value, sizeof(T));
+        persistent_snapshot_detail::putFixed(out, bits, sizeof(T));
+    }
+    static T read(SnapshotReader&, persistent_snapshot_detail::Cursor& in) {
+        Bits bits = static_cast<Bits>(in.fixed(sizeof(T)));
+        T value;
+        std::memcpy(&value, &bits, sizeof(T));
+        return value;
+    }
+};
+
+template<>
+struct SnapshotCodec<std::string> {
+    static std::string name() {
+        return "str";
+    }
+    static void write(SnapshotWriter&, std::string& out, const std::string& value) {
+        persistent_snapshot_detail::putString(out, value);
+    }
+    static std::string read(SnapshotReader&, persistent_snapshot_detail::Cursor& in) {
+        return in.string();
+    }
+};
+
+template<typename A, typename B>
+struct SnapshotCodec<std::pair<A, B>> {
+    static std::string name() {
+        return "pair<" + SnapshotCodec<A>::name() + "," + SnapshotCodec<B>::name() + ">";
+    }
+    static void write(SnapshotWriter& writer, std::string& out, const std::pair<A, B>& value) {
+        SnapshotCodec<A>::write(writer, out, value.first);
+        SnapshotCodec<B>::write(writer, out, value.second);
+    }
+    static std::pair<A, B> read(SnapshotReader& reader, persistent_snapshot_detail::Cursor& in) {
+        A first = SnapshotCodec<A>::read(reader, in);
+        B second = SnapshotCodec<B>::read(reader, in);
+        return std::pair<A, B>(std::move(first), std::move(second));
+    }
+};
+
+// Структуры как элементы: в буфер пишется только дескриптор,
+// узлы структуры уходят в поток отдельными записями
+template<typename T>
+struct SnapshotCodec<PersistentVector<T>> {
+    static constexpr SnapshotKind KIND = SnapshotKind::VECTOR;
+    static std::string name() {
+        return "vector<" + SnapshotCodec<T>::name() + ">";
+    }
+    static void write(SnapshotWriter& writer, std::string& out, const PersistentVector<T>& value);
+    static PersistentVector<T> read(SnapshotReader& reader, persistent_snapshot_detail::Cursor& in);
+};
+
+template<typename T>
+struct SnapshotCodec<PersistentList<T>> {
+    static constexpr SnapshotKind KIND = SnapshotKind::LIST;
+    static std::string name() {
+        return "list<" + SnapshotCodec<T>::name() + ">";
+    }
+    static void write(SnapshotWriter& writer, std::string& out, const PersistentList<T>& value);
+    static PersistentList<T> read(SnapshotReader& reader, persistent_snapshot_detail::Cursor& in);
+};
+
+template<typename K, typename V>
+struct SnapshotCodec<PersistentMap<K, V>> {
+    static constexpr SnapshotKind KIND = SnapshotKind::MAP;
+    static std::string name() {
+        return "map<" + SnapshotCodec<K>::name() + "," + SnapshotCodec<V>::name() + ">";
+    }
+    static void write(SnapshotWriter& writer, std::string& out, const PersistentMap<K, V>& value);
+    static PersistentMap<K, V> read(SnapshotReader& reader, persistent_snapshot_detail::Cursor& in);
+};
+
+// PersistentValue: тег типа и значение; вложенные структуры
+// поддерживаются для тех же типов, что и в persistent_value.cpp
+template<>
+struct SnapshotCodec<PersistentValue> {
+    static constexpr SnapshotKind KIND = SnapshotKind::VALUE;
+    static std::string name() {
+        return "value";
+    }
+    static void write(SnapshotWriter& writer, std::string& out, const PersistentValue& value);
+    static PersistentValue read(SnapshotReader& reader, persistent_snapshot_detail::Cursor& in);
+};
+
+// -----------------------------------------
+// ------------ Запись снимков -------------
+// -----------------------------------------
+class SnapshotWriter {
+public:
+    // header = false - дозапись в поток, где заголовок уже есть
+    explicit SnapshotWriter(std::ostream& out, bool header = true);
+
+    // Запись версии как корня; возвращает номер корня в этом потоке.
+    // Узлы, уже записанные этим writer'ом, повторно не пишутся.
+    template<typename S>
+    size_t write(const S& structure, uint64_t tag = 0);
+
+    void flush();
+
+    size_t nodesWritten() const {
+        return written;
+    }
+    size_t nodesReused() const {
+        return reused;
+    }
+    // Узлы в таблице записанных
+    size_t nodesKnown() const {
+        return known.size();
+    }
+    // Номер следующего корня (после resume - с учетом корней файла)
+    size_t rootsWritten() const {
+        return roots;
+    }
+    // Дозапись в файл, прочитанный reader'ом (writer создается с header = false)
+    void resume(const SnapshotReader& reader);
+    // Удаление из таблицы узлов, на которые ссылается только она
+    void prune();
+
+    // -----------------------------------------
+    // ------ Дескрипторы (для кодеков) --------
+    // -----------------------------------------
+    template<typename T>
+    void putVector(std::string& out, const PersistentVector<T>& vector);
+    template<typename T>
+    void putList(std::string& out, const PersistentList<T>& list);
+    template<typename K, typename V>
+    void putMap(std::string& out, const PersistentMap<K, V>& map);
+
+private:
+    // Записанный узел: номер и сильная ссылка. Ссылка держит адрес
+    // занятым и увеличивает use_count, поэтому rvalue-операции
+    // (std::move(v).set) копируют записанный узел, а не меняют его
+    // на месте под тем же номером
+    struct Known {
+        uint64_t id;
+        std::shared_ptr<const void> node;
+    };
+
+    std::ostream& stream;
+    std::unordered_map<const void*, Known> known;
+    uint64_t nextId = 0;
+    size_t written = 0;
+    size_t reused = 0;
+    size_t roots = 0;
+
+    template<typename P>
+    uint64_t lookup(const std::shared_ptr<P>& node);
+    template<typename P>
+    uint64_t remember(const std::shared_ptr<P>& node, uint64_t id);
+    uint64_t emitNode(const std::string& payload);
+    void emitRecord(char type, const std::string& payload);
+
+    template<typename T>
+    uint64_t vectorNode(const std::shared_ptr<typename PersistentVector<T>::Node>& node, size_t shift);
+    template<typename T>
+    uint64_t listNode(const std::shared_ptr<typename PersistentList<T>::Node>& node);
+    template<typename K, typename V>
+    uint64_t mapNode(const std::shared_ptr<typename PersistentMap<K, V>::Node>& node);
+};
+
+// -----------------------------------------
+// ------------ Чтение снимков -------------
+// -----------------------------------------
+class SnapshotReader {
+public:
+    // Описание сохраненной версии
+    struct RootInfo {
+        SnapshotKind kind;
+        std::string type; // Имя типа (например, "map<str,i32>")
+        uint64_t tag; // Метка пользователя
+        size_t offset; // Смещение дескриптора в буфере
+        size_t length;
+    };
+
+    // allowTornTail - оборванная последняя запись отбрасывается
+    // (ее границу сообщает validBytes), иначе это ошибка
+    explicit SnapshotReader(std::istream& in, bool allowTornTail = false);
+    explicit SnapshotReader(std::string bytes, bool allowTornTail = false);
+
+    size_t roots() const {
+        return rootTable.size();
+    }
+    const RootInfo& root(size_t index) const;
+    size_t nodes() const {
+        return nodeOffsets.size();
+    }
+    // Длина корректной части (заголовок и целые записи)
+    size_t validBytes() const {
+        return valid;
+    }
+
+    // Восстановление версии; тип должен совпадать с записанным
+    template<typename S>
+    S read(size_t index);
+    // Последняя записанная версия
+    template<typename S>
+    S readLast() {
+        if (rootTable.empty()) {
+            throw std::out_of_range("Snapshot has no roots");
+        }
+        return read<S>(rootTable.size() - 1);
+    }
+
+    // -----------------------------------------
+    // ------ Дескрипторы (для кодеков) --------
+    // -----------------------------------------
+    template<typename T>
+    PersistentVector<T> getVector(persistent_snapshot_detail::Cursor& in);
+    template<typename T>
+    PersistentList<T> getList(persistent_snapshot_detail::Cursor& in);
+    template<typename K, typename V>
+    PersistentMap<K, V> getMap(persistent_snapshot_detail::Cursor& in);
+
+private:
+    friend class SnapshotWriter;
+
+    std::string buffer;
+    size_t valid = 0;
+    std::vector<std::pair<size_t, size_t>> nodeOffsets; // Смещение и длина записи узла
+    std::vector<RootInfo> rootTable;
+    std::vector<std::shared_ptr<void>> decoded; // Восстановленные узлы по номеру
+    std::vector<const void*> decodedTypes; // Тип восстановленного узла
+    // Узел, значения которого сейчас читаются (0 - дескриптор корня):
+    // вложенные в значения структуры записаны раньше него
+    uint64_t container = 0;
+
+    // Смена container на время чтения значений узла
+    class ContainerScope {
+    public:
+        ContainerScope(SnapshotReader& reader, uint64_t id) : owner(reader), saved(reader.container) {
+            owner.container = id;
+        }
+        ~ContainerScope() {
+            owner.container = saved;
+        }
+        ContainerScope(const ContainerScope&) = delete;
+        ContainerScope& operator=(const ContainerScope&) = delete;
+    private:
+        SnapshotReader& owner;
+        uint64_t saved;
+    };
+
+    void parse(bool allowTornTail);
+    persistent_snapshot_detail::Cursor nodeCursor(uint64_t id, uint8_t kind) const;
+    void checkChild(uint64_t child, uint64_t parent) const;
+    uint64_t nestedRoot(persistent_snapshot_detail::Cursor& in) const;
+    template<typename N>
+    std::shared_ptr<N> cached(uint64_t id) const;
+    template<typename N>
+    void store(uint64_t id, const std::shared_ptr<N>& node);
+
+    template<typename T>
+    std::shared_ptr<typename PersistentVector<T>::Node> vectorNode(uint64_t id);
+    template<typename T>
+    std::shared_ptr<typename PersistentList<T>::Node> listNode(uint64_t id);
+    template<typename K, typename V>
+    std::shared_ptr<typename PersistentMap<K, V>::Node> mapNode(uint64_t id);
+};
+
+#include "persistent_snapshot_impl.hpp"
+
+#endif
@@ -0,0 +1,705 @@
+#ifndef PERSISTENT_SNAPSHOT_IMPL_HPP
+#define PERSISTENT_SNAPSHOT_IMPL_HPP
+
+#include "persistent_snapshot.hpp"
+#include <algorithm>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <typeindex>
+
+// -----------------------------------------
+// ------- Реализация двоичных снимков -----
+// -----------------------------------------
+
+namespace persistent_snapshot_detail {
+    template<typename T>
+    struct TypeTag {
+        using type = T;
+    };
+
+    // Уникальный ключ типа для проверки восстановленных узлов
+    template<typename N>
+    const void* typeKey() {
+        static const char key = 0;
+        return &key;
+    }
+
+    // Коды типов элементов вложенных структур PersistentValue
+    // (элементы вектора и списка, значения массива)
+    inline uint8_t elementCode(const PersistentValue& value) {
+        if (value.hasElementType<int>()) return 1;
+        if (value.hasElementType<double>()) return 2;
+        if (value.hasElementType<std::string>()) return 3;
+        if (value.hasElementType<PersistentValue>()) return 4;
+        if (value.hasElementType<int64_t>()) return 5;
+        if (value.hasElementType<float>()) return 6;
+        if (value.hasElementType<bool>()) return 7;
+        throw std::runtime_error("Unsupported nested element type");
+    }
+
+    template<typename F>
+    void withElement(uint8_t code, F&& fn) {
+        switch (code) {
+        case 1: fn(TypeTag<int>()); break;
+        case 2: fn(TypeTag<double>()); break;
+        case 3: fn(TypeTag<std::string>()); break;
+        case 4: fn(TypeTag<PersistentValue>()); break;
+        case 5: fn(TypeTag<int64_t>()); break;
+        case 6: fn(TypeTag<float>()); break;
+        case 7: fn(TypeTag<bool>()); break;
+        default: throw std::runtime_error("Corrupted snapshot");
+        }
+    }
+}
+
+// -----------------------------------------
+// ------- Кодеки вложенных структур -------
+// -----------------------------------------
+template<typename T>
+void SnapshotCodec<PersistentVector<T>>::write(SnapshotWriter& writer, std::string& out,
+    const PersistentVector<T>& value) {
+    writer.putVector(out, value);
+}
+
+template<typename T>
+PersistentVector<T> SnapshotCodec<PersistentVector<T>>::read(SnapshotReader& reader,
+    persistent_snapshot_detail::Cursor& in) {
+    return reader.getVector<T>(in);
+}
+
+template<typename T>
+void SnapshotCodec<PersistentList<T>>::write(SnapshotWriter& writer, std::string& out,
+    const PersistentList<T>& value) {
+    writer.putList(out, value);
+}
+
+template<typename T>
+PersistentList<T> SnapshotCodec<PersistentList<T>>::read(SnapshotReader& reader,
+    persistent_snapshot_detail::Cursor& in) {
+    return reader.getList<T>(in);
+}
+
+template<typename K, typename V>
+void SnapshotCodec<PersistentMap<K, V>>::write(SnapshotWriter& writer, std::string& out,
+    const PersistentMap<K, V>& value) {
+    writer.putMap(out, value);
+}
+
+template<typename K, typename V>
+PersistentMap<K, V> SnapshotCodec<PersistentMap<K, V>>::read(SnapshotReader& reader,
+    persistent_snapshot_detail::Cursor& in) {
+    return reader.getMap<K, V>(in);
+}
+
+// -----------------------------------------
+// --------- Кодек PersistentValue ---------
+// -----------------------------------------
+inline void SnapshotCodec<PersistentValue>::write(SnapshotWriter& writer, std::string& out,
+    const PersistentValue& value) {
+    using namespace persistent_snapshot_detail;
+    out.push_back(static_cast<char>(value.type()));
+
+    switch (value.type()) {
+    case ValueType::NULL_VALUE:
+        break;
+    case ValueType::INT:
+        putSigned(out, value.asInt());
+        break;
+    case ValueType::DOUBLE:
+        SnapshotCodec<double>::write(writer, out, value.asDouble());
+        break;
+    case ValueType::BOOL:
+        out.push_back(value.asBool() ? 1 : 0);
+        break;
+    case ValueType::STRING:
+        putString(out, value.asString());
+        break;
+    case ValueType::VECTOR: {
+        uint8_t code = elementCode(value);
+        out.push_back(static_cast<char>(code));
+        withElement(code, [&](auto tag) {
+            using T = typename decltype(tag)::type;
+            writer.putVector(out, value.vectorRef<T>());
+        });
+        break;
+    }
+    case ValueType::LIST: {
+        uint8_t code = elementCode(value);
+        out.push_back(static_cast<char>(code));
+        withElement(code, [&](auto tag) {
+            using T = typename decltype(tag)::type;
+            writer.putList(out, value.listRef<T>());
+        });
+        break;
+    }
+    case ValueType::MAP: {
+        // Вложенные массивы поддерживаются только со строковыми ключами
+        if (!value.hasKeyType<std::string>()) {
+            throw std::runtime_error("Unsupported nested key type");
+        }
+        uint8_t code = elementCode(value);
+        out.push_back(static_cast<char>(code));
+        withElement(code, [&](auto tag) {
+            using V = typename decltype(tag)::type;
+            writer.putMap(out, value.mapRef<std::string, V>());
+        });
+        break;
+    }
+    }
+}
+
+inline PersistentValue SnapshotCodec<PersistentValue>::read(SnapshotReader& reader,
+    persistent_snapshot_detail::Cursor& in) {
+    using namespace persistent_snapshot_detail;
+    PersistentValue result;
+
+    switch (static_cast<ValueType>(in.byte())) {
+    case ValueType::NULL_VALUE:
+        break;
+    case ValueType::INT:
+        result = PersistentValue(static_cast<int>(in.signedVarint()));
+        break;
+    case ValueType::DOUBLE:
+        result = PersistentValue(SnapshotCodec<double>::read(reader, in));
+        break;
+    case ValueType::BOOL:
+        result = PersistentValue(in.byte() != 0);
+        break;
+    case ValueType::STRING:
+        result = PersistentValue(in.string());
+        break;
+    case ValueType::VECTOR:
+        withElement(in.byte(), [&](auto tag) {
+            using T = typename decltype(tag)::type;
+            result = PersistentValue(reader.getVector<T>(in));
+        });
+        break;
+    case ValueType::LIST:
+        withElement(in.byte(), [&](auto tag) {
+            using T = typename decltype(tag)::type;
+            result = PersistentValue(reader.getList<T>(in));
+        });
+        break;
+    case ValueType::MAP:
+        withElement(in.byte(), [&](auto tag) {
+            using V = typename decltype(tag)::type;
+            result = PersistentValue(reader.getMap<std::string, V>(in));
+        });
+        break;
+    default:
+        throw std::runtime_error("Corrupted snapshot");
+    }
+    return result;
+}
+
+// -----------------------------------------
+// ------------ Запись снимков -------------
+// -----------------------------------------
+inline SnapshotWriter::SnapshotWriter(std::ostream& out, bool header) : stream(out) {
+    using namespace persistent_snapshot_detail;
+    if (header) {
+        std::string bytes(MAGIC, sizeof(MAGIC));
+        putFixed(bytes, FORMAT_VERSION, sizeof(FORMAT_VERSION));
+        stream.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        if (!stream) {
+            throw std::runtime_error("Snapshot write failed");
+        }
+    }
+}
+
+// Запись версии: узлы (только новые), затем запись корня
+template<typename S>
+size_t SnapshotWriter::write(const S& structure, uint64_t tag) {
+    using namespace persistent_snapshot_detail;
+    std::string descriptor;
+    SnapshotCodec<S>::write(*this, descriptor, structure);
+
+    std::string payload;
+    payload.push_back(static_cast<char>(SnapshotCodec<S>::KIND));
+    putString(payload, SnapshotCodec<S>::name());
+    putVarint(payload, tag);
+    payload.append(descriptor);
+    emitRecord(ROOT_RECORD, payload);
+    return roots++;
+}
+
+// Продолжение файла, прочитанного reader'ом: нумерация узлов и корней
+// продолжается, восстановленные узлы считаются уже записанными
+inline void SnapshotWriter::resume(const SnapshotReader& reader) {
+    nextId = reader.nodes();
+    roots = reader.roots();
+    for (size_t i = 0; i < reader.decoded.size(); ++i) {
+        if (reader.decoded[i]) {
+            known[reader.decoded[i].get()] = Known{ i + 1, reader.decoded[i] };
+        }
+    }
+}
+
+inline void SnapshotWriter::flush() {
+    stream.flush();
+    if (!stream) {
+        throw std::runtime_error("Snapshot write failed");
+    }
+}
+
+// Узлы, которые держит только таблица, не входят ни в одну живую
+// версию. Потомок записывается раньше родителя, поэтому обход по
+// убыванию номеров освобождает родителя до проверки его потомков -
+// поддерево целиком уходит за один проход
+inline void SnapshotWriter::prune() {
+    std::vector<std::pair<uint64_t, const void*>> order;
+    order.reserve(known.size());
+    for (const auto& entry : known) {
+        order.emplace_back(entry.second.id, entry.first);
+    }
+    std::sort(order.begin(), order.end(), std::greater<>());
+    for (const auto& item : order) {
+        auto it = known.find(item.second);
+        if (it->second.node.use_count() == 1) {
+            known.erase(it);
+        }
+    }
+}
+
+// Номер уже записанного узла (0 - узел новый)
+template<typename P>
+uint64_t SnapshotWriter::lookup(const std::shared_ptr<P>& node) {
+    auto it = known.find(node.get());
+    if (it == known.end()) {
+        return 0;
+    }
+    ++reused;
+    return it->second.id;
+}
+
+template<typename P>
+uint64_t SnapshotWriter::remember(const std::shared_ptr<P>& node, uint64_t id) {
+    known[node.get()] = Known{ id, node };
+    return id;
+}
+
+inline uint64_t SnapshotWriter::emitNode(const std::string& payload) {
+    emitRecord(persistent_snapshot_detail::NODE_RECORD, payload);
+    ++written;
+    return ++nextId;
+}
+
+inline void SnapshotWriter::emitRecord(char type, const std::string& payload) {
+    std::string header(1, type);
+    persistent_snapshot_detail::putVarint(header, payload.size());
+    stream.write(header.data(), static_cast<std::streamsize>(header.size()));
+    stream.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    if (!stream) {
+        throw std::runtime_error("Snapshot write failed");
+    }
+}
+
+// -----------------------------------------
+// ------------- Запись узлов --------------
+// -----------------------------------------
+// Узел вектора: потомки (или значения листа) по заполненным ячейкам
+template<typename T>
+uint64_t SnapshotWriter::vectorNode(const std::shared_ptr<typename PersistentVector<T>::Node>& node,
+    size_t shift) {
+    using namespace persistent_snapshot_detail;
+    if (!node) {
+        return 0;
+    }
+    if (uint64_t id = lookup(node)) {
+        return id;
+    }
+
+    bool leaf = shift == 0;
+    uint64_t children[PersistentVector<T>::BRANCHING_FACTOR] = {};
+    if (!leaf) {
+        for (size_t i = 0; i < node->slots; ++i) {
+            children[i] = vectorNode<T>(node->children[i], shift - PersistentVector<T>::BITS_PER_LEVEL);
+        }
+    }
+
+    std::string payload(1, static_cast<char>(VECTOR_NODE));
+    putVarint(payload, node->count);
+    putVarint(payload, node->slots);
+    payload.push_back(leaf ? 1 : 0);
+    for (size_t i = 0; i < node->slots; ++i) {
+        if (!leaf) {
+            putVarint(payload, children[i]);
+        }
+        else if (node->values[i]) {
+            payload.push_back(1);
+            SnapshotCodec<T>::write(*this, payload, *node->values[i]);
+        }
+        else {
+            payload.push_back(0);
+        }
+    }
+    return remember(node, emitNode(payload));
+}
+
+// Чанки списка: цепочка обходится циклом до первого записанного чанка
+template<typename T>
+uint64_t SnapshotWriter::listNode(const std::shared_ptr<typename PersistentList<T>::Node>& node) {
+    using namespace persistent_snapshot_detail;
+    std::vector<std::shared_ptr<typename PersistentList<T>::Node>> pending;
+    uint64_t after = 0;
+    for (auto current = node; current; current = current->next) {
+        if ((after = lookup(current)) != 0) {
+            break;
+        }
+        pending.push_back(current);
+    }
+
+    for (auto it = pending.rbegin(); it != pending.rend(); ++it) {
+        const auto& chunk = *it;
+        std::string payload(1, static_cast<char>(LIST_NODE));
+        putVarint(payload, after);
+        putVarint(payload, chunk->count);
+        for (size_t i = 0; i < chunk->count; ++i) {
+            SnapshotCodec<T>::write(*this, payload, chunk->value(i));
+        }
+        after = remember(chunk, emitNode(payload));
+    }
+    return after;
+}
+
+// Узел HAMT: битовая маска, потомки и записи листа
+template<typename K, typename V>
+uint64_t SnapshotWriter::mapNode(const std::shared_ptr<typename PersistentMap<K, V>::Node>& node) {
+    using namespace persistent_snapshot_detail;
+    if (!node) {
+        return 0;
+    }
+    if (uint64_t id = lookup(node)) {
+        return id;
+    }
+
+    std::vector<uint64_t> children;
+    children.reserve(node->children.size());
+    for (const auto& child : node->children) {
+        children.push_back(mapNode<K, V>(child));
+    }
+
+    std::string payload(1, static_cast<char>(MAP_NODE));
+    putVarint(payload, node->bitmap);
+    putVarint(payload, children.size());
+    for (uint64_t child : children) {
+        putVarint(payload, child);
+    }
+    putVarint(payload, node->entries.size());
+    for (const auto& entry : node->entries) {
+        SnapshotCodec<K>::write(*this, payload, entry.first);
+        SnapshotCodec<V>::write(*this, payload, entry.second);
+    }
+    return remember(node, emitNode(payload));
+}
+
+// -----------------------------------------
+// -------- Дескрипторы структур -----------
+// -----------------------------------------
+template<typename T>
+void SnapshotWriter::putVector(std::string& out, const PersistentVector<T>& vector) {
+    using namespace persistent_snapshot_detail;
+    uint64_t root = vectorNode<T>(vector.data->root, vector.data->shift);
+    putVarint(out, vector.data->size);
+    putVarint(out, vector.data->shift);
+    putVarint(out, root);
+}
+
+template<typename T>
+void SnapshotWriter::putList(std::string& out, const PersistentList<T>& list) {
+    using namespace persistent_snapshot_detail;
+    uint64_t head = listNode<T>(list.head);
+    putVarint(out, list.list_size);
+    putVarint(out, list.head_used);
+    putVarint(out, head);
+}
+
+template<typename K, typename V>
+void SnapshotWriter::putMap(std::string& out, const PersistentMap<K, V>& map) {
+    using namespace persistent_snapshot_detail;
+    uint64_t root = mapNode<K, V>(map.root);
+    putVarint(out, map.map_size);
+    putVarint(out, root);
+}
+
+// -----------------------------------------
+// ------------ Чтение снимков -------------
+// -----------------------------------------
+inline SnapshotReader::SnapshotReader(std::istream& in, bool allowTornTail) {
+    // Поток читается целиком крупными блоками
+    char chunk[1 << 16];
+    while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0) {
+        buffer.append(chunk, static_cast<size_t>(in.gcount()));
+    }
+    parse(allowTornTail);
+}
+
+inline SnapshotReader::SnapshotReader(std::string bytes, bool allowTornTail) : buffer(std::move(bytes)) {
+    parse(allowTornTail);
+}
+
+// Индексация записей: узлы только запоминаются, декодируются по запросу
+inline void SnapshotReader::parse(bool allowTornTail) {
+    using namespace persistent_snapshot_detail;
+    if (buffer.size() < HEADER_SIZE || std::memcmp(buffer.data(), MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error("Not a snapshot");
+    }
+    Cursor header(buffer.data() + sizeof(MAGIC), buffer.data() + HEADER_SIZE);
+    if (header.fixed(sizeof(FORMAT_VERSION)) != FORMAT_VERSION) {
+        throw std::runtime_error("Unsupported snapshot format version");
+    }
+
+    Cursor in(buffer.data() + HEADER_SIZE, buffer.data() + buffer.size());
+    valid = HEADER_SIZE;
+    while (!in.atEnd()) {
+        char type = 0;
+        uint64_t length = 0;
+        Cursor record = in;
+        try {
+            type = static_cast<char>(in.byte());
+            length = in.varint();
+            record = in.take(length);
+        }
+        catch (const std::runtime_error&) {
+            // Последняя запись оборвана (сбой во время дозаписи)
+            if (!allowTornTail) {
+                throw;
+            }
+            break;
+        }
+        size_t offset = static_cast<size_t>(record.position() - buffer.data());
+
+        if (type == NODE_RECORD) {
+            nodeOffsets.emplace_back(offset, static_cast<size_t>(length));
+        }
+        else if (type == ROOT_RECORD) {
+            RootInfo info;
+            info.kind = static_cast<SnapshotKind>(record.byte());
+            info.type = record.string();
+            info.tag = record.varint();
+            info.offset = static_cast<size_t>(record.position() - buffer.data());
+            info.length = static_cast<size_t>(length) - (info.offset - offset);
+            rootTable.push_back(std::move(info));
+        }
+        else {
+            throw std::runtime_error("Corrupted snapshot");
+        }
+        valid = offset + static_cast<size_t>(length);
+    }
+    decoded.resize(nodeOffsets.size());
+    decodedTypes.resize(nodeOffsets.size(), nullptr);
+}
+
+inline const SnapshotReader::RootInfo& SnapshotReader::root(size_t index) const {
+    if (index >= rootTable.size()) {
+        throw std::out_of_range("Root index out of range");
+    }
+    return rootTable[index];
+}
+
+template<typename S>
+S SnapshotReader::read(size_t index) {
+    const RootInfo& info = root(index);
+    if (info.kind != SnapshotCodec<S>::KIND || info.type != SnapshotCodec<S>::name()) {
+        throw std::runtime_error("Snapshot type mismatch: stored " + info.type +
+            ", requested " + SnapshotCodec<S>::name());
+    }
+    persistent_snapshot_detail::Cursor in(buffer.data() + info.offset,
+        buffer.data() + info.offset + info.length);
+    return SnapshotCodec<S>::read(*this, in);
+}
+
+inline persistent_snapshot_detail::Cursor SnapshotReader::nodeCursor(uint64_t id, uint8_t kind) const {
+    if (id == 0 || id > nodeOffsets.size()) {
+        throw std::runtime_error("Corrupted snapshot");
+    }
+    const auto& [offset, length] = nodeOffsets[id - 1];
+    persistent_snapshot_detail::Cursor in(buffer.data() + offset, buffer.data() + offset + length);
+    if (in.byte() != kind) {
+        throw std::runtime_error("Corrupted snapshot");
+    }
+    return in;
+}
+
+// Потомок всегда записан раньше родителя (защита от циклов)
+inline void SnapshotReader::checkChild(uint64_t child, uint64_t parent) const {
+    if (child >= parent) {
+        throw std::runtime_error("Corrupted snapshot");
+    }
+}
+
+// Корень структуры из дескриптора. Внутри значения узла он записан
+// раньше этого узла - иначе поврежденный номер зациклил бы чтение
+inline uint64_t SnapshotReader::nestedRoot(persistent_snapshot_detail::Cursor& in) const {
+    uint64_t id = in.varint();
+    if (container != 0) {
+        checkChild(id, container);
+    }
+    return id;
+}
+
+// Уже восстановленный узел того же типа (разделение между версиями)
+template<typename N>
+std::shared_ptr<N> SnapshotReader::cached(uint64_t id) const {
+    if (!decoded[id - 1]) {
+        return nullptr;
+    }
+    if (decodedTypes[id - 1] != persistent_snapshot_detail::typeKey<N>()) {
+        throw std::runtime_error("Snapshot type mismatch");
+    }
+    return std::static_pointer_cast<N>(decoded[id - 1]);
+}
+
+template<typename N>
+void SnapshotReader::store(uint64_t id, const std::shared_ptr<N>& node) {
+    decoded[id - 1] = node;
+    decodedTypes[id - 1] = persistent_snapshot_detail::typeKey<N>();
+}
+
+// -----------------------------------------
+// ---------- Восстановление узлов ---------
+// -----------------------------------------
+template<typename T>
+std::shared_ptr<typename PersistentVector<T>::Node> SnapshotReader::vectorNode(uint64_t id) {
+    using Node = typename PersistentVector<T>::Node;
+    using namespace persistent_snapshot_detail;
+    if (id == 0) {
+        return nullptr;
+    }
+    if (auto node = cached<Node>(id)) {
+        return node;
+    }
+
+    Cursor in = nodeCursor(id, VECTOR_NODE);
+    auto node = std::make_shared<Node>();
+    node->count = static_cast<size_t>(in.varint());
+    node->slots = static_cast<size_t>(in.varint());
+    if (node->slots > PersistentVector<T>::BRANCHING_FACTOR) {
+        throw std::runtime_error("Corrupted snapshot");
+    }
+    bool leaf = in.byte() != 0;
+    ContainerScope scope(*this, id);
+    for (size_t i = 0; i < node->slots; ++i) {
+        if (!leaf) {
+            uint64_t child = in.varint();
+            checkChild(child, id);
+            node->children[i] = vectorNode<T>(child);
+        }
+        else if (in.byte()) {
+            node->values[i] = SnapshotCodec<T>::read(*this, in);
+        }
+    }
+    store(id, node);
+    return node;
+}
+
+// Цепочка чанков восстанавливается циклом с конца
+template<typename T>
+std::shared_ptr<typename PersistentList<T>::Node> SnapshotReader::listNode(uint64_t id) {
+    using Node = typename PersistentList<T>::Node;
+    using namespace persistent_snapshot_detail;
+    std::vector<uint64_t> chain;
+    std::shared_ptr<Node> rest;
+    for (uint64_t current = id; current != 0;) {
+        if ((rest = cached<Node>(current))) {
+            break;
+        }
+        chain.push_back(current);
+        Cursor in = nodeCursor(current, LIST_NODE);
+        uint64_t next = in.varint();
+        checkChild(next, current);
+        current = next;
+    }
+
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        Cursor in = nodeCursor(*it, LIST_NODE);
+        in.varint();
+        auto node = std::make_shared<Node>(rest);
+        size_t count = static_cast<size_t>(in.varint());
+        if (count > PersistentList<T>::CHUNK_SIZE) {
+            throw std::runtime_error("Corrupted snapshot");
+        }
+        ContainerScope scope(*this, *it);
+        for (size_t i = 0; i < count; ++i) {
+            node->emplace(SnapshotCodec<T>::read(*this, in));
+        }
+        store(*it, node);
+        rest = std::move(node);
+    }
+    return rest;
+}
+
+template<typename K, typename V>
+std::shared_ptr<typename PersistentMap<K, V>::Node> SnapshotReader::mapNode(uint64_t id) {
+    using Node = typename PersistentMap<K, V>::Node;
+    using namespace persistent_snapshot_detail;
+    if (id == 0) {
+        return nullptr;
+    }
+    if (auto node = cached<Node>(id)) {
+        return node;
+    }
+
+    Cursor in = nodeCursor(id, MAP_NODE);
+    auto node = std::make_shared<Node>();
+    node->bitmap = static_cast<uint32_t>(in.varint());
+    size_t childCount = static_cast<size_t>(in.varint());
+    if (childCount > PersistentMap<K, V>::BRANCHING_FACTOR) {
+        throw std::runtime_error("Corrupted snapshot");
+    }
+    node->children.reserve(childCount);
+    for (size_t i = 0; i < childCount; ++i) {
+        uint64_t child = in.varint();
+        checkChild(child, id);
+        node->children.push_back(mapNode<K, V>(child));
+    }
+    size_t entryCount = static_cast<size_t>(in.varint());
+    node->entries.reserve(entryCount);
+    ContainerScope scope(*this, id);
+    for (size_t i = 0; i < entryCount; ++i) {
+        K key = SnapshotCodec<K>::read(*this, in);
+        V value = SnapshotCodec<V>::read(*this, in);
+        node->entries.emplace_back(std::move(key), std::move(value));
+    }
+    store(id, node);
+    return node;
+}
+
+// -----------------------------------------
+// -------- Дескрипторы структур -----------
+// -----------------------------------------
+template<typename T>
+PersistentVector<T> SnapshotReader::getVector(persistent_snapshot_detail::Cursor& in) {
+    using Data = typename PersistentVector<T>::Data;
+    size_t size = static_cast<size_t>(in.varint());
+    size_t shift = static_cast<size_t>(in.varint());
+    auto root = vectorNode<T>(nestedRoot(in));
+    if (!root || shift % PersistentVector<T>::BITS_PER_LEVEL != 0 || shift >= 64) {
+        throw std::runtime_error("Corrupted snapshot");
+    }
+    return PersistentVector<T>(std::make_shared<Data>(root, size, shift));
+}
+
+template<typename T>
+PersistentList<T> SnapshotReader::getList(persistent_snapshot_detail::Cursor& in) {
+    size_t size = static_cast<size_t>(in.varint());
+    size_t used = static_cast<size_t>(in.varint());
+    auto head = listNode<T>(nestedRoot(in));
+    if ((head ? used > head->count || used == 0 : used != 0) || (size == 0) != !head) {
+        throw std::runtime_error("Corrupted snapshot");
+    }
+    return PersistentList<T>(head, used, size);
+}
+
+template<typename K, typename V>
+PersistentMap<K, V> SnapshotReader::getMap(persistent_snapshot_detail::Cursor& in) {
+    size_t size = static_cast<size_t>(in.varint());
+    auto root = mapNode<K, V>(nestedRoot(in));
+    if (!root) {
+        throw std::runtime_error("Corrupted snapshot");
+    }
+    return PersistentMap<K, V>(root, size);
+}
+
+#endif
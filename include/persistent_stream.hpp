@@ -0,0 +1,147 @@
+#ifndef PERSISTENT_STREAM_HPP
+#define PERSISTENT_STREAM_HPP
+
+#include "persistent_list.hpp"
+#include <memory>
+#include <functional>
+#include <optional>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+// -----------------------------------------
+// ----------- Ленивый поток ---------------
+// -----------------------------------------
+//
+// Персистентный ленивый список:
+// - Хвост потока - отложенное вычисление (thunk), которое
+//   выполняется не более одного раза и запоминается;
+// - Комбинаторы map/filter/takeWhile/take/zip не строят
+//   промежуточных списков: каждый элемент вычисляется только
+//   тогда, когда его запрашивает потребитель;
+// - Поток может быть бесконечным.
+
+template<typename T>
+class PersistentStream {
+private:
+    template<typename U>
+    friend class PersistentStream;
+
+    struct State;
+
+    // -----------------------------------------
+    // ------------ Ячейка потока --------------
+    // -----------------------------------------
+    struct Cell {
+        T value; // Текущий элемент
+        std::shared_ptr<State> rest; // Хвост (nullptr - пустой поток)
+    };
+
+    // -----------------------------------------
+    // -------- Запоминаемое вычисление --------
+    // -----------------------------------------
+    struct State {
+        std::function<std::optional<Cell>()> thunk; // Отложенное вычисление
+        std::optional<Cell> cell; // Результат после вычисления
+        std::once_flag once;
+
+        State(std::function<std::optional<Cell>()> fn) : thunk(std::move(fn)) {}
+        ~State();
+    };
+
+    std::shared_ptr<State> state;
+
+    PersistentStream(std::shared_ptr<State> s) : state(std::move(s)) {}
+
+    // Вычисление головы (nullptr - поток пуст)
+    const Cell* force() const;
+    // Создание потока из отложенного вычисления
+    static PersistentStream<T> lazy(std::function<std::optional<Cell>()> thunk);
+
+public:
+    // -----------------------------------------
+    // -------------- Конструкторы -------------
+    // -----------------------------------------
+    PersistentStream();
+    static PersistentStream<T> fromList(const PersistentList<T>& list);
+    static PersistentStream<T> fromVector(const std::vector<T>& values);
+    // Бесконечный поток seed, f(seed), f(f(seed)), ...
+    template<typename F>
+    static PersistentStream<T> iterate(const T& seed, F next);
+
+    // -----------------------------------------
+    // ------------- Базовый API ---------------
+    // -----------------------------------------
+    bool empty() const; // Вычисляет голову
+    const T& front() const;
+    PersistentStream<T> tail() const;
+    PersistentStream<T> prepend(const T& value) const; // Добавление в начало (без вычисления)
+
+    // -----------------------------------------
+    // -------- Ленивые преобразования ---------
+    // -----------------------------------------
+    template<typename F>
+    PersistentStream<std::decay_t<std::invoke_result_t<F, const T&>>> map(F fn) const;
+    template<typename P>
+    PersistentStream<T> filter(P pred) const;
+    template<typename P>
+    PersistentStream<T> takeWhile(P pred) const;
+    template<typename P>
+    PersistentStream<T> take_while(P pred) const {
+        return takeWhile(pred);
+    }
+    PersistentStream<T> take(size_t n) const;
+    PersistentStream<T> drop(size_t n) const;
+    template<typename U>
+    PersistentStream<std::pair<T, U>> zip(const PersistentStream<U>& other) const;
+
+    // -----------------------------------------
+    // ------------- Преобразования ------------
+    // -----------------------------------------
+    // Вычисляют поток целиком (поток должен быть конечным)
+    std::vector<T> toVector() const;
+    PersistentList<T> toList() const;
+
+    // -----------------------------------------
+    // ----------- Итератор по потоку ----------
+    // -----------------------------------------
+    class Iterator {
+    private:
+        PersistentStream<T> current; // Непройденная часть потока
+
+    public:
+        Iterator(const PersistentStream<T>& s) : current(s) {}
+        // Разыменование указателя (значение)
+        const T& operator*() const {
+            return current.front();
+        }
+        // Следующий элемент
+        Iterator& operator++() {
+            current = current.tail();
+            return *this;
+        }
+        // Итераторы совпадают, когда оба дошли до конца или стоят на одной ячейке
+        bool operator!=(const Iterator& other) const {
+            bool atEnd = current.empty();
+            bool otherAtEnd = other.current.empty();
+            if (atEnd || otherAtEnd) {
+                return atEnd != otherAtEnd;
+            }
+            return current.state != other.current.state;
+        }
+    };
+
+    // Итератор на первый элемент
+    Iterator begin() const {
+        return Iterator(*this);
+    }
+    // Итератор за последний элемент
+    Iterator end() const {
+        return Iterator(PersistentStream<T>());
+    }
+};
+
+#include "persistent_stream_impl.hpp"
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef PERSISTENT_STREAM_IMPL_HPP
+#define PERSISTENT_STREAM_IMPL_HPP
+
+#include "persistent_stream.hpp"
+#include <stdexcept>
+
+// -----------------------------------------
+// ------- Реализация ленивого потока ------
+// -----------------------------------------
+
+// -----------------------------------------
+// ------- Запоминаемое вычисление ---------
+// -----------------------------------------
+// Итеративное освобождение вычисленной цепочки, чтобы не переполнить стек
+template<typename T>
+PersistentStream<T>::State::~State() {
+    std::shared_ptr<State> rest = cell ? std::move(cell->rest) : nullptr;
+    while (rest && rest.use_count() == 1) {
+        std::shared_ptr<State> after = rest->cell ? std::move(rest->cell->rest) : nullptr;
+        rest = std::move(after);
+    }
+}
+
+// Вычисление головы потока (не более одного раза)
+template<typename T>
+const typename PersistentStream<T>::Cell* PersistentStream<T>::force() const {
+    if (!state) {
+        return nullptr;
+    }
+    std::call_once(state->once, [this] {
+        state->cell = state->thunk();
+        state->thunk = nullptr; // Отпускаем захваченный источник
+    });
+    return state->cell ? &*state->cell : nullptr;
+}
+
+// Создание потока из отложенного вычисления
+template<typename T>
+PersistentStream<T> PersistentStream<T>::lazy(std::function<std::optional<Cell>()> thunk) {
+    return PersistentStream<T>(std::make_shared<State>(std::move(thunk)));
+}
+
+// -----------------------------------------
+// -------------- Конструкторы -------------
+// -----------------------------------------
+// Пустой поток
+template<typename T>
+PersistentStream<T>::PersistentStream() : state(nullptr) {}
+
+// Ленивый обход списка (узлы списка не копируются)
+template<typename T>
+PersistentStream<T> PersistentStream<T>::fromList(const PersistentList<T>& list) {
+    return lazy([list]() -> std::optional<Cell> {
+        if (list.empty()) {
+            return std::nullopt;
+        }
+        return Cell{ list.front(), fromList(list.tail()).state };
+    });
+}
+
+// Поток из вектора
+template<typename T>
+PersistentStream<T> PersistentStream<T>::fromVector(const std::vector<T>& values) {
+    return fromList(PersistentList<T>(values));
+}
+
+// Бесконечный поток итераций
+template<typename T>
+template<typename F>
+PersistentStream<T> PersistentStream<T>::iterate(const T& seed, F next) {
+    return lazy([seed, next]() -> std::optional<Cell> {
+        return Cell{ seed, iterate(next(seed), next).state };
+    });
+}
+
+// -----------------------------------------
+// ------------- Базовый API ---------------
+// -----------------------------------------
+template<typename T>
+bool PersistentStream<T>::empty() const {
+    return force() == nullptr;
+}
+
+template<typename T>
+const T& PersistentStream<T>::front() const {
+    const Cell* cell = force();
+    if (!cell) {
+        throw std::runtime_error("Stream is empty");
+    }
+    return cell->value;
+}
+
+template<typename T>
+PersistentStream<T> PersistentStream<T>::tail() const {
+    const Cell* cell = force();
+    if (!cell) {
+        throw std::runtime_error("Cannot get tail of empty stream");
+    }
+    return PersistentStream<T>(cell->rest);
+}
+
+// Добавление в начало: текущий поток становится хвостом без вычисления
+template<typename T>
+PersistentStream<T> PersistentStream<T>::prepend(const T& value) const {
+    auto rest = state;
+    return lazy([value, rest]() -> std::optional<Cell> {
+        return Cell{ value, rest };
+    });
+}
+
+// -----------------------------------------
+// -------- Ленивые преобразования ---------
+// -----------------------------------------
+// Отображение: элемент преобразуется, когда его запрашивают
+template<typename T>
+template<typename F>
+PersistentStream<std::decay_t<std::invoke_result_t<F, const T&>>>
+PersistentStream<T>::map(F fn) const {
+    using U = std::decay_t<std::invoke_result_t<F, const T&>>;
+    using Result = PersistentStream<U>;
+    auto source = *this;
+    return Result::lazy([source, fn]() -> std::optional<typename Result::Cell> {
+        const Cell* cell = source.force();
+        if (!cell) {
+            return std::nullopt;
+        }
+        return typename Result::Cell{ fn(cell->value), PersistentStream<T>(cell->rest).map(fn).state };
+    });
+}
+
+// Фильтрация: пропуск неподходящих элементов идет циклом, без рекурсии
+template<typename T>
+template<typename P>
+PersistentStream<T> PersistentStream<T>::filter(P pred) const {
+    auto source = *this;
+    return lazy([source, pred]() -> std::optional<Cell> {
+        const Cell* cell = source.force();
+        std::shared_ptr<State> keep; // Удерживает текущую ячейку источника
+        while (cell && !pred(cell->value)) {
+            keep = cell->rest;
+            cell = PersistentStream<T>(keep).force();
+        }
+        if (!cell) {
+            return std::nullopt;
+        }
+        return Cell{ cell->value, PersistentStream<T>(cell->rest).filter(pred).state };
+    });
+}
+
+// Префикс, пока выполняется условие
+template<typename T>
+template<typename P>
+PersistentStream<T> PersistentStream<T>::takeWhile(P pred) const {
+    auto source = *this;
+    return lazy([source, pred]() -> std::optional<Cell> {
+        const Cell* cell = source.force();
+        if (!cell || !pred(cell->value)) {
+            return std::nullopt;
+        }
+        return Cell{ cell->value, PersistentStream<T>(cell->rest).takeWhile(pred).state };
+    });
+}
+
+// Первые n элементов
+template<typename T>
+PersistentStream<T> PersistentStream<T>::take(size_t n) const {
+    if (n == 0) {
+        return PersistentStream<T>();
+    }
+    auto source = *this;
+    return lazy([source, n]() -> std::optional<Cell> {
+        const Cell* cell = source.force();
+        if (!cell) {
+            return std::nullopt;
+        }
+        return Cell{ cell->value, PersistentStream<T>(cell->rest).take(n - 1).state };
+    });
+}
+
+// Без первых n элементов (пропуск выполняется при первом обращении)
+template<typename T>
+PersistentStream<T> PersistentStream<T>::drop(size_t n) const {
+    if (n == 0) {
+        return *this;
+    }
+    auto source = *this;
+    return lazy([source, n]() -> std::optional<Cell> {
+        auto current = source;
+        for (size_t i = 0; i < n && !current.empty(); ++i) {
+            current = current.tail();
+        }
+        const Cell* cell = current.force();
+        if (!cell) {
+            return std::nullopt;
+        }
+        return *cell;
+    });
+}
+
+// Попарное объединение двух потоков (до конца более короткого)
+template<typename T>
+template<typename U>
+PersistentStream<std::pair<T, U>> PersistentStream<T>::zip(const PersistentStream<U>& other) const {
+    using Result = PersistentStream<std::pair<T, U>>;
+    auto left = *this;
+    auto right = other;
+    return Result::lazy([left, right]() -> std::optional<typename Result::Cell> {
+        const Cell* a = left.force();
+        if (!a) {
+            return std::nullopt;
+        }
+        const auto* b = right.force();
+        if (!b) {
+            return std::nullopt;
+        }
+        auto rest = PersistentStream<T>(a->rest).zip(PersistentStream<U>(b->rest));
+        return typename Result::Cell{ std::make_pair(a->value, b->value), rest.state };
+    });
+}
+
+// -----------------------------------------
+// ------------- Преобразования ------------
+// -----------------------------------------
+template<typename T>
+std::vector<T> PersistentStream<T>::toVector() const {
+    std::vector<T> result;
+    for (const auto& value : *this) {
+        result.push_back(value);
+    }
+    return result;
+}
+
+template<typename T>
+PersistentList<T> PersistentStream<T>::toList() const {
+    return PersistentList<T>(toVector());
+}
+
+#endif
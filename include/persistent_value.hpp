@@ -1,201 +1,375 @@
-#ifndef PERSISTENT_VALUE_HPP
-#define PERSISTENT_VALUE_HPP
-
-#include <memory>
-#include <variant>
-#include <string>
-#include <vector>
-#include <map>
-#include <optional>
-#include <stdexcept>
-#include <typeindex>
-#include <unordered_map>
-
-// -----------------------------------------
-// ----------- Хранимые значения -----------
-// -----------------------------------------
-// 
-// Вспомогательный класс, который реализует 
-// хранение и утилиты для работы с значениями 
-// и их типами
-template<typename T>
-class PersistentVector;
-
-template<typename T>
-class PersistentList;
-
-template<typename K, typename V>
-class PersistentMap;
-
-enum class ValueType {
-    NULL_VALUE,
-    INT,
-    DOUBLE,
-    BOOL,
-    STRING,
-    VECTOR,
-    LIST,
-    MAP
-};
-
-class PersistentValue {
-private:
-    // структуры для хранения типизированных указателей
-    struct VectorHolder {
-        std::shared_ptr<void> vectorPtr;
-        std::type_index elementType;
-
-        template<typename T>
-        VectorHolder(std::shared_ptr<PersistentVector<T>> ptr)
-            : vectorPtr(ptr), elementType(typeid(T)) {
-        }
-
-        template<typename T>
-        std::shared_ptr<PersistentVector<T>> get() const {
-            if (elementType == typeid(T)) {
-                return std::static_pointer_cast<PersistentVector<T>>(vectorPtr);
-            }
-            return nullptr;
-        }
-
-        std::type_index getElementType() const { return elementType; }
-    };
-
-    struct ListHolder {
-        std::shared_ptr<void> listPtr;
-        std::type_index elementType;
-
-        template<typename T>
-        ListHolder(std::shared_ptr<PersistentList<T>> ptr)
-            : listPtr(ptr), elementType(typeid(T)) {
-        }
-
-        template<typename T>
-        std::shared_ptr<PersistentList<T>> get() const {
-            if (elementType == typeid(T)) {
-                return std::static_pointer_cast<PersistentList<T>>(listPtr);
-            }
-            return nullptr;
-        }
-
-        std::type_index getElementType() const { return elementType; }
-    };
-
-    struct MapHolder {
-        std::shared_ptr<void> mapPtr;
-        std::type_index keyType;
-        std::type_index valueType;
-
-        template<typename K, typename V>
-        MapHolder(std::shared_ptr<PersistentMap<K, V>> ptr)
-            : mapPtr(ptr), keyType(typeid(K)), valueType(typeid(V)) {
-        }
-
-        template<typename K, typename V>
-        std::shared_ptr<PersistentMap<K, V>> get() const {
-            if (keyType == typeid(K) && valueType == typeid(V)) {
-                return std::static_pointer_cast<PersistentMap<K, V>>(mapPtr);
-            }
-            return nullptr;
-        }
-
-        std::type_index getKeyType() const { return keyType; }
-        std::type_index getValueType() const { return valueType; }
-    };
-
-    std::variant<
-        std::monostate,
-        int,
-        double,
-        bool,
-        std::string,
-        std::shared_ptr<VectorHolder>,
-        std::shared_ptr<ListHolder>,
-        std::shared_ptr<MapHolder>
-    > data;
-
-public:
-    // -----------------------------------------
-    // -------------- Конструкторы -------------
-    // -----------------------------------------
-    PersistentValue();
-    PersistentValue(int value);
-    PersistentValue(double value);
-    PersistentValue(bool value);
-    PersistentValue(const std::string& value);
-    PersistentValue(const char* value);
-
-    // -----------------------------------------
-    // -- Конструкторы для кастомных структур --
-    // -----------------------------------------
-    template<typename T>
-    PersistentValue(const PersistentVector<T>& vector);
-
-    template<typename T>
-    PersistentValue(const PersistentList<T>& list);
-
-    template<typename K, typename V>
-    PersistentValue(const PersistentMap<K, V>& map);
-
-    template<typename T>
-    PersistentValue(std::shared_ptr<PersistentVector<T>> vector);
-
-    template<typename T>
-    PersistentValue(std::shared_ptr<PersistentList<T>> list);
-
-    template<typename K, typename V>
-    PersistentValue(std::shared_ptr<PersistentMap<K, V>> map);
-
-    // -----------------------------------------
-    // -------------- Тип данных ---------------
-    // -----------------------------------------
-    ValueType type() const;
-
-    // -----------------------------------------
-    // --------- Проверка типов данных ---------
-    // -----------------------------------------
-    bool isNull() const;
-    bool isInt() const;
-    bool isDouble() const;
-    bool isBool() const;
-    bool isString() const;
-    bool isVector() const;
-    bool isList() const;
-    bool isMap() const;
-
-    // -----------------------------------------
-    // ------- Получение значений данных -------
-    // -----------------------------------------
-    int asInt() const;
-    double asDouble() const;
-    bool asBool() const;
-    std::string asString() const;
-
-    template<typename T>
-    std::shared_ptr<PersistentVector<T>> asVector() const;
-
-    template<typename T>
-    std::shared_ptr<PersistentList<T>> asList() const;
-
-    template<typename K, typename V>
-    std::shared_ptr<PersistentMap<K, V>> asMap() const;
-
-    // для вложенных структур
-    std::type_index getElementType() const;
-    std::type_index getKeyType() const;
-    std::type_index getValueType() const;
-
-    // глубокая копия
-    PersistentValue clone() const;
-
-    // для отладки
-    std::string toString() const;
-
-    // -----------------------------------------
-    // ---- Перегрузка операторов сравнения ----
-    // -----------------------------------------
-    bool operator==(const PersistentValue& other) const;
-    bool operator!=(const PersistentValue& other) const;
-};
-
+#ifndef PERSISTENT_VALUE_HPP
+#define PERSISTENT_VALUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <mutex>
+#include <functional>
+#include <vector>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <typeindex>
+#include <unordered_map>
+#include "persistent_data_structure.hpp"
+
+// -----------------------------------------
+// ----------- Хранимые значения -----------
+// -----------------------------------------
+// 
+// Вспомогательный класс, который реализует 
+// хранение и утилиты для работы с значениями 
+// и их типами
+template<typename T>
+class PersistentVector;
+
+template<typename T>
+class PersistentList;
+
+template<typename K, typename V>
+class PersistentMap;
+
+namespace persistent_value_detail {
+    // Метка типа: адрес статической переменной, один на тип в программе
+    template<typename T>
+    const void* typeId() {
+        static const char id = 0;
+        return &id;
+    }
+}
+
+enum class ValueType {
+    NULL_VALUE,
+    INT,
+    DOUBLE,
+    BOOL,
+    STRING,
+    VECTOR,
+    LIST,
+    MAP
+};
+
+// -----------------------------------------
+// ------- Компактное представление --------
+// -----------------------------------------
+//
+// PersistentValue занимает 16 байт: тег типа и 8 байт данных.
+// - null, int, double и bool хранятся прямо в значении;
+// - строка и вложенная структура - в "коробке" (Box) в куче со
+//   встроенным атомарным счетчиком ссылок. Копия значения только
+//   увеличивает счетчик; структура лежит в коробке сама, без
+//   промежуточного shared_ptr, поэтому доступ к ней - один переход.
+// Тип вложенной структуры определяется по адресу ее описания
+// (StructureType, одно на тип) - без сравнения std::type_index.
+// Шаблоны определены в persistent_value_impl.hpp, поэтому элементы
+// структур могут быть любого типа (int64_t, float, ...) без обертки
+// каждого элемента в PersistentValue.
+class StringPool;
+class PathStep;
+
+// Путь в документе: ключи массивов и индексы векторов, например
+// { "users", 3, "name" }
+using ValuePath = std::vector<PathStep>;
+
+class PersistentValue {
+private:
+    friend class StringPool;
+    friend class HashConsTable;
+
+    // Общая часть коробок: счетчик ссылок
+    struct Box {
+        mutable std::atomic<uint32_t> refs{ 1 };
+    };
+
+    struct StringBox : Box {
+        uint32_t pool = 0; // Номер пула интернирования (0 - строка не интернирована)
+        std::string value;
+
+        explicit StringBox(std::string text) : value(std::move(text)) {
+        }
+    };
+
+    struct StructureBox;
+
+    // Описание типа вложенной структуры
+    struct StructureType {
+        std::type_index elementType; // Элементы вектора и списка, значения массива
+        std::type_index keyType;     // Ключи массива (для вектора и списка - void)
+        const void* elementId;       // Те же типы для быстрой проверки (typeId)
+        const void* keyId;
+        bool (*equals)(const StructureBox*, const StructureBox*);
+        size_t (*hash)(const StructureBox*);
+        void (*destroy)(const StructureBox*);
+        PersistentValue (*deepCopy)(const StructureBox*);
+        PersistentValue (*canonical)(const PersistentValue&, HashConsTable&);
+    };
+
+    struct StructureBox : Box {
+        const StructureType* structureType;
+    };
+
+    template<typename S>
+    struct StructureBoxOf : StructureBox {
+        S structure;
+
+        explicit StructureBoxOf(S value) : structure(std::move(value)) {
+        }
+    };
+
+    // Описание типа S (единственный экземпляр на тип)
+    template<typename S>
+    static const StructureType* structureType();
+
+    // Коробка структуры S, если значение хранит именно ее
+    template<typename S>
+    const StructureBoxOf<S>* structureBox(ValueType expected) const;
+
+    ValueType tag;
+    union {
+        int intValue;
+        double doubleValue;
+        bool boolValue;
+        const Box* box;
+        uint64_t bits; // Все 8 байт данных - для копирования
+    };
+
+    bool boxed() const {
+        return tag >= ValueType::STRING;
+    }
+    // То же самое значение (та же коробка или те же данные)
+    bool identical(const PersistentValue& other) const {
+        return tag == other.tag && bits == other.bits;
+    }
+    PersistentValue updateIn(const ValuePath& path, size_t depth,
+        const std::function<PersistentValue(const PersistentValue&)>& fn) const;
+    const StructureBox* structure() const {
+        return static_cast<const StructureBox*>(box);
+    }
+    void retain() const;
+    void release();
+    static void releaseBox(ValueType kind, const Box* box);
+
+    // Канонизация структуры таблицей хеш-консинга (persistent_hashcons.hpp)
+    template<typename Table, typename S>
+    static bool canonicalizeIn(Table& table, S& structure);
+
+    // shared_ptr на структуру в коробке, разделяющий владение коробкой
+    template<typename S>
+    std::shared_ptr<S> share(const S& structure) const;
+
+public:
+    // -----------------------------------------
+    // -------------- Конструкторы -------------
+    // -----------------------------------------
+    PersistentValue();
+    PersistentValue(int value);
+    PersistentValue(double value);
+    PersistentValue(bool value);
+    PersistentValue(const std::string& value);
+    PersistentValue(std::string&& value);
+    PersistentValue(std::string_view value);
+    PersistentValue(const char* value);
+
+    PersistentValue(const PersistentValue& other);
+    PersistentValue(PersistentValue&& other) noexcept;
+    PersistentValue& operator=(const PersistentValue& other);
+    PersistentValue& operator=(PersistentValue&& other) noexcept;
+    ~PersistentValue();
+
+    // -----------------------------------------
+    // -- Конструкторы для кастомных структур --
+    // -----------------------------------------
+    template<typename T>
+    PersistentValue(const PersistentVector<T>& vector);
+
+    template<typename T>
+    PersistentValue(const PersistentList<T>& list);
+
+    template<typename K, typename V>
+    PersistentValue(const PersistentMap<K, V>& map);
+
+    template<typename T>
+    PersistentValue(std::shared_ptr<PersistentVector<T>> vector);
+
+    template<typename T>
+    PersistentValue(std::shared_ptr<PersistentList<T>> list);
+
+    template<typename K, typename V>
+    PersistentValue(std::shared_ptr<PersistentMap<K, V>> map);
+
+    // -----------------------------------------
+    // -------------- Тип данных ---------------
+    // -----------------------------------------
+    ValueType type() const;
+
+    // -----------------------------------------
+    // --------- Проверка типов данных ---------
+    // -----------------------------------------
+    bool isNull() const;
+    bool isInt() const;
+    bool isDouble() const;
+    bool isBool() const;
+    bool isString() const;
+    bool isVector() const;
+    bool isList() const;
+    bool isMap() const;
+
+    // -----------------------------------------
+    // ------- Получение значений данных -------
+    // -----------------------------------------
+    int asInt() const;
+    double asDouble() const;
+    bool asBool() const;
+    const std::string& asString() const;
+    std::string_view asStringView() const;
+
+    template<typename T>
+    std::shared_ptr<PersistentVector<T>> asVector() const;
+
+    template<typename T>
+    std::shared_ptr<PersistentList<T>> asList() const;
+
+    template<typename K, typename V>
+    std::shared_ptr<PersistentMap<K, V>> asMap() const;
+
+    // Ссылка на структуру внутри значения - без выделения памяти
+    // и счетчиков ссылок (действительна, пока живет значение)
+    template<typename T>
+    const PersistentVector<T>& vectorRef() const;
+
+    template<typename T>
+    const PersistentList<T>& listRef() const;
+
+    template<typename K, typename V>
+    const PersistentMap<K, V>& mapRef() const;
+
+    // Тип элементов вектора и списка (значений массива) и тип ключей
+    // массива; сравнение адресов меток, без std::type_index
+    template<typename T>
+    bool hasElementType() const;
+    template<typename K>
+    bool hasKeyType() const;
+
+    // для вложенных структур
+    std::type_index getElementType() const;
+    std::type_index getKeyType() const;
+    std::type_index getValueType() const;
+
+    // Копия за O(1): данные неизменяемы, поэтому копия разделяет
+    // строку или структуру с исходным значением
+    PersistentValue clone() const;
+    // Полная копия на новых узлах (например, для переноса в другой
+    // аллокатор); вложенные PersistentValue копируются рекурсивно
+    PersistentValue deepCopy() const;
+
+    // -----------------------------------------
+    // -------- Вложенные изменения по пути ----
+    // -----------------------------------------
+    // Ключ пути - PersistentMap<std::string, PersistentValue>, индекс -
+    // PersistentVector<PersistentValue>. Копируются только узлы вдоль
+    // пути, остальные поддеревья документа разделяются с исходным.
+    // Отсутствующий ключ создается (промежуточные уровни - пустыми
+    // массивами), индекс, равный размеру вектора, добавляет элемент.
+    PersistentValue setIn(const ValuePath& path, PersistentValue value) const;
+    // fn получает текущее значение (null, если его нет)
+    PersistentValue updateIn(const ValuePath& path,
+        const std::function<PersistentValue(const PersistentValue&)>& fn) const;
+    // Значение по пути или nullopt, если его нет
+    std::optional<PersistentValue> getIn(const ValuePath& path) const;
+
+    // JSON-представление (JsonWriter, persistent_json.hpp)
+    std::string toString() const;
+
+    // -----------------------------------------
+    // ---- Перегрузка операторов сравнения ----
+    // -----------------------------------------
+    // Вложенные структуры сравниваются по содержимому; одна и та же
+    // структура (или общие узлы двух версий) - за O(1)
+    bool operator==(const PersistentValue& other) const;
+    bool operator!=(const PersistentValue& other) const;
+    size_t hash() const; // Согласован с ==
+};
+
+// -----------------------------------------
+// -------------- Шаг пути -----------------
+// -----------------------------------------
+class PathStep {
+public:
+    PathStep(const char* key) : name(key) {
+    }
+    PathStep(std::string key) : name(std::move(key)) {
+    }
+    PathStep(std::string_view key) : name(key) {
+    }
+    PathStep(size_t index) : position(index), indexed(true) {
+    }
+    PathStep(int index) : position(static_cast<size_t>(index)), indexed(true) {
+        if (index < 0) {
+            throw std::out_of_range("Negative path index");
+        }
+    }
+
+    bool isIndex() const {
+        return indexed;
+    }
+    const std::string& key() const {
+        return name;
+    }
+    size_t index() const {
+        return position;
+    }
+
+private:
+    std::string name;
+    size_t position = 0;
+    bool indexed = false;
+};
+
+// -----------------------------------------
+// ------- Интернирование строк ------------
+// -----------------------------------------
+//
+// Пул хранит каждую строку один раз: повторные ключи и строки-
+// перечисления разделяют одну коробку, а строки одного пула
+// сравниваются по адресу. Пул может быть глобальным (global())
+// или локальным для набора документов; значения переживают пул.
+//
+//   PersistentValue status = StringPool::global().intern("active");
+class StringPool {
+public:
+    StringPool();
+    ~StringPool();
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    static StringPool& global();
+
+    PersistentValue intern(std::string_view text);
+
+    // Освобождение строк, на которые ссылается только пул
+    size_t prune();
+    size_t size() const;
+
+private:
+    using StringBox = PersistentValue::StringBox;
+
+    uint32_t id;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string_view, const StringBox*> entries; // Ключ указывает в коробку
+};
+
+namespace std {
+    template<>
+    struct hash<PersistentValue> {
+        size_t operator()(const PersistentValue& value) const {
+            return value.hash();
+        }
+    };
+}
+
+#include "persistent_value_impl.hpp"
+
 #endif
\ No newline at end of file
@@ -0,0 +1,275 @@
+#ifndef PERSISTENT_VALUE_IMPL_HPP
+#define PERSISTENT_VALUE_IMPL_HPP
+
+#include "persistent_value.hpp"
+#include "persistent_vector.hpp"
+#include "persistent_list.hpp"
+#include "persistent_map.hpp"
+#include "persistent_hashcons.hpp"
+#include <type_traits>
+#include <typeinfo>
+
+// -----------------------------------------
+// -------- Реализация шаблонов значений ---
+// -----------------------------------------
+//
+// Определения в заголовке: вложенная структура может иметь любой
+// тип элементов (int64_t, float, собственные структуры), описание
+// типа создается при первом использовании, без списка явных
+// инстанцирований.
+
+namespace persistent_value_detail {
+    // Типы элементов и ключей структуры (для getElementType/getKeyType)
+    template<typename S>
+    struct StructureTraits;
+
+    template<typename T>
+    struct StructureTraits<PersistentVector<T>> {
+        using Element = T;
+        using Key = void;
+    };
+
+    template<typename T>
+    struct StructureTraits<PersistentList<T>> {
+        using Element = T;
+        using Key = void;
+    };
+
+    template<typename K, typename V>
+    struct StructureTraits<PersistentMap<K, V>> {
+        using Element = V;
+        using Key = K;
+    };
+
+    // Сравнимы ли элементы через ==. Без сравнения элементов равны
+    // только значения с общей коробкой (проверяется до equals)
+    template<typename T, typename = void>
+    struct equatable : std::false_type {};
+
+    template<typename T>
+    struct equatable<T, std::void_t<decltype(std::declval<const T&>() == std::declval<const T&>())>>
+        : std::true_type {};
+
+    // Глубокое копирование: структуры собираются заново на месте
+    // (rvalue-перегрузки), вложенные значения копируются рекурсивно
+    template<typename T>
+    T copyElement(const T& value) {
+        if constexpr (std::is_same_v<T, PersistentValue>) {
+            return value.deepCopy();
+        }
+        else {
+            return value;
+        }
+    }
+
+    template<typename T>
+    PersistentVector<T> copyStructure(const PersistentVector<T>& vector) {
+        PersistentVector<T> result;
+        for (const auto& item : vector) {
+            result = std::move(result).append(copyElement(item));
+        }
+        return result;
+    }
+
+    template<typename T>
+    PersistentList<T> copyStructure(const PersistentList<T>& list) {
+        std::vector<T> items = list.toVector();
+        for (size_t i = 0; i < items.size(); ++i) {
+            items[i] = copyElement(static_cast<const T&>(items[i]));
+        }
+        return PersistentList<T>(items);
+    }
+
+    template<typename K, typename V>
+    PersistentMap<K, V> copyStructure(const PersistentMap<K, V>& map) {
+        PersistentMap<K, V> result;
+        for (const auto& entry : map) {
+            result = std::move(result).set(entry.first, copyElement(entry.second));
+        }
+        return result;
+    }
+}
+
+// -----------------------------------------
+// ------------- Коробки структур ----------
+// -----------------------------------------
+// Описание - статическая переменная встроенной функции: одна на тип
+// во всей программе, поэтому тип проверяется сравнением адресов
+template<typename S>
+const PersistentValue::StructureType* PersistentValue::structureType() {
+    using Box = StructureBoxOf<S>;
+    using Traits = persistent_value_detail::StructureTraits<S>;
+    static const StructureType type = {
+        typeid(typename Traits::Element),
+        typeid(typename Traits::Key),
+        persistent_value_detail::typeId<typename Traits::Element>(),
+        persistent_value_detail::typeId<typename Traits::Key>(),
+        [](const StructureBox* a, const StructureBox* b) {
+            if constexpr (persistent_value_detail::equatable<typename Traits::Element>::value) {
+                return static_cast<const Box*>(a)->structure == static_cast<const Box*>(b)->structure;
+            }
+            else {
+                return false;
+            }
+        },
+        [](const StructureBox* box) -> size_t {
+            if constexpr (persistent_hash_detail::hashable<S>::value) {
+                return static_cast<const Box*>(box)->structure.hash();
+            }
+            else {
+                throw std::runtime_error("Structure elements are not hashable");
+            }
+        },
+        [](const StructureBox* box) {
+            delete static_cast<const Box*>(box);
+        },
+        [](const StructureBox* box) {
+            return PersistentValue(persistent_value_detail::copyStructure(static_cast<const Box*>(box)->structure));
+        },
+        [](const PersistentValue& value, HashConsTable& table) {
+            // Без хеша элементов узлы не канонизируются
+            if constexpr (persistent_hash_detail::hashable<S>::value) {
+                S structure = static_cast<const Box*>(value.structure())->structure;
+                return canonicalizeIn(table, structure) ? PersistentValue(structure) : value;
+            }
+            else {
+                return value;
+            }
+        }
+    };
+    return &type;
+}
+
+template<typename S>
+const PersistentValue::StructureBoxOf<S>* PersistentValue::structureBox(ValueType expected) const {
+    if (tag != expected || structure()->structureType != structureType<S>()) {
+        return nullptr;
+    }
+    return static_cast<const StructureBoxOf<S>*>(box);
+}
+
+// Таблица зависит от параметра шаблона: persistent_hashcons.hpp
+// может быть включен после этого файла
+template<typename Table, typename S>
+bool PersistentValue::canonicalizeIn(Table& table, S& structure) {
+    return table.canonicalize(structure);
+}
+
+// -----------------------------------------
+// -------------- Конструкторы -------------
+// -----------------------------------------
+template<typename T>
+PersistentValue::PersistentValue(const PersistentVector<T>& vector) : tag(ValueType::VECTOR) {
+    auto created = new StructureBoxOf<PersistentVector<T>>(vector);
+    created->structureType = structureType<PersistentVector<T>>();
+    box = created;
+}
+
+template<typename T>
+PersistentValue::PersistentValue(const PersistentList<T>& list) : tag(ValueType::LIST) {
+    auto created = new StructureBoxOf<PersistentList<T>>(list);
+    created->structureType = structureType<PersistentList<T>>();
+    box = created;
+}
+
+template<typename K, typename V>
+PersistentValue::PersistentValue(const PersistentMap<K, V>& map) : tag(ValueType::MAP) {
+    auto created = new StructureBoxOf<PersistentMap<K, V>>(map);
+    created->structureType = structureType<PersistentMap<K, V>>();
+    box = created;
+}
+
+template<typename T>
+PersistentValue::PersistentValue(std::shared_ptr<PersistentVector<T>> vector)
+    : PersistentValue(*vector) {
+}
+
+template<typename T>
+PersistentValue::PersistentValue(std::shared_ptr<PersistentList<T>> list)
+    : PersistentValue(*list) {
+}
+
+template<typename K, typename V>
+PersistentValue::PersistentValue(std::shared_ptr<PersistentMap<K, V>> map)
+    : PersistentValue(*map) {
+}
+
+// -----------------------------------------
+// ---- Получение значений с проверкой -----
+// -----------------------------------------
+// Ссылки на структуру внутри коробки
+template<typename T>
+const PersistentVector<T>& PersistentValue::vectorRef() const {
+    if (!isVector()) {
+        throw std::runtime_error("Not a vector");
+    }
+    auto holder = structureBox<PersistentVector<T>>(ValueType::VECTOR);
+    if (!holder) {
+        throw std::runtime_error("Vector type mismatch");
+    }
+    return holder->structure;
+}
+
+template<typename T>
+const PersistentList<T>& PersistentValue::listRef() const {
+    if (!isList()) {
+        throw std::runtime_error("Not a list");
+    }
+    auto holder = structureBox<PersistentList<T>>(ValueType::LIST);
+    if (!holder) {
+        throw std::runtime_error("List type mismatch");
+    }
+    return holder->structure;
+}
+
+template<typename K, typename V>
+const PersistentMap<K, V>& PersistentValue::mapRef() const {
+    if (!isMap()) {
+        throw std::runtime_error("Not a map");
+    }
+    auto holder = structureBox<PersistentMap<K, V>>(ValueType::MAP);
+    if (!holder) {
+        throw std::runtime_error("Map type mismatch");
+    }
+    return holder->structure;
+}
+
+// Указатель разделяет владение коробкой со значением
+template<typename S>
+std::shared_ptr<S> PersistentValue::share(const S& structure) const {
+    retain();
+    ValueType kind = tag;
+    const Box* owner = box;
+    return std::shared_ptr<S>(const_cast<S*>(&structure), [kind, owner](S*) {
+        releaseBox(kind, owner);
+    });
+}
+
+template<typename T>
+std::shared_ptr<PersistentVector<T>> PersistentValue::asVector() const {
+    return share(vectorRef<T>());
+}
+
+template<typename T>
+std::shared_ptr<PersistentList<T>> PersistentValue::asList() const {
+    return share(listRef<T>());
+}
+
+template<typename K, typename V>
+std::shared_ptr<PersistentMap<K, V>> PersistentValue::asMap() const {
+    return share(mapRef<K, V>());
+}
+
+// Тип элементов - по адресу метки типа, без std::type_index
+template<typename T>
+bool PersistentValue::hasElementType() const {
+    return (isVector() || isList() || isMap()) &&
+        structure()->structureType->elementId == persistent_value_detail::typeId<T>();
+}
+
+template<typename K>
+bool PersistentValue::hasKeyType() const {
+    return isMap() && structure()->structureType->keyId == persistent_value_detail::typeId<K>();
+}
+
+#endif
@@ -1,154 +1,383 @@
-#ifndef PERSISTENT_VECTOR_HPP
-#define PERSISTENT_VECTOR_HPP
-
-#include "persistent_data_structure.hpp"
-#include <memory>
-#include <vector>
-#include <optional>
-#include <cstdint>
-#include <stdexcept>
-
-// -----------------------------------------
-// ---------------- Массив -----------------
-// -----------------------------------------
-// 
-// Реализация массива через Bitmapped Vector Trie:
-// - Каждый узел дерева хранит фиксированное число потомков;
-// - Глубина дерева зависит от длины вектора;
-// - Листья являются элементами вектора.
-
-template<typename T>
-class PersistentVector : public IPersistentStructure<T> {
-private:
-    // -----------------------------------------
-    // ----------- Константы дерева ------------
-    // -----------------------------------------
-    static constexpr size_t BRANCHING_FACTOR = 32; // Количество потомков в узле
-    static constexpr size_t BITS_PER_LEVEL = 5; // Уровень ветвления
-    static constexpr size_t BIT_MASK = BRANCHING_FACTOR - 1; // Битовая маска
-
-    // -----------------------------------------
-    // ------------ Структура узла -------------
-    // -----------------------------------------
-    struct Node {
-        std::shared_ptr<Node> children[BRANCHING_FACTOR]; // Потомки
-        std::optional<T> values[BRANCHING_FACTOR];  // Значения
-        size_t count = 0;
-
-        Node() = default;
-        // -----------------------------------------
-        // ----------- Клонирование узла -----------
-        // -----------------------------------------
-        std::shared_ptr<Node> clone() const {
-            auto new_node = std::make_shared<Node>();
-            for (size_t i = 0; i < BRANCHING_FACTOR; ++i) {
-                new_node->children[i] = children[i];
-                new_node->values[i] = values[i];
-            }
-            new_node->count = count;
-            return new_node;
-        }
-    };
-    // -----------------------------------------
-    // ----------- Структура дерева ------------
-    // -----------------------------------------
-    struct Data {
-        std::shared_ptr<Node> root;
-        size_t size; // Размер
-        size_t shift; // Смещение
-
-        Data() : root(std::make_shared<Node>()), size(0), shift(BITS_PER_LEVEL) {}
-        Data(std::shared_ptr<Node> r, size_t s, size_t sh) : root(r), size(s), shift(sh) {}
-    };
-
-    std::shared_ptr<Data> data;
-
-    // Клонирование метода с изменением данных
-    std::shared_ptr<typename PersistentVector<T>::Node>
-        assocNode(std::shared_ptr<typename PersistentVector<T>::Node> node,
-            size_t shift, size_t index, const T& value) const;
-
-    // Получение значения по индексу
-    const T& getNodeValue(size_t index) const;
-    // Добавление элемента в конец
-    std::shared_ptr<Data> push(const T& value) const;
-
-public:
-    // -----------------------------------------
-    // -------------- Конструкторы -------------
-    // -----------------------------------------
-    PersistentVector();
-    PersistentVector(const std::vector<T>& values);
-
-    // -----------------------------------------
-    // ---------- IPersistentStructure ---------
-    // -----------------------------------------
-    size_t size() const override;
-    bool empty() const override;
-    std::shared_ptr<IPersistentStructure<T>> clear() const override;
-    std::shared_ptr<IPersistentStructure<T>> clone() const override;
-
-    // -----------------------------------------
-    // ---------- Перекрытие операторов --------
-    // -----------------------------------------
-    const T& operator[](size_t index) const;
-    const T& get(size_t index) const;
-
-    // Установка по индексу нового элемента
-    PersistentVector<T> set(size_t index, const T& value) const;
-    // Добавление элемента в конец
-    PersistentVector<T> append(const T& value) const;
-    PersistentVector<T> push_back(const T& value) const {
-        return append(value);
-    }
-    // Удаление элемента
-    PersistentVector<T> pop_back() const;
-
-    // -----------------------------------------
-    // ----------- Итератор по дереву ----------
-    // -----------------------------------------
-    class Iterator {
-    private:
-        const PersistentVector* vec;  // Указатель на вектор
-        size_t index; // Текущий индекс
-
-    public:
-        // -----------------------------------------
-        // -------------- Конструктор --------------
-        // -----------------------------------------
-        Iterator(const PersistentVector* v, size_t i) : vec(v), index(i) {}
-        // -----------------------------------------
-        // ---------- Перекрытие операторов --------
-        // -----------------------------------------
-        // Разыменование указателя (значение)
-        T operator*() const {
-            return (*vec)[index];
-        }
-        // Следующий элемент
-        Iterator& operator++() {
-            ++index;
-            return *this;
-        }
-        // Оператор неравенства
-        bool operator!=(const Iterator& other) const {
-            return vec != other.vec || index != other.index;
-        }
-    };
-    // -----------------------------------------
-    // ------------ Для работы цикла -----------
-    // -----------------------------------------
-    // Итератор на первый элемент
-    Iterator begin() const {
-        return Iterator(this, 0);
-    }
-    // Итератор за последний эелемент
-    Iterator end() const {
-        return Iterator(this, size());
-    }
-    // Преобразования
-    std::vector<T> toStdVector() const;
-};
-
-#include "persistent_vector_impl.hpp"
-
+#ifndef PERSISTENT_VECTOR_HPP
+#define PERSISTENT_VECTOR_HPP
+
+#include "persistent_data_structure.hpp"
+#include "persistent_reclaimer.hpp"
+#include "persistent_parallel.hpp"
+#include <memory>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <cstring>
+#include <functional>
+
+// -----------------------------------------
+// ---------------- Массив -----------------
+// -----------------------------------------
+// 
+// Реализация массива через Bitmapped Vector Trie:
+// - Каждый узел дерева хранит фиксированное число потомков;
+// - Глубина дерева зависит от длины вектора;
+// - Листья являются элементами вектора.
+
+template<typename T>
+class PersistentVector : public IPersistentStructure<T> {
+private:
+    friend class SnapshotWriter;
+    friend class SnapshotReader;
+    friend class MappedSnapshotWriter;
+    friend class HashConsTable;
+
+    // -----------------------------------------
+    // ----------- Константы дерева ------------
+    // -----------------------------------------
+    static constexpr size_t BRANCHING_FACTOR = 32; // Количество потомков в узле
+    static constexpr size_t BITS_PER_LEVEL = 5; // Уровень ветвления
+    static constexpr size_t BIT_MASK = BRANCHING_FACTOR - 1; // Битовая маска
+    // Значения листа можно копировать побайтно (числа, POD-структуры)
+    static constexpr bool TRIVIAL_VALUES =
+        std::is_trivially_copyable_v<T> && std::is_trivially_copyable_v<std::optional<T>>;
+
+    // -----------------------------------------
+    // ------------ Структура узла -------------
+    // -----------------------------------------
+    struct Node {
+        std::shared_ptr<Node> children[BRANCHING_FACTOR]; // Потомки
+        std::optional<T> values[BRANCHING_FACTOR];  // Значения
+        size_t count = 0;
+        size_t slots = 0; // Ячейки за этой границей пусты
+        persistent_hash_detail::NodeHash merkle; // Хеш содержимого поддерева
+
+        Node() = default;
+
+        // Отметка о заполнении ячейки pos
+        void touch(size_t pos) {
+            if (pos >= slots) {
+                slots = pos + 1;
+            }
+        }
+        // -----------------------------------------
+        // ----------- Клонирование узла -----------
+        // -----------------------------------------
+        // Копируются только заполненные ячейки; значения тривиальных
+        // типов - одним memcpy, пустые потомки не трогают счетчики ссылок
+        std::shared_ptr<Node> clone() const {
+            auto new_node = std::make_shared<Node>();
+            if constexpr (TRIVIAL_VALUES) {
+                std::memcpy(static_cast<void*>(new_node->values),
+                    static_cast<const void*>(values), slots * sizeof(std::optional<T>));
+            }
+            else {
+                for (size_t i = 0; i < slots; ++i) {
+                    if (values[i]) {
+                        new_node->values[i] = values[i];
+                    }
+                }
+            }
+            for (size_t i = 0; i < slots; ++i) {
+                if (children[i]) {
+                    new_node->children[i] = children[i];
+                }
+            }
+            new_node->count = count;
+            new_node->slots = slots;
+            size_t hash;
+            if (merkle.get(hash)) {
+                new_node->merkle.set(hash);
+            }
+            return new_node;
+        }
+    };
+    // -----------------------------------------
+    // ----------- Структура дерева ------------
+    // -----------------------------------------
+    struct Data {
+        std::shared_ptr<Node> root;
+        size_t size; // Размер
+        size_t shift; // Смещение
+
+        Data() : root(std::make_shared<Node>()), size(0), shift(BITS_PER_LEVEL) {}
+        Data(std::shared_ptr<Node> r, size_t s, size_t sh) : root(r), size(s), shift(sh) {}
+    };
+
+    std::shared_ptr<Data> data;
+
+    PersistentVector(std::shared_ptr<Data> d) : data(std::move(d)) {}
+
+    // Клонирование пути с изменением данных.
+    // init записывает значение прямо в ячейку листа; при inPlace
+    // узлы, которыми владеет только эта версия, изменяются на месте.
+    template<typename Init>
+    std::shared_ptr<Node> assocNode(const std::shared_ptr<Node>& node,
+        size_t shift, size_t index, Init& init, bool inPlace) const;
+
+    // Получение значения по индексу
+    const T& getNodeValue(size_t index) const;
+    // Добавление элемента в конец
+    template<typename Init>
+    std::shared_ptr<Data> push(Init& init, bool inPlace) const;
+    // Установка значения по индексу
+    template<typename Init>
+    std::shared_ptr<Data> assoc(size_t index, Init& init, bool inPlace) const;
+    // Спуск к элементу с изменением через fn; путь копируется
+    // только если fn вернула новое значение
+    template<typename F>
+    std::shared_ptr<Node> modifyNode(const std::shared_ptr<Node>& node,
+        size_t shift, size_t index, F& fn) const;
+
+    // Удаление последнего элемента с копированием пути; при inPlace
+    // узлы, которыми владеет только эта версия, изменяются на месте
+    std::shared_ptr<Data> pop(bool inPlace) const;
+    std::shared_ptr<Node> popNode(const std::shared_ptr<Node>& node, size_t shift, size_t index,
+        bool inPlace) const;
+
+    // -----------------------------------------
+    // ---------- Пакетные изменения -----------
+    // -----------------------------------------
+    // Поддерево с пакетом не меньше этого размера собирается параллельно
+    static constexpr size_t PARALLEL_BATCH = 4096;
+
+    // Пакет упорядочен по индексу: элементы одного поддерева идут
+    // подряд, граница поддерева находится двоичным поиском (lower)
+
+    // Значения по индексам; при повторе индекса действует последнее
+    struct ValueBatch {
+        std::vector<std::pair<size_t, const T*>> items;
+
+        size_t size() const {
+            return items.size();
+        }
+        size_t index(size_t i) const {
+            return items[i].first;
+        }
+        size_t lower(size_t from, size_t to, size_t index) const;
+        void apply(size_t i, std::optional<T>& slot) const {
+            slot = *items[i].second;
+        }
+    };
+
+    // Отрезок [first, first + count); новое значение - fn(старое)
+    template<typename F>
+    struct RangeBatch {
+        size_t first;
+        size_t count;
+        F& fn;
+
+        size_t size() const {
+            return count;
+        }
+        size_t index(size_t i) const {
+            return first + i;
+        }
+        size_t lower(size_t from, size_t to, size_t index) const {
+            size_t offset = index - first;
+            return offset < from ? from : (offset < to ? offset : to);
+        }
+        void apply(size_t, std::optional<T>& slot) const {
+            slot = fn(static_cast<const T&>(*slot));
+        }
+    };
+
+    // Каждый затронутый узел копируется один раз; потомки с большими
+    // частями пакета собираются на PersistentThreadPool
+    template<typename Batch>
+    std::shared_ptr<Node> updateNode(const std::shared_ptr<Node>& node, size_t shift,
+        size_t from, size_t to, const Batch& batch, bool inPlace) const;
+    template<typename Batch>
+    std::shared_ptr<Data> updateMany(const Batch& batch, bool inPlace) const;
+    ValueBatch valueBatch(const std::vector<size_t>& indices, const std::vector<T>& values) const;
+
+    // Сборка снизу вверх за O(n): листья заполняются напрямую
+    // (fill(i, slot) записывает i-й элемент), уровни родителей - за
+    // один проход; большие уровни делятся между потоками пула
+    template<typename Fill>
+    static std::shared_ptr<Data> build(size_t size, Fill&& fill);
+    static void collect(const Node* node, size_t shift, std::vector<T>& out, size_t size);
+
+    // Сравнение первых count элементов поддерева
+    static bool nodesEqual(const Node* a, const Node* b, size_t shift, size_t count);
+
+    // Хеши Меркла: сумма вкладов ячеек, вклад зависит от позиции.
+    // Сумма позволяет обновить хеш копии узла по разнице одной ячейки.
+    static constexpr bool MERKLE = persistent_hash_detail::hashable<T>::value;
+    static bool hashing(); // Режим PersistentHashing включен и T хешируется
+    static size_t valueTerm(size_t pos, const std::optional<T>& value);
+    static size_t childTerm(size_t pos, const Node* child, size_t shift);
+    static size_t nodeHash(const Node* node, size_t shift);
+
+public:
+    // -----------------------------------------
+    // -------------- Конструкторы -------------
+    // -----------------------------------------
+    PersistentVector();
+    PersistentVector(const std::vector<T>& values);
+    PersistentVector(std::vector<T>&& values);
+    PersistentVector(const T* first, const T* last); // Непрерывный диапазон
+    PersistentVector(const PersistentVector& other) = default;
+    PersistentVector(PersistentVector&& other) noexcept = default;
+    PersistentVector& operator=(PersistentVector other) noexcept;
+    // Освобождение версии (через сборщик, если он включен)
+    ~PersistentVector() override;
+
+    // -----------------------------------------
+    // ---------- IPersistentStructure ---------
+    // -----------------------------------------
+    size_t size() const override;
+    bool empty() const override;
+    std::shared_ptr<IPersistentStructure<T>> clear() const override;
+    std::shared_ptr<IPersistentStructure<T>> clone() const override;
+
+    // -----------------------------------------
+    // ---------- Перекрытие операторов --------
+    // -----------------------------------------
+    const T& operator[](size_t index) const;
+    const T& get(size_t index) const;
+
+    // -----------------------------------------
+    // --------- Модификации (версии) ----------
+    // -----------------------------------------
+    // Перегрузки для rvalue (std::move(vec).append(x)) переиспользуют
+    // узлы, которыми владеет только эта версия, вместо копирования пути.
+
+    // Установка по индексу нового элемента
+    PersistentVector<T> set(size_t index, const T& value) const&;
+    PersistentVector<T> set(size_t index, T&& value) const&;
+    PersistentVector<T> set(size_t index, const T& value) &&;
+    PersistentVector<T> set(size_t index, T&& value) &&;
+    // Конструирование нового элемента на месте по индексу
+    template<typename... Args>
+    PersistentVector<T> emplace(size_t index, Args&&... args) const&;
+    template<typename... Args>
+    PersistentVector<T> emplace(size_t index, Args&&... args) &&;
+    // Изменение элемента за один спуск: fn(элемент) возвращает
+    // std::optional<T>, пустой результат оставляет вектор прежним
+    // (возвращается та же версия без копирования пути)
+    template<typename F>
+    PersistentVector<T> update(size_t index, F fn) const;
+
+    // Добавление элемента в конец
+    PersistentVector<T> append(const T& value) const&;
+    PersistentVector<T> append(T&& value) const&;
+    PersistentVector<T> append(const T& value) &&;
+    PersistentVector<T> append(T&& value) &&;
+    // Конструирование элемента на месте в конце
+    template<typename... Args>
+    PersistentVector<T> emplace_back(Args&&... args) const&;
+    template<typename... Args>
+    PersistentVector<T> emplace_back(Args&&... args) &&;
+
+    PersistentVector<T> push_back(const T& value) const& {
+        return append(value);
+    }
+    PersistentVector<T> push_back(T&& value) const& {
+        return append(std::move(value));
+    }
+    PersistentVector<T> push_back(const T& value) && {
+        return std::move(*this).append(value);
+    }
+    PersistentVector<T> push_back(T&& value) && {
+        return std::move(*this).append(std::move(value));
+    }
+    // Удаление элемента
+    PersistentVector<T> pop_back() const&;
+    PersistentVector<T> pop_back() &&;
+
+    // Пакетная установка: индексы группируются по поддеревьям, каждый
+    // затронутый узел копируется один раз, независимые поддеревья
+    // большого пакета собираются параллельно. При повторе индекса
+    // действует последнее значение.
+    PersistentVector<T> setMany(const std::vector<size_t>& indices, const std::vector<T>& values) const&;
+    PersistentVector<T> setMany(const std::vector<size_t>& indices, const std::vector<T>& values) &&;
+    // Замена элементов [first, last) на fn(элемент). fn вызывается
+    // с нескольких потоков и не должна иметь общего изменяемого состояния.
+    template<typename F>
+    PersistentVector<T> update(size_t first, size_t last, F fn) const&;
+    template<typename F>
+    PersistentVector<T> update(size_t first, size_t last, F fn) &&;
+
+    // -----------------------------------------
+    // ----------- Итератор по дереву ----------
+    // -----------------------------------------
+    class Iterator {
+    private:
+        const PersistentVector* vec;  // Указатель на вектор
+        size_t index; // Текущий индекс
+
+    public:
+        // -----------------------------------------
+        // -------------- Конструктор --------------
+        // -----------------------------------------
+        Iterator(const PersistentVector* v, size_t i) : vec(v), index(i) {}
+        // -----------------------------------------
+        // ---------- Перекрытие операторов --------
+        // -----------------------------------------
+        // Разыменование указателя (ссылка на элемент в узле)
+        const T& operator*() const {
+            return (*vec)[index];
+        }
+        // Следующий элемент
+        Iterator& operator++() {
+            ++index;
+            return *this;
+        }
+        // Оператор неравенства
+        bool operator!=(const Iterator& other) const {
+            return vec != other.vec || index != other.index;
+        }
+    };
+    // -----------------------------------------
+    // ------------ Для работы цикла -----------
+    // -----------------------------------------
+    // Итератор на первый элемент
+    Iterator begin() const {
+        return Iterator(this, 0);
+    }
+    // Итератор за последний эелемент
+    Iterator end() const {
+        return Iterator(this, size());
+    }
+    // Преобразования
+    std::vector<T> toStdVector() const;
+
+    // Отсортированная версия: части сортируются на потоках пула и
+    // попарно сливаются, вектор собирается снизу вверх. cmp вызывается
+    // с нескольких потоков.
+    template<typename Compare = std::less<T>>
+    PersistentVector<T> sorted(Compare cmp = Compare()) const;
+    // Равные элементы сохраняют порядок
+    template<typename Compare = std::less<T>>
+    PersistentVector<T> stable_sorted(Compare cmp = Compare()) const;
+
+    // -----------------------------------------
+    // ------- Сравнение и хеширование ---------
+    // -----------------------------------------
+    // Структурное сравнение: общие узлы двух версий пропускаются за O(1),
+    // поэлементно сравниваются только различающиеся поддеревья
+    bool operator==(const PersistentVector& other) const;
+    bool operator!=(const PersistentVector& other) const {
+        return !(*this == other);
+    }
+    // Согласован с ==; O(1), если хеш корня уже известен
+    // (режим PersistentHashing или повторный вызов)
+    size_t hash() const;
+};
+
+namespace persistent_hash_detail {
+    template<typename T>
+    struct hashable<PersistentVector<T>> : hashable<T> {};
+}
+
+namespace std {
+    template<typename T>
+    struct hash<PersistentVector<T>> {
+        size_t operator()(const PersistentVector<T>& vector) const {
+            return vector.hash();
+        }
+    };
+}
+
+#include "persistent_vector_impl.hpp"
+
 #endif
\ No newline at end of file
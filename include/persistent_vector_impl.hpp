@@ -1,267 +1,975 @@
-#ifndef PERSISTENT_VECTOR_IMPL_HPP
-#define PERSISTENT_VECTOR_IMPL_HPP
-
-#include "persistent_vector.hpp"
-#include <stack>
-#include <iostream>
-
-// -----------------------------------------
-// ---------- Реализация массива -----------
-// -----------------------------------------
-
-// -----------------------------------------
-// -------------- Конструктор --------------
-// -----------------------------------------
-template<typename T>
-PersistentVector<T>::PersistentVector() : data(std::make_shared<Data>()) {
-    // Для пустого вектора shift должен быть 0
-    data->shift = 0;
-}
-
-// -----------------------------------------
-// ------ Конструктор из std::vector -------
-// -----------------------------------------
-template<typename T>
-PersistentVector<T>::PersistentVector(const std::vector<T>& values) : data(std::make_shared<Data>()) {
-    data->shift = 0;
-    for (const auto& value : values) {
-        data = push(value);
-    }
-}
-
-// -----------------------------------------
-// ------ Методы IPersistentStructure ------
-// -----------------------------------------
-template<typename T>
-size_t PersistentVector<T>::size() const {
-    return data->size;
-}
-
-template<typename T>
-bool PersistentVector<T>::empty() const {
-    return data->size == 0;
-}
-
-template<typename T>
-std::shared_ptr<IPersistentStructure<T>> PersistentVector<T>::clear() const {
-    return std::make_shared<PersistentVector<T>>();
-}
-
-template<typename T>
-std::shared_ptr<IPersistentStructure<T>> PersistentVector<T>::clone() const {
-    auto result = std::make_shared<PersistentVector<T>>();
-    result->data = data;
-    return result;
-}
-
-// -----------------------------------------
-// ----- Получение элемента по индексу -----
-// -----------------------------------------
-template<typename T>
-const T& PersistentVector<T>::operator[](size_t index) const {
-    return getNodeValue(index);
-}
-
-template<typename T>
-const T& PersistentVector<T>::get(size_t index) const {
-    return getNodeValue(index);
-}
-
-// Реализация получения элемента по индексу
-template<typename T>
-const T& PersistentVector<T>::getNodeValue(size_t index) const {
-    // Проверка на корректность индекса
-    if (index >= data->size) {
-        throw std::out_of_range("Index out of range");
-    }
-
-    // Если вектор пустой 
-    if (empty()) {
-        throw std::runtime_error("Vector is empty");
-    }
-
-    auto node = data->root;
-    size_t shift = data->shift;
-
-    // Если shift = 0, значит все элементы в корневом узле
-    if (shift == 0) {
-        // Все элементы в корневом узле
-        if (index >= BRANCHING_FACTOR) {
-            throw std::out_of_range("Index out of range for leaf node");
-        }
-
-        if (!node->values[index]) {
-            throw std::runtime_error("Value not found in leaf node");
-        }
-
-        return *node->values[index];
-    }
-
-    // Иначе спускаемся по дереву
-    while (shift > 0) {
-        // Поиск потомка, содержащего элемент
-        size_t pos = (index >> shift) & BIT_MASK;
-
-        // Проверяем, существует ли узел потомка
-        if (!node->children[pos]) {
-            throw std::runtime_error("Internal error: child node not found");
-        }
-
-        node = node->children[pos];
-        shift -= BITS_PER_LEVEL;
-    }
-    // Извлечение значения из найденного узла
-    size_t pos = index & BIT_MASK;
-
-    if (!node->values[pos]) {
-        throw std::runtime_error("Internal error: value not found in leaf");
-    }
-
-    return *node->values[pos];
-}
-
-// -----------------------------------------
-// ------ Вставка элемента по индексу ------
-// -----------------------------------------
-// Алгоритм вставки по индексу элемента 
-template<typename T>
-std::shared_ptr<typename PersistentVector<T>::Node>
-PersistentVector<T>::assocNode(std::shared_ptr<typename PersistentVector<T>::Node> node,
-    size_t shift, size_t index, const T& value) const {
-    // Если shift = 0 (все элементы в корне)
-    if (shift == 0) {
-        auto newNode = node->clone();
-        size_t pos = index & BIT_MASK;
-        // Обновляем счетчик
-        if (!node->values[pos].has_value()) {
-            // Добавляем новый элемент
-            newNode->count = node->count + 1;
-        }
-        // Обновляем существующий
-        newNode->values[pos] = value;
-
-        return newNode;
-    }
-    // Общий случай: клонируем путь
-    auto newNode = node->clone();
-    // Устанавливаем значение в листе
-    size_t pos = (index >> shift) & BIT_MASK;
-
-    if (!node->children[pos]) {
-        // Если не существует - создаем новый
-        auto child = std::make_shared<Node>();
-        newNode->children[pos] = assocNode(child, shift - BITS_PER_LEVEL, index, value);
-    }
-    else {
-        // Иначе - клонируем в новый вектор
-        newNode->children[pos] = assocNode(node->children[pos], shift - BITS_PER_LEVEL, index, value);
-    }
-    // Обновляем счетчик
-    newNode->count = 0;
-    for (size_t i = 0; i < BRANCHING_FACTOR; ++i) {
-        if (newNode->children[i]) {
-            newNode->count += newNode->children[i]->count;
-        }
-    }
-
-    return newNode;
-}
-
-// Алгоритм вставки по индексу элемента (новый вектор)
-template<typename T>
-PersistentVector<T> PersistentVector<T>::set(size_t index, const T& value) const {
-    if (index >= size()) {
-        throw std::out_of_range("Index out of range");
-    }
-
-    auto newRoot = assocNode(data->root, data->shift, index, value);
-    auto newData = std::make_shared<Data>(newRoot, data->size, data->shift);
-
-    PersistentVector result;
-    result.data = newData;
-    return result;
-}
-
-// -----------------------------------------
-// ------ Добавление элемента в конец ------
-// -----------------------------------------
-template<typename T>
-PersistentVector<T> PersistentVector<T>::append(const T& value) const {
-    PersistentVector result;
-    result.data = push(value);
-    return result;
-}
-
-// Реализация добавления элемента в конец
-template<typename T>
-std::shared_ptr<typename PersistentVector<T>::Data>
-PersistentVector<T>::push(const T& value) const {
-    // Очевидный случай
-    if (empty()) {
-        auto root = std::make_shared<Node>();
-        root->values[0] = value;
-        root->count = 1;
-        return std::make_shared<Data>(root, 1, 0);
-    }
-
-    size_t depth = data->shift / BITS_PER_LEVEL + 1;
-    size_t capacity = 1;
-    for (size_t i = 0; i < depth; ++i) {
-        capacity *= BRANCHING_FACTOR;
-    }
-
-    // Очевидный случай: Есть место в текущем корне (shift = 0)
-    if (data->size < capacity) {
-        // Есть место в текущем дереве
-        auto newRoot = assocNode(data->root, data->shift, data->size, value);
-        return std::make_shared<Data>(newRoot, data->size + 1, data->shift);
-    }
-    else {
-        // Нужно увеличить глубину
-        auto newRoot = std::make_shared<Node>();
-        newRoot->children[0] = data->root;
-        size_t newShift = data->shift + BITS_PER_LEVEL;
-
-        auto updatedRoot = assocNode(newRoot, newShift, data->size, value);
-        return std::make_shared<Data>(updatedRoot, data->size + 1, newShift);
-    }
-}
-// -----------------------------------------
-// ----- Удаление последнего элемента ------
-// -----------------------------------------
-// Реализация удаления последнего элемента
-template<typename T>
-PersistentVector<T> PersistentVector<T>::pop_back() const {
-    // Очевидный случай
-    if (empty()) {
-        throw std::runtime_error("Cannot pop from empty vector");
-    }
-
-    if (data->size == 1) {
-        return PersistentVector<T>();
-    }
-    // Уменьшаем счетчик
-    auto newRoot = data->root->clone();
-    auto newData = std::make_shared<Data>(newRoot, data->size - 1, data->shift);
-
-    PersistentVector result;
-    result.data = newData;
-    return result;
-}
-
-// -----------------------------------------
-// -- Преобразование в встроенный вектор ---
-// -----------------------------------------
-template<typename T>
-std::vector<T> PersistentVector<T>::toStdVector() const {
-    std::vector<T> result;
-    result.reserve(size());
-    // Простой обход 
-    for (size_t i = 0; i < size(); ++i) {
-        result.push_back(get(i));
-    }
-
-    return result;
-}
-
+#ifndef PERSISTENT_VECTOR_IMPL_HPP
+#define PERSISTENT_VECTOR_IMPL_HPP
+
+#include "persistent_vector.hpp"
+#include <stack>
+#include <iostream>
+#include <algorithm>
+
+// -----------------------------------------
+// ---------- Реализация массива -----------
+// -----------------------------------------
+
+// -----------------------------------------
+// -------------- Конструктор --------------
+// -----------------------------------------
+template<typename T>
+PersistentVector<T>::PersistentVector() : data(std::make_shared<Data>()) {
+    // Для пустого вектора shift должен быть 0
+    data->shift = 0;
+}
+
+// -----------------------------------------
+// ------ Конструктор из std::vector -------
+// -----------------------------------------
+// Форма дерева та же, что у вектора, собранного append
+template<typename T>
+PersistentVector<T>::PersistentVector(const std::vector<T>& values)
+    : data(build(values.size(), [&values](size_t i, std::optional<T>& slot) {
+        slot.emplace(values[i]);
+    })) {
+}
+
+template<typename T>
+PersistentVector<T>::PersistentVector(std::vector<T>&& values)
+    : data(build(values.size(), [&values](size_t i, std::optional<T>& slot) {
+        slot.emplace(std::move(values[i]));
+    })) {
+}
+
+template<typename T>
+PersistentVector<T>::PersistentVector(const T* first, const T* last)
+    : data(build(static_cast<size_t>(last - first), [first](size_t i, std::optional<T>& slot) {
+        slot.emplace(first[i]);
+    })) {
+}
+
+// -----------------------------------------
+// ---------- Сборка снизу вверх -----------
+// -----------------------------------------
+template<typename T>
+template<typename Fill>
+std::shared_ptr<typename PersistentVector<T>::Data>
+PersistentVector<T>::build(size_t size, Fill&& fill) {
+    if (size == 0) {
+        auto empty = std::make_shared<Data>();
+        empty->shift = 0;
+        return empty;
+    }
+    bool hashed = hashing();
+    // Небольшой вектор собирается на вызывающем потоке: пул не создается
+    bool parallel = size >= PARALLEL_BATCH;
+    auto forEach = [parallel](size_t count, const auto& fn) {
+        if (parallel) {
+            PersistentThreadPool::instance().forEach(count, PARALLEL_BATCH / BRANCHING_FACTOR, fn);
+        }
+        else {
+            for (size_t i = 0; i < count; ++i) {
+                fn(i);
+            }
+        }
+    };
+
+    // Листья: по BRANCHING_FACTOR элементов, последний - неполный
+    std::vector<std::shared_ptr<Node>> level((size + BRANCHING_FACTOR - 1) / BRANCHING_FACTOR);
+    forEach(level.size(), [&](size_t i) {
+        auto leaf = std::make_shared<Node>();
+        size_t begin = i * BRANCHING_FACTOR;
+        size_t end = std::min(size, begin + BRANCHING_FACTOR);
+        for (size_t j = begin; j < end; ++j) {
+            fill(j, leaf->values[j - begin]);
+        }
+        leaf->count = end - begin;
+        leaf->slots = end - begin;
+        if (hashed) {
+            nodeHash(leaf.get(), 0);
+        }
+        level[i] = std::move(leaf);
+    });
+
+    // Уровни родителей, пока не останется корень. Высота совпадает с
+    // той, до которой дорастает вектор при append
+    size_t shift = 0;
+    while (level.size() > 1) {
+        shift += BITS_PER_LEVEL;
+        std::vector<std::shared_ptr<Node>> parents((level.size() + BRANCHING_FACTOR - 1) / BRANCHING_FACTOR);
+        forEach(parents.size(), [&](size_t i) {
+            auto parent = std::make_shared<Node>();
+            size_t begin = i * BRANCHING_FACTOR;
+            size_t end = std::min(level.size(), begin + BRANCHING_FACTOR);
+            for (size_t j = begin; j < end; ++j) {
+                parent->count += level[j]->count;
+                parent->children[j - begin] = std::move(level[j]);
+            }
+            parent->slots = end - begin;
+            if (hashed) {
+                nodeHash(parent.get(), shift);
+            }
+            parents[i] = std::move(parent);
+        });
+        level = std::move(parents);
+    }
+    return std::make_shared<Data>(std::move(level[0]), size, shift);
+}
+
+// -----------------------------------------
+// ----- Присваивание и освобождение -------
+// -----------------------------------------
+// Старая версия уходит во временный объект и освобождается в его деструкторе
+template<typename T>
+PersistentVector<T>& PersistentVector<T>::operator=(PersistentVector other) noexcept {
+    data.swap(other.data);
+    return *this;
+}
+
+// Последняя ссылка на версию передается сборщику
+template<typename T>
+PersistentVector<T>::~PersistentVector() {
+    PersistentReclaimer::instance().retire(data);
+}
+
+// -----------------------------------------
+// ------ Методы IPersistentStructure ------
+// -----------------------------------------
+template<typename T>
+size_t PersistentVector<T>::size() const {
+    return data->size;
+}
+
+template<typename T>
+bool PersistentVector<T>::empty() const {
+    return data->size == 0;
+}
+
+template<typename T>
+std::shared_ptr<IPersistentStructure<T>> PersistentVector<T>::clear() const {
+    return std::make_shared<PersistentVector<T>>();
+}
+
+template<typename T>
+std::shared_ptr<IPersistentStructure<T>> PersistentVector<T>::clone() const {
+    auto result = std::make_shared<PersistentVector<T>>();
+    result->data = data;
+    return result;
+}
+
+// -----------------------------------------
+// ----- Получение элемента по индексу -----
+// -----------------------------------------
+template<typename T>
+const T& PersistentVector<T>::operator[](size_t index) const {
+    return getNodeValue(index);
+}
+
+template<typename T>
+const T& PersistentVector<T>::get(size_t index) const {
+    return getNodeValue(index);
+}
+
+// Реализация получения элемента по индексу
+template<typename T>
+const T& PersistentVector<T>::getNodeValue(size_t index) const {
+    // Проверка на корректность индекса
+    if (index >= data->size) {
+        throw std::out_of_range("Index out of range");
+    }
+
+    // Если вектор пустой 
+    if (empty()) {
+        throw std::runtime_error("Vector is empty");
+    }
+
+    // Спуск по сырым указателям: узлы держит корень версии
+    const Node* node = data->root.get();
+    size_t shift = data->shift;
+
+    // Если shift = 0, значит все элементы в корневом узле
+    if (shift == 0) {
+        // Все элементы в корневом узле
+        if (index >= BRANCHING_FACTOR) {
+            throw std::out_of_range("Index out of range for leaf node");
+        }
+
+        if (!node->values[index]) {
+            throw std::runtime_error("Value not found in leaf node");
+        }
+
+        return *node->values[index];
+    }
+
+    // Иначе спускаемся по дереву
+    while (shift > 0) {
+        // Поиск потомка, содержащего элемент
+        size_t pos = (index >> shift) & BIT_MASK;
+
+        // Проверяем, существует ли узел потомка
+        if (!node->children[pos]) {
+            throw std::runtime_error("Internal error: child node not found");
+        }
+
+        node = node->children[pos].get();
+        shift -= BITS_PER_LEVEL;
+    }
+    // Извлечение значения из найденного узла
+    size_t pos = index & BIT_MASK;
+
+    if (!node->values[pos]) {
+        throw std::runtime_error("Internal error: value not found in leaf");
+    }
+
+    return *node->values[pos];
+}
+
+// -----------------------------------------
+// ------ Вставка элемента по индексу ------
+// -----------------------------------------
+// Алгоритм вставки по индексу элемента 
+template<typename T>
+template<typename Init>
+std::shared_ptr<typename PersistentVector<T>::Node>
+PersistentVector<T>::assocNode(const std::shared_ptr<Node>& node,
+    size_t shift, size_t index, Init& init, bool inPlace) const {
+    // Узел, которым владеет только эта версия, можно изменять на месте
+    auto newNode = (inPlace && node.use_count() == 1) ? node : node->clone();
+
+    // Хеш копии обновляется по разнице изменившейся ячейки
+    size_t hash = 0;
+    bool hashed = hashing() && newNode->merkle.get(hash);
+    if (!hashed) {
+        newNode->merkle.reset();
+    }
+
+    // Если shift = 0 (все элементы в корне)
+    if (shift == 0) {
+        size_t pos = index & BIT_MASK;
+        // Обновляем счетчик
+        if (!newNode->values[pos].has_value()) {
+            // Добавляем новый элемент
+            newNode->count += 1;
+        }
+        if (hashed) {
+            hash -= valueTerm(pos, newNode->values[pos]);
+        }
+        // Записываем значение сразу в ячейку листа
+        init(newNode->values[pos]);
+        newNode->touch(pos);
+
+        if (hashed) {
+            newNode->merkle.set(hash + valueTerm(pos, newNode->values[pos]));
+        }
+        else if (hashing()) {
+            nodeHash(newNode.get(), shift);
+        }
+        return newNode;
+    }
+    // Общий случай: клонируем путь
+    size_t pos = (index >> shift) & BIT_MASK;
+    // Счетчик обновляем по разнице, не обходя всех потомков
+    size_t before = newNode->children[pos] ? newNode->children[pos]->count : 0;
+    if (hashed) {
+        hash -= childTerm(pos, newNode->children[pos].get(), shift - BITS_PER_LEVEL);
+    }
+
+    if (!newNode->children[pos]) {
+        // Если не существует - создаем новый (им владеет только эта версия)
+        newNode->children[pos] = std::make_shared<Node>();
+        newNode->touch(pos);
+        newNode->children[pos] = assocNode(newNode->children[pos], shift - BITS_PER_LEVEL, index, init, true);
+    }
+    else {
+        // Иначе - клонируем (или изменяем на месте) потомка
+        newNode->children[pos] = assocNode(newNode->children[pos], shift - BITS_PER_LEVEL, index, init, inPlace);
+    }
+    // Обновляем счетчик
+    newNode->count = newNode->count - before + newNode->children[pos]->count;
+
+    if (hashed) {
+        newNode->merkle.set(hash + childTerm(pos, newNode->children[pos].get(), shift - BITS_PER_LEVEL));
+    }
+    else if (hashing()) {
+        nodeHash(newNode.get(), shift);
+    }
+    return newNode;
+}
+
+// Реализация установки значения по индексу
+template<typename T>
+template<typename Init>
+std::shared_ptr<typename PersistentVector<T>::Data>
+PersistentVector<T>::assoc(size_t index, Init& init, bool inPlace) const {
+    if (index >= size()) {
+        throw std::out_of_range("Index out of range");
+    }
+
+    if (inPlace && data.use_count() == 1) {
+        data->root = assocNode(data->root, data->shift, index, init, true);
+        return data;
+    }
+    auto newRoot = assocNode(data->root, data->shift, index, init, false);
+    return std::make_shared<Data>(newRoot, data->size, data->shift);
+}
+
+// Алгоритм вставки по индексу элемента (новый вектор)
+template<typename T>
+PersistentVector<T> PersistentVector<T>::set(size_t index, const T& value) const& {
+    auto init = [&value](std::optional<T>& slot) { slot = value; };
+    return PersistentVector<T>(assoc(index, init, false));
+}
+
+template<typename T>
+PersistentVector<T> PersistentVector<T>::set(size_t index, T&& value) const& {
+    auto init = [&value](std::optional<T>& slot) { slot = std::move(value); };
+    return PersistentVector<T>(assoc(index, init, false));
+}
+
+template<typename T>
+PersistentVector<T> PersistentVector<T>::set(size_t index, const T& value) && {
+    PersistentVector<T> self(std::move(*this));
+    auto init = [&value](std::optional<T>& slot) { slot = value; };
+    return PersistentVector<T>(self.assoc(index, init, true));
+}
+
+template<typename T>
+PersistentVector<T> PersistentVector<T>::set(size_t index, T&& value) && {
+    PersistentVector<T> self(std::move(*this));
+    auto init = [&value](std::optional<T>& slot) { slot = std::move(value); };
+    return PersistentVector<T>(self.assoc(index, init, true));
+}
+
+// Конструирование элемента на месте по индексу
+template<typename T>
+template<typename... Args>
+PersistentVector<T> PersistentVector<T>::emplace(size_t index, Args&&... args) const& {
+    auto init = [&](std::optional<T>& slot) { slot.emplace(std::forward<Args>(args)...); };
+    return PersistentVector<T>(assoc(index, init, false));
+}
+
+template<typename T>
+template<typename... Args>
+PersistentVector<T> PersistentVector<T>::emplace(size_t index, Args&&... args) && {
+    PersistentVector<T> self(std::move(*this));
+    auto init = [&](std::optional<T>& slot) { slot.emplace(std::forward<Args>(args)...); };
+    return PersistentVector<T>(self.assoc(index, init, true));
+}
+
+// Изменение элемента через fn за один спуск по дереву
+template<typename T>
+template<typename F>
+std::shared_ptr<typename PersistentVector<T>::Node>
+PersistentVector<T>::modifyNode(const std::shared_ptr<Node>& node,
+    size_t shift, size_t index, F& fn) const {
+    size_t pos = (index >> shift) & BIT_MASK;
+    if (shift == 0) {
+        std::optional<T> value = fn(static_cast<const T&>(*node->values[pos]));
+        if (!value) {
+            return node;
+        }
+        auto newNode = node->clone();
+        size_t hash = 0;
+        bool hashed = hashing() && newNode->merkle.get(hash);
+        if (hashed) {
+            hash -= valueTerm(pos, newNode->values[pos]);
+        }
+        else {
+            newNode->merkle.reset();
+        }
+        newNode->values[pos] = std::move(value);
+
+        if (hashed) {
+            newNode->merkle.set(hash + valueTerm(pos, newNode->values[pos]));
+        }
+        else if (hashing()) {
+            nodeHash(newNode.get(), shift);
+        }
+        return newNode;
+    }
+    // Потомок не изменился - узел остается общим с исходной версией
+    const auto& child = node->children[pos];
+    auto updated = modifyNode(child, shift - BITS_PER_LEVEL, index, fn);
+    if (updated == child) {
+        return node;
+    }
+    auto newNode = node->clone();
+    size_t hash = 0;
+    bool hashed = hashing() && newNode->merkle.get(hash);
+    if (hashed) {
+        hash -= childTerm(pos, child.get(), shift - BITS_PER_LEVEL);
+    }
+    else {
+        newNode->merkle.reset();
+    }
+    newNode->children[pos] = std::move(updated);
+
+    if (hashed) {
+        newNode->merkle.set(hash + childTerm(pos, newNode->children[pos].get(), shift - BITS_PER_LEVEL));
+    }
+    else if (hashing()) {
+        nodeHash(newNode.get(), shift);
+    }
+    return newNode;
+}
+
+template<typename T>
+template<typename F>
+PersistentVector<T> PersistentVector<T>::update(size_t index, F fn) const {
+    if (index >= size()) {
+        throw std::out_of_range("Index out of range");
+    }
+    auto newRoot = modifyNode(data->root, data->shift, index, fn);
+    if (newRoot == data->root) {
+        return *this;
+    }
+    return PersistentVector<T>(std::make_shared<Data>(newRoot, data->size, data->shift));
+}
+
+// -----------------------------------------
+// ------ Добавление элемента в конец ------
+// -----------------------------------------
+template<typename T>
+PersistentVector<T> PersistentVector<T>::append(const T& value) const& {
+    auto init = [&value](std::optional<T>& slot) { slot = value; };
+    return PersistentVector<T>(push(init, false));
+}
+
+template<typename T>
+PersistentVector<T> PersistentVector<T>::append(T&& value) const& {
+    auto init = [&value](std::optional<T>& slot) { slot = std::move(value); };
+    return PersistentVector<T>(push(init, false));
+}
+
+template<typename T>
+PersistentVector<T> PersistentVector<T>::append(const T& value) && {
+    PersistentVector<T> self(std::move(*this));
+    auto init = [&value](std::optional<T>& slot) { slot = value; };
+    return PersistentVector<T>(self.push(init, true));
+}
+
+template<typename T>
+PersistentVector<T> PersistentVector<T>::append(T&& value) && {
+    PersistentVector<T> self(std::move(*this));
+    auto init = [&value](std::optional<T>& slot) { slot = std::move(value); };
+    return PersistentVector<T>(self.push(init, true));
+}
+
+// Конструирование элемента на месте в конце
+template<typename T>
+template<typename... Args>
+PersistentVector<T> PersistentVector<T>::emplace_back(Args&&... args) const& {
+    auto init = [&](std::optional<T>& slot) { slot.emplace(std::forward<Args>(args)...); };
+    return PersistentVector<T>(push(init, false));
+}
+
+template<typename T>
+template<typename... Args>
+PersistentVector<T> PersistentVector<T>::emplace_back(Args&&... args) && {
+    PersistentVector<T> self(std::move(*this));
+    auto init = [&](std::optional<T>& slot) { slot.emplace(std::forward<Args>(args)...); };
+    return PersistentVector<T>(self.push(init, true));
+}
+
+// Реализация добавления элемента в конец
+template<typename T>
+template<typename Init>
+std::shared_ptr<typename PersistentVector<T>::Data>
+PersistentVector<T>::push(Init& init, bool inPlace) const {
+    // Очевидный случай
+    if (empty()) {
+        auto root = std::make_shared<Node>();
+        init(root->values[0]);
+        root->count = 1;
+        root->slots = 1;
+        return std::make_shared<Data>(root, 1, 0);
+    }
+
+    size_t depth = data->shift / BITS_PER_LEVEL + 1;
+    size_t capacity = 1;
+    for (size_t i = 0; i < depth; ++i) {
+        capacity *= BRANCHING_FACTOR;
+    }
+
+    // Версией владеет только вызывающий - меняем ее на месте
+    bool reuse = inPlace && data.use_count() == 1;
+
+    // Очевидный случай: Есть место в текущем корне (shift = 0)
+    if (data->size < capacity) {
+        // Есть место в текущем дереве
+        auto newRoot = assocNode(data->root, data->shift, data->size, init, reuse);
+        if (reuse) {
+            data->root = std::move(newRoot);
+            data->size += 1;
+            return data;
+        }
+        return std::make_shared<Data>(newRoot, data->size + 1, data->shift);
+    }
+    else {
+        // Нужно увеличить глубину
+        auto newRoot = std::make_shared<Node>();
+        newRoot->children[0] = data->root;
+        newRoot->slots = 1;
+        newRoot->count = data->root->count;
+        size_t newShift = data->shift + BITS_PER_LEVEL;
+
+        auto updatedRoot = assocNode(newRoot, newShift, data->size, init, true);
+        if (reuse) {
+            data->root = std::move(updatedRoot);
+            data->size += 1;
+            data->shift = newShift;
+            return data;
+        }
+        return std::make_shared<Data>(updatedRoot, data->size + 1, newShift);
+    }
+}
+// -----------------------------------------
+// ----- Удаление последнего элемента ------
+// -----------------------------------------
+template<typename T>
+PersistentVector<T> PersistentVector<T>::pop_back() const& {
+    return PersistentVector<T>(pop(false));
+}
+
+template<typename T>
+PersistentVector<T> PersistentVector<T>::pop_back() && {
+    PersistentVector<T> self(std::move(*this));
+    return PersistentVector<T>(self.pop(true));
+}
+
+// Реализация удаления последнего элемента
+template<typename T>
+std::shared_ptr<typename PersistentVector<T>::Data> PersistentVector<T>::pop(bool inPlace) const {
+    // Очевидный случай
+    if (empty()) {
+        throw std::runtime_error("Cannot pop from empty vector");
+    }
+
+    if (data->size == 1) {
+        return PersistentVector<T>().data;
+    }
+    bool reuse = inPlace && data.use_count() == 1;
+    auto newRoot = popNode(data->root, data->shift, data->size - 1, reuse);
+    size_t newShift = data->shift;
+    // Корень с единственным потомком - лишний уровень: форма дерева
+    // остается такой же, как у вектора того же размера, собранного append
+    while (newShift > 0 && newRoot->slots == 1) {
+        newRoot = newRoot->children[0];
+        newShift -= BITS_PER_LEVEL;
+    }
+    if (reuse) {
+        data->root = std::move(newRoot);
+        data->size -= 1;
+        data->shift = newShift;
+        return data;
+    }
+    return std::make_shared<Data>(newRoot, data->size - 1, newShift);
+}
+
+// Копирование пути к последнему элементу с очисткой его ячейки;
+// опустевший узел заменяется пустым указателем. Потомок изменяется
+// на месте, только если на месте изменяется и родитель: потомок
+// общего узла принадлежит и другим версиям
+template<typename T>
+std::shared_ptr<typename PersistentVector<T>::Node>
+PersistentVector<T>::popNode(const std::shared_ptr<Node>& node, size_t shift, size_t index,
+    bool inPlace) const {
+    bool own = inPlace && node.use_count() == 1;
+    size_t pos = (index >> shift) & BIT_MASK;
+    // Вклад потомка в хеш - до рекурсии: на месте потомок изменится
+    size_t childBefore = shift > 0 && hashing() ?
+        childTerm(pos, node->children[pos].get(), shift - BITS_PER_LEVEL) : 0;
+    std::shared_ptr<Node> child;
+    if (shift > 0) {
+        child = popNode(node->children[pos], shift - BITS_PER_LEVEL, index, own);
+    }
+    if (pos == 0 && !child) {
+        return nullptr;
+    }
+
+    auto newNode = own ? node : node->clone();
+    size_t hash = 0;
+    bool hashed = hashing() && newNode->merkle.get(hash);
+    if (!hashed) {
+        newNode->merkle.reset();
+    }
+
+    if (shift == 0) {
+        if (hashed) {
+            hash -= valueTerm(pos, newNode->values[pos]);
+        }
+        newNode->values[pos].reset();
+        newNode->slots = pos;
+    }
+    else {
+        if (hashed) {
+            hash = hash - childBefore + childTerm(pos, child.get(), shift - BITS_PER_LEVEL);
+        }
+        newNode->children[pos] = std::move(child);
+        if (!newNode->children[pos]) {
+            newNode->slots = pos;
+        }
+    }
+    newNode->count -= 1;
+
+    if (hashed) {
+        newNode->merkle.set(hash);
+    }
+    else if (hashing()) {
+        nodeHash(newNode.get(), shift);
+    }
+    return newNode;
+}
+
+// -----------------------------------------
+// ---------- Пакетные изменения -----------
+// -----------------------------------------
+template<typename T>
+size_t PersistentVector<T>::ValueBatch::lower(size_t from, size_t to, size_t index) const {
+    auto it = std::lower_bound(items.begin() + from, items.begin() + to, index,
+        [](const std::pair<size_t, const T*>& item, size_t bound) { return item.first < bound; });
+    return static_cast<size_t>(it - items.begin());
+}
+
+// Индексы проверяются до изменений: rvalue-версия не остается
+// наполовину измененной
+template<typename T>
+typename PersistentVector<T>::ValueBatch
+PersistentVector<T>::valueBatch(const std::vector<size_t>& indices, const std::vector<T>& values) const {
+    if (indices.size() != values.size()) {
+        throw std::invalid_argument("setMany: indices and values differ in size");
+    }
+    ValueBatch batch;
+    batch.items.reserve(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+        if (indices[i] >= size()) {
+            throw std::out_of_range("Index out of range");
+        }
+        batch.items.emplace_back(indices[i], &values[i]);
+    }
+    auto byIndex = [](const std::pair<size_t, const T*>& a, const std::pair<size_t, const T*>& b) {
+        return a.first < b.first;
+    };
+    if (!std::is_sorted(batch.items.begin(), batch.items.end(), byIndex)) {
+        std::stable_sort(batch.items.begin(), batch.items.end(), byIndex);
+    }
+    return batch;
+}
+
+template<typename T>
+template<typename Batch>
+std::shared_ptr<typename PersistentVector<T>::Node>
+PersistentVector<T>::updateNode(const std::shared_ptr<Node>& node, size_t shift,
+    size_t from, size_t to, const Batch& batch, bool inPlace) const {
+    auto newNode = (inPlace && node.use_count() == 1) ? node : node->clone();
+    newNode->merkle.reset();
+
+    if (shift == 0) {
+        for (size_t i = from; i < to; ++i) {
+            batch.apply(i, newNode->values[batch.index(i) & BIT_MASK]);
+        }
+    }
+    else {
+        // Части пакета по потомкам: [bounds[g], bounds[g + 1]) -> positions[g]
+        size_t bounds[BRANCHING_FACTOR + 1];
+        size_t positions[BRANCHING_FACTOR];
+        size_t groups = 0;
+        for (size_t i = from; i < to; ++groups) {
+            size_t index = batch.index(i);
+            positions[groups] = (index >> shift) & BIT_MASK;
+            bounds[groups] = i;
+            i = batch.lower(i, to, ((index >> shift) + 1) << shift);
+        }
+        bounds[groups] = to;
+
+        // Потомки разные - потоки пишут в разные ячейки узла
+        auto rebuild = [&](size_t g) {
+            size_t pos = positions[g];
+            newNode->children[pos] = updateNode(newNode->children[pos], shift - BITS_PER_LEVEL,
+                bounds[g], bounds[g + 1], batch, inPlace);
+        };
+        if (groups > 1 && to - from >= PARALLEL_BATCH) {
+            PersistentThreadPool::instance().parallelFor(groups, rebuild);
+        }
+        else {
+            for (size_t g = 0; g < groups; ++g) {
+                rebuild(g);
+            }
+        }
+    }
+
+    // Хеши потомков уже посчитаны - пересчитывается только этот узел
+    if (hashing()) {
+        nodeHash(newNode.get(), shift);
+    }
+    return newNode;
+}
+
+template<typename T>
+template<typename Batch>
+std::shared_ptr<typename PersistentVector<T>::Data>
+PersistentVector<T>::updateMany(const Batch& batch, bool inPlace) const {
+    if (batch.size() == 0) {
+        return data;
+    }
+    if (inPlace && data.use_count() == 1) {
+        data->root = updateNode(data->root, data->shift, 0, batch.size(), batch, true);
+        return data;
+    }
+    auto newRoot = updateNode(data->root, data->shift, 0, batch.size(), batch, false);
+    return std::make_shared<Data>(newRoot, data->size, data->shift);
+}
+
+template<typename T>
+PersistentVector<T> PersistentVector<T>::setMany(const std::vector<size_t>& indices,
+    const std::vector<T>& values) const& {
+    return PersistentVector<T>(updateMany(valueBatch(indices, values), false));
+}
+
+template<typename T>
+PersistentVector<T> PersistentVector<T>::setMany(const std::vector<size_t>& indices,
+    const std::vector<T>& values) && {
+    ValueBatch batch = valueBatch(indices, values);
+    PersistentVector<T> self(std::move(*this));
+    return PersistentVector<T>(self.updateMany(batch, true));
+}
+
+template<typename T>
+template<typename F>
+PersistentVector<T> PersistentVector<T>::update(size_t first, size_t last, F fn) const& {
+    if (first > last || last > size()) {
+        throw std::out_of_range("Index out of range");
+    }
+    return PersistentVector<T>(updateMany(RangeBatch<F>{ first, last - first, fn }, false));
+}
+
+template<typename T>
+template<typename F>
+PersistentVector<T> PersistentVector<T>::update(size_t first, size_t last, F fn) && {
+    if (first > last || last > size()) {
+        throw std::out_of_range("Index out of range");
+    }
+    PersistentVector<T> self(std::move(*this));
+    return PersistentVector<T>(self.updateMany(RangeBatch<F>{ first, last - first, fn }, true));
+}
+
+// -----------------------------------------
+// -- Преобразование в встроенный вектор ---
+// -----------------------------------------
+// Обход листьев по порядку, без спуска от корня на каждый индекс
+template<typename T>
+void PersistentVector<T>::collect(const Node* node, size_t shift, std::vector<T>& out, size_t size) {
+    for (size_t i = 0; i < node->slots && out.size() < size; ++i) {
+        if (shift == 0) {
+            out.push_back(*node->values[i]);
+        }
+        else if (node->children[i]) {
+            collect(node->children[i].get(), shift - BITS_PER_LEVEL, out, size);
+        }
+    }
+}
+
+template<typename T>
+std::vector<T> PersistentVector<T>::toStdVector() const {
+    std::vector<T> result;
+    result.reserve(size());
+    if (!empty()) {
+        collect(data->root.get(), data->shift, result, size());
+    }
+    return result;
+}
+
+// -----------------------------------------
+// -------------- Сортировка ---------------
+// -----------------------------------------
+namespace persistent_vector_detail {
+    // Части сортируются на потоках пула, затем соседние отсортированные
+    // части сливаются попарно (std::inplace_merge устойчив), пока не
+    // останется одна
+    template<typename T, typename Compare>
+    void parallelSort(std::vector<T>& items, Compare& cmp, bool stable, size_t grain) {
+        auto sortRange = [&](size_t from, size_t to) {
+            if (stable) {
+                std::stable_sort(items.begin() + from, items.begin() + to, cmp);
+            }
+            else {
+                std::sort(items.begin() + from, items.begin() + to, cmp);
+            }
+        };
+        // Меньше двух частей - сортировка на вызывающем потоке, без пула
+        if (items.size() < 2 * grain) {
+            sortRange(0, items.size());
+            return;
+        }
+        auto& pool = PersistentThreadPool::instance();
+        size_t parts = std::min(pool.concurrency(), items.size() / grain);
+        if (parts <= 1) {
+            sortRange(0, items.size());
+            return;
+        }
+
+        std::vector<size_t> bounds(parts + 1);
+        for (size_t p = 0; p <= parts; ++p) {
+            bounds[p] = items.size() * p / parts;
+        }
+        pool.parallelFor(parts, [&](size_t p) {
+            sortRange(bounds[p], bounds[p + 1]);
+        });
+        for (size_t width = 1; width < parts; width *= 2) {
+            size_t pairs = (parts + 2 * width - 1) / (2 * width);
+            pool.parallelFor(pairs, [&](size_t pair) {
+                size_t left = pair * 2 * width;
+                size_t middle = std::min(parts, left + width);
+                size_t right = std::min(parts, left + 2 * width);
+                std::inplace_merge(items.begin() + bounds[left], items.begin() + bounds[middle],
+                    items.begin() + bounds[right], cmp);
+            });
+        }
+    }
+}
+
+template<typename T>
+template<typename Compare>
+PersistentVector<T> PersistentVector<T>::sorted(Compare cmp) const {
+    std::vector<T> items = toStdVector();
+    persistent_vector_detail::parallelSort(items, cmp, false, PARALLEL_BATCH);
+    return PersistentVector<T>(std::move(items));
+}
+
+template<typename T>
+template<typename Compare>
+PersistentVector<T> PersistentVector<T>::stable_sorted(Compare cmp) const {
+    std::vector<T> items = toStdVector();
+    persistent_vector_detail::parallelSort(items, cmp, true, PARALLEL_BATCH);
+    return PersistentVector<T>(std::move(items));
+}
+
+// -----------------------------------------
+// ------- Сравнение и хеширование ---------
+// -----------------------------------------
+// Форма дерева определяется размером, поэтому поддеревья равных векторов
+// совпадают по позициям
+template<typename T>
+bool PersistentVector<T>::nodesEqual(const Node* a, const Node* b, size_t shift, size_t count) {
+    // Общий узел - поддеревья равны без обхода
+    if (a == b) {
+        return true;
+    }
+    if (!a || !b) {
+        return false;
+    }
+    // Известные и различные хеши - поддеревья различны
+    size_t hashA;
+    size_t hashB;
+    if (a->merkle.get(hashA) && b->merkle.get(hashB) && hashA != hashB) {
+        return false;
+    }
+    if (shift == 0) {
+        for (size_t i = 0; i < count; ++i) {
+            if (a->values[i].has_value() != b->values[i].has_value()) {
+                return false;
+            }
+            if (a->values[i] && !(*a->values[i] == *b->values[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    size_t span = size_t(1) << shift; // Элементов в поддереве потомка
+    for (size_t i = 0; count > 0; ++i) {
+        size_t part = count < span ? count : span;
+        if (!nodesEqual(a->children[i].get(), b->children[i].get(), shift - BITS_PER_LEVEL, part)) {
+            return false;
+        }
+        count -= part;
+    }
+    return true;
+}
+
+template<typename T>
+bool PersistentVector<T>::operator==(const PersistentVector& other) const {
+    if (data == other.data) {
+        return true;
+    }
+    if (data->size != other.data->size) {
+        return false;
+    }
+    if (data->size == 0) {
+        return true;
+    }
+
+    // Дерево из старого снимка может быть глубже, чем нужно для размера:
+    // лишние уровни - цепочка из первых потомков
+    const Node* a = data->root.get();
+    const Node* b = other.data->root.get();
+    size_t shiftA = data->shift;
+    size_t shiftB = other.data->shift;
+    while (shiftA > shiftB) {
+        a = a->children[0].get();
+        shiftA -= BITS_PER_LEVEL;
+    }
+    while (shiftB > shiftA) {
+        b = b->children[0].get();
+        shiftB -= BITS_PER_LEVEL;
+    }
+    return nodesEqual(a, b, shiftA, data->size);
+}
+
+// -----------------------------------------
+// ------------- Хеши Меркла ---------------
+// -----------------------------------------
+template<typename T>
+bool PersistentVector<T>::hashing() {
+    if constexpr (MERKLE) {
+        return PersistentHashing::enabled();
+    }
+    else {
+        return false;
+    }
+}
+
+template<typename T>
+size_t PersistentVector<T>::valueTerm(size_t pos, const std::optional<T>& value) {
+    if constexpr (MERKLE) {
+        return value ? persistent_hash_detail::combine(pos, std::hash<T>()(*value)) : 0;
+    }
+    else {
+        return 0;
+    }
+}
+
+template<typename T>
+size_t PersistentVector<T>::childTerm(size_t pos, const Node* child, size_t shift) {
+    return child ? persistent_hash_detail::combine(pos, nodeHash(child, shift)) : 0;
+}
+
+// Хеш поддерева; известные хеши потомков не пересчитываются
+template<typename T>
+size_t PersistentVector<T>::nodeHash(const Node* node, size_t shift) {
+    size_t hash = 0;
+    if (node->merkle.get(hash)) {
+        return hash;
+    }
+    for (size_t i = 0; i < node->slots; ++i) {
+        hash += shift == 0
+            ? valueTerm(i, node->values[i])
+            : childTerm(i, node->children[i].get(), shift - BITS_PER_LEVEL);
+    }
+    node->merkle.set(hash);
+    return hash;
+}
+
+template<typename T>
+size_t PersistentVector<T>::hash() const {
+    static_assert(MERKLE, "PersistentVector::hash requires std::hash for the element type");
+    if (data->size == 0) {
+        return 0;
+    }
+    // Лишние уровни над корнем (векторы до pop_back в старых снимках)
+    // не меняют содержимое - хешируется то же поддерево, что и у равного вектора
+    const Node* node = data->root.get();
+    size_t shift = data->shift;
+    while (shift > 0 && node->slots == 1) {
+        node = node->children[0].get();
+        shift -= BITS_PER_LEVEL;
+    }
+    return persistent_hash_detail::combine(data->size, nodeHash(node, shift));
+}
+
 #endif
\ No newline at end of file
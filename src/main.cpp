@@ -1,618 +1,2742 @@
-#include <gtest/gtest.h>
-#include <memory>
-#include <vector>
-#include <string>
-#include <stdexcept>
-#include <cassert>
-
-#include "persistent_vector.hpp"
-#include "persistent_list.hpp"
-#include "persistent_map.hpp"
-#include "persistent_value.hpp"
-#include "persistent_data_structure.hpp"
-
-#include "persistent_vector_impl.hpp"
-#include "persistent_list_impl.hpp"
-#include "persistent_map_impl.hpp"
-
-// -----------------------------------------
-// ------ ТЕСТЫ ДЛЯ PERSISTENT VECTOR ------
-// -----------------------------------------
-
-class PersistentVectorTest : public ::testing::Test {
-protected:
-    void SetUp() override {
-    }
-
-    void TearDown() override {
-    }
-};
-// Создание пустого вектора
-TEST_F(PersistentVectorTest, EmptyVectorCreation) {
-    PersistentVector<int> vec;
-    EXPECT_TRUE(vec.empty());
-    EXPECT_EQ(vec.size(), 0);
-}
-// Добавление элементов
-TEST_F(PersistentVectorTest, AppendingElements) {
-    PersistentVector<int> vec;
-    auto vec1 = vec.append(1);
-    auto vec2 = vec1.append(2);
-    auto vec3 = vec2.append(3);
-
-    EXPECT_EQ(vec1.size(), 1);
-    EXPECT_EQ(vec2.size(), 2);
-    EXPECT_EQ(vec3.size(), 3);
-    EXPECT_EQ(vec1.get(0), 1);
-    EXPECT_EQ(vec2.get(1), 2);
-    EXPECT_EQ(vec3.get(2), 3);
-}
-// Изменение элементов
-TEST_F(PersistentVectorTest, ModifyingElements) {
-    PersistentVector<int> vec;
-    auto vec1 = vec.append(1).append(2).append(3);
-    auto vec2 = vec1.set(1, 99);
-
-    EXPECT_EQ(vec1.get(0), 1);
-    EXPECT_EQ(vec1.get(1), 2);
-    EXPECT_EQ(vec1.get(2), 3);
-    EXPECT_EQ(vec2.get(0), 1);
-    EXPECT_EQ(vec2.get(1), 99);
-    EXPECT_EQ(vec2.get(2), 3);
-}
-// Удаление элементов
-TEST_F(PersistentVectorTest, RemovingElementsPopBack) {
-    PersistentVector<int> vec;
-    auto vec1 = vec.append(1).append(2).append(3);
-    auto vec2 = vec1.pop_back();
-
-    EXPECT_EQ(vec1.size(), 3);
-    EXPECT_EQ(vec2.size(), 2);
-    EXPECT_EQ(vec1.get(2), 3);
-}
-// Доступ по индексу
-TEST_F(PersistentVectorTest, IndexAccess) {
-    PersistentVector<std::string> vec;
-    auto vec1 = vec.append("a").append("b").append("c");
-
-    EXPECT_EQ(vec1.get(0), "a");
-    EXPECT_EQ(vec1.get(1), "b");
-    EXPECT_EQ(vec1.get(2), "c");
-}
-// Обработка исключений
-TEST_F(PersistentVectorTest, ExceptionHandling) {
-    PersistentVector<int> vec;
-    auto vec1 = vec.append(1);
-
-    EXPECT_THROW(vec1.get(5), std::out_of_range);
-    EXPECT_THROW(vec1.set(5, 10), std::out_of_range);
-}
-// Цепочки операций
-TEST_F(PersistentVectorTest, OperationChaining) {
-    PersistentVector<int> vec;
-    auto result = vec.append(1)
-        .append(2)
-        .set(0, 10)
-        .append(3)
-        .pop_back()
-        .set(1, 20);
-
-    EXPECT_EQ(result.size(), 2);
-    EXPECT_EQ(result.get(0), 10);
-    EXPECT_EQ(result.get(1), 20);
-}
-// Сравнение векторов
-TEST_F(PersistentVectorTest, VectorComparison) {
-    PersistentVector<int> vec1, vec2;
-    auto v1 = vec1.append(1).append(2).append(3);
-    auto v2 = vec2.append(1).append(2).append(3);
-    auto v3 = v1.set(1, 99);
-}
-// Векторы разных типов
-TEST_F(PersistentVectorTest, VectorWithDifferentTypes) {
-    PersistentVector<int> intVec;
-    auto intResult = intVec.append(1).append(2).append(3);
-    EXPECT_EQ(intResult.size(), 3);
-    EXPECT_EQ(intResult.get(1), 2);
-
-    PersistentVector<std::string> strVec;
-    auto strResult = strVec.append("hello").append("world");
-    EXPECT_EQ(strResult.size(), 2);
-    EXPECT_EQ(strResult.get(0), "hello");
-
-    PersistentVector<double> doubleVec;
-    auto doubleResult = doubleVec.append(1.1).append(2.2);
-    EXPECT_EQ(doubleResult.size(), 2);
-    EXPECT_DOUBLE_EQ(doubleResult.get(0), 1.1);
-}
-// Тест производительности
-TEST_F(PersistentVectorTest, PerformanceTest) {
-    PersistentVector<int> vec;
-    auto current = vec;
-
-    for (int i = 0; i < 1000; ++i) {
-        current = current.append(i);
-    }
-
-    EXPECT_EQ(current.size(), 1000);
-    EXPECT_EQ(current.get(999), 999);
-}
-
-// -----------------------------------------
-// ------- ТЕСТЫ ДЛЯ PERSISTENT LIST -------
-// -----------------------------------------
-
-class PersistentListTest : public ::testing::Test {
-protected:
-    void SetUp() override {}
-    void TearDown() override {}
-};
-// Создание пустого списка
-TEST_F(PersistentListTest, EmptyListCreation) {
-    PersistentList<int> list;
-    EXPECT_TRUE(list.empty());
-    EXPECT_EQ(list.size(), 0);
-}
-// Добавление в начало
-TEST_F(PersistentListTest, PrependingElements) {
-    PersistentList<int> list;
-    auto list1 = list.prepend(1);
-    auto list2 = list1.prepend(2);
-    auto list3 = list2.prepend(3);
-
-    EXPECT_EQ(list1.size(), 1);
-    EXPECT_EQ(list2.size(), 2);
-    EXPECT_EQ(list3.size(), 3);
-    EXPECT_EQ(list1.front(), 1);
-    EXPECT_EQ(list2.front(), 2);
-    EXPECT_EQ(list3.front(), 3);
-}
-// Получение хвоста списка
-TEST_F(PersistentListTest, GettingTail) {
-    PersistentList<std::string> list;
-    auto list1 = list.prepend("c").prepend("b").prepend("a");
-    auto tail1 = list1.tail();
-    auto tail2 = tail1.tail();
-
-    EXPECT_EQ(list1.front(), "a");
-    EXPECT_EQ(tail1.front(), "b");
-    EXPECT_EQ(tail2.front(), "c");
-    EXPECT_EQ(list1.size(), 3);
-    EXPECT_EQ(tail1.size(), 2);
-    EXPECT_EQ(tail2.size(), 1);
-}
-// Конкатенация списков
-TEST_F(PersistentListTest, ConcatenatingLists) {
-    PersistentList<int> list1, list2;
-    auto l1 = list1.prepend(3).prepend(2).prepend(1);  // [1, 2, 3]
-    auto l2 = list2.prepend(6).prepend(5).prepend(4);  // [4, 5, 6]
-    auto concatenated = l1.concat(l2);  // [1, 2, 3, 4, 5, 6]
-
-    EXPECT_EQ(concatenated.size(), 6);
-
-    auto current = concatenated;
-    int expected[] = { 1, 2, 3, 4, 5, 6 };
-    for (int i = 0; i < 6; ++i) {
-        EXPECT_EQ(current.front(), expected[i]);
-        current = current.tail();
-    }
-}
-// Обработка исключений
-TEST_F(PersistentListTest, ExceptionHandling) {
-    PersistentList<int> emptyList;
-
-    EXPECT_THROW(emptyList.front(), std::runtime_error);
-    EXPECT_THROW(emptyList.tail(), std::runtime_error);
-}
-// Цепочки операций
-TEST_F(PersistentListTest, OperationChaining) {
-    PersistentList<std::string> list;
-    auto result = list.prepend("world")
-        .prepend("hello")
-        .tail()
-        .prepend("there")
-        .concat(list.prepend("!"));
-
-    EXPECT_EQ(result.size(), 3);
-}
-// Сравнение списков
-TEST_F(PersistentListTest, ListComparison) {
-    PersistentList<int> list1, list2;
-    auto l1 = list1.prepend(3).prepend(2).prepend(1);
-    auto l2 = list2.prepend(3).prepend(2).prepend(1);
-    auto l3 = l1.tail();
-}
-// Списки разных типов
-TEST_F(PersistentListTest, ListWithDifferentTypes) {
-    PersistentList<int> intList;
-    auto intResult = intList.prepend(3).prepend(2).prepend(1);
-    EXPECT_EQ(intResult.size(), 3);
-    EXPECT_EQ(intResult.front(), 1);
-
-    PersistentList<std::string> strList;
-    auto strResult = strList.prepend("world").prepend("hello");
-    EXPECT_EQ(strResult.size(), 2);
-    EXPECT_EQ(strResult.front(), "hello");
-
-    PersistentList<double> doubleList;
-    auto doubleResult = doubleList.prepend(3.14).prepend(2.71);
-    EXPECT_EQ(doubleResult.size(), 2);
-    EXPECT_DOUBLE_EQ(doubleResult.front(), 2.71);
-}
-// Проверка неизменяемости
-TEST_F(PersistentListTest, ImmutabilityTest) {
-    PersistentList<int> base;
-    auto list1 = base.prepend(1).prepend(2).prepend(3);
-    auto list2 = list1.tail();
-    auto list3 = list1.prepend(0);
-
-    EXPECT_EQ(list1.size(), 3);
-    EXPECT_EQ(list2.size(), 2);
-    EXPECT_EQ(list3.size(), 4);
-    EXPECT_EQ(list1.front(), 3);
-    EXPECT_EQ(list3.front(), 0);
-}
-// Большой список
-TEST_F(PersistentListTest, LargeListTest) {
-    PersistentList<int> list;
-    auto current = list;
-
-    for (int i = 0; i < 100; ++i) {
-        current = current.prepend(i);
-    }
-
-    EXPECT_EQ(current.size(), 100);
-
-    auto temp = current;
-    for (int i = 99; i >= 0; --i) {
-        EXPECT_EQ(temp.front(), i);
-        temp = temp.tail();
-    }
-}
-
-// -----------------------------------------
-// -------- ТЕСТЫ ДЛЯ PERSISTENT MAP -------
-// -----------------------------------------
-class PersistentMapTest : public ::testing::Test {
-protected:
-    void SetUp() override {}
-    void TearDown() override {}
-};
-// Создание пустого массива
-TEST_F(PersistentMapTest, EmptyMapCreation) {
-    PersistentMap<std::string, int> map;
-    EXPECT_TRUE(map.empty());
-    EXPECT_EQ(map.size(), 0);
-}
-// Добавление элементов
-TEST_F(PersistentMapTest, AddingElements) {
-    PersistentMap<std::string, int> map;
-    auto map1 = map.set("one", 1);
-    auto map2 = map1.set("two", 2);
-    auto map3 = map2.set("three", 3);
-
-    EXPECT_EQ(map1.size(), 1);
-    EXPECT_EQ(map2.size(), 2);
-    EXPECT_EQ(map3.size(), 3);
-    EXPECT_EQ(map1.at("one"), 1);
-    EXPECT_EQ(map2.at("two"), 2);
-    EXPECT_EQ(map3.at("three"), 3);
-}
-// Обновление элементов
-TEST_F(PersistentMapTest, UpdatingElements) {
-    PersistentMap<std::string, std::string> map;
-    auto map1 = map.set("name", "Alice").set("age", "30");
-    auto map2 = map1.set("name", "Bob");
-
-    EXPECT_EQ(map1.at("name"), "Alice");
-    EXPECT_EQ(map1.at("age"), "30");
-    EXPECT_EQ(map2.at("name"), "Bob");
-    EXPECT_EQ(map2.at("age"), "30");
-    EXPECT_EQ(map1.size(), 2);
-    EXPECT_EQ(map2.size(), 2);
-}
-// Удаление элементов
-TEST_F(PersistentMapTest, RemovingElements) {
-    PersistentMap<std::string, int> map;
-    auto map1 = map.set("a", 1).set("b", 2).set("c", 3);
-    auto map2 = map1.erase("b");
-
-    EXPECT_EQ(map1.size(), 3);
-    EXPECT_EQ(map2.size(), 2);
-    EXPECT_TRUE(map1.contains("b"));
-    EXPECT_FALSE(map2.contains("b"));
-    EXPECT_TRUE(map2.contains("a"));
-    EXPECT_TRUE(map2.contains("c"));
-}
-// Проверка наличия ключа
-TEST_F(PersistentMapTest, CheckingKeyExistence) {
-    PersistentMap<std::string, double> map;
-    auto map1 = map.set("pi", 3.14).set("e", 2.71);
-
-    EXPECT_TRUE(map1.contains("pi"));
-    EXPECT_TRUE(map1.contains("e"));
-    EXPECT_FALSE(map1.contains("phi"));
-}
-// Доступ к значениям
-TEST_F(PersistentMapTest, AccessingValues) {
-    PersistentMap<std::string, std::string> map;
-    auto map1 = map.set("language", "C++").set("version", "17");
-
-    EXPECT_EQ(map1.at("language"), "C++");
-    EXPECT_EQ(map1.at("version"), "17");
-}
-// Обработка исключений
-TEST_F(PersistentMapTest, ExceptionHandling) {
-    PersistentMap<std::string, int> map;
-    EXPECT_THROW(map.at("nonexistent"), std::out_of_range);
-}
-// Цепочки операций
-TEST_F(PersistentMapTest, OperationChaining) {
-    PersistentMap<std::string, int> map;
-    auto result = map.set("a", 1)
-        .set("b", 2)
-        .erase("a")
-        .set("c", 3)
-        .set("b", 20);
-
-    EXPECT_EQ(result.size(), 2);
-    EXPECT_FALSE(result.contains("a"));
-    EXPECT_EQ(result.at("b"), 20);
-    EXPECT_EQ(result.at("c"), 3);
-}
-// Массивы с разными типами значений
-TEST_F(PersistentMapTest, MapWithDifferentValueTypes) {
-    PersistentMap<std::string, int> intMap;
-    auto intResult = intMap.set("count", 42).set("index", 0);
-    EXPECT_EQ(intResult.size(), 2);
-    EXPECT_EQ(intResult.at("count"), 42);
-
-    PersistentMap<std::string, std::string> strMap;
-    auto strResult = strMap.set("name", "Alice").set("city", "Wonderland");
-    EXPECT_EQ(strResult.size(), 2);
-    EXPECT_EQ(strResult.at("name"), "Alice");
-
-    PersistentMap<std::string, double> doubleMap;
-    auto doubleResult = doubleMap.set("pi", 3.14159).set("e", 2.71828);
-    EXPECT_EQ(doubleResult.size(), 2);
-    EXPECT_DOUBLE_EQ(doubleResult.at("pi"), 3.14159);
-}
-// Большой массив
-TEST_F(PersistentMapTest, LargeMapTest) {
-    PersistentMap<int, std::string> map;
-    auto current = map;
-
-    for (int i = 0; i < 100; ++i) {
-        current = current.set(i, "Value_" + std::to_string(i));
-    }
-
-    EXPECT_EQ(current.size(), 100);
-    EXPECT_EQ(current.at(0), "Value_0");
-    EXPECT_EQ(current.at(50), "Value_50");
-    EXPECT_EQ(current.at(99), "Value_99");
-}
-// Проверка неизменяемости
-TEST_F(PersistentMapTest, ImmutabilityTest) {
-    PersistentMap<std::string, int> base;
-    auto map1 = base.set("x", 10).set("y", 20);
-    auto map2 = map1.set("x", 100);
-    auto map3 = map1.erase("y");
-
-    EXPECT_EQ(map1.at("x"), 10);
-    EXPECT_EQ(map1.at("y"), 20);
-    EXPECT_EQ(map2.at("x"), 100);
-    EXPECT_EQ(map2.at("y"), 20);
-    EXPECT_EQ(map3.at("x"), 10);
-    EXPECT_FALSE(map3.contains("y"));
-}
-// Сравнение массивов
-TEST_F(PersistentMapTest, MapComparison) {
-    PersistentMap<std::string, int> map1, map2;
-    auto m1 = map1.set("a", 1).set("b", 2);
-    auto m2 = map2.set("a", 1).set("b", 2);
-    auto m3 = m1.set("a", 100);
-}
-
-// -----------------------------------------
-// ------ ТЕСТЫ ДЛЯ ВЛОЖЕННЫХ СТРУКТУР -----
-// -----------------------------------------
-class NestingTest : public ::testing::Test {
-protected:
-    void SetUp() override {}
-    void TearDown() override {}
-};
-// Вектор векторов
-TEST_F(NestingTest, VectorOfVectors) {
-    PersistentVector<int> inner1, inner2, inner3;
-    inner1 = inner1.append(1).append(2).append(3);
-    inner2 = inner2.append(4).append(5);
-    inner3 = inner3.append(6).append(7).append(8).append(9);
-
-    PersistentVector<PersistentVector<int>> matrix;
-    matrix = matrix.append(inner1).append(inner2).append(inner3);
-
-    EXPECT_EQ(matrix.size(), 3);
-    EXPECT_EQ(matrix.get(0).size(), 3);
-    EXPECT_EQ(matrix.get(1).size(), 2);
-    EXPECT_EQ(matrix.get(2).size(), 4);
-    EXPECT_EQ(matrix.get(0).get(0), 1);
-    EXPECT_EQ(matrix.get(1).get(1), 5);
-    EXPECT_EQ(matrix.get(2).get(3), 9);
-}
-// Список списков
-TEST_F(NestingTest, ListOfLists) {
-    PersistentList<std::string> listA, listB, listC;
-    listA = listA.prepend("C").prepend("B").prepend("A");
-    listB = listB.prepend("World").prepend("Hello");
-    listC = listC.prepend("Z").prepend("Y").prepend("X");
-
-    PersistentList<PersistentList<std::string>> listOfLists;
-    listOfLists = listOfLists.prepend(listC).prepend(listB).prepend(listA);
-
-    EXPECT_EQ(listOfLists.size(), 3);
-    EXPECT_EQ(listOfLists.front().size(), 3);
-    EXPECT_EQ(listOfLists.tail().front().size(), 2);
-}
-// Массив со значениями векторами
-TEST_F(NestingTest, MapWithVectorValues) {
-    PersistentVector<int> scores, ages, weights;
-    scores = scores.append(95).append(87).append(92).append(88);
-    ages = ages.append(25).append(30).append(28);
-    weights = weights.append(70).append(65).append(68).append(72).append(67);
-
-    PersistentMap<std::string, PersistentVector<int>> data;
-    data = data.set("scores", scores)
-        .set("ages", ages)
-        .set("weights", weights);
-
-    EXPECT_EQ(data.size(), 3);
-    EXPECT_EQ(data.at("scores").size(), 4);
-    EXPECT_EQ(data.at("ages").size(), 3);
-    EXPECT_EQ(data.at("weights").size(), 5);
-    EXPECT_EQ(data.at("scores").get(0), 95);
-    EXPECT_EQ(data.at("ages").get(1), 30);
-    EXPECT_EQ(data.at("weights").get(4), 67);
-}
-// Глубокое вложение (списки в массивах в векторах)
-TEST_F(NestingTest, DeepNesting) {
-    PersistentList<int> evenNumbers, oddNumbers, primeNumbers;
-    evenNumbers = evenNumbers.prepend(8).prepend(6).prepend(4).prepend(2);
-    oddNumbers = oddNumbers.prepend(9).prepend(7).prepend(5).prepend(3).prepend(1);
-    primeNumbers = primeNumbers.prepend(11).prepend(7).prepend(5).prepend(3).prepend(2);
-
-    PersistentMap<std::string, PersistentList<int>> student1, student2;
-    student1 = student1.set("even", evenNumbers).set("odd", oddNumbers);
-    student2 = student2.set("even", evenNumbers).set("prime", primeNumbers);
-
-    PersistentVector<PersistentMap<std::string, PersistentList<int>>> classData;
-    classData = classData.append(student1).append(student2);
-
-    EXPECT_EQ(classData.size(), 2);
-    EXPECT_TRUE(classData.get(0).contains("even"));
-    EXPECT_TRUE(classData.get(0).contains("odd"));
-    EXPECT_FALSE(classData.get(0).contains("prime"));
-    EXPECT_TRUE(classData.get(1).contains("even"));
-    EXPECT_TRUE(classData.get(1).contains("prime"));
-    EXPECT_EQ(classData.get(0).at("even").front(), 2);
-    EXPECT_EQ(classData.get(1).at("prime").front(), 2);
-}
-// Тестирует создание PersistentValue разных типов
-TEST_F(NestingTest, PersistentValueConstructors) {
-    PersistentValue nullValue;
-    PersistentValue intValue(100);
-    PersistentValue doubleValue(3.14);
-    PersistentValue boolValue(false);
-    PersistentValue stringValue("test");
-
-    PersistentVector<int> testVec;
-    testVec = testVec.append(1).append(2);
-    PersistentValue vectorValue(testVec);
-
-    PersistentMap<std::string, int> testMap;
-    testMap = testMap.set("key", 123);
-    PersistentValue mapValue(testMap);
-
-    EXPECT_TRUE(nullValue.isNull());
-    EXPECT_TRUE(intValue.isInt());
-    EXPECT_TRUE(doubleValue.isDouble());
-    EXPECT_TRUE(boolValue.isBool());
-    EXPECT_TRUE(stringValue.isString());
-
-    EXPECT_EQ(intValue.asInt(), 100);
-    EXPECT_DOUBLE_EQ(doubleValue.asDouble(), 3.14);
-    EXPECT_EQ(boolValue.asBool(), false);
-    EXPECT_EQ(stringValue.asString(), "test");
-}
-// Модификация вложенных структур
-TEST_F(NestingTest, ModifyingNestedStructures) {
-    PersistentVector<int> row1, row2;
-    row1 = row1.append(1).append(2).append(3);
-    row2 = row2.append(4).append(5).append(6);
-
-    PersistentVector<PersistentVector<int>> matrix;
-    matrix = matrix.append(row1).append(row2);
-
-    int originalRow1Size = row1.size();
-    int originalMatrixSize = matrix.size();
-    int originalValue = matrix.get(0).get(1);
-
-    PersistentVector<int> modifiedRow1 = row1.set(1, 99);
-    PersistentVector<PersistentVector<int>> modifiedMatrix = matrix.set(0, modifiedRow1);
-
-    EXPECT_EQ(row1.size(), originalRow1Size);
-    EXPECT_EQ(matrix.size(), originalMatrixSize);
-    EXPECT_EQ(matrix.get(0).get(1), originalValue);
-    EXPECT_EQ(modifiedMatrix.get(0).get(1), 99);
-    EXPECT_EQ(modifiedMatrix.get(1).get(2), 6);
-}
-
-// -----------------------------------------
-// ------ ТЕСТЫ ДЛЯ ГРАНИЧНЫХ СЛУЧАЕВ ------
-// -----------------------------------------
-
-class EdgeCasesTest : public ::testing::Test {
-protected:
-    void SetUp() override {}
-    void TearDown() override {}
-};
-// Вектор с максимальным количеством операций
-TEST_F(EdgeCasesTest, VectorWithMaximumOperations) {
-    PersistentVector<int> vec;
-    auto current = vec;
-    for (int i = 0; i < 50; ++i) {
-        current = current.append(i);
-        if (i % 10 == 0) {
-            current = current.set(i / 2, i * 10);
-        }
-    }
-
-    EXPECT_EQ(current.size(), 50);
-}
-// Список с чередованием операций
-TEST_F(EdgeCasesTest, ListWithOperationAlternation) {
-    PersistentList<int> list;
-    auto l1 = list.prepend(1).prepend(2).prepend(3);
-    auto l2 = l1.tail().prepend(0);
-    auto l3 = l1.concat(l2);
-
-    EXPECT_EQ(l1.size(), 3);
-    EXPECT_EQ(l2.size(), 3);
-    EXPECT_EQ(l3.size(), 6);
-}
-// Многократную перезапись одного ключа в MAP
-TEST_F(EdgeCasesTest, MapWithOverwriteChain) {
-    PersistentMap<std::string, int> map;
-    auto result = map.set("a", 1)
-        .set("a", 2)
-        .set("a", 3)
-        .set("a", 4);
-
-    EXPECT_EQ(result.at("a"), 4);
-    EXPECT_EQ(result.size(), 1);
-}
-// Комбинированные структуры
-TEST_F(EdgeCasesTest, CombinedStructures) {
-    PersistentVector<PersistentList<int>> vectorOfLists;
-    PersistentList<int> list1, list2;
-    list1 = list1.prepend(3).prepend(2).prepend(1);
-    list2 = list2.prepend(6).prepend(5).prepend(4);
-
-    auto vec = vectorOfLists.append(list1).append(list2);
-    EXPECT_EQ(vec.size(), 2);
-    EXPECT_EQ(vec.get(0).size(), 3);
-
-    PersistentMap<std::string, PersistentVector<int>> mapOfVectors;
-    PersistentVector<int> vec1, vec2;
-    vec1 = vec1.append(1).append(2);
-    vec2 = vec2.append(3).append(4).append(5);
-
-    auto mp = mapOfVectors.set("first", vec1).set("second", vec2);
-    EXPECT_EQ(mp.size(), 2);
-    EXPECT_EQ(mp.at("first").size(), 2);
-    EXPECT_EQ(mp.at("second").size(), 3);
-}
-
-int main(int argc, char** argv) {
-    ::testing::InitGoogleTest(&argc, argv);
-    return RUN_ALL_TESTS();
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cassert>
+#include <sstream>
+#include <filesystem>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <unordered_set>
+#include <random>
+#include <algorithm>
+
+#include "persistent_vector.hpp"
+#include "persistent_list.hpp"
+#include "persistent_map.hpp"
+#include "persistent_value.hpp"
+#include "persistent_data_structure.hpp"
+#include "persistent_reclaimer.hpp"
+#include "persistent_stream.hpp"
+#include "persistent_snapshot.hpp"
+#include "persistent_mapped.hpp"
+#include "persistent_checkpoint.hpp"
+#include "persistent_oplog.hpp"
+#include "persistent_replication.hpp"
+#include "persistent_json.hpp"
+#include "persistent_hashcons.hpp"
+#include "persistent_atom.hpp"
+#include "persistent_mvcc.hpp"
+#include "persistent_parallel.hpp"
+
+#include "persistent_vector_impl.hpp"
+#include "persistent_list_impl.hpp"
+#include "persistent_map_impl.hpp"
+
+// -----------------------------------------
+// ------ ТЕСТЫ ДЛЯ PERSISTENT VECTOR ------
+// -----------------------------------------
+
+class PersistentVectorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+    }
+
+    void TearDown() override {
+    }
+};
+// Создание пустого вектора
+TEST_F(PersistentVectorTest, EmptyVectorCreation) {
+    PersistentVector<int> vec;
+    EXPECT_TRUE(vec.empty());
+    EXPECT_EQ(vec.size(), 0);
+}
+// Добавление элементов
+TEST_F(PersistentVectorTest, AppendingElements) {
+    PersistentVector<int> vec;
+    auto vec1 = vec.append(1);
+    auto vec2 = vec1.append(2);
+    auto vec3 = vec2.append(3);
+
+    EXPECT_EQ(vec1.size(), 1);
+    EXPECT_EQ(vec2.size(), 2);
+    EXPECT_EQ(vec3.size(), 3);
+    EXPECT_EQ(vec1.get(0), 1);
+    EXPECT_EQ(vec2.get(1), 2);
+    EXPECT_EQ(vec3.get(2), 3);
+}
+// Изменение элементов
+TEST_F(PersistentVectorTest, ModifyingElements) {
+    PersistentVector<int> vec;
+    auto vec1 = vec.append(1).append(2).append(3);
+    auto vec2 = vec1.set(1, 99);
+
+    EXPECT_EQ(vec1.get(0), 1);
+    EXPECT_EQ(vec1.get(1), 2);
+    EXPECT_EQ(vec1.get(2), 3);
+    EXPECT_EQ(vec2.get(0), 1);
+    EXPECT_EQ(vec2.get(1), 99);
+    EXPECT_EQ(vec2.get(2), 3);
+}
+// Удаление элементов
+TEST_F(PersistentVectorTest, RemovingElementsPopBack) {
+    PersistentVector<int> vec;
+    auto vec1 = vec.append(1).append(2).append(3);
+    auto vec2 = vec1.pop_back();
+
+    EXPECT_EQ(vec1.size(), 3);
+    EXPECT_EQ(vec2.size(), 2);
+    EXPECT_EQ(vec1.get(2), 3);
+}
+// Доступ по индексу
+TEST_F(PersistentVectorTest, IndexAccess) {
+    PersistentVector<std::string> vec;
+    auto vec1 = vec.append("a").append("b").append("c");
+
+    EXPECT_EQ(vec1.get(0), "a");
+    EXPECT_EQ(vec1.get(1), "b");
+    EXPECT_EQ(vec1.get(2), "c");
+}
+// Обработка исключений
+TEST_F(PersistentVectorTest, ExceptionHandling) {
+    PersistentVector<int> vec;
+    auto vec1 = vec.append(1);
+
+    EXPECT_THROW(vec1.get(5), std::out_of_range);
+    EXPECT_THROW(vec1.set(5, 10), std::out_of_range);
+}
+// Цепочки операций
+TEST_F(PersistentVectorTest, OperationChaining) {
+    PersistentVector<int> vec;
+    auto result = vec.append(1)
+        .append(2)
+        .set(0, 10)
+        .append(3)
+        .pop_back()
+        .set(1, 20);
+
+    EXPECT_EQ(result.size(), 2);
+    EXPECT_EQ(result.get(0), 10);
+    EXPECT_EQ(result.get(1), 20);
+}
+// Сравнение векторов
+TEST_F(PersistentVectorTest, VectorComparison) {
+    PersistentVector<int> vec1, vec2;
+    auto v1 = vec1.append(1).append(2).append(3);
+    auto v2 = vec2.append(1).append(2).append(3);
+    auto v3 = v1.set(1, 99);
+}
+// Векторы разных типов
+TEST_F(PersistentVectorTest, VectorWithDifferentTypes) {
+    PersistentVector<int> intVec;
+    auto intResult = intVec.append(1).append(2).append(3);
+    EXPECT_EQ(intResult.size(), 3);
+    EXPECT_EQ(intResult.get(1), 2);
+
+    PersistentVector<std::string> strVec;
+    auto strResult = strVec.append("hello").append("world");
+    EXPECT_EQ(strResult.size(), 2);
+    EXPECT_EQ(strResult.get(0), "hello");
+
+    PersistentVector<double> doubleVec;
+    auto doubleResult = doubleVec.append(1.1).append(2.2);
+    EXPECT_EQ(doubleResult.size(), 2);
+    EXPECT_DOUBLE_EQ(doubleResult.get(0), 1.1);
+}
+// Тест производительности
+TEST_F(PersistentVectorTest, PerformanceTest) {
+    PersistentVector<int> vec;
+    auto current = vec;
+
+    for (int i = 0; i < 1000; ++i) {
+        current = current.append(i);
+    }
+
+    EXPECT_EQ(current.size(), 1000);
+    EXPECT_EQ(current.get(999), 999);
+}
+// Клонирование узлов с тривиальными и нетривиальными значениями
+TEST_F(PersistentVectorTest, NodeCloningKeepsVersionsApart) {
+    struct Point { int x; double y; };
+    PersistentVector<Point> points;
+    PersistentVector<std::string> names;
+    for (int i = 0; i < 1500; ++i) {
+        points = points.append(Point{ i, i * 0.5 });
+        names = names.append(std::to_string(i));
+    }
+
+    auto movedPoints = points.set(1030, Point{ -1, -1.0 }).set(3, Point{ -3, -3.0 });
+    auto movedNames = names.set(1030, "changed");
+
+    EXPECT_EQ(points.get(1030).x, 1030);
+    EXPECT_EQ(points.get(3).y, 1.5);
+    EXPECT_EQ(movedPoints.get(1030).x, -1);
+    EXPECT_EQ(movedPoints.get(3).x, -3);
+    EXPECT_EQ(movedPoints.get(1499).x, 1499);
+    EXPECT_EQ(names.get(1030), "1030");
+    EXPECT_EQ(movedNames.get(1030), "changed");
+    EXPECT_EQ(movedNames.get(1029), "1029");
+
+    auto shorter = points.pop_back().append(Point{ 7, 7.0 });
+    EXPECT_EQ(shorter.get(1499).x, 7);
+    EXPECT_EQ(points.get(1499).x, 1499);
+}
+
+// -----------------------------------------
+// ------- ТЕСТЫ ДЛЯ PERSISTENT LIST -------
+// -----------------------------------------
+
+class PersistentListTest : public ::testing::Test {
+protected:
+    void SetUp() override {}
+    void TearDown() override {}
+};
+// Создание пустого списка
+TEST_F(PersistentListTest, EmptyListCreation) {
+    PersistentList<int> list;
+    EXPECT_TRUE(list.empty());
+    EXPECT_EQ(list.size(), 0);
+}
+// Добавление в начало
+TEST_F(PersistentListTest, PrependingElements) {
+    PersistentList<int> list;
+    auto list1 = list.prepend(1);
+    auto list2 = list1.prepend(2);
+    auto list3 = list2.prepend(3);
+
+    EXPECT_EQ(list1.size(), 1);
+    EXPECT_EQ(list2.size(), 2);
+    EXPECT_EQ(list3.size(), 3);
+    EXPECT_EQ(list1.front(), 1);
+    EXPECT_EQ(list2.front(), 2);
+    EXPECT_EQ(list3.front(), 3);
+}
+// Получение хвоста списка
+TEST_F(PersistentListTest, GettingTail) {
+    PersistentList<std::string> list;
+    auto list1 = list.prepend("c").prepend("b").prepend("a");
+    auto tail1 = list1.tail();
+    auto tail2 = tail1.tail();
+
+    EXPECT_EQ(list1.front(), "a");
+    EXPECT_EQ(tail1.front(), "b");
+    EXPECT_EQ(tail2.front(), "c");
+    EXPECT_EQ(list1.size(), 3);
+    EXPECT_EQ(tail1.size(), 2);
+    EXPECT_EQ(tail2.size(), 1);
+}
+// Конкатенация списков
+TEST_F(PersistentListTest, ConcatenatingLists) {
+    PersistentList<int> list1, list2;
+    auto l1 = list1.prepend(3).prepend(2).prepend(1);  // [1, 2, 3]
+    auto l2 = list2.prepend(6).prepend(5).prepend(4);  // [4, 5, 6]
+    auto concatenated = l1.concat(l2);  // [1, 2, 3, 4, 5, 6]
+
+    EXPECT_EQ(concatenated.size(), 6);
+
+    auto current = concatenated;
+    int expected[] = { 1, 2, 3, 4, 5, 6 };
+    for (int i = 0; i < 6; ++i) {
+        EXPECT_EQ(current.front(), expected[i]);
+        current = current.tail();
+    }
+}
+// Обработка исключений
+TEST_F(PersistentListTest, ExceptionHandling) {
+    PersistentList<int> emptyList;
+
+    EXPECT_THROW(emptyList.front(), std::runtime_error);
+    EXPECT_THROW(emptyList.tail(), std::runtime_error);
+}
+// Цепочки операций
+TEST_F(PersistentListTest, OperationChaining) {
+    PersistentList<std::string> list;
+    auto result = list.prepend("world")
+        .prepend("hello")
+        .tail()
+        .prepend("there")
+        .concat(list.prepend("!"));
+
+    EXPECT_EQ(result.size(), 3);
+}
+// Сравнение списков
+TEST_F(PersistentListTest, ListComparison) {
+    PersistentList<int> list1, list2;
+    auto l1 = list1.prepend(3).prepend(2).prepend(1);
+    auto l2 = list2.prepend(3).prepend(2).prepend(1);
+    auto l3 = l1.tail();
+}
+// Списки разных типов
+TEST_F(PersistentListTest, ListWithDifferentTypes) {
+    PersistentList<int> intList;
+    auto intResult = intList.prepend(3).prepend(2).prepend(1);
+    EXPECT_EQ(intResult.size(), 3);
+    EXPECT_EQ(intResult.front(), 1);
+
+    PersistentList<std::string> strList;
+    auto strResult = strList.prepend("world").prepend("hello");
+    EXPECT_EQ(strResult.size(), 2);
+    EXPECT_EQ(strResult.front(), "hello");
+
+    PersistentList<double> doubleList;
+    auto doubleResult = doubleList.prepend(3.14).prepend(2.71);
+    EXPECT_EQ(doubleResult.size(), 2);
+    EXPECT_DOUBLE_EQ(doubleResult.front(), 2.71);
+}
+// Проверка неизменяемости
+TEST_F(PersistentListTest, ImmutabilityTest) {
+    PersistentList<int> base;
+    auto list1 = base.prepend(1).prepend(2).prepend(3);
+    auto list2 = list1.tail();
+    auto list3 = list1.prepend(0);
+
+    EXPECT_EQ(list1.size(), 3);
+    EXPECT_EQ(list2.size(), 2);
+    EXPECT_EQ(list3.size(), 4);
+    EXPECT_EQ(list1.front(), 3);
+    EXPECT_EQ(list3.front(), 0);
+}
+// Большой список
+TEST_F(PersistentListTest, LargeListTest) {
+    PersistentList<int> list;
+    auto current = list;
+
+    for (int i = 0; i < 100; ++i) {
+        current = current.prepend(i);
+    }
+
+    EXPECT_EQ(current.size(), 100);
+
+    auto temp = current;
+    for (int i = 99; i >= 0; --i) {
+        EXPECT_EQ(temp.front(), i);
+        temp = temp.tail();
+    }
+}
+
+// Операции на границах чанков
+TEST_F(PersistentListTest, ChunkBoundaries) {
+    std::vector<int> values;
+    for (int i = 0; i < 100; ++i) {
+        values.push_back(i);
+    }
+    PersistentList<int> list(values);
+
+    EXPECT_EQ(list.size(), 100);
+    EXPECT_EQ(list.toVector(), values);
+    EXPECT_EQ(list.at(0), 0);
+    EXPECT_EQ(list.at(17), 17);
+    EXPECT_EQ(list.at(99), 99);
+    EXPECT_EQ(list.back(), 99);
+
+    auto dropped = list.drop(37);
+    EXPECT_EQ(dropped.size(), 63);
+    EXPECT_EQ(dropped.front(), 37);
+    EXPECT_EQ(dropped.at(62), 99);
+
+    auto taken = list.take(20);
+    EXPECT_EQ(taken.size(), 20);
+    EXPECT_EQ(taken.toVector(), std::vector<int>(values.begin(), values.begin() + 20));
+
+    auto reversed = taken.reverse();
+    EXPECT_EQ(reversed.front(), 19);
+    EXPECT_EQ(reversed.back(), 0);
+}
+// Добавление в начало после tail() не портит исходную версию
+TEST_F(PersistentListTest, PrependAfterTailCopiesOnWrite) {
+    PersistentList<std::string> list;
+    for (int i = 0; i < 5; ++i) {
+        list = list.prepend("v" + std::to_string(i));
+    }
+    auto shorter = list.tail().tail();
+    auto branched = shorter.prepend("x");
+
+    EXPECT_EQ(list.front(), "v4");
+    EXPECT_EQ(list.at(1), "v3");
+    EXPECT_EQ(shorter.front(), "v2");
+    EXPECT_EQ(branched.front(), "x");
+    EXPECT_EQ(branched.at(1), "v2");
+    EXPECT_EQ(branched.size(), 4);
+}
+// Итерация, zipper и конкатенация поверх нескольких чанков
+TEST_F(PersistentListTest, MultiChunkTraversal) {
+    PersistentList<int> list;
+    for (int i = 49; i >= 0; --i) {
+        list = list.prepend(i);
+    }
+    int expected = 0;
+    for (int value : list) {
+        EXPECT_EQ(value, expected++);
+    }
+    EXPECT_EQ(expected, 50);
+
+    auto inserted = list.insertAt(25, -1);
+    EXPECT_EQ(inserted.size(), 51);
+    EXPECT_EQ(inserted.at(24), 24);
+    EXPECT_EQ(inserted.at(25), -1);
+    EXPECT_EQ(inserted.at(26), 25);
+
+    auto joined = list.take(10).concat(list.drop(40));
+    EXPECT_EQ(joined.size(), 20);
+    EXPECT_EQ(joined.at(9), 9);
+    EXPECT_EQ(joined.at(10), 40);
+    EXPECT_EQ(joined.append(100).back(), 100);
+}
+
+// -----------------------------------------
+// -------- ТЕСТЫ ДЛЯ PERSISTENT MAP -------
+// -----------------------------------------
+class PersistentMapTest : public ::testing::Test {
+protected:
+    void SetUp() override {}
+    void TearDown() override {}
+};
+// Создание пустого массива
+TEST_F(PersistentMapTest, EmptyMapCreation) {
+    PersistentMap<std::string, int> map;
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(map.size(), 0);
+}
+// Добавление элементов
+TEST_F(PersistentMapTest, AddingElements) {
+    PersistentMap<std::string, int> map;
+    auto map1 = map.set("one", 1);
+    auto map2 = map1.set("two", 2);
+    auto map3 = map2.set("three", 3);
+
+    EXPECT_EQ(map1.size(), 1);
+    EXPECT_EQ(map2.size(), 2);
+    EXPECT_EQ(map3.size(), 3);
+    EXPECT_EQ(map1.at("one"), 1);
+    EXPECT_EQ(map2.at("two"), 2);
+    EXPECT_EQ(map3.at("three"), 3);
+}
+// Обновление элементов
+TEST_F(PersistentMapTest, UpdatingElements) {
+    PersistentMap<std::string, std::string> map;
+    auto map1 = map.set("name", "Alice").set("age", "30");
+    auto map2 = map1.set("name", "Bob");
+
+    EXPECT_EQ(map1.at("name"), "Alice");
+    EXPECT_EQ(map1.at("age"), "30");
+    EXPECT_EQ(map2.at("name"), "Bob");
+    EXPECT_EQ(map2.at("age"), "30");
+    EXPECT_EQ(map1.size(), 2);
+    EXPECT_EQ(map2.size(), 2);
+}
+// Удаление элементов
+TEST_F(PersistentMapTest, RemovingElements) {
+    PersistentMap<std::string, int> map;
+    auto map1 = map.set("a", 1).set("b", 2).set("c", 3);
+    auto map2 = map1.erase("b");
+
+    EXPECT_EQ(map1.size(), 3);
+    EXPECT_EQ(map2.size(), 2);
+    EXPECT_TRUE(map1.contains("b"));
+    EXPECT_FALSE(map2.contains("b"));
+    EXPECT_TRUE(map2.contains("a"));
+    EXPECT_TRUE(map2.contains("c"));
+}
+// Проверка наличия ключа
+TEST_F(PersistentMapTest, CheckingKeyExistence) {
+    PersistentMap<std::string, double> map;
+    auto map1 = map.set("pi", 3.14).set("e", 2.71);
+
+    EXPECT_TRUE(map1.contains("pi"));
+    EXPECT_TRUE(map1.contains("e"));
+    EXPECT_FALSE(map1.contains("phi"));
+}
+// Доступ к значениям
+TEST_F(PersistentMapTest, AccessingValues) {
+    PersistentMap<std::string, std::string> map;
+    auto map1 = map.set("language", "C++").set("version", "17");
+
+    EXPECT_EQ(map1.at("language"), "C++");
+    EXPECT_EQ(map1.at("version"), "17");
+}
+// Обработка исключений
+TEST_F(PersistentMapTest, ExceptionHandling) {
+    PersistentMap<std::string, int> map;
+    EXPECT_THROW(map.at("nonexistent"), std::out_of_range);
+}
+// Цепочки операций
+TEST_F(PersistentMapTest, OperationChaining) {
+    PersistentMap<std::string, int> map;
+    auto result = map.set("a", 1)
+        .set("b", 2)
+        .erase("a")
+        .set("c", 3)
+        .set("b", 20);
+
+    EXPECT_EQ(result.size(), 2);
+    EXPECT_FALSE(result.contains("a"));
+    EXPECT_EQ(result.at("b"), 20);
+    EXPECT_EQ(result.at("c"), 3);
+}
+// Массивы с разными типами значений
+TEST_F(PersistentMapTest, MapWithDifferentValueTypes) {
+    PersistentMap<std::string, int> intMap;
+    auto intResult = intMap.set("count", 42).set("index", 0);
+    EXPECT_EQ(intResult.size(), 2);
+    EXPECT_EQ(intResult.at("count"), 42);
+
+    PersistentMap<std::string, std::string> strMap;
+    auto strResult = strMap.set("name", "Alice").set("city", "Wonderland");
+    EXPECT_EQ(strResult.size(), 2);
+    EXPECT_EQ(strResult.at("name"), "Alice");
+
+    PersistentMap<std::string, double> doubleMap;
+    auto doubleResult = doubleMap.set("pi", 3.14159).set("e", 2.71828);
+    EXPECT_EQ(doubleResult.size(), 2);
+    EXPECT_DOUBLE_EQ(doubleResult.at("pi"), 3.14159);
+}
+// Большой массив
+TEST_F(PersistentMapTest, LargeMapTest) {
+    PersistentMap<int, std::string> map;
+    auto current = map;
+
+    for (int i = 0; i < 100; ++i) {
+        current = current.set(i, "Value_" + std::to_string(i));
+    }
+
+    EXPECT_EQ(current.size(), 100);
+    EXPECT_EQ(current.at(0), "Value_0");
+    EXPECT_EQ(current.at(50), "Value_50");
+    EXPECT_EQ(current.at(99), "Value_99");
+}
+// Проверка неизменяемости
+TEST_F(PersistentMapTest, ImmutabilityTest) {
+    PersistentMap<std::string, int> base;
+    auto map1 = base.set("x", 10).set("y", 20);
+    auto map2 = map1.set("x", 100);
+    auto map3 = map1.erase("y");
+
+    EXPECT_EQ(map1.at("x"), 10);
+    EXPECT_EQ(map1.at("y"), 20);
+    EXPECT_EQ(map2.at("x"), 100);
+    EXPECT_EQ(map2.at("y"), 20);
+    EXPECT_EQ(map3.at("x"), 10);
+    EXPECT_FALSE(map3.contains("y"));
+}
+// Сравнение массивов
+TEST_F(PersistentMapTest, MapComparison) {
+    PersistentMap<std::string, int> map1, map2;
+    auto m1 = map1.set("a", 1).set("b", 2);
+    auto m2 = map2.set("a", 1).set("b", 2);
+    auto m3 = m1.set("a", 100);
+}
+
+// -----------------------------------------
+// ------ ТЕСТЫ ДЛЯ ВЛОЖЕННЫХ СТРУКТУР -----
+// -----------------------------------------
+class NestingTest : public ::testing::Test {
+protected:
+    void SetUp() override {}
+    void TearDown() override {}
+};
+// Вектор векторов
+TEST_F(NestingTest, VectorOfVectors) {
+    PersistentVector<int> inner1, inner2, inner3;
+    inner1 = inner1.append(1).append(2).append(3);
+    inner2 = inner2.append(4).append(5);
+    inner3 = inner3.append(6).append(7).append(8).append(9);
+
+    PersistentVector<PersistentVector<int>> matrix;
+    matrix = matrix.append(inner1).append(inner2).append(inner3);
+
+    EXPECT_EQ(matrix.size(), 3);
+    EXPECT_EQ(matrix.get(0).size(), 3);
+    EXPECT_EQ(matrix.get(1).size(), 2);
+    EXPECT_EQ(matrix.get(2).size(), 4);
+    EXPECT_EQ(matrix.get(0).get(0), 1);
+    EXPECT_EQ(matrix.get(1).get(1), 5);
+    EXPECT_EQ(matrix.get(2).get(3), 9);
+}
+// Список списков
+TEST_F(NestingTest, ListOfLists) {
+    PersistentList<std::string> listA, listB, listC;
+    listA = listA.prepend("C").prepend("B").prepend("A");
+    listB = listB.prepend("World").prepend("Hello");
+    listC = listC.prepend("Z").prepend("Y").prepend("X");
+
+    PersistentList<PersistentList<std::string>> listOfLists;
+    listOfLists = listOfLists.prepend(listC).prepend(listB).prepend(listA);
+
+    EXPECT_EQ(listOfLists.size(), 3);
+    EXPECT_EQ(listOfLists.front().size(), 3);
+    EXPECT_EQ(listOfLists.tail().front().size(), 2);
+}
+// Массив со значениями векторами
+TEST_F(NestingTest, MapWithVectorValues) {
+    PersistentVector<int> scores, ages, weights;
+    scores = scores.append(95).append(87).append(92).append(88);
+    ages = ages.append(25).append(30).append(28);
+    weights = weights.append(70).append(65).append(68).append(72).append(67);
+
+    PersistentMap<std::string, PersistentVector<int>> data;
+    data = data.set("scores", scores)
+        .set("ages", ages)
+        .set("weights", weights);
+
+    EXPECT_EQ(data.size(), 3);
+    EXPECT_EQ(data.at("scores").size(), 4);
+    EXPECT_EQ(data.at("ages").size(), 3);
+    EXPECT_EQ(data.at("weights").size(), 5);
+    EXPECT_EQ(data.at("scores").get(0), 95);
+    EXPECT_EQ(data.at("ages").get(1), 30);
+    EXPECT_EQ(data.at("weights").get(4), 67);
+}
+// Глубокое вложение (списки в массивах в векторах)
+TEST_F(NestingTest, DeepNesting) {
+    PersistentList<int> evenNumbers, oddNumbers, primeNumbers;
+    evenNumbers = evenNumbers.prepend(8).prepend(6).prepend(4).prepend(2);
+    oddNumbers = oddNumbers.prepend(9).prepend(7).prepend(5).prepend(3).prepend(1);
+    primeNumbers = primeNumbers.prepend(11).prepend(7).prepend(5).prepend(3).prepend(2);
+
+    PersistentMap<std::string, PersistentList<int>> student1, student2;
+    student1 = student1.set("even", evenNumbers).set("odd", oddNumbers);
+    student2 = student2.set("even", evenNumbers).set("prime", primeNumbers);
+
+    PersistentVector<PersistentMap<std::string, PersistentList<int>>> classData;
+    classData = classData.append(student1).append(student2);
+
+    EXPECT_EQ(classData.size(), 2);
+    EXPECT_TRUE(classData.get(0).contains("even"));
+    EXPECT_TRUE(classData.get(0).contains("odd"));
+    EXPECT_FALSE(classData.get(0).contains("prime"));
+    EXPECT_TRUE(classData.get(1).contains("even"));
+    EXPECT_TRUE(classData.get(1).contains("prime"));
+    EXPECT_EQ(classData.get(0).at("even").front(), 2);
+    EXPECT_EQ(classData.get(1).at("prime").front(), 2);
+}
+// Тестирует создание PersistentValue разных типов
+TEST_F(NestingTest, PersistentValueConstructors) {
+    PersistentValue nullValue;
+    PersistentValue intValue(100);
+    PersistentValue doubleValue(3.14);
+    PersistentValue boolValue(false);
+    PersistentValue stringValue("test");
+
+    PersistentVector<int> testVec;
+    testVec = testVec.append(1).append(2);
+    PersistentValue vectorValue(testVec);
+
+    PersistentMap<std::string, int> testMap;
+    testMap = testMap.set("key", 123);
+    PersistentValue mapValue(testMap);
+
+    EXPECT_TRUE(nullValue.isNull());
+    EXPECT_TRUE(intValue.isInt());
+    EXPECT_TRUE(doubleValue.isDouble());
+    EXPECT_TRUE(boolValue.isBool());
+    EXPECT_TRUE(stringValue.isString());
+
+    EXPECT_EQ(intValue.asInt(), 100);
+    EXPECT_DOUBLE_EQ(doubleValue.asDouble(), 3.14);
+    EXPECT_EQ(boolValue.asBool(), false);
+    EXPECT_EQ(stringValue.asString(), "test");
+}
+// Модификация вложенных структур
+TEST_F(NestingTest, ModifyingNestedStructures) {
+    PersistentVector<int> row1, row2;
+    row1 = row1.append(1).append(2).append(3);
+    row2 = row2.append(4).append(5).append(6);
+
+    PersistentVector<PersistentVector<int>> matrix;
+    matrix = matrix.append(row1).append(row2);
+
+    int originalRow1Size = row1.size();
+    int originalMatrixSize = matrix.size();
+    int originalValue = matrix.get(0).get(1);
+
+    PersistentVector<int> modifiedRow1 = row1.set(1, 99);
+    PersistentVector<PersistentVector<int>> modifiedMatrix = matrix.set(0, modifiedRow1);
+
+    EXPECT_EQ(row1.size(), originalRow1Size);
+    EXPECT_EQ(matrix.size(), originalMatrixSize);
+    EXPECT_EQ(matrix.get(0).get(1), originalValue);
+    EXPECT_EQ(modifiedMatrix.get(0).get(1), 99);
+    EXPECT_EQ(modifiedMatrix.get(1).get(2), 6);
+}
+
+// -----------------------------------------
+// ------ ТЕСТЫ ДЛЯ ГРАНИЧНЫХ СЛУЧАЕВ ------
+// -----------------------------------------
+
+class EdgeCasesTest : public ::testing::Test {
+protected:
+    void SetUp() override {}
+    void TearDown() override {}
+};
+// Вектор с максимальным количеством операций
+TEST_F(EdgeCasesTest, VectorWithMaximumOperations) {
+    PersistentVector<int> vec;
+    auto current = vec;
+    for (int i = 0; i < 50; ++i) {
+        current = current.append(i);
+        if (i % 10 == 0) {
+            current = current.set(i / 2, i * 10);
+        }
+    }
+
+    EXPECT_EQ(current.size(), 50);
+}
+// Список с чередованием операций
+TEST_F(EdgeCasesTest, ListWithOperationAlternation) {
+    PersistentList<int> list;
+    auto l1 = list.prepend(1).prepend(2).prepend(3);
+    auto l2 = l1.tail().prepend(0);
+    auto l3 = l1.concat(l2);
+
+    EXPECT_EQ(l1.size(), 3);
+    EXPECT_EQ(l2.size(), 3);
+    EXPECT_EQ(l3.size(), 6);
+}
+// Многократную перезапись одного ключа в MAP
+TEST_F(EdgeCasesTest, MapWithOverwriteChain) {
+    PersistentMap<std::string, int> map;
+    auto result = map.set("a", 1)
+        .set("a", 2)
+        .set("a", 3)
+        .set("a", 4);
+
+    EXPECT_EQ(result.at("a"), 4);
+    EXPECT_EQ(result.size(), 1);
+}
+// Комбинированные структуры
+TEST_F(EdgeCasesTest, CombinedStructures) {
+    PersistentVector<PersistentList<int>> vectorOfLists;
+    PersistentList<int> list1, list2;
+    list1 = list1.prepend(3).prepend(2).prepend(1);
+    list2 = list2.prepend(6).prepend(5).prepend(4);
+
+    auto vec = vectorOfLists.append(list1).append(list2);
+    EXPECT_EQ(vec.size(), 2);
+    EXPECT_EQ(vec.get(0).size(), 3);
+
+    PersistentMap<std::string, PersistentVector<int>> mapOfVectors;
+    PersistentVector<int> vec1, vec2;
+    vec1 = vec1.append(1).append(2);
+    vec2 = vec2.append(3).append(4).append(5);
+
+    auto mp = mapOfVectors.set("first", vec1).set("second", vec2);
+    EXPECT_EQ(mp.size(), 2);
+    EXPECT_EQ(mp.at("first").size(), 2);
+    EXPECT_EQ(mp.at("second").size(), 3);
+}
+
+// -----------------------------------------
+// ---- ТЕСТЫ ДЛЯ ОТЛОЖЕННОГО ОСВОБОЖДЕНИЯ --
+// -----------------------------------------
+
+class ReclaimerTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        PersistentReclaimer::instance().enable();
+    }
+    void TearDown() override {
+        PersistentReclaimer::instance().disable();
+    }
+};
+// Версии освобождаются фоновым потоком
+TEST_F(ReclaimerTest, DroppedVersionsAreReclaimed) {
+    auto& reclaimer = PersistentReclaimer::instance();
+    auto before = reclaimer.stats();
+    {
+        PersistentVector<int> vec;
+        for (int i = 0; i < 2000; ++i) {
+            vec = vec.append(i);
+        }
+        PersistentMap<int, int> map;
+        for (int i = 0; i < 500; ++i) {
+            map = map.set(i, i * i);
+        }
+        EXPECT_EQ(vec.get(1999), 1999);
+        EXPECT_EQ(map.at(20), 400);
+    }
+    reclaimer.drain();
+    auto after = reclaimer.stats();
+
+    EXPECT_GT(after.retired, before.retired);
+    EXPECT_EQ(after.backlog, 0);
+    EXPECT_EQ(after.retired - before.retired, after.reclaimed - before.reclaimed);
+}
+// Освобождение старой версии не затрагивает новую
+TEST_F(ReclaimerTest, SurvivingVersionStaysIntact) {
+    PersistentVector<std::string> survivor;
+    {
+        PersistentVector<std::string> base;
+        for (int i = 0; i < 100; ++i) {
+            base = base.append("item_" + std::to_string(i));
+        }
+        survivor = base.set(50, "changed");
+    }
+    PersistentReclaimer::instance().drain();
+
+    EXPECT_EQ(survivor.size(), 100);
+    EXPECT_EQ(survivor.get(0), "item_0");
+    EXPECT_EQ(survivor.get(50), "changed");
+    EXPECT_EQ(survivor.get(99), "item_99");
+}
+// Переполнение очереди приводит к синхронному освобождению
+TEST_F(ReclaimerTest, BoundedBacklogFallsBackToInline) {
+    auto& reclaimer = PersistentReclaimer::instance();
+    reclaimer.enable(0);
+    auto before = reclaimer.stats();
+    {
+        PersistentMap<std::string, int> map;
+        map = map.set("a", 1).set("b", 2);
+    }
+    auto after = reclaimer.stats();
+
+    EXPECT_EQ(after.retired, before.retired);
+    EXPECT_GT(after.inlined, before.inlined);
+}
+
+// -----------------------------------------
+// ------ ТЕСТЫ ДЛЯ ЛЕНИВЫХ ПОТОКОВ --------
+// -----------------------------------------
+
+class PersistentStreamTest : public ::testing::Test {
+protected:
+    void SetUp() override {}
+    void TearDown() override {}
+};
+// Цепочка преобразований вычисляет только запрошенные элементы
+TEST_F(PersistentStreamTest, ShortCircuitPipeline) {
+    int calls = 0;
+    auto naturals = PersistentStream<int>::iterate(0, [](int x) { return x + 1; });
+    auto result = naturals
+        .map([&calls](int x) { ++calls; return x * x; })
+        .filter([](int x) { return x % 2 == 0; })
+        .take(3)
+        .toVector();
+
+    EXPECT_EQ(result, std::vector<int>({ 0, 4, 16 }));
+    EXPECT_EQ(calls, 5);
+}
+// Хвост вычисляется один раз и запоминается
+TEST_F(PersistentStreamTest, MemoizedThunks) {
+    int calls = 0;
+    auto stream = PersistentStream<int>::fromVector({ 1, 2, 3 })
+        .map([&calls](int x) { ++calls; return x * 10; });
+
+    EXPECT_EQ(stream.toVector(), std::vector<int>({ 10, 20, 30 }));
+    EXPECT_EQ(stream.toVector(), std::vector<int>({ 10, 20, 30 }));
+    EXPECT_EQ(stream.tail().front(), 20);
+    EXPECT_EQ(calls, 3);
+}
+// takeWhile, drop и zip
+TEST_F(PersistentStreamTest, TakeWhileDropAndZip) {
+    auto naturals = PersistentStream<int>::iterate(1, [](int x) { return x + 1; });
+    auto small = naturals.take_while([](int x) { return x < 5; });
+    EXPECT_EQ(small.toVector(), std::vector<int>({ 1, 2, 3, 4 }));
+
+    auto names = PersistentStream<std::string>::fromVector({ "a", "b", "c" });
+    auto pairs = naturals.drop(10).zip(names).toVector();
+    ASSERT_EQ(pairs.size(), 3);
+    EXPECT_EQ(pairs[0], std::make_pair(11, std::string("a")));
+    EXPECT_EQ(pairs[2], std::make_pair(13, std::string("c")));
+}
+// Преобразование в PersistentList и обратно
+TEST_F(PersistentStreamTest, ListRoundTrip) {
+    PersistentList<int> list({ 5, 6, 7, 8 });
+    auto stream = PersistentStream<int>::fromList(list).prepend(4);
+
+    EXPECT_FALSE(stream.empty());
+    EXPECT_EQ(stream.front(), 4);
+
+    auto back = stream.map([](int x) { return x + 1; }).toList();
+    EXPECT_EQ(back.size(), 5);
+    EXPECT_EQ(back.front(), 5);
+    EXPECT_EQ(back.back(), 9);
+    EXPECT_TRUE(PersistentStream<int>().empty());
+    EXPECT_THROW(PersistentStream<int>().front(), std::runtime_error);
+}
+
+// -----------------------------------------
+// ------- ТЕСТЫ ДЛЯ СЕМАНТИКИ ПЕРЕМЕЩЕНИЯ -
+// -----------------------------------------
+
+// Значение, считающее свои копирования
+struct CopyCounted {
+    static int copies;
+    std::string text;
+
+    CopyCounted(std::string t) : text(std::move(t)) {}
+    CopyCounted(const CopyCounted& other) : text(other.text) { ++copies; }
+    CopyCounted(CopyCounted&& other) noexcept = default;
+    CopyCounted& operator=(const CopyCounted& other) { text = other.text; ++copies; return *this; }
+    CopyCounted& operator=(CopyCounted&& other) noexcept = default;
+};
+int CopyCounted::copies = 0;
+
+class MoveSemanticsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        CopyCounted::copies = 0;
+    }
+    void TearDown() override {}
+};
+// Уникальный вектор дописывается на месте, значения не копируются
+TEST_F(MoveSemanticsTest, VectorRvalueAppendReusesNodes) {
+    PersistentVector<CopyCounted> vec;
+    for (int i = 0; i < 1100; ++i) {
+        vec = std::move(vec).emplace_back("item_" + std::to_string(i));
+    }
+    vec = std::move(vec).set(7, CopyCounted("seven"));
+    EXPECT_EQ(CopyCounted::copies, 0);
+    EXPECT_EQ(vec.size(), 1100);
+    EXPECT_EQ(vec.get(7).text, "seven");
+    EXPECT_EQ(vec.get(1099).text, "item_1099");
+
+    // Разделяемая версия по-прежнему копирует путь и не меняется
+    auto shared = vec;
+    auto changed = std::move(shared).set(0, CopyCounted("zero"));
+    EXPECT_GT(CopyCounted::copies, 0);
+    EXPECT_EQ(vec.get(0).text, "item_0");
+    EXPECT_EQ(changed.get(0).text, "zero");
+}
+// Добавление в начало списка без копирования значений
+TEST_F(MoveSemanticsTest, ListEmplaceFront) {
+    PersistentList<CopyCounted> list;
+    for (int i = 0; i < 40; ++i) {
+        list = std::move(list).emplace_front(std::to_string(i));
+    }
+    list = std::move(list).prepend(CopyCounted("head"));
+    EXPECT_EQ(CopyCounted::copies, 0);
+    EXPECT_EQ(list.size(), 41);
+    EXPECT_EQ(list.front().text, "head");
+    EXPECT_EQ(list.back().text, "0");
+}
+// Уникальный массив обновляется на месте, в том числе при разделении листов
+TEST_F(MoveSemanticsTest, MapRvalueSetAndEmplace) {
+    PersistentMap<int, CopyCounted> map;
+    for (int i = 0; i < 300; ++i) {
+        map = std::move(map).emplace(i, "v" + std::to_string(i));
+    }
+    map = std::move(map).set(5, CopyCounted("five"));
+    EXPECT_EQ(CopyCounted::copies, 0);
+    EXPECT_EQ(map.size(), 300);
+    EXPECT_EQ(map.at(5).text, "five");
+    EXPECT_EQ(map.at(299).text, "v299");
+
+    auto before = map;
+    auto after = map.set(5, CopyCounted("changed"));
+    EXPECT_EQ(before.at(5).text, "five");
+    EXPECT_EQ(after.at(5).text, "changed");
+    EXPECT_EQ(after.size(), 300);
+}
+
+// -----------------------------------------
+// -------- ТЕСТЫ ДЛЯ ДВОИЧНЫХ СНИМКОВ -----
+// -----------------------------------------
+
+class SnapshotTest : public ::testing::Test {
+protected:
+    void SetUp() override {}
+    void TearDown() override {}
+};
+// Сохранение и восстановление всех видов структур
+TEST_F(SnapshotTest, RoundTripStructures) {
+    PersistentVector<int> vec;
+    for (int i = -500; i < 1500; ++i) {
+        vec = vec.append(i);
+    }
+    PersistentList<std::string> list({ "a", "b", "c" });
+    list = list.tail().prepend("x");
+    PersistentMap<std::string, double> map;
+    for (int i = 0; i < 200; ++i) {
+        map = map.set("key" + std::to_string(i), i * 0.25);
+    }
+
+    std::stringstream file;
+    SnapshotWriter writer(file);
+    EXPECT_EQ(writer.write(vec, 10), 0);
+    EXPECT_EQ(writer.write(list, 20), 1);
+    EXPECT_EQ(writer.write(map, 30), 2);
+
+    SnapshotReader reader(file);
+    ASSERT_EQ(reader.roots(), 3);
+    EXPECT_EQ(reader.root(0).kind, SnapshotKind::VECTOR);
+    EXPECT_EQ(reader.root(1).tag, 20);
+    EXPECT_EQ(reader.root(2).type, "map<str,f64>");
+
+    auto vec2 = reader.read<PersistentVector<int>>(0);
+    EXPECT_EQ(vec2.toStdVector(), vec.toStdVector());
+    auto list2 = reader.read<PersistentList<std::string>>(1);
+    EXPECT_EQ(list2.toVector(), std::vector<std::string>({ "x", "b", "c" }));
+    auto map2 = reader.readLast<PersistentMap<std::string, double>>();
+    EXPECT_EQ(map2.size(), 200);
+    EXPECT_EQ(map2.at("key199"), 199 * 0.25);
+
+    // Восстановленные версии остаются обычными персистентными структурами
+    auto changed = map2.set("key0", -1.0).erase("key1");
+    EXPECT_EQ(changed.size(), 199);
+    EXPECT_EQ(map2.at("key0"), 0.0);
+}
+// Общие узлы версий записываются один раз
+TEST_F(SnapshotTest, SharedNodesWrittenOnce) {
+    PersistentMap<int, int> map;
+    for (int i = 0; i < 5000; ++i) {
+        map = std::move(map).set(i, i);
+    }
+
+    std::stringstream file;
+    SnapshotWriter writer(file);
+    writer.write(map, 0);
+    size_t oneVersion = file.str().size();
+    size_t baseNodes = writer.nodesWritten();
+
+    for (int v = 1; v < 100; ++v) {
+        map = map.set(v * 31, -v);
+        writer.write(map, v);
+    }
+    // 99 новых версий стоят меньше одной полной
+    EXPECT_LT(file.str().size(), oneVersion * 2);
+    EXPECT_LT(writer.nodesWritten() - baseNodes, baseNodes);
+    EXPECT_GT(writer.nodesReused(), 0);
+
+    SnapshotReader reader(file);
+    EXPECT_EQ(reader.roots(), 100);
+    auto first = reader.read<PersistentMap<int, int>>(0);
+    auto last = reader.readLast<PersistentMap<int, int>>();
+    EXPECT_EQ(first.at(31), 31);
+    EXPECT_EQ(last.at(31), -1);
+    EXPECT_EQ(last.at(99 * 31), -99);
+    EXPECT_EQ(reader.root(57).tag, 57);
+}
+// Вложенные структуры внутри PersistentValue
+TEST_F(SnapshotTest, NestedPersistentValue) {
+    PersistentVector<int> numbers({ 1, 2, 3 });
+    PersistentList<PersistentValue> mixed({ PersistentValue(1), PersistentValue("two"), PersistentValue(true) });
+    PersistentMap<std::string, PersistentValue> doc;
+    doc = doc.set("numbers", PersistentValue(numbers))
+        .set("mixed", PersistentValue(mixed))
+        .set("pi", PersistentValue(3.14))
+        .set("none", PersistentValue());
+
+    std::stringstream file;
+    SnapshotWriter writer(file);
+    writer.write(PersistentValue(doc), 1);
+
+    SnapshotReader reader(file);
+    auto value = reader.read<PersistentValue>(0);
+    ASSERT_TRUE(value.isMap());
+    auto restored = value.asMap<std::string, PersistentValue>();
+    EXPECT_EQ(restored->size(), 4);
+    EXPECT_EQ(restored->at("numbers").asVector<int>()->toStdVector(), std::vector<int>({ 1, 2, 3 }));
+    auto list = restored->at("mixed").asList<PersistentValue>();
+    EXPECT_EQ(list->at(1).asString(), "two");
+    EXPECT_TRUE(list->at(2).asBool());
+    EXPECT_EQ(restored->at("pi").asDouble(), 3.14);
+    EXPECT_TRUE(restored->at("none").isNull());
+}
+// Записанный узел не меняется на месте rvalue-операцией
+TEST_F(SnapshotTest, RvalueUpdateAfterWrite) {
+    PersistentVector<int> vec({ 10, 11, 12 });
+    using IntMap = PersistentMap<int, int>;
+    IntMap map;
+    map = std::move(map).set(1, 1);
+    PersistentList<int> list({ 3 });
+
+    std::stringstream file;
+    SnapshotWriter writer(file);
+    writer.write(vec);
+    writer.write(map);
+    writer.write(list);
+
+    vec = std::move(vec).set(0, 999);
+    map = std::move(map).set(1, 777);
+    list = std::move(list).prepend(2);
+    writer.write(vec);
+    writer.write(map);
+    writer.write(list);
+
+    SnapshotReader reader(file);
+    EXPECT_EQ(reader.read<PersistentVector<int>>(0).get(0), 10);
+    EXPECT_EQ(reader.read<PersistentVector<int>>(3).get(0), 999);
+    EXPECT_EQ(reader.read<IntMap>(1).at(1), 1);
+    EXPECT_EQ(reader.read<IntMap>(4).at(1), 777);
+    EXPECT_EQ(reader.read<PersistentList<int>>(2).toVector(), std::vector<int>({ 3 }));
+    EXPECT_EQ(reader.read<PersistentList<int>>(5).toVector(), std::vector<int>({ 2, 3 }));
+}
+// Узлы отброшенных версий уходят из таблицы целыми поддеревьями
+TEST_F(SnapshotTest, PruneReleasesDroppedVersions) {
+    std::stringstream file;
+    SnapshotWriter writer(file);
+    PersistentVector<int> kept({ 1, 2, 3 });
+    writer.write(kept);
+    size_t keptNodes = writer.nodesKnown();
+    {
+        PersistentVector<int> dropped(std::vector<int>(5000, 7));
+        writer.write(dropped);
+    }
+    EXPECT_GT(writer.nodesKnown(), keptNodes);
+    writer.prune();
+    EXPECT_EQ(writer.nodesKnown(), keptNodes);
+}
+// Номер корня вложенной структуры, указывающий на содержащий узел
+// (или позже), - ошибка чтения, а не бесконечная рекурсия
+TEST_F(SnapshotTest, RejectsMalformedNesting) {
+    PersistentVector<PersistentValue> inner;
+    inner = inner.append(PersistentValue(1));
+    PersistentVector<PersistentValue> outer;
+    outer = outer.append(PersistentValue(inner));
+
+    std::stringstream file;
+    SnapshotWriter writer(file);
+    writer.write(outer);
+    ASSERT_EQ(writer.nodesWritten(), 2);
+    std::string bytes = file.str();
+
+    // Любой байт, замененный номером внешнего узла: чтение завершается
+    // результатом или исключением
+    size_t rejected = 0;
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        std::string corrupted = bytes;
+        corrupted[i] = 2;
+        try {
+            SnapshotReader reader(corrupted);
+            reader.readLast<PersistentVector<PersistentValue>>();
+        }
+        catch (const std::exception&) {
+            ++rejected;
+        }
+    }
+    EXPECT_GT(rejected, 0);
+}
+// Несовпадение типа и поврежденные данные
+TEST_F(SnapshotTest, RejectsMismatchedAndCorruptedData) {
+    std::stringstream file;
+    SnapshotWriter writer(file);
+    writer.write(PersistentVector<int>({ 1, 2, 3 }));
+    std::string bytes = file.str();
+
+    SnapshotReader reader(bytes);
+    EXPECT_THROW(reader.read<PersistentVector<std::string>>(0), std::runtime_error);
+    EXPECT_THROW(reader.read<PersistentList<int>>(0), std::runtime_error);
+    EXPECT_THROW(reader.read<PersistentVector<int>>(1), std::out_of_range);
+
+    EXPECT_THROW(SnapshotReader(std::string("garbage")), std::runtime_error);
+    EXPECT_THROW(SnapshotReader(bytes.substr(0, bytes.size() - 2)), std::runtime_error);
+}
+
+// -----------------------------------------
+// --- ТЕСТЫ ДЛЯ ОТОБРАЖАЕМЫХ СНИМКОВ ------
+// -----------------------------------------
+
+// Общая база тестов с файлами: имя из зерна запуска и имени теста,
+// оставшийся от прошлого запуска файл удаляется при выдаче пути,
+// все выданные файлы - в TearDown
+class TempFileTest : public ::testing::Test {
+protected:
+    std::string tempPath(const std::string& prefix, const std::string& extension = "") {
+        std::string path = (std::filesystem::temp_directory_path() /
+            ("persistent_" + prefix + "_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed()) +
+                ::testing::UnitTest::GetInstance()->current_test_info()->name() + extension)).string();
+        std::remove(path.c_str());
+        files.push_back(path);
+        return path;
+    }
+    void TearDown() override {
+        for (const std::string& file : files) {
+            std::remove(file.c_str());
+        }
+    }
+
+private:
+    std::vector<std::string> files;
+};
+
+class MappedSnapshotTest : public TempFileTest {
+protected:
+    std::string path;
+
+    void SetUp() override {
+        path = tempPath("mapped");
+    }
+};
+// Чтение вектора прямо из отображенного файла
+TEST_F(MappedSnapshotTest, VectorLookups) {
+    PersistentVector<int> numbers;
+    for (int i = 0; i < 3000; ++i) {
+        numbers = std::move(numbers).append(i * 3);
+    }
+    MappedSnapshotWriter::write(path, numbers.set(1234, -1));
+
+    MappedVectorView<int> view(path);
+    EXPECT_EQ(view.size(), 3000);
+    EXPECT_EQ(view[0], 0);
+    EXPECT_EQ(view.get(1234), -1);
+    EXPECT_EQ(view.at(2999), 2999 * 3);
+    EXPECT_THROW(view.at(3000), std::out_of_range);
+
+    PersistentVector<std::string> words({ "alpha", "", "gamma" });
+    MappedSnapshotWriter::write(path, words);
+    MappedVectorView<std::string> strings(path);
+    EXPECT_EQ(strings.get(0), "alpha");
+    EXPECT_TRUE(strings.get(1).empty());
+    EXPECT_EQ(strings.get(2), "gamma");
+}
+// Поиск в HAMT без десериализации
+TEST_F(MappedSnapshotTest, MapLookups) {
+    PersistentMap<std::string, int> ids;
+    for (int i = 0; i < 5000; ++i) {
+        ids = std::move(ids).set("user" + std::to_string(i), i);
+    }
+    MappedSnapshotWriter::write(path, ids);
+
+    MappedMapView<std::string, int> view(path);
+    EXPECT_EQ(view.size(), 5000);
+    for (int i = 0; i < 5000; i += 97) {
+        EXPECT_EQ(view.at("user" + std::to_string(i)), i);
+    }
+    EXPECT_TRUE(view.contains("user4999"));
+    EXPECT_FALSE(view.contains("user5000"));
+    EXPECT_FALSE(view.get("nobody").has_value());
+    EXPECT_THROW(view.at("nobody"), std::out_of_range);
+
+    // Представление продолжает работать, пока жив хотя бы один владелец файла
+    auto shared = view.mappedFile();
+    MappedMapView<std::string, int> second(shared);
+    EXPECT_EQ(second.get("user42").value(), 42);
+}
+// Проверка заголовка и типов
+TEST_F(MappedSnapshotTest, RejectsWrongTypeOrFile) {
+    PersistentMap<int, double> map;
+    map = map.set(1, 0.5).set(2, 1.5);
+    MappedSnapshotWriter::write(path, map);
+
+    MappedMapView<int, double> view(path);
+    EXPECT_EQ(view.at(2), 1.5);
+    EXPECT_THROW((MappedMapView<int, int>(path)), std::runtime_error);
+    EXPECT_THROW((MappedVectorView<double>(path)), std::runtime_error);
+    EXPECT_THROW((MappedVectorView<int>(path + ".missing")), std::runtime_error);
+}
+
+// -----------------------------------------
+// ---- ТЕСТЫ ДЛЯ КОНТРОЛЬНЫХ ТОЧЕК --------
+// -----------------------------------------
+
+class CheckpointTest : public TempFileTest {
+protected:
+    std::string path;
+
+    void SetUp() override {
+        path = tempPath("checkpoint");
+    }
+};
+// Точка после небольших изменений дописывает только новые узлы
+TEST_F(CheckpointTest, WritesOnlyChangedNodes) {
+    PersistentMap<int, int> map;
+    for (int i = 0; i < 20000; ++i) {
+        map = std::move(map).set(i, i);
+    }
+
+    PersistentCheckpointer<PersistentMap<int, int>> checkpointer(path);
+    EXPECT_FALSE(checkpointer.recovered().has_value());
+    size_t full = checkpointer.checkpoint(map, 1);
+    auto sizeAfterFull = std::filesystem::file_size(path);
+
+    for (int i = 0; i < 10; ++i) {
+        map = map.set(i * 1000, -i);
+    }
+    size_t delta = checkpointer.checkpoint(map, 2);
+    EXPECT_GT(delta, 0);
+    EXPECT_LE(delta, 10 * 5); // Не больше пути на каждое изменение
+    EXPECT_LT(delta * 20, full);
+    EXPECT_LT(std::filesystem::file_size(path) - sizeAfterFull, sizeAfterFull / 20);
+    EXPECT_EQ(checkpointer.checkpoints(), 2);
+
+    // Без изменений точка состоит только из записи корня
+    EXPECT_EQ(checkpointer.checkpoint(map, 3), 0);
+}
+// Повторное открытие восстанавливает версию и продолжает инкрементально
+TEST_F(CheckpointTest, ReopenContinuesIncrementally) {
+    PersistentVector<std::string> vec;
+    for (int i = 0; i < 5000; ++i) {
+        vec = std::move(vec).append("line " + std::to_string(i));
+    }
+    {
+        PersistentCheckpointer<PersistentVector<std::string>> checkpointer(path);
+        checkpointer.checkpoint(vec, 7);
+    }
+
+    PersistentCheckpointer<PersistentVector<std::string>> reopened(path);
+    ASSERT_TRUE(reopened.recovered().has_value());
+    EXPECT_EQ(reopened.recoveredTag(), 7);
+    auto restored = *reopened.recovered();
+    EXPECT_EQ(restored.size(), 5000);
+    EXPECT_EQ(restored.get(4321), "line 4321");
+
+    size_t delta = reopened.checkpoint(restored.set(10, "edited"), 8);
+    EXPECT_LE(delta, 4);
+    EXPECT_EQ(reopened.checkpoints(), 2);
+
+    std::ifstream file(path, std::ios::binary);
+    SnapshotReader reader(file);
+    EXPECT_EQ(reader.readLast<PersistentVector<std::string>>().get(10), "edited");
+    EXPECT_EQ(reader.read<PersistentVector<std::string>>(0).get(10), "line 10");
+}
+// rvalue-изменение между точками не теряется
+TEST_F(CheckpointTest, RvalueUpdateBetweenCheckpoints) {
+    PersistentVector<int> vec(std::vector<int>(100, 0));
+    {
+        PersistentCheckpointer<PersistentVector<int>> checkpointer(path);
+        checkpointer.checkpoint(vec, 1);
+        vec = std::move(vec).set(0, 999);
+        EXPECT_GT(checkpointer.checkpoint(vec, 2), 0);
+    }
+    PersistentCheckpointer<PersistentVector<int>> reopened(path);
+    ASSERT_TRUE(reopened.recovered().has_value());
+    EXPECT_EQ(reopened.recovered()->get(0), 999);
+
+    // То же после восстановления: узлы файла тоже считаются общими
+    auto restored = *reopened.recovered();
+    restored = std::move(restored).set(1, 555);
+    reopened.checkpoint(restored, 3);
+    PersistentCheckpointer<PersistentVector<int>> again(path);
+    EXPECT_EQ(again.recovered()->get(0), 999);
+    EXPECT_EQ(again.recovered()->get(1), 555);
+}
+// Оборванная запись отрезается, восстанавливается предыдущая точка
+TEST_F(CheckpointTest, TornTailIsTruncated) {
+    PersistentMap<std::string, int> map;
+    map = map.set("a", 1).set("b", 2);
+    {
+        PersistentCheckpointer<PersistentMap<std::string, int>> checkpointer(path);
+        checkpointer.checkpoint(map, 1);
+    }
+    auto intact = std::filesystem::file_size(path);
+    {
+        std::ofstream tail(path, std::ios::binary | std::ios::app);
+        tail.write("N\x7f\x01\x02", 4); // Запись длиной 127 байт, от которой дошло 2
+    }
+
+    PersistentCheckpointer<PersistentMap<std::string, int>> reopened(path);
+    EXPECT_EQ(std::filesystem::file_size(path), intact);
+    ASSERT_TRUE(reopened.recovered().has_value());
+    EXPECT_EQ(reopened.recovered()->at("b"), 2);
+
+    reopened.checkpoint(reopened.recovered()->set("c", 3), 2);
+    PersistentCheckpointer<PersistentMap<std::string, int>> again(path);
+    EXPECT_EQ(again.recovered()->at("c"), 3);
+    EXPECT_EQ(again.recoveredTag(), 2);
+}
+
+// -----------------------------------------
+// ------ ТЕСТЫ ДЛЯ ЖУРНАЛА ОПЕРАЦИЙ --------
+// -----------------------------------------
+
+class OperationLogTest : public TempFileTest {
+protected:
+    std::string logPath;
+    std::string snapshotPath;
+    OperationLogOptions fast; // Без fsync: тестам не нужна устойчивость к отключению питания
+
+    void SetUp() override {
+        logPath = tempPath("oplog", ".log");
+        snapshotPath = tempPath("oplog", ".snap");
+        fast.fsync = false;
+    }
+};
+// Операции над массивом фиксируются и воспроизводятся
+TEST_F(OperationLogTest, ReplaysMapOperations) {
+    using Log = OperationLog<PersistentMap<std::string, int>>;
+    {
+        Log log(logPath, fast);
+        log.set("a", 1);
+        log.set("b", 2);
+        log.erase("a");
+        uint64_t lsn = log.set("c", 3);
+        EXPECT_EQ(lsn, 4);
+        EXPECT_LT(log.durableLsn(), lsn);
+        log.commit(lsn);
+        EXPECT_EQ(log.durableLsn(), lsn);
+        EXPECT_THROW(log.commit(lsn + 1), std::out_of_range);
+    }
+
+    auto state = Log::replay(logPath, {});
+    EXPECT_EQ(state.size(), 2);
+    EXPECT_FALSE(state.contains("a"));
+    EXPECT_EQ(state.at("c"), 3);
+
+    // Повторное открытие продолжает нумерацию
+    Log reopened(logPath, fast);
+    EXPECT_EQ(reopened.lastLsn(), 4);
+    EXPECT_EQ(reopened.set("d", 4), 5);
+}
+// Восстановление: снимок с LSN в метке корня плюс хвост журнала
+TEST_F(OperationLogTest, RecoversFromSnapshotAndTail) {
+    using Rows = PersistentVector<PersistentVector<int>>;
+    using Log = OperationLog<Rows>;
+    Rows live;
+    Log log(logPath, fast);
+    PersistentCheckpointer<Rows> checkpointer(snapshotPath);
+
+    for (int key = 0; key < 10; ++key) {
+        live = live.append(PersistentVector<int>());
+        log.append(PersistentVector<int>());
+    }
+    for (int i = 1; i <= 100; ++i) {
+        PersistentVector<int> row = live.get(i % 10).append(i);
+        live = live.set(i % 10, row);
+        uint64_t lsn = log.set(i % 10, row); // Строка целиком: ее узлы в записи
+        if (i == 60) {
+            checkpointer.checkpoint(live, lsn);
+        }
+    }
+    log.sync();
+
+    auto recovered = Log::recover(snapshotPath, logPath);
+    ASSERT_EQ(recovered.size(), live.size());
+    for (int key = 0; key < 10; ++key) {
+        ASSERT_EQ(recovered.get(key).size(), 10);
+        EXPECT_EQ(recovered.get(key).get(9), live.get(key).get(9));
+    }
+    // Без снимка - весь журнал с пустого состояния
+    std::remove(snapshotPath.c_str());
+    EXPECT_EQ(Log::recover(snapshotPath, logPath).get(3).get(0), 3);
+}
+// Оборванная запись отрезается при открытии
+TEST_F(OperationLogTest, TornTailIsTruncated) {
+    using Log = OperationLog<PersistentMap<std::string, int>>;
+    {
+        Log log(logPath, fast);
+        log.set("kept", 1);
+        log.sync();
+    }
+    auto intact = std::filesystem::file_size(logPath);
+    {
+        std::ofstream tail(logPath, std::ios::binary | std::ios::app);
+        tail.write("\x40\x00\x00\x00\x12\x34", 6); // Заголовок кадра длиной 64 байта без данных
+    }
+
+    EXPECT_EQ(Log::replay(logPath, {}).size(), 1);
+    Log reopened(logPath, fast);
+    EXPECT_EQ(std::filesystem::file_size(logPath), intact);
+    reopened.commit(reopened.set("next", 2));
+    EXPECT_EQ(Log::replay(logPath, {}).at("next"), 2);
+}
+// Потоки, фиксирующие одновременно, делят синхронизации
+TEST_F(OperationLogTest, GroupCommitBatchesSyncs) {
+    using Log = OperationLog<PersistentMap<int, int>>;
+    const int threads = 8;
+    const int perThread = 200;
+    {
+        Log log(logPath); // С fsync - именно его стоимость делится между потоками
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&log, t] {
+                for (int i = 0; i < perThread; ++i) {
+                    log.commit(log.set(t * perThread + i, i));
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        EXPECT_EQ(log.durableLsn(), threads * perThread);
+        EXPECT_LT(log.syncs(), static_cast<size_t>(threads * perThread));
+    }
+    auto state = Log::replay(logPath, {});
+    EXPECT_EQ(state.size(), threads * perThread);
+    EXPECT_EQ(state.at(3 * perThread + 7), 7);
+}
+// Журнал вектора: append, set, pop_back
+TEST_F(OperationLogTest, ReplaysVectorOperations) {
+    using Log = OperationLog<PersistentVector<std::string>>;
+    {
+        Log log(logPath, fast);
+        for (int i = 0; i < 50; ++i) {
+            log.append("item " + std::to_string(i));
+        }
+        log.set(7, "seven");
+        log.pop_back();
+    }
+
+    auto state = Log::replay(logPath, {});
+    EXPECT_EQ(state.size(), 49);
+    EXPECT_EQ(state.get(7), "seven");
+    EXPECT_EQ(state.get(48), "item 48");
+
+    // Записи до baseLsn уже учтены в base
+    auto tail = Log::replay(logPath, PersistentVector<std::string>().append("base"), 51);
+    EXPECT_EQ(tail.size(), 0);
+}
+// Длинный журнал читается блоками; erase и pop_back применяются
+// на месте и не задевают другие версии
+TEST_F(OperationLogTest, ReplaysLongLogInChunks) {
+    using Log = OperationLog<PersistentMap<int, int>>;
+    {
+        Log log(logPath, fast);
+        for (int i = 0; i < 200000; ++i) {
+            log.set(i, i);
+        }
+        for (int i = 0; i < 200000; i += 2) {
+            log.erase(i);
+        }
+    }
+    ASSERT_GT(std::filesystem::file_size(logPath), 2u << 20);
+
+    auto state = Log::replay(logPath, {});
+    EXPECT_EQ(state.size(), 100000);
+    EXPECT_FALSE(state.contains(0));
+    EXPECT_EQ(state.at(199999), 199999);
+
+    PersistentMap<int, int> kept = state;
+    auto erased = std::move(state).erase(1);
+    EXPECT_TRUE(kept.contains(1));
+    EXPECT_FALSE(erased.contains(1));
+    EXPECT_EQ(erased.size(), 99999);
+
+    PersistentVector<int> numbers(std::vector<int>(3000, 1));
+    PersistentVector<int> before = numbers;
+    auto popped = std::move(numbers).pop_back();
+    EXPECT_EQ(before.size(), 3000);
+    EXPECT_EQ(popped.size(), 2999);
+    EXPECT_EQ(std::move(popped).pop_back().size(), 2998);
+}
+
+// -----------------------------------------
+// --- ТЕСТЫ ДЛЯ СТРУКТУРНОГО СРАВНЕНИЯ ----
+// -----------------------------------------
+
+class StructuralEqualityTest : public ::testing::Test {};
+// Векторы, построенные разными путями, равны и имеют один хеш
+TEST_F(StructuralEqualityTest, VectorsCompareByContent) {
+    PersistentVector<int> built;
+    for (int i = 0; i < 1000; ++i) {
+        built = built.append(i);
+    }
+    PersistentVector<int> fromStd(built.toStdVector());
+    EXPECT_TRUE(built == fromStd);
+    EXPECT_EQ(built.hash(), fromStd.hash());
+
+    // Дерево после pop_back глубже, чем у вектора того же размера
+    PersistentVector<int> small;
+    for (int i = 0; i < 32; ++i) {
+        small = small.append(i);
+    }
+    auto popped = small.append(99).pop_back();
+    EXPECT_TRUE(popped == small);
+    EXPECT_EQ(std::hash<PersistentVector<int>>()(popped), std::hash<PersistentVector<int>>()(small));
+
+    auto changed = built.set(500, -1);
+    EXPECT_TRUE(changed != built);
+    EXPECT_TRUE(changed.set(500, 500) == built);
+    EXPECT_FALSE(built == built.pop_back());
+}
+// Списки с разной нарезкой на чанки и общим хвостом
+TEST_F(StructuralEqualityTest, ListsCompareByContent) {
+    PersistentList<std::string> prepended;
+    for (int i = 99; i >= 0; --i) {
+        prepended = prepended.prepend(std::to_string(i));
+    }
+    std::vector<std::string> items;
+    for (int i = 0; i < 100; ++i) {
+        items.push_back(std::to_string(i));
+    }
+    PersistentList<std::string> fromStd(items);
+    EXPECT_TRUE(prepended == fromStd);
+    EXPECT_EQ(prepended.hash(), fromStd.hash());
+
+    // Версии с общим хвостом
+    auto shared = prepended.tail().prepend("0");
+    EXPECT_TRUE(shared == prepended);
+    EXPECT_TRUE(prepended.tail().prepend("x") != prepended);
+    EXPECT_TRUE(prepended != prepended.tail());
+}
+// Массивы с разной формой дерева (порядок вставки, удаления)
+TEST_F(StructuralEqualityTest, MapsCompareByContent) {
+    PersistentMap<int, std::string> forward;
+    PersistentMap<int, std::string> backward;
+    for (int i = 0; i < 500; ++i) {
+        forward = forward.set(i, std::to_string(i));
+        backward = backward.set(499 - i, std::to_string(499 - i));
+    }
+    EXPECT_TRUE(forward == backward);
+    EXPECT_EQ(forward.hash(), backward.hash());
+
+    auto withExtra = forward.set(1000, "x").erase(1000);
+    EXPECT_TRUE(withExtra == forward);
+    EXPECT_EQ(withExtra.hash(), forward.hash());
+
+    EXPECT_TRUE(forward.set(7, "seven") != backward);
+    EXPECT_TRUE(forward.erase(7) != backward);
+    EXPECT_TRUE((PersistentMap<int, std::string>() == PersistentMap<int, std::string>()));
+}
+// Документы PersistentValue, собранные отдельно, равны и дедуплицируются
+TEST_F(StructuralEqualityTest, ValuesCompareDeeply) {
+    auto makeDocument = [](int id) {
+        PersistentMap<std::string, PersistentValue> doc;
+        doc = doc.set("id", PersistentValue(id));
+        doc = doc.set("tags", PersistentValue(PersistentVector<PersistentValue>()
+            .append(PersistentValue("a")).append(PersistentValue("b"))));
+        doc = doc.set("scores", PersistentValue(PersistentList<int>(std::vector<int>({ 1, 2, 3 }))));
+        return PersistentValue(doc);
+    };
+    PersistentValue first = makeDocument(1);
+    PersistentValue second = makeDocument(1);
+    PersistentValue other = makeDocument(2);
+
+    EXPECT_TRUE(first == second);
+    EXPECT_EQ(first.hash(), second.hash());
+    EXPECT_TRUE(first != other);
+
+    // Одинаковое содержимое разных типов элементов не равно
+    EXPECT_TRUE(PersistentValue(PersistentVector<int>().append(1)) !=
+        PersistentValue(PersistentVector<double>().append(1.0)));
+
+    std::unordered_set<PersistentValue> unique{ first, second, other, makeDocument(2) };
+    EXPECT_EQ(unique.size(), 2);
+}
+
+// -----------------------------------------
+// --- ТЕСТЫ ДЛЯ КОМПАКТНЫХ ЗНАЧЕНИЙ -------
+// -----------------------------------------
+
+class CompactValueTest : public ::testing::Test {};
+
+// Скаляры хранятся в самом значении, строки и структуры - в общей коробке
+TEST_F(CompactValueTest, CopiesShareBoxes) {
+    EXPECT_LE(sizeof(PersistentValue), 16u);
+
+    PersistentValue text("shared text");
+    PersistentValue copy = text;
+    PersistentValue moved = std::move(copy);
+    EXPECT_TRUE(copy.isNull());
+    EXPECT_EQ(moved.asString(), "shared text");
+    EXPECT_EQ(moved, text);
+
+    PersistentValue number(7);
+    number = text;
+    EXPECT_EQ(number.asString(), "shared text");
+    number = PersistentValue(2.5);
+    EXPECT_DOUBLE_EQ(number.asDouble(), 2.5);
+    EXPECT_EQ(text.asString(), "shared text");
+}
+
+// Ссылка на структуру без копирования и shared_ptr, переживающий значение
+TEST_F(CompactValueTest, StructuresAreReferencedDirectly) {
+    auto vector = PersistentVector<int>().append(1).append(2).append(3);
+    PersistentValue value(vector);
+    PersistentValue copy = value;
+
+    EXPECT_EQ(&value.vectorRef<int>(), &copy.vectorRef<int>());
+    EXPECT_EQ(value.vectorRef<int>().get(2), 3);
+    EXPECT_THROW(value.vectorRef<double>(), std::runtime_error);
+    EXPECT_THROW((value.mapRef<std::string, int>()), std::runtime_error);
+
+    std::shared_ptr<PersistentVector<int>> shared = value.asVector<int>();
+    value = PersistentValue();
+    copy = PersistentValue();
+    EXPECT_EQ(shared->toStdVector(), std::vector<int>({ 1, 2, 3 }));
+
+    PersistentValue map(PersistentMap<std::string, int>().set("a", 1));
+    EXPECT_EQ(map.getKeyType(), std::type_index(typeid(std::string)));
+    EXPECT_EQ(map.getValueType(), std::type_index(typeid(int)));
+    EXPECT_EQ((map.mapRef<std::string, int>().at("a")), 1);
+}
+
+// Строки читаются без копирования; интернированные разделяют одну коробку
+TEST_F(CompactValueTest, InternedStringsShareStorage) {
+    std::string source = "moved text";
+    PersistentValue moved(std::move(source));
+    PersistentValue viewed(std::string_view("view text"));
+    EXPECT_EQ(moved.asStringView(), "moved text");
+    EXPECT_EQ(viewed.asString(), "view text");
+    EXPECT_EQ(&moved.asString(), &PersistentValue(moved).asString());
+
+    StringPool pool;
+    PersistentValue first = pool.intern("active");
+    PersistentValue second = pool.intern(std::string("active"));
+    PersistentValue other = pool.intern("inactive");
+    EXPECT_EQ(first.asStringView().data(), second.asStringView().data());
+    EXPECT_EQ(first, second);
+    EXPECT_NE(first, other);
+    EXPECT_EQ(first, PersistentValue("active"));
+    EXPECT_EQ(pool.size(), 2u);
+
+    // Строки, которые держит только пул, освобождаются
+    other = PersistentValue();
+    EXPECT_EQ(pool.prune(), 1u);
+    EXPECT_EQ(pool.size(), 1u);
+    EXPECT_NE(pool.intern("inactive"), first);
+}
+
+// clone() разделяет данные, deepCopy() собирает документ заново
+TEST_F(CompactValueTest, CloneSharesAndDeepCopyRebuilds) {
+    PersistentMap<std::string, PersistentValue> fields;
+    fields = fields.set("name", PersistentValue("document"))
+        .set("tags", PersistentValue(PersistentVector<PersistentValue>().append(PersistentValue("a"))))
+        .set("scores", PersistentValue(PersistentList<int>(std::vector<int>({ 1, 2 }))));
+    PersistentValue document(fields);
+
+    PersistentValue clone = document.clone();
+    EXPECT_EQ((&clone.mapRef<std::string, PersistentValue>()), (&document.mapRef<std::string, PersistentValue>()));
+
+    PersistentValue copy = document.deepCopy();
+    EXPECT_EQ(copy, document);
+    const auto& copied = copy.mapRef<std::string, PersistentValue>();
+    const auto& original = document.mapRef<std::string, PersistentValue>();
+    EXPECT_NE(&copied, &original);
+    EXPECT_NE(copied.at("name").asStringView().data(), original.at("name").asStringView().data());
+    const auto& tags = copied.at("tags").vectorRef<PersistentValue>();
+    EXPECT_NE(tags.get(0).asStringView().data(),
+        original.at("tags").vectorRef<PersistentValue>().get(0).asStringView().data());
+    EXPECT_EQ(copied.at("scores").listRef<int>().toVector(), std::vector<int>({ 1, 2 }));
+}
+
+// Элементы любого типа хранятся в структуре без обертки в PersistentValue
+TEST_F(CompactValueTest, StoresArbitraryElementTypes) {
+    PersistentValue ids(PersistentVector<int64_t>().append(int64_t(1) << 40).append(-5));
+    PersistentValue weights(PersistentMap<std::string, float>().set("a", 0.5f));
+    PersistentValue flags(PersistentList<bool>().prepend(true));
+
+    EXPECT_TRUE(ids.hasElementType<int64_t>());
+    EXPECT_FALSE(ids.hasElementType<int>());
+    EXPECT_TRUE(weights.hasKeyType<std::string>());
+    EXPECT_TRUE(weights.hasElementType<float>());
+    EXPECT_EQ(ids.vectorRef<int64_t>().get(0), int64_t(1) << 40);
+    EXPECT_FLOAT_EQ((weights.mapRef<std::string, float>().at("a")), 0.5f);
+    EXPECT_THROW(ids.vectorRef<int>(), std::runtime_error);
+    EXPECT_EQ(ids, PersistentValue(PersistentVector<int64_t>({ int64_t(1) << 40, -5 })));
+    EXPECT_EQ(ids.deepCopy(), ids);
+
+    // Нехешируемые элементы: хранение и сравнение работают, хеш - нет
+    struct Point {
+        int x;
+        int y;
+        bool operator==(const Point& other) const {
+            return x == other.x && y == other.y;
+        }
+    };
+    PersistentValue points(PersistentVector<Point>().append({ 1, 2 }));
+    EXPECT_EQ(points.vectorRef<Point>().get(0).y, 2);
+    EXPECT_EQ(points, PersistentValue(PersistentVector<Point>().append({ 1, 2 })));
+    EXPECT_THROW(points.hash(), std::runtime_error);
+
+    // Без operator== у элементов равны только копии одного значения
+    struct Foo {
+        int x;
+    };
+    PersistentValue foos(PersistentVector<Foo>().append({ 7 }));
+    PersistentValue same = foos;
+    EXPECT_EQ(foos.vectorRef<Foo>().get(0).x, 7);
+    EXPECT_EQ(foos, same);
+    EXPECT_NE(foos, PersistentValue(PersistentVector<Foo>().append({ 7 })));
+    EXPECT_THROW(foos.hash(), std::runtime_error);
+    EXPECT_EQ(foos.deepCopy().vectorRef<Foo>().get(0).x, 7);
+
+    std::string json;
+    JsonWriter(json).write(ids);
+    EXPECT_EQ(json, "[1099511627776.0,-5]");
+    json.clear();
+    JsonWriter(json).write(flags);
+    EXPECT_EQ(json, "[true]");
+
+    std::stringstream file;
+    SnapshotWriter writer(file);
+    writer.write(ids, 1);
+    writer.write(weights, 2);
+    SnapshotReader reader(file);
+    EXPECT_EQ(reader.read<PersistentValue>(0), ids);
+    EXPECT_EQ(reader.read<PersistentValue>(1), weights);
+}
+
+// -----------------------------------------
+// ------------- ТЕСТЫ ДЛЯ JSON ------------
+// -----------------------------------------
+
+class JsonTest : public ::testing::Test {};
+
+// Документ читается в PersistentMap/PersistentVector и записывается обратно
+TEST_F(JsonTest, ReadsAndWritesDocuments) {
+    PersistentValue doc = JsonReader::read(R"( {"id": 7, "ratio": 0.5, "big": 5000000000,
+        "ok": true, "none": null, "tags": ["a", "b", [1, 2.0]], "nested": {"empty": {}}} )");
+
+    const auto& fields = doc.mapRef<std::string, PersistentValue>();
+    EXPECT_EQ(fields.size(), 7u);
+    EXPECT_EQ(fields.at("id").asInt(), 7);
+    EXPECT_DOUBLE_EQ(fields.at("ratio").asDouble(), 0.5);
+    EXPECT_DOUBLE_EQ(fields.at("big").asDouble(), 5000000000.0);
+    EXPECT_TRUE(fields.at("ok").asBool());
+    EXPECT_TRUE(fields.at("none").isNull());
+    const auto& tags = fields.at("tags").vectorRef<PersistentValue>();
+    EXPECT_EQ(tags.get(1).asString(), "b");
+    EXPECT_TRUE(tags.get(2).vectorRef<PersistentValue>().get(1).isDouble());
+
+    // Повторное чтение записанного текста дает равный документ
+    std::string text;
+    JsonWriter(text).write(doc);
+    EXPECT_EQ(JsonReader::read(text), doc);
+    EXPECT_EQ(doc.toString(), text);
+
+    EXPECT_EQ(PersistentValue(PersistentVector<int>().append(1).append(2)).toString(), "[1,2]");
+    EXPECT_EQ(PersistentValue(PersistentList<std::string>(std::vector<std::string>({ "x" }))).toString(), "[\"x\"]");
+    EXPECT_EQ(PersistentValue(PersistentMap<std::string, double>().set("k", 1.0)).toString(), "{\"k\":1.0}");
+}
+
+// Escape-последовательности, \u и суррогатные пары
+TEST_F(JsonTest, HandlesEscapes) {
+    PersistentValue value = JsonReader::read(R"("q\"b\\s\/n\n\u00e9\ud83d\ude00")");
+    EXPECT_EQ(value.asString(), "q\"b\\s/n\n\xc3\xa9\xf0\x9f\x98\x80");
+
+    std::string text;
+    JsonWriter(text).write(PersistentValue(std::string("tab\t\x01\"")));
+    EXPECT_EQ(text, R"("tab\t\u0001\"")");
+}
+
+// Ошибки разбора сообщают смещение
+TEST_F(JsonTest, RejectsMalformedInput) {
+    for (const char* text : { "", "[1,]", "{\"a\" 1}", "tru", "01", "\"open", "\"\\x\"", "[1] 2", "1e999", "\"\\ud800\"" }) {
+        EXPECT_THROW(JsonReader::read(text), std::runtime_error) << text;
+    }
+    EXPECT_THROW(JsonReader::read(std::string(JsonReader::MAX_DEPTH + 1, '[')), std::runtime_error);
+    try {
+        JsonReader::read("[1, x]");
+        FAIL();
+    }
+    catch (const std::runtime_error& error) {
+        EXPECT_NE(std::string(error.what()).find("offset 4"), std::string::npos);
+    }
+}
+
+// События разбора напрямую в запись; строки - через пул
+TEST_F(JsonTest, StreamsEventsAndInternsStrings) {
+    std::string compact;
+    JsonWriter writer(compact);
+    JsonReader::parse(" { \"a\" : [ 1 , { } , [ ] ] , \"b\" : \"x\" } ", writer);
+    EXPECT_EQ(compact, R"({"a":[1,{},[]],"b":"x"})");
+
+    StringPool pool;
+    PersistentValue doc = JsonReader::read(R"([{"state": "active"}, {"state": "active"}])", &pool);
+    const auto& items = doc.vectorRef<PersistentValue>();
+    auto state = [&](size_t index) {
+        return items.get(index).mapRef<std::string, PersistentValue>().at("state").asStringView().data();
+    };
+    EXPECT_EQ(state(0), state(1));
+    EXPECT_EQ(pool.size(), 1u);
+}
+
+// -----------------------------------------
+// ------- ТЕСТЫ ДЛЯ ИЗМЕНЕНИЙ ПО ПУТИ -----
+// -----------------------------------------
+
+class PathUpdateTest : public ::testing::Test {
+protected:
+    PersistentValue config = JsonReader::read(R"({
+        "server": {"ports": [80, 443], "name": "main"},
+        "limits": {"rps": 100}
+    })");
+};
+
+// Изменение копирует только путь, соседние поддеревья разделяются
+TEST_F(PathUpdateTest, SetInCopiesOnlyTheSpine) {
+    PersistentValue updated = config.setIn({ "server", "ports", 1 }, PersistentValue(8443));
+
+    EXPECT_EQ(updated.getIn({ "server", "ports", 1 })->asInt(), 8443);
+    EXPECT_EQ(config.getIn({ "server", "ports", 1 })->asInt(), 443);
+    EXPECT_EQ(updated.getIn({ "server", "name" })->asString(), "main");
+
+    // Нетронутое поддерево - та же коробка
+    using Fields = PersistentMap<std::string, PersistentValue>;
+    const Fields& before = config.getIn({ "limits" })->mapRef<std::string, PersistentValue>();
+    const Fields& after = updated.getIn({ "limits" })->mapRef<std::string, PersistentValue>();
+    EXPECT_EQ(&before, &after);
+
+    // Запись того же значения не меняет документ
+    PersistentValue same = config.setIn({ "limits" }, *config.getIn({ "limits" }));
+    EXPECT_EQ((&same.mapRef<std::string, PersistentValue>()), (&config.mapRef<std::string, PersistentValue>()));
+}
+
+// Отсутствующие ключи создаются, индекс size() добавляет элемент
+TEST_F(PathUpdateTest, CreatesMissingLevels) {
+    PersistentValue updated = config.setIn({ "features", "beta", "enabled" }, PersistentValue(true))
+        .setIn({ "server", "ports", 2 }, PersistentValue(8080));
+
+    EXPECT_TRUE(updated.getIn({ "features", "beta", "enabled" })->asBool());
+    EXPECT_EQ(updated.getIn({ "server", "ports" })->vectorRef<PersistentValue>().size(), 3u);
+    EXPECT_FALSE(config.getIn({ "features" }).has_value());
+    EXPECT_FALSE(config.getIn({ "server", "ports", 5 }).has_value());
+    EXPECT_FALSE(config.getIn({ "server", "name", "x" }).has_value());
+
+    EXPECT_THROW(config.setIn({ "server", "ports", 5 }, PersistentValue(1)), std::out_of_range);
+    EXPECT_THROW(config.setIn({ "server", 0 }, PersistentValue(1)), std::runtime_error);
+    EXPECT_THROW(config.setIn({ "server", "name", "x" }, PersistentValue(1)), std::runtime_error);
+}
+
+// updateIn получает текущее значение
+TEST_F(PathUpdateTest, UpdateInAppliesFunction) {
+    auto increment = [](const PersistentValue& current) {
+        return PersistentValue(current.isNull() ? 1 : current.asInt() + 1);
+    };
+    PersistentValue updated = config.updateIn({ "limits", "rps" }, increment)
+        .updateIn({ "limits", "burst" }, increment);
+
+    EXPECT_EQ(updated.getIn({ "limits", "rps" })->asInt(), 101);
+    EXPECT_EQ(updated.getIn({ "limits", "burst" })->asInt(), 1);
+    EXPECT_EQ(config.getIn({ "limits", "rps" })->asInt(), 100);
+    EXPECT_EQ(config.setIn({}, PersistentValue(5)).asInt(), 5);
+}
+
+// update спускается один раз и не копирует путь, если fn ничего не меняет
+TEST_F(PathUpdateTest, UpdateKeepsVersionWhenUnchanged) {
+    PersistentMap<std::string, int> counts = PersistentMap<std::string, int>().set("visits", 1);
+    auto bump = [](const int* visits) -> std::optional<int> {
+        return visits ? *visits + 1 : 1;
+    };
+    auto next = counts.update("visits", bump).update("errors", bump);
+    EXPECT_EQ(next.get("visits"), 2);
+    EXPECT_EQ(next.get("errors"), 1);
+    EXPECT_EQ(next.size(), 2u);
+    EXPECT_EQ(counts.get("visits"), 1);
+    auto same = next.update("visits", [](const int*) -> std::optional<int> { return std::nullopt; });
+    EXPECT_EQ(same.size(), 2u);
+    EXPECT_TRUE(same == next);
+
+    PersistentVector<int> numbers = PersistentVector<int>().append(10).append(11);
+    auto doubled = numbers.update(1, [](int x) -> std::optional<int> { return x * 2; });
+    EXPECT_EQ(doubled.get(1), 22);
+    EXPECT_EQ(numbers.get(1), 11);
+    EXPECT_THROW(numbers.update(2, [](int x) -> std::optional<int> { return x; }), std::out_of_range);
+
+    // Неизмененный лист - тот же документ
+    PersistentValue same_doc = config.updateIn({ "server", "ports", 0 },
+        [](const PersistentValue& port) { return port; });
+    EXPECT_EQ((&same_doc.mapRef<std::string, PersistentValue>()), (&config.mapRef<std::string, PersistentValue>()));
+}
+
+// -----------------------------------------
+// ---------- ТЕСТЫ ДЛЯ ХЕШ-КОНСИНГА -------
+// -----------------------------------------
+
+class HashConsTest : public ::testing::Test {
+protected:
+    HashConsTable table;
+};
+
+// Равные поддеревья документа - одна коробка
+TEST_F(HashConsTest, EqualSubtreesShareOneBox) {
+    using Fields = PersistentMap<std::string, PersistentValue>;
+    PersistentValue doc = JsonReader::read(R"([
+        {"tags": ["a", "b"], "limits": {"rps": 100}},
+        {"tags": ["a", "b"], "limits": {"rps": 100}},
+        {"tags": ["a", "c"], "limits": {"rps": 100}}
+    ])", table);
+    const auto& items = doc.vectorRef<PersistentValue>();
+
+    EXPECT_EQ((&items.get(0).mapRef<std::string, PersistentValue>()),
+        (&items.get(1).mapRef<std::string, PersistentValue>()));
+    const Fields& third = items.get(2).mapRef<std::string, PersistentValue>();
+    EXPECT_NE((&items.get(0).mapRef<std::string, PersistentValue>()), &third);
+    const Fields& limits = third.get("limits")->mapRef<std::string, PersistentValue>();
+    EXPECT_EQ((&items.get(0).getIn({ "limits" })->mapRef<std::string, PersistentValue>()), &limits);
+
+    // Значение, собранное отдельно, сводится к тому же представителю
+    PersistentValue separate(Fields().set("rps", PersistentValue(100)));
+    EXPECT_EQ((&table.canonical(separate).mapRef<std::string, PersistentValue>()), &limits);
+    EXPECT_GT(table.reused(), 0u);
+}
+
+// Векторы с одним различным элементом разделяют все узлы, кроме пути
+TEST_F(HashConsTest, VersionsShareNodes) {
+    std::vector<int> values(10000);
+    for (int i = 0; i < 10000; ++i) {
+        values[i] = i;
+    }
+    PersistentVector<int> first(values);
+    values[5000] = -1;
+    PersistentVector<int> second(values);
+
+    first = table.canonical(first);
+    size_t alone = table.nodes();
+    second = table.canonical(second);
+    EXPECT_LE(table.nodes() - alone, 3u); // Лист, промежуточный узел и корень
+    EXPECT_EQ(second.get(5000), -1);
+
+    // Равный вектор, собранный добавлением, не добавляет узлов
+    PersistentVector<int> appended;
+    for (int i = 0; i < 10000; ++i) {
+        appended = appended.append(i);
+    }
+    size_t reused = table.reused();
+    appended = table.canonical(appended);
+    EXPECT_EQ(table.nodes(), alone + 3);
+    EXPECT_GT(table.reused(), reused);
+    EXPECT_EQ(appended, first);
+}
+
+// Таблица не удерживает узлы и значения, которыми никто не пользуется
+TEST_F(HashConsTest, PruneReleasesUnusedEntries) {
+    {
+        PersistentValue doc = JsonReader::read(R"({"a": [1, 2, {"b": "c"}], "d": {"e": [1, 2]}})", table);
+        PersistentMap<int, int> map;
+        for (int i = 0; i < 100; ++i) {
+            map = map.set(i, i * i);
+        }
+        map = table.canonical(map);
+        EXPECT_GT(table.nodes(), 0u);
+        EXPECT_GT(table.values(), 0u);
+        table.prune();
+        EXPECT_GT(table.values(), 0u);
+        EXPECT_EQ(doc.getIn({ "a", 2, "b" })->asString(), "c");
+    }
+    EXPECT_GT(table.prune(), 0u);
+    EXPECT_EQ(table.nodes(), 0u);
+    EXPECT_EQ(table.values(), 0u);
+}
+
+// -----------------------------------------
+// ------- ТЕСТЫ ДЛЯ АТОМАРНОЙ ЯЧЕЙКИ ------
+// -----------------------------------------
+
+class AtomTest : public ::testing::Test {};
+
+// Писатели не теряют обновлений, читатели видят только целые версии
+TEST_F(AtomTest, SwapRetriesUnderContention) {
+    using Counters = PersistentMap<std::string, int>;
+    Atom<Counters> current(Counters().set("a", 0).set("b", 0));
+    std::atomic<bool> done{ false };
+
+    std::thread reader([&] {
+        int last = 0;
+        while (!done.load()) {
+            Counters snapshot = current.load();
+            // a и b меняются одной версией
+            EXPECT_EQ(snapshot.at("a"), snapshot.at("b"));
+            EXPECT_GE(snapshot.at("a"), last);
+            last = snapshot.at("a");
+        }
+    });
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&] {
+            for (int i = 0; i < 2000; ++i) {
+                current.swap([](const Counters& map) {
+                    return map.set("a", map.at("a") + 1).set("b", map.at("b") + 1);
+                });
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    done.store(true);
+    reader.join();
+
+    EXPECT_EQ(current.load().at("a"), 8000);
+    EXPECT_EQ(current.load().at("b"), 8000);
+}
+
+// Установка только поверх ожидаемой версии
+TEST_F(AtomTest, CompareAndSetChecksExpectedVersion) {
+    Atom<PersistentVector<int>> current(PersistentVector<int>({ 1, 2 }));
+    PersistentVector<int> seen = current.load();
+
+    EXPECT_TRUE(current.compare_and_set(seen, seen.append(3)));
+    EXPECT_FALSE(current.compare_and_set(seen, seen.append(4)));
+    EXPECT_EQ(current.load().toStdVector(), std::vector<int>({ 1, 2, 3 }));
+
+    PersistentVector<int> previous = current.exchange(PersistentVector<int>());
+    EXPECT_EQ(previous.size(), 3u);
+    EXPECT_EQ(current.load().size(), 0u);
+}
+
+// Снятые версии освобождаются, как только их отпустит последний читатель
+TEST_F(AtomTest, ReleasesReplacedVersions) {
+    auto first = std::make_shared<int>(1);
+    std::weak_ptr<int> watch = first;
+    {
+        Atom<PersistentVector<std::shared_ptr<int>>> current(PersistentVector<std::shared_ptr<int>>().append(first));
+        first.reset();
+
+        auto held = current.load();
+        // Больше взятых ссылок, чем порог переноса счетчика
+        for (int i = 0; i < 10000; ++i) {
+            EXPECT_EQ(*current.load().get(0), 1);
+        }
+        current.swap([](const auto&) {
+            return PersistentVector<std::shared_ptr<int>>().append(std::make_shared<int>(2));
+        });
+        EXPECT_FALSE(watch.expired());
+        held = current.load();
+        EXPECT_TRUE(watch.expired());
+        EXPECT_EQ(*held.get(0), 2);
+    }
+}
+
+// -----------------------------------------
+// ---------- ТЕСТЫ ДЛЯ ТРАНЗАКЦИЙ ---------
+// -----------------------------------------
+
+class TransactionTest : public ::testing::Test {
+protected:
+    using Accounts = TransactionalMap<std::string, int>;
+
+    static PersistentMap<std::string, int> initial() {
+        return PersistentMap<std::string, int>().set("alice", 100).set("bob", 100);
+    }
+};
+
+// Транзакция читает свой снимок и собственные записи
+TEST_F(TransactionTest, ReadsSnapshotAndOwnWrites) {
+    Accounts accounts(initial());
+    auto reader = accounts.begin();
+    auto writer = accounts.begin();
+
+    writer.set("alice", 50);
+    writer.erase("bob");
+    EXPECT_EQ(writer.get("alice"), std::optional<int>(50));
+    EXPECT_FALSE(writer.contains("bob"));
+    EXPECT_EQ(accounts.snapshot().at("alice"), 100);
+
+    EXPECT_TRUE(writer.commit());
+    EXPECT_EQ(accounts.version(), 1u);
+    EXPECT_EQ(accounts.snapshot().at("alice"), 50);
+    EXPECT_FALSE(accounts.snapshot().contains("bob"));
+
+    // Более поздняя фиксация не видна начатой ранее транзакции
+    EXPECT_EQ(reader.get("alice"), std::optional<int>(100));
+    EXPECT_EQ(reader.get("bob"), std::optional<int>(100));
+    EXPECT_TRUE(reader.commit());
+
+    EXPECT_FALSE(writer.active());
+    EXPECT_THROW(writer.set("alice", 1), std::runtime_error);
+    EXPECT_THROW(writer.commit(), std::runtime_error);
+}
+
+// Записи в один ключ конфликтуют, в разные - переносятся
+TEST_F(TransactionTest, DetectsWriteConflicts) {
+    Accounts accounts(initial());
+    auto first = accounts.begin();
+    auto second = accounts.begin();
+    auto other = accounts.begin();
+
+    first.set("alice", first.get("alice").value() + 10);
+    second.set("alice", second.get("alice").value() + 20);
+    other.set("carol", 7);
+
+    EXPECT_TRUE(first.commit());
+    EXPECT_FALSE(second.commit());
+    EXPECT_TRUE(other.commit());
+
+    auto latest = accounts.snapshot();
+    EXPECT_EQ(latest.at("alice"), 110);
+    EXPECT_EQ(latest.at("bob"), 100);
+    EXPECT_EQ(latest.at("carol"), 7);
+    EXPECT_EQ(accounts.version(), 2u);
+    EXPECT_EQ(accounts.commits(), 2u);
+    EXPECT_EQ(accounts.conflicts(), 1u);
+
+    auto cancelled = accounts.begin();
+    cancelled.set("alice", 0);
+    cancelled.rollback();
+    EXPECT_EQ(accounts.snapshot().at("alice"), 110);
+}
+
+// Write skew: обе транзакции проверяют сумму и снимают с разных
+// счетов. SNAPSHOT пропускает обе, SERIALIZABLE - только первую.
+TEST_F(TransactionTest, SerializableRejectsWriteSkew) {
+    auto withdraw = [](Accounts::Transaction& tx, const std::string& account) {
+        int total = tx.get("alice").value() + tx.get("bob").value();
+        if (total >= 150) {
+            tx.set(account, tx.get(account).value() - 150);
+        }
+    };
+
+    for (IsolationLevel level : { IsolationLevel::SNAPSHOT, IsolationLevel::SERIALIZABLE }) {
+        Accounts accounts(initial());
+        auto first = accounts.begin(level);
+        auto second = accounts.begin(level);
+        withdraw(first, "alice");
+        withdraw(second, "bob");
+
+        EXPECT_TRUE(first.commit());
+        int total = accounts.snapshot().at("alice") + accounts.snapshot().at("bob");
+        if (level == IsolationLevel::SNAPSHOT) {
+            EXPECT_TRUE(second.commit());
+            EXPECT_EQ(accounts.snapshot().at("alice") + accounts.snapshot().at("bob"), -100);
+        }
+        else {
+            EXPECT_FALSE(second.commit());
+            EXPECT_EQ(accounts.snapshot().at("alice") + accounts.snapshot().at("bob"), total);
+        }
+    }
+}
+
+// Повтор до фиксации: ни одно увеличение не теряется
+TEST_F(TransactionTest, AtomicallyRetriesConcurrentUpdates) {
+    TransactionalMap<int, int> counters;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&counters, t] {
+            for (int i = 0; i < 500; ++i) {
+                counters.atomically([t](TransactionalMap<int, int>::Transaction& tx) {
+                    tx.set(-1, tx.get(-1).value_or(0) + 1); // общий ключ
+                    tx.set(t, tx.get(t).value_or(0) + 1);   // свой ключ
+                });
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto result = counters.snapshot();
+    EXPECT_EQ(result.at(-1), 2000);
+    for (int t = 0; t < 4; ++t) {
+        EXPECT_EQ(result.at(t), 500);
+    }
+    EXPECT_EQ(counters.commits(), 2000u);
+    EXPECT_EQ(counters.version(), 2000u);
+}
+
+// fn, зафиксировавшая транзакцию сама, повторяется при конфликте,
+// откат завершает atomically без повтора
+TEST_F(TransactionTest, AtomicallyRetriesCommitInsideFunction) {
+    TransactionalMap<int, int> counters;
+    int attempts = 0;
+    counters.atomically([&](TransactionalMap<int, int>::Transaction& tx) {
+        int value = tx.get(0).value_or(0);
+        if (++attempts == 1) {
+            // Другой писатель успевает раньше
+            auto other = counters.begin();
+            other.set(0, 100);
+            EXPECT_TRUE(other.commit());
+        }
+        tx.set(0, value + 1);
+        tx.commit();
+    });
+    EXPECT_EQ(attempts, 2);
+    EXPECT_EQ(counters.snapshot().at(0), 101);
+    EXPECT_EQ(counters.conflicts(), 1u);
+
+    attempts = 0;
+    counters.atomically([&](TransactionalMap<int, int>::Transaction& tx) {
+        ++attempts;
+        tx.set(0, -1);
+        tx.rollback();
+    });
+    EXPECT_EQ(attempts, 1);
+    EXPECT_EQ(counters.snapshot().at(0), 101);
+}
+
+// -----------------------------------------
+// ------ ТЕСТЫ ДЛЯ ПАКЕТНЫХ ИЗМЕНЕНИЙ -----
+// -----------------------------------------
+
+class BatchUpdateTest : public ::testing::Test {
+protected:
+    static PersistentMap<int, int> build(int count) {
+        PersistentMap<int, int> map;
+        for (int i = 0; i < count; ++i) {
+            map = std::move(map).set(i, i);
+        }
+        return map;
+    }
+};
+
+// Пакет дает тот же массив, что и изменения по одному
+TEST_F(BatchUpdateTest, SetManyMatchesSingleSets) {
+    PersistentMap<int, int> base = build(20000);
+    std::vector<std::pair<int, int>> updates;
+    for (int i = 0; i < 10000; ++i) {
+        updates.emplace_back((i * 7919) % 30000, -i); // обновления и новые ключи
+    }
+    updates.emplace_back(5, 1);
+    updates.emplace_back(5, 2); // повтор - действует последний
+
+    PersistentMap<int, int> expected = base;
+    for (const auto& [key, value] : updates) {
+        expected = expected.set(key, value);
+    }
+    PersistentMap<int, int> batched = base.setMany(updates);
+
+    EXPECT_EQ(batched.size(), expected.size());
+    EXPECT_TRUE(batched == expected);
+    EXPECT_EQ(batched.at(5), 2);
+    EXPECT_EQ(base.size(), 20000u);
+    EXPECT_EQ(base.at(5), 5);
+
+    // Сборка с нуля и на месте
+    PersistentMap<int, int> fresh = PersistentMap<int, int>().setMany(updates);
+    PersistentMap<int, int> moved = std::move(fresh).setMany(std::vector<std::pair<int, int>>{ { -1, -1 } });
+    PersistentMap<int, int> rebuilt(updates);
+    EXPECT_EQ(moved.size(), rebuilt.size() + 1);
+    EXPECT_EQ(moved.at(5), 2);
+    EXPECT_EQ(moved.at(-1), -1);
+}
+
+// Удаление пакетом и по одному; опустевшие поддеревья схлопываются
+TEST_F(BatchUpdateTest, EraseManyRemovesKeys) {
+    PersistentMap<int, int> base = build(5000);
+    std::vector<int> keys;
+    for (int i = 0; i < 5000; i += 2) {
+        keys.push_back(i);
+    }
+    keys.push_back(-7); // отсутствующий ключ
+
+    PersistentMap<int, int> odd = base.eraseMany(keys);
+    EXPECT_EQ(odd.size(), 2500u);
+    for (int i = 0; i < 5000; ++i) {
+        EXPECT_EQ(odd.contains(i), i % 2 == 1);
+    }
+    EXPECT_EQ(base.size(), 5000u);
+
+    PersistentMap<int, int> single = base;
+    for (int key : keys) {
+        single = single.erase(key);
+    }
+    EXPECT_TRUE(single == odd);
+
+    std::vector<int> rest;
+    for (const auto& entry : odd) {
+        rest.push_back(entry.first);
+    }
+    EXPECT_EQ(rest.size(), 2500u);
+    PersistentMap<int, int> empty = std::move(odd).eraseMany(rest);
+    EXPECT_TRUE(empty.empty());
+    EXPECT_FALSE(empty.begin() != empty.end());
+    EXPECT_TRUE((empty == PersistentMap<int, int>()));
+    EXPECT_EQ(empty.set(1, 1).at(1), 1);
+}
+
+// Хеши Меркла пересчитываются для скопированных узлов
+TEST_F(BatchUpdateTest, KeepsMerkleHashes) {
+    PersistentHashing::enable();
+    PersistentMap<int, int> base = build(3000);
+    std::vector<std::pair<int, int>> updates = { { 1, 10 }, { 2000, 20 }, { 4000, 40 } };
+    std::vector<int> erased = { 3, 2999 };
+
+    PersistentMap<int, int> batched = base.setMany(updates).eraseMany(erased);
+    PersistentMap<int, int> single = base.set(1, 10).set(2000, 20).set(4000, 40).erase(3).erase(2999);
+    EXPECT_EQ(batched.hash(), single.hash());
+    EXPECT_TRUE(batched == single);
+    PersistentHashing::disable();
+}
+
+// Сборка массива на пуле потоков совпадает со вставками по одному
+TEST_F(BatchUpdateTest, MapBuildsInParallel) {
+    PersistentHashing::enable();
+    std::vector<std::pair<std::string, int>> pairs;
+    for (int i = 0; i < 60000; ++i) {
+        pairs.emplace_back("key" + std::to_string(i % 50000), i); // с повторами
+    }
+
+    PersistentThreadPool::instance().resize(4);
+    PersistentMap<std::string, int> parallel(pairs);
+    PersistentThreadPool::instance().resize(PersistentThreadPool::defaultWorkers());
+
+    PersistentMap<std::string, int> serial;
+    for (const auto& [key, value] : pairs) {
+        serial = std::move(serial).set(key, value);
+    }
+    EXPECT_EQ(parallel.size(), 50000u);
+    EXPECT_TRUE(parallel == serial);
+    EXPECT_EQ(parallel.hash(), serial.hash());
+    EXPECT_EQ(parallel.at("key7"), 50007);
+    EXPECT_EQ(parallel.at("key12345"), 12345);
+    PersistentHashing::disable();
+}
+
+// Пакет по индексам дает тот же вектор, что и set по одному
+TEST_F(BatchUpdateTest, VectorSetManyMatchesSingleSets) {
+    std::vector<int> source(100000);
+    for (int i = 0; i < 100000; ++i) {
+        source[i] = i;
+    }
+    PersistentVector<int> base(source);
+
+    std::vector<size_t> indices;
+    std::vector<int> values;
+    for (int i = 0; i < 5000; ++i) {
+        indices.push_back((static_cast<size_t>(i) * 7919) % 100000);
+        values.push_back(-i);
+    }
+    indices.push_back(42);
+    values.push_back(1);
+    indices.push_back(42);
+    values.push_back(2); // повтор - действует последний
+
+    PersistentVector<int> expected = base;
+    for (size_t i = 0; i < indices.size(); ++i) {
+        expected = expected.set(indices[i], values[i]);
+    }
+    PersistentVector<int> batched = base.setMany(indices, values);
+    EXPECT_TRUE(batched == expected);
+    EXPECT_EQ(batched[42], 2);
+    EXPECT_EQ(base[42], 42);
+
+    PersistentVector<int> moved = std::move(batched).setMany({ 0 }, { 7 });
+    EXPECT_EQ(moved[0], 7);
+    EXPECT_THROW(base.setMany({ 100000 }, { 1 }), std::out_of_range);
+    EXPECT_THROW(base.setMany({ 1, 2 }, { 1 }), std::invalid_argument);
+}
+
+// Отрезок обновляется параллельно; результат не зависит от числа потоков
+TEST_F(BatchUpdateTest, VectorUpdateRangeInParallel) {
+    PersistentHashing::enable();
+    PersistentVector<long> base;
+    for (long i = 0; i < 50000; ++i) {
+        base = std::move(base).append(i);
+    }
+
+    auto twice = [](const long& value) { return value * 2; };
+    PersistentThreadPool::instance().resize(4);
+    PersistentVector<long> parallel = base.update(1000, 45000, twice);
+    PersistentThreadPool::instance().resize(0);
+    PersistentVector<long> serial = base.update(1000, 45000, twice);
+    PersistentThreadPool::instance().resize(PersistentThreadPool::defaultWorkers());
+
+    EXPECT_TRUE(parallel == serial);
+    EXPECT_EQ(parallel.hash(), serial.hash());
+    EXPECT_EQ(parallel[999], 999);
+    EXPECT_EQ(parallel[1000], 2000);
+    EXPECT_EQ(parallel[44999], 89998);
+    EXPECT_EQ(parallel[45000], 45000);
+    EXPECT_EQ(base[1000], 1000);
+
+    PersistentVector<long> expected = base;
+    for (size_t i = 1000; i < 45000; ++i) {
+        expected = std::move(expected).set(i, base[i] * 2);
+    }
+    EXPECT_EQ(parallel.hash(), expected.hash());
+    EXPECT_THROW(base.update(10, 50001, twice), std::out_of_range);
+    PersistentHashing::disable();
+}
+
+// Исключение из задачи передается вызывающему, остальные задачи выполняются
+TEST_F(BatchUpdateTest, ThreadPoolRethrowsErrors) {
+    PersistentThreadPool pool(3);
+    std::atomic<int> ran{ 0 };
+    EXPECT_THROW(pool.parallelFor(100, [&](size_t i) {
+        ++ran;
+        if (i == 17) {
+            throw std::runtime_error("task failed");
+        }
+    }), std::runtime_error);
+    EXPECT_EQ(ran.load(), 100);
+
+    // Вложенные вызовы не блокируются на занятых потоках
+    std::atomic<int> leaves{ 0 };
+    pool.parallelFor(8, [&](size_t) {
+        pool.parallelFor(8, [&](size_t) { ++leaves; });
+    });
+    EXPECT_EQ(leaves.load(), 64);
+}
+
+// -----------------------------------------
+// -------- ТЕСТЫ ДЛЯ СБОРКИ И СОРТИРОВКИ --
+// -----------------------------------------
+
+class BulkVectorTest : public ::testing::Test {};
+
+// Сборка снизу вверх дает то же дерево, что и append
+TEST_F(BulkVectorTest, BuildsSameTreeAsAppend) {
+    PersistentHashing::enable();
+    for (size_t size : { 0u, 1u, 31u, 32u, 33u, 1024u, 1025u, 40000u }) {
+        std::vector<int> values(size);
+        for (size_t i = 0; i < size; ++i) {
+            values[i] = static_cast<int>(i * 3);
+        }
+        PersistentVector<int> appended;
+        for (int value : values) {
+            appended = appended.append(value);
+        }
+        PersistentVector<int> built(values.data(), values.data() + values.size());
+
+        EXPECT_EQ(built.size(), size);
+        EXPECT_TRUE(built == appended);
+        if (size > 0) {
+            EXPECT_EQ(built.hash(), appended.hash());
+            EXPECT_EQ(built[size - 1], static_cast<int>((size - 1) * 3));
+            EXPECT_EQ(built.pop_back().toStdVector(), appended.pop_back().toStdVector());
+        }
+        // После сборки вектор изменяется как обычно
+        PersistentVector<int> grown = built.append(-1);
+        EXPECT_EQ(grown[size], -1);
+        EXPECT_EQ(grown.size(), size + 1);
+        EXPECT_EQ(built.toStdVector(), values);
+    }
+    PersistentHashing::disable();
+}
+
+// Сортировка на нескольких потоках совпадает с std::sort
+TEST_F(BulkVectorTest, SortsInParallel) {
+    std::mt19937 random(5);
+    std::vector<int> values(50000);
+    for (auto& value : values) {
+        value = static_cast<int>(random() % 1000);
+    }
+    PersistentVector<int> source(values);
+    std::vector<int> expected = values;
+    std::sort(expected.begin(), expected.end());
+
+    PersistentThreadPool::instance().resize(3);
+    PersistentVector<int> ascending = source.sorted();
+    PersistentVector<int> descending = source.sorted(std::greater<int>());
+    PersistentThreadPool::instance().resize(PersistentThreadPool::defaultWorkers());
+
+    EXPECT_EQ(ascending.toStdVector(), expected);
+    EXPECT_EQ(descending[0], expected.back());
+    std::vector<int> reversed = descending.toStdVector();
+    EXPECT_TRUE(std::is_sorted(reversed.begin(), reversed.end(), std::greater<int>()));
+    EXPECT_EQ(source.toStdVector(), values);
+    EXPECT_EQ(PersistentVector<int>().sorted().size(), 0u);
+}
+
+// Равные ключи сохраняют исходный порядок
+TEST_F(BulkVectorTest, StableSortKeepsOrderOfEqualKeys) {
+    std::vector<std::pair<int, int>> items;
+    for (int i = 0; i < 30000; ++i) {
+        items.emplace_back((i * 7) % 10, i);
+    }
+    PersistentVector<std::pair<int, int>> source(std::move(items));
+    auto byKey = [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+        return a.first < b.first;
+    };
+
+    PersistentThreadPool::instance().resize(4);
+    PersistentVector<std::pair<int, int>> result = source.stable_sorted(byKey);
+    PersistentThreadPool::instance().resize(PersistentThreadPool::defaultWorkers());
+
+    ASSERT_EQ(result.size(), 30000u);
+    for (size_t i = 1; i < result.size(); ++i) {
+        const auto& previous = result[i - 1];
+        const auto& current = result[i];
+        ASSERT_TRUE(previous.first < current.first ||
+            (previous.first == current.first && previous.second < current.second));
+    }
+}
+
+// -----------------------------------------
+// -------- ТЕСТЫ ДЛЯ ХЕШЕЙ МЕРКЛА ---------
+// -----------------------------------------
+
+class MerkleHashingTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        PersistentHashing::enable();
+    }
+    void TearDown() override {
+        PersistentHashing::disable();
+    }
+};
+// Хеши, обновленные по разнице при копировании пути, совпадают
+// с посчитанными заново
+TEST_F(MerkleHashingTest, VectorHashesFollowPathCopies) {
+    PersistentVector<int> eager;
+    for (int i = 0; i < 5000; ++i) {
+        eager = eager.append(i);
+    }
+    auto edited = eager.set(1234, -1).set(4999, 7).append(5000).pop_back();
+
+    PersistentHashing::disable();
+    std::vector<int> plain = eager.toStdVector();
+    plain[1234] = -1;
+    plain[4999] = 7;
+    PersistentVector<int> lazy(plain);
+    EXPECT_EQ(edited.hash(), lazy.hash());
+    EXPECT_TRUE(edited == lazy);
+    EXPECT_NE(edited.hash(), eager.hash());
+    EXPECT_TRUE(edited != eager);
+}
+// pop_back очищает ячейку и убирает лишний уровень дерева
+TEST_F(MerkleHashingTest, PopBackKeepsCanonicalShape) {
+    PersistentVector<std::string> base;
+    for (int i = 0; i < 32; ++i) {
+        base = base.append(std::to_string(i));
+    }
+    auto popped = base.append("extra").pop_back();
+    EXPECT_EQ(popped.hash(), base.hash());
+    EXPECT_TRUE(popped == base);
+    EXPECT_EQ(popped.append("other").get(32), "other");
+    EXPECT_EQ(popped.append("other").hash(), base.append("other").hash());
+
+    auto shrunk = base;
+    while (shrunk.size() > 1) {
+        shrunk = shrunk.pop_back();
+    }
+    EXPECT_TRUE(shrunk == PersistentVector<std::string>().append("0"));
+    EXPECT_EQ(shrunk.hash(), PersistentVector<std::string>().append("0").hash());
+}
+// Хеш массива не зависит от порядка вставок и разделения листьев
+TEST_F(MerkleHashingTest, MapHashIsOrderIndependent) {
+    PersistentMap<std::string, PersistentVector<int>> forward;
+    PersistentMap<std::string, PersistentVector<int>> backward;
+    for (int i = 0; i < 300; ++i) {
+        forward = forward.set("k" + std::to_string(i), PersistentVector<int>().append(i));
+        backward = backward.set("k" + std::to_string(299 - i), PersistentVector<int>().append(299 - i));
+    }
+    EXPECT_EQ(forward.hash(), backward.hash());
+    EXPECT_TRUE(forward == backward);
+
+    auto changed = forward.set("k17", PersistentVector<int>().append(-17));
+    EXPECT_NE(changed.hash(), forward.hash());
+    EXPECT_TRUE(changed != backward);
+    EXPECT_EQ(changed.set("k17", PersistentVector<int>().append(17)).hash(), forward.hash());
+    EXPECT_EQ(forward.set("tmp", PersistentVector<int>()).erase("tmp").hash(), forward.hash());
+
+    // Тот же массив, собранный без режима хешей
+    PersistentHashing::disable();
+    PersistentMap<std::string, PersistentVector<int>> lazy;
+    for (int i = 0; i < 300; ++i) {
+        lazy = std::move(lazy).set("k" + std::to_string(i), PersistentVector<int>().append(i));
+    }
+    EXPECT_EQ(lazy.hash(), forward.hash());
+}
+// update обновляет хеши по разнице так же, как set
+TEST_F(MerkleHashingTest, UpdateHashesMatchSet) {
+    PersistentVector<int> vec;
+    PersistentMap<int, int> map;
+    for (int i = 0; i < 2000; ++i) {
+        vec = std::move(vec).append(i);
+        map = std::move(map).set(i, i);
+    }
+    vec.hash();
+    map.hash();
+    auto negate = [](int x) -> std::optional<int> { return -x; };
+    EXPECT_EQ(vec.update(1500, negate).hash(), vec.set(1500, -1500).hash());
+    EXPECT_EQ(map.update(700, [](const int* x) -> std::optional<int> { return -*x; }).hash(),
+        map.set(700, -700).hash());
+    EXPECT_EQ(map.update(5000, [](const int*) -> std::optional<int> { return 1; }).hash(),
+        map.set(5000, 1).hash());
+}
+
+// -----------------------------------------
+// --------- ТЕСТЫ ДЛЯ РЕПЛИКАЦИИ ----------
+// -----------------------------------------
+
+class ReplicationTest : public ::testing::Test {
+protected:
+    // Обмен сообщениями без канала
+    template<typename S>
+    static void synchronize(ReplicationSender<S>& sender, ReplicationReceiver<S>& receiver) {
+        for (std::string message = sender.start(); !message.empty();
+            message = sender.handle(receiver.handle(message))) {
+        }
+    }
+};
+// Небольшое изменение передает только новые узлы
+TEST_F(ReplicationTest, TransfersOnlyMissingNodes) {
+    PersistentMap<int, int> primary;
+    for (int i = 0; i < 50000; ++i) {
+        primary = std::move(primary).set(i, i);
+    }
+    ReplicationReceiver<PersistentMap<int, int>> replica;
+
+    ReplicationSender<PersistentMap<int, int>> full(primary);
+    synchronize(full, replica);
+    EXPECT_TRUE(replica.version() == primary);
+    EXPECT_EQ(replica.version().size(), 50000);
+
+    auto before = replica.version();
+    for (int i = 0; i < 10; ++i) {
+        primary = primary.set(i * 4999, -i);
+    }
+    primary = primary.set(100000, 1);
+    ReplicationSender<PersistentMap<int, int>> delta(primary);
+    synchronize(delta, replica);
+
+    EXPECT_TRUE(replica.version() == primary);
+    EXPECT_EQ(replica.version().at(4999), -1);
+    EXPECT_EQ(replica.version().at(100000), 1);
+    EXPECT_LT(delta.bytesSent() * 50, full.bytesSent());
+    EXPECT_LE(delta.nodesSent(), 11 * 5);
+    EXPECT_GT(replica.nodesReused(), 0);
+    // Прежняя версия реплики не изменилась
+    EXPECT_EQ(before.at(4999), 4999);
+
+    // Повторная синхронизация той же версии - один обмен вопросом о корне
+    ReplicationSender<PersistentMap<int, int>> same(primary);
+    synchronize(same, replica);
+    EXPECT_EQ(same.nodesSent(), 0);
+}
+// Синхронизация через канал между потоками, значения - вложенные структуры
+TEST_F(ReplicationTest, ReplicatesOverPipe) {
+    using Map = PersistentMap<std::string, PersistentVector<int>>;
+    Map primary;
+    for (int i = 0; i < 2000; ++i) {
+        primary = primary.set("row" + std::to_string(i), PersistentVector<int>().append(i).append(i * 2));
+    }
+    ReplicationReceiver<Map> replica;
+
+    for (int round = 0; round < 3; ++round) {
+        primary = primary.set("row" + std::to_string(round), PersistentVector<int>().append(-round));
+        ReplicationPipe pipe;
+        ReplicationSender<Map> sender(primary);
+        std::thread replicaThread([&] { replica.serve(pipe.replica()); });
+        sender.run(pipe.primary());
+        replicaThread.join();
+
+        EXPECT_TRUE(replica.version() == primary);
+    }
+    EXPECT_EQ(replica.version().at("row2").get(0), -2);
+    EXPECT_EQ(replica.version().at("row1999").get(1), 3998);
+}
+// Реплика с расходящейся версией сходится к версии отправителя
+TEST_F(ReplicationTest, ConvergesFromDivergentVersion) {
+    PersistentMap<std::string, int> base;
+    for (int i = 0; i < 1000; ++i) {
+        base = base.set("k" + std::to_string(i), i);
+    }
+    ReplicationReceiver<PersistentMap<std::string, int>> replica(base.set("stale", 1).erase("k5"));
+    auto primary = base.set("k7", 70);
+
+    ReplicationSender<PersistentMap<std::string, int>> sender(primary);
+    synchronize(sender, replica);
+    EXPECT_TRUE(replica.version() == primary);
+    EXPECT_FALSE(replica.version().contains("stale"));
+    EXPECT_EQ(replica.version().at("k5"), 5);
+}
+// Версия реплики, измененная пользователем на месте, не выдается
+// за узлы отправителя
+TEST_F(ReplicationTest, IgnoresNodesChangedInPlace) {
+    using Map = PersistentMap<int, int>;
+    for (int count : { 4, 5000 }) {
+        Map v1;
+        for (int i = 0; i < count; ++i) {
+            v1 = std::move(v1).set(i * 10, i);
+        }
+        Map v2 = v1.set(10, -1);
+        ReplicationReceiver<Map> replica;
+
+        ReplicationSender<Map> first(v1);
+        synchronize(first, replica);
+        Map mine = replica.version();
+        ReplicationSender<Map> second(v2);
+        synchronize(second, replica);
+        mine = std::move(mine).set(7, 7);
+
+        ReplicationSender<Map> again(v1);
+        synchronize(again, replica);
+        EXPECT_TRUE(replica.version() == v1);
+        EXPECT_EQ(replica.version().size(), static_cast<size_t>(count));
+        EXPECT_FALSE(replica.version().contains(7));
+
+        ReplicationSender<Map> next(v2);
+        synchronize(next, replica);
+        EXPECT_TRUE(replica.version() == v2);
+        EXPECT_TRUE(mine.contains(7));
+    }
+}
+// Кадры сообщений в потоке
+TEST_F(ReplicationTest, StreamChannelFramesMessages) {
+    std::stringstream wire;
+    StreamChannel channel(wire, wire);
+    channel.send("first");
+    channel.send(std::string("\0binary\0", 8));
+    EXPECT_EQ(channel.receive(), "first");
+    EXPECT_EQ(channel.receive(), std::string("\0binary\0", 8));
+    EXPECT_THROW(channel.receive(), std::runtime_error);
+}
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
 }
\ No newline at end of file
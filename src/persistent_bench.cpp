@@ -0,0 +1,427 @@
+#include "persistent_vector.hpp"
+#include "persistent_map.hpp"
+#include "persistent_replication.hpp"
+#include "persistent_json.hpp"
+#include "persistent_hashcons.hpp"
+#include "persistent_atom.hpp"
+#include "persistent_parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// -----------------------------------------
+// -------- Замеры производительности ------
+// -----------------------------------------
+//
+// Стоимость режима хешей Меркла (PersistentHashing): копирование пути
+// с хешами и без, сравнение и хеширование версий. Объем репликации
+// версии массива после небольшого изменения. Скорость разбора
+// и записи JSON. Пакетные изменения и сборка массива и вектора
+// против изменений по одному, сортировка вектора.
+//
+//   persistent_bench [количество элементов]
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    double elapsedMs(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    template<typename F>
+    double measure(F&& body) {
+        auto start = Clock::now();
+        body();
+        return elapsedMs(start);
+    }
+
+    void report(const char* name, double off, double on) {
+        std::printf("%-34s %10.1f ms %10.1f ms %+8.1f%%\n", name, off, on, (on / off - 1.0) * 100.0);
+    }
+
+    // Один прогон сценариев; возвращает времена по порядку
+    std::vector<double> run(size_t n, bool merkle) {
+        if (merkle) {
+            PersistentHashing::enable();
+        }
+        else {
+            PersistentHashing::disable();
+        }
+        std::vector<double> times;
+        std::mt19937_64 random(42);
+        size_t checksum = 0;
+
+        PersistentVector<long> vector;
+        times.push_back(measure([&] {
+            for (size_t i = 0; i < n; ++i) {
+                vector = std::move(vector).append(static_cast<long>(i));
+            }
+        }));
+
+        // Каждая версия сохраняется на шаг - путь копируется, а не меняется на месте
+        times.push_back(measure([&] {
+            PersistentVector<long> version = vector;
+            for (size_t i = 0; i < n; ++i) {
+                version = version.set(random() % n, static_cast<long>(i));
+            }
+            checksum += version.size();
+        }));
+
+        PersistentMap<long, long> map;
+        times.push_back(measure([&] {
+            for (size_t i = 0; i < n; ++i) {
+                map = map.set(static_cast<long>(random() % (n * 2)), static_cast<long>(i));
+            }
+        }));
+
+        // Хеш версии после одного изменения: в режиме Меркла известен сразу
+        times.push_back(measure([&] {
+            for (size_t i = 0; i < 100; ++i) {
+                checksum += vector.set(i, -1).hash();
+                checksum += map.set(static_cast<long>(i), -1).hash();
+            }
+        }));
+
+        // Сравнение версий, различающихся одним значением
+        auto other = map.set(static_cast<long>(n), -1);
+        times.push_back(measure([&] {
+            for (size_t i = 0; i < 100; ++i) {
+                checksum += (map == other.set(static_cast<long>(i), -2)) ? 1 : 0;
+            }
+        }));
+
+        if (checksum == 0) {
+            std::printf("\n");
+        }
+        PersistentHashing::disable();
+        return times;
+    }
+
+    template<typename S>
+    void synchronize(ReplicationSender<S>& sender, ReplicationReceiver<S>& receiver) {
+        for (std::string message = sender.start(); !message.empty();
+            message = sender.handle(receiver.handle(message))) {
+        }
+    }
+
+    // Полная передача массива и передача после 10 изменений
+    void replication(size_t n) {
+        PersistentMap<long, long> primary;
+        for (size_t i = 0; i < n; ++i) {
+            primary = std::move(primary).set(static_cast<long>(i), static_cast<long>(i));
+        }
+        ReplicationReceiver<PersistentMap<long, long>> replica;
+        ReplicationSender<PersistentMap<long, long>> full(primary);
+        double fullMs = measure([&] { synchronize(full, replica); });
+
+        for (long i = 0; i < 10; ++i) {
+            primary = primary.set(i * 7919, -i);
+        }
+        ReplicationSender<PersistentMap<long, long>> delta(primary);
+        double deltaMs = measure([&] { synchronize(delta, replica); });
+
+        std::printf("\nreplication of %zu entries\n", n);
+        std::printf("%-34s %10zu bytes %6zu nodes %8.1f ms\n", "full", full.bytesSent(), full.nodesSent(), fullMs);
+        std::printf("%-34s %10zu bytes %6zu nodes %8.1f ms %zu rounds\n", "after 10 updates",
+            delta.bytesSent(), delta.nodesSent(), deltaMs, delta.rounds());
+    }
+
+    // Массив из n/10 документов; МБ/с по размеру текста
+    void json(size_t n) {
+        std::string text = "[";
+        for (size_t i = 0; i < n / 10; ++i) {
+            text += (i ? "," : "");
+            text += "{\"id\":" + std::to_string(i) + ",\"name\":\"user " + std::to_string(i) +
+                "\",\"score\":" + std::to_string(i * 0.25) + ",\"active\":true,\"tags\":[\"red\",\"green\"]," +
+                "\"address\":{\"city\":\"Moscow\",\"street\":\"Tverskaya\",\"zip\":\"125009\"}}";
+        }
+        text += "]";
+        double megabytes = static_cast<double>(text.size()) / (1024.0 * 1024.0);
+
+        // Только события разбора, без построения дерева
+        struct Counter : JsonHandler {
+            size_t values = 0;
+            void null() override { ++values; }
+            void boolean(bool) override { ++values; }
+            void integer(int) override { ++values; }
+            void number(double) override { ++values; }
+            void string(std::string_view) override { ++values; }
+            void beginObject() override {}
+            void key(std::string_view) override {}
+            void endObject() override { ++values; }
+            void beginArray() override {}
+            void endArray() override { ++values; }
+        } counter;
+        double parseMs = measure([&] { JsonReader::parse(text, counter); });
+
+        PersistentValue document;
+        double readMs = measure([&] { document = JsonReader::read(text); });
+        document = PersistentValue();
+        StringPool pool;
+        double pooledMs = measure([&] { document = JsonReader::read(text, &pool); });
+        // Повторяющиеся адреса и списки тегов сводятся к одной коробке
+        document = PersistentValue();
+        HashConsTable table;
+        double consedMs = measure([&] { document = JsonReader::read(text, table); });
+        std::string output;
+        output.reserve(text.size());
+        double writeMs = measure([&] { JsonWriter(output).write(document); });
+
+        std::printf("\njson, %.1f MB\n", megabytes);
+        std::printf("%-34s %10.1f ms %8.0f MB/s\n", "parse (events only)", parseMs, megabytes / parseMs * 1000.0);
+        std::printf("%-34s %10.1f ms %8.0f MB/s\n", "read", readMs, megabytes / readMs * 1000.0);
+        std::printf("%-34s %10.1f ms %8.0f MB/s\n", "read (interned strings)", pooledMs, megabytes / pooledMs * 1000.0);
+        std::printf("%-34s %10.1f ms %8.0f MB/s  (%zu structures, %zu reused)\n", "read (hash-consed)",
+            consedMs, megabytes / consedMs * 1000.0, table.values(), table.reused());
+        std::printf("%-34s %10.1f ms %8.0f MB/s\n", "write", writeMs, megabytes / writeMs * 1000.0);
+    }
+
+    // Текущая версия под мьютексом - для сравнения с Atom
+    template<typename S>
+    class LockedCell {
+    public:
+        explicit LockedCell(S initial) : current(std::move(initial)) {
+        }
+        S load() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return current;
+        }
+        template<typename F>
+        void swap(F&& fn) {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = fn(current);
+        }
+
+    private:
+        mutable std::mutex mutex;
+        S current;
+    };
+
+    // Чтений в секунду (млн) у readers потоков при одном писателе
+    template<typename Cell>
+    double readRate(Cell& cell, size_t readers) {
+        std::atomic<bool> stop{ false };
+        std::atomic<size_t> reads{ 0 };
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < readers; ++t) {
+            threads.emplace_back([&, t] {
+                size_t local = 0;
+                long checksum = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    checksum += cell.load().get(static_cast<long>((local + t) & 1023)).value_or(0);
+                    ++local;
+                }
+                reads.fetch_add(local, std::memory_order_relaxed);
+                if (checksum < 0) {
+                    std::printf("unexpected checksum\n");
+                }
+            });
+        }
+        threads.emplace_back([&] {
+            for (long i = 0; !stop.load(std::memory_order_relaxed); ++i) {
+                cell.swap([i](const PersistentMap<long, long>& map) { return map.set(i & 1023, i); });
+                std::this_thread::yield();
+            }
+        });
+        auto start = Clock::now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        stop.store(true);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return static_cast<double>(reads.load()) / elapsedMs(start) / 1000.0;
+    }
+
+    void atom() {
+        PersistentMap<long, long> initial;
+        for (long i = 0; i < 1024; ++i) {
+            initial = std::move(initial).set(i, i);
+        }
+        Atom<PersistentMap<long, long>> shared(initial);
+        LockedCell<PersistentMap<long, long>> locked(initial);
+
+        std::printf("\nreaders of a shared map, one writer (%u hardware threads)\n",
+            std::thread::hardware_concurrency());
+        std::printf("%-34s %13s %13s\n", "", "Atom", "mutex");
+        for (size_t readers = 1; readers <= 64; readers *= 2) {
+            double atomRate = readRate(shared, readers);
+            double lockedRate = readRate(locked, readers);
+            std::printf("%-26s %4zu    %8.2f M/s  %8.2f M/s\n", "reader threads", readers, atomRate, lockedRate);
+        }
+    }
+
+    // 10K изменений массива из n записей: по одному и пакетом
+    void batch(size_t n) {
+        PersistentHashing::disable();
+        PersistentMap<long, long> base;
+        for (size_t i = 0; i < n; ++i) {
+            base = std::move(base).set(static_cast<long>(i), static_cast<long>(i));
+        }
+        std::mt19937_64 random(7);
+        std::vector<std::pair<long, long>> updates;
+        std::vector<long> keys;
+        for (long i = 0; i < 10000; ++i) {
+            long key = static_cast<long>(random() % (n + n / 10 + 1));
+            updates.emplace_back(key, i);
+            keys.push_back(key);
+        }
+
+        std::printf("\n10000 changes of a map with %zu entries\n", n);
+        std::printf("%-34s %13s %13s\n", "", "one by one", "batch");
+        PersistentMap<long, long> single;
+        PersistentMap<long, long> batched;
+        double setMs = measure([&] {
+            single = base;
+            for (const auto& [key, value] : updates) {
+                single = single.set(key, value);
+            }
+        });
+        double setManyMs = measure([&] { batched = base.setMany(updates); });
+        std::printf("%-34s %10.1f ms %10.1f ms\n", "set / setMany", setMs, setManyMs);
+        double eraseMs = measure([&] {
+            for (long key : keys) {
+                single = single.erase(key);
+            }
+        });
+        double eraseManyMs = measure([&] { batched = batched.eraseMany(keys); });
+        std::printf("%-34s %10.1f ms %10.1f ms\n", "erase / eraseMany", eraseMs, eraseManyMs);
+        if (!(single == batched)) {
+            std::printf("batched map differs\n");
+        }
+    }
+
+    // Сборка массива из n пар: вставками по одному и одним пакетом
+    void mapBuild(size_t n) {
+        PersistentHashing::disable();
+        std::vector<std::pair<long, long>> pairs;
+        for (size_t i = 0; i < n; ++i) {
+            pairs.emplace_back(static_cast<long>(i * 2654435761u), static_cast<long>(i));
+        }
+        std::printf("\nbuild a map of %zu pairs (%zu threads)\n", n,
+            PersistentThreadPool::instance().concurrency());
+        PersistentMap<long, long> single;
+        double setMs = measure([&] {
+            for (const auto& [key, value] : pairs) {
+                single = std::move(single).set(key, value);
+            }
+        });
+        size_t built = 0;
+        double batchMs = measure([&] { built = PersistentMap<long, long>(pairs).size(); });
+        std::printf("%-34s %10.1f ms %10.1f ms\n", "set in place / batch build", setMs, batchMs);
+        if (built != single.size()) {
+            std::printf("batch build differs\n");
+        }
+    }
+
+    // Отсортированная версия вектора: вручную (копия, std::sort,
+    // append по одному) и sorted(); сборка из std::vector
+    void vectorSort(size_t n) {
+        PersistentHashing::disable();
+        std::mt19937_64 random(3);
+        std::vector<long> values(n);
+        for (auto& value : values) {
+            value = static_cast<long>(random() % 1000000);
+        }
+        PersistentVector<long> source(values);
+
+        std::printf("\nsort a vector of %zu elements (%zu threads)\n", n,
+            PersistentThreadPool::instance().concurrency());
+        std::printf("%-34s %13s %13s\n", "", "manual", "library");
+        PersistentVector<long> manual;
+        PersistentVector<long> sorted;
+        double manualMs = measure([&] {
+            std::vector<long> items;
+            for (size_t i = 0; i < source.size(); ++i) {
+                items.push_back(source.get(i));
+            }
+            std::sort(items.begin(), items.end());
+            for (long item : items) {
+                manual = std::move(manual).append(item);
+            }
+        });
+        double sortedMs = measure([&] { sorted = source.sorted(); });
+        std::printf("%-34s %10.1f ms %10.1f ms\n", "sorted()", manualMs, sortedMs);
+
+        PersistentVector<long> appended;
+        double appendMs = measure([&] {
+            for (long value : values) {
+                appended = std::move(appended).append(value);
+            }
+        });
+        PersistentVector<long> built;
+        double buildMs = measure([&] { built = PersistentVector<long>(values); });
+        std::printf("%-34s %10.1f ms %10.1f ms\n", "append in place / bottom-up", appendMs, buildMs);
+        if (!(manual == sorted) || !(appended == built)) {
+            std::printf("sorted vector differs\n");
+        }
+    }
+
+    // Шаг симуляции: изменение 5% вектора из n элементов
+    void vectorBatch(size_t n) {
+        PersistentHashing::disable();
+        PersistentVector<double> state;
+        for (size_t i = 0; i < n; ++i) {
+            state = std::move(state).append(static_cast<double>(i));
+        }
+        std::mt19937_64 random(11);
+        std::vector<size_t> indices;
+        std::vector<double> values;
+        for (size_t i = 0; i < n / 20; ++i) {
+            indices.push_back(random() % n);
+            values.push_back(static_cast<double>(i));
+        }
+
+        std::printf("\n5%% of a vector with %zu elements (%zu threads)\n", n,
+            PersistentThreadPool::instance().concurrency());
+        PersistentVector<double> single;
+        PersistentVector<double> batched;
+        double setMs = measure([&] {
+            single = state;
+            for (size_t i = 0; i < indices.size(); ++i) {
+                single = single.set(indices[i], values[i]);
+            }
+        });
+        double setManyMs = measure([&] { batched = state.setMany(indices, values); });
+        std::printf("%-34s %10.1f ms %10.1f ms\n", "set / setMany", setMs, setManyMs);
+        double updateMs = measure([&] {
+            batched = state.update(0, n / 20, [](const double& value) { return value * 0.5; });
+        });
+        std::printf("%-34s %10.1f ms\n", "update of a 5% range", updateMs);
+        if (batched.size() != single.size()) {
+            std::printf("batched vector differs\n");
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? static_cast<size_t>(std::stoul(argv[1])) : 1000000;
+    std::printf("n = %zu\n%-34s %13s %13s %9s\n", n, "", "merkle off", "merkle on", "overhead");
+
+    auto off = run(n, false);
+    auto on = run(n, true);
+    const char* names[] = {
+        "vector append (in place)",
+        "vector set (path copy)",
+        "map set (path copy)",
+        "hash() after one change x100",
+        "== of versions, one diff x100",
+    };
+    for (size_t i = 0; i < off.size(); ++i) {
+        report(names[i], off[i], on[i]);
+    }
+    replication(n);
+    json(n);
+    atom();
+    batch(n);
+    mapBuild(n);
+    vectorBatch(n);
+    vectorSort(n);
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include "persistent_hashcons.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+// -----------------------------------------
+// ----------- Вложенные значения ----------
+// -----------------------------------------
+PersistentValue HashConsTable::canonical(const PersistentValue& value) {
+    if (!value.boxed()) {
+        return value;
+    }
+    if (value.tag == ValueType::STRING) {
+        return strings.intern(value.asStringView());
+    }
+    // Коробка уже в таблице - поддерево каноническое
+    if (valueBoxes.count(value.box)) {
+        return value;
+    }
+
+    // Структура канонизируется через описание своего типа
+    PersistentValue candidate = value.structure()->structureType->canonical(value, *this);
+    size_t hash = candidate.hash();
+    auto range = valueTable.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == candidate) {
+            ++reuseCount;
+            return it->second;
+        }
+    }
+    valueTable.emplace(hash, candidate);
+    valueBoxes.insert(candidate.box);
+    grown();
+    return candidate;
+}
+
+void HashConsTable::remember(size_t hash, const void* kind, size_t level, weak_ptr<void> node) {
+    nodeTable.emplace(hash, NodeEntry{ kind, level, std::move(node) });
+    grown();
+}
+
+void HashConsTable::grown() {
+    if (nodeTable.size() + valueTable.size() < pruneAt) {
+        return;
+    }
+    prune();
+    pruneAt = max(MIN_PRUNE, 2 * (nodeTable.size() + valueTable.size()));
+}
+
+// -----------------------------------------
+// ---------------- Очистка ----------------
+// -----------------------------------------
+// Значение, удерживаемое только таблицей, отпускается; это может
+// освободить вложенные значения и узлы, поэтому проход повторяется
+size_t HashConsTable::prune() {
+    size_t removed = 0;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = valueTable.begin(); it != valueTable.end();) {
+            if (it->second.box->refs.load(memory_order_acquire) == 1) {
+                valueBoxes.erase(it->second.box);
+                it = valueTable.erase(it);
+                ++removed;
+                changed = true;
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+    for (auto it = nodeTable.begin(); it != nodeTable.end();) {
+        if (it->second.node.expired()) {
+            it = nodeTable.erase(it);
+            ++removed;
+        }
+        else {
+            ++it;
+        }
+    }
+    strings.prune();
+    return removed;
+}
@@ -0,0 +1,636 @@
+#include "persistent_json.hpp"
+#include "persistent_hashcons.hpp"
+#include "persistent_vector.hpp"
+#include "persistent_list.hpp"
+#include "persistent_map.hpp"
+
+#include <charconv>
+#include <cmath>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+// -----------------------------------------
+// ---------------- Разбор -----------------
+// -----------------------------------------
+namespace {
+    class JsonParser {
+    public:
+        JsonParser(string_view text, JsonHandler& target)
+            : begin(text.data()), pos(text.data()), end(text.data() + text.size()), handler(target) {
+        }
+
+        void document() {
+            skipSpace();
+            value(0);
+            skipSpace();
+            if (pos != end) {
+                fail("Unexpected data after document");
+            }
+        }
+
+    private:
+        const char* begin;
+        const char* pos;
+        const char* end;
+        JsonHandler& handler;
+        std::string scratch; // Строка с escape-последовательностями
+
+        [[noreturn]] void fail(const char* message) const {
+            throw runtime_error("JSON parse error at offset " + to_string(pos - begin) + ": " + message);
+        }
+
+        void skipSpace() {
+            while (pos < end && (*pos == ' ' || *pos == '\n' || *pos == '\r' || *pos == '\t')) {
+                ++pos;
+            }
+        }
+
+        void value(size_t depth) {
+            if (pos == end) {
+                fail("Unexpected end of input");
+            }
+            switch (*pos) {
+            case '{': object(depth + 1); break;
+            case '[': array(depth + 1); break;
+            case '"': handler.string(text()); break;
+            case 't': literal("true", 4); handler.boolean(true); break;
+            case 'f': literal("false", 5); handler.boolean(false); break;
+            case 'n': literal("null", 4); handler.null(); break;
+            default: number(); break;
+            }
+        }
+
+        void object(size_t depth) {
+            if (depth > JsonReader::MAX_DEPTH) {
+                fail("Nesting too deep");
+            }
+            ++pos;
+            handler.beginObject();
+            skipSpace();
+            if (pos < end && *pos == '}') {
+                ++pos;
+                handler.endObject();
+                return;
+            }
+            while (true) {
+                if (pos == end || *pos != '"') {
+                    fail("Expected object key");
+                }
+                handler.key(text());
+                skipSpace();
+                if (pos == end || *pos != ':') {
+                    fail("Expected ':'");
+                }
+                ++pos;
+                skipSpace();
+                value(depth);
+                skipSpace();
+                if (pos < end && *pos == ',') {
+                    ++pos;
+                    skipSpace();
+                    continue;
+                }
+                if (pos < end && *pos == '}') {
+                    ++pos;
+                    handler.endObject();
+                    return;
+                }
+                fail("Expected ',' or '}'");
+            }
+        }
+
+        void array(size_t depth) {
+            if (depth > JsonReader::MAX_DEPTH) {
+                fail("Nesting too deep");
+            }
+            ++pos;
+            handler.beginArray();
+            skipSpace();
+            if (pos < end && *pos == ']') {
+                ++pos;
+                handler.endArray();
+                return;
+            }
+            while (true) {
+                value(depth);
+                skipSpace();
+                if (pos < end && *pos == ',') {
+                    ++pos;
+                    skipSpace();
+                    continue;
+                }
+                if (pos < end && *pos == ']') {
+                    ++pos;
+                    handler.endArray();
+                    return;
+                }
+                fail("Expected ',' or ']'");
+            }
+        }
+
+        void literal(const char* word, size_t length) {
+            if (static_cast<size_t>(end - pos) < length || string_view(pos, length) != string_view(word, length)) {
+                fail("Invalid literal");
+            }
+            pos += length;
+        }
+
+        // Строка: без escape-последовательностей - прямо из входного буфера
+        string_view text() {
+            const char* start = ++pos;
+            while (pos < end) {
+                unsigned char c = static_cast<unsigned char>(*pos);
+                if (c == '"') {
+                    return string_view(start, static_cast<size_t>(pos++ - start));
+                }
+                if (c == '\\' || c < 0x20) {
+                    break;
+                }
+                ++pos;
+            }
+            scratch.assign(start, pos);
+            while (true) {
+                if (pos == end) {
+                    fail("Unterminated string");
+                }
+                unsigned char c = static_cast<unsigned char>(*pos++);
+                if (c == '"') {
+                    return scratch;
+                }
+                if (c < 0x20) {
+                    --pos;
+                    fail("Control character in string");
+                }
+                if (c != '\\') {
+                    scratch.push_back(static_cast<char>(c));
+                    continue;
+                }
+                if (pos == end) {
+                    fail("Unterminated string");
+                }
+                switch (*pos++) {
+                case '"': scratch.push_back('"'); break;
+                case '\\': scratch.push_back('\\'); break;
+                case '/': scratch.push_back('/'); break;
+                case 'b': scratch.push_back('\b'); break;
+                case 'f': scratch.push_back('\f'); break;
+                case 'n': scratch.push_back('\n'); break;
+                case 'r': scratch.push_back('\r'); break;
+                case 't': scratch.push_back('\t'); break;
+                case 'u': codePoint(); break;
+                default:
+                    --pos;
+                    fail("Invalid escape sequence");
+                }
+            }
+        }
+
+        uint32_t hex4() {
+            if (end - pos < 4) {
+                fail("Invalid \\u escape");
+            }
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i) {
+                char c = *pos++;
+                value <<= 4;
+                if (c >= '0' && c <= '9') value |= static_cast<uint32_t>(c - '0');
+                else if (c >= 'a' && c <= 'f') value |= static_cast<uint32_t>(c - 'a' + 10);
+                else if (c >= 'A' && c <= 'F') value |= static_cast<uint32_t>(c - 'A' + 10);
+                else fail("Invalid \\u escape");
+            }
+            return value;
+        }
+
+        // \uXXXX (и суррогатная пара) в UTF-8
+        void codePoint() {
+            uint32_t code = hex4();
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                if (end - pos < 2 || pos[0] != '\\' || pos[1] != 'u') {
+                    fail("Unpaired surrogate");
+                }
+                pos += 2;
+                uint32_t low = hex4();
+                if (low < 0xDC00 || low > 0xDFFF) {
+                    fail("Unpaired surrogate");
+                }
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            }
+            else if (code >= 0xDC00 && code <= 0xDFFF) {
+                fail("Unpaired surrogate");
+            }
+
+            if (code < 0x80) {
+                scratch.push_back(static_cast<char>(code));
+            }
+            else if (code < 0x800) {
+                scratch.push_back(static_cast<char>(0xC0 | (code >> 6)));
+                scratch.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+            else if (code < 0x10000) {
+                scratch.push_back(static_cast<char>(0xE0 | (code >> 12)));
+                scratch.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                scratch.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+            else {
+                scratch.push_back(static_cast<char>(0xF0 | (code >> 18)));
+                scratch.push_back(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+                scratch.push_back(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+                scratch.push_back(static_cast<char>(0x80 | (code & 0x3F)));
+            }
+        }
+
+        bool digit() const {
+            return pos < end && *pos >= '0' && *pos <= '9';
+        }
+
+        // Грамматика числа JSON; целые, помещающиеся в int, - integer()
+        void number() {
+            const char* start = pos;
+            bool integral = true;
+            if (*pos == '-') {
+                ++pos;
+            }
+            if (pos < end && *pos == '0') {
+                ++pos;
+            }
+            else if (digit()) {
+                while (digit()) ++pos;
+            }
+            else {
+                fail("Unexpected character");
+            }
+            if (pos < end && *pos == '.') {
+                integral = false;
+                ++pos;
+                if (!digit()) fail("Invalid number");
+                while (digit()) ++pos;
+            }
+            if (pos < end && (*pos == 'e' || *pos == 'E')) {
+                integral = false;
+                ++pos;
+                if (pos < end && (*pos == '+' || *pos == '-')) ++pos;
+                if (!digit()) fail("Invalid number");
+                while (digit()) ++pos;
+            }
+
+            if (integral) {
+                int value = 0;
+                auto parsed = from_chars(start, pos, value);
+                if (parsed.ec == errc() && parsed.ptr == pos) {
+                    handler.integer(value);
+                    return;
+                }
+            }
+            double value = 0;
+            auto parsed = from_chars(start, pos, value);
+            if (parsed.ec != errc() || parsed.ptr != pos) {
+                fail("Number out of range");
+            }
+            handler.number(value);
+        }
+    };
+
+    // Сборка дерева: открытые объекты и массивы - на стеке, каждый
+    // растет на месте; готовое значение добавляется в родителя
+    class ValueBuilder : public JsonHandler {
+    public:
+        ValueBuilder(StringPool* strings, HashConsTable* canonical) : pool(strings), table(canonical) {
+        }
+
+        PersistentValue result;
+
+        void null() override {
+            add(PersistentValue());
+        }
+        void boolean(bool value) override {
+            add(PersistentValue(value));
+        }
+        void integer(int value) override {
+            add(PersistentValue(value));
+        }
+        void number(double value) override {
+            add(PersistentValue(value));
+        }
+        void string(string_view value) override {
+            add(pool ? pool->intern(value) : PersistentValue(value));
+        }
+        void beginObject() override {
+            open(true);
+        }
+        void key(string_view name) override {
+            stack[depth - 1].key.assign(name.data(), name.size());
+        }
+        void endObject() override {
+            Frame& frame = stack[--depth];
+            add(PersistentValue(std::move(frame.object)));
+            frame.object = PersistentMap<std::string, PersistentValue>();
+        }
+        void beginArray() override {
+            open(false);
+        }
+        void endArray() override {
+            Frame& frame = stack[--depth];
+            add(PersistentValue(std::move(frame.array)));
+            frame.array = PersistentVector<PersistentValue>();
+        }
+
+    private:
+        struct Frame {
+            bool isObject = false;
+            std::string key;
+            PersistentMap<std::string, PersistentValue> object;
+            PersistentVector<PersistentValue> array;
+        };
+
+        StringPool* pool;
+        HashConsTable* table; // Готовые значения сводятся к каноническим
+        std::vector<Frame> stack; // Кадры переиспользуются между уровнями
+        size_t depth = 0;
+
+        void open(bool isObject) {
+            if (depth == stack.size()) {
+                stack.emplace_back();
+            }
+            stack[depth++].isObject = isObject;
+        }
+
+        void add(PersistentValue value) {
+            if (table) {
+                value = table->canonical(value);
+            }
+            if (depth == 0) {
+                result = std::move(value);
+                return;
+            }
+            Frame& frame = stack[depth - 1];
+            if (frame.isObject) {
+                frame.object = std::move(frame.object).set(std::move(frame.key), std::move(value));
+            }
+            else {
+                frame.array = std::move(frame.array).append(std::move(value));
+            }
+        }
+    };
+}
+
+void JsonReader::parse(string_view text, JsonHandler& handler) {
+    JsonParser(text, handler).document();
+}
+
+namespace {
+    std::string readAll(istream& in) {
+        std::string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+        if (in.bad()) {
+            throw runtime_error("JSON read failed");
+        }
+        return text;
+    }
+}
+
+PersistentValue JsonReader::read(string_view text, StringPool* pool) {
+    ValueBuilder builder(pool, nullptr);
+    parse(text, builder);
+    return std::move(builder.result);
+}
+
+PersistentValue JsonReader::read(istream& in, StringPool* pool) {
+    return read(string_view(readAll(in)), pool);
+}
+
+PersistentValue JsonReader::read(string_view text, HashConsTable& table) {
+    ValueBuilder builder(nullptr, &table);
+    parse(text, builder);
+    return std::move(builder.result);
+}
+
+PersistentValue JsonReader::read(istream& in, HashConsTable& table) {
+    return read(string_view(readAll(in)), table);
+}
+
+// -----------------------------------------
+// ---------------- Запись -----------------
+// -----------------------------------------
+void JsonWriter::element() {
+    if (separate) {
+        out.push_back(',');
+    }
+    separate = true;
+}
+
+void JsonWriter::null() {
+    element();
+    out.append("null", 4);
+}
+
+void JsonWriter::boolean(bool value) {
+    element();
+    if (value) {
+        out.append("true", 4);
+    }
+    else {
+        out.append("false", 5);
+    }
+}
+
+void JsonWriter::integer(int value) {
+    element();
+    char buffer[16];
+    auto written = to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, written.ptr);
+}
+
+// Кратчайшая точная запись; у целых дописывается ".0", чтобы
+// при чтении число осталось double. NaN и бесконечности - null
+void JsonWriter::number(double value) {
+    if (!isfinite(value)) {
+        null();
+        return;
+    }
+    element();
+    char buffer[32];
+    auto written = to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, written.ptr);
+    if (string_view(buffer, static_cast<size_t>(written.ptr - buffer)).find_first_of(".e") == string_view::npos) {
+        out.append(".0", 2);
+    }
+}
+
+namespace {
+    // Символы, которые в строке JSON экранируются
+    struct EscapeTable {
+        bool escaped[256] = {};
+
+        EscapeTable() {
+            for (int c = 0; c < 0x20; ++c) {
+                escaped[c] = true;
+            }
+            escaped[static_cast<unsigned char>('"')] = true;
+            escaped[static_cast<unsigned char>('\\')] = true;
+        }
+    };
+    const EscapeTable ESCAPES;
+}
+
+void JsonWriter::string(string_view value) {
+    static const char HEX[] = "0123456789abcdef";
+    element();
+    out.push_back('"');
+    size_t run = 0; // Начало участка без экранирования
+    for (size_t i = 0; i < value.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (!ESCAPES.escaped[c]) {
+            continue;
+        }
+        out.append(value.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+        case '"': out.append("\\\"", 2); break;
+        case '\\': out.append("\\\\", 2); break;
+        case '\n': out.append("\\n", 2); break;
+        case '\r': out.append("\\r", 2); break;
+        case '\t': out.append("\\t", 2); break;
+        case '\b': out.append("\\b", 2); break;
+        case '\f': out.append("\\f", 2); break;
+        default: {
+            char escaped[6] = { '\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 15] };
+            out.append(escaped, sizeof(escaped));
+        }
+        }
+    }
+    out.append(value.data() + run, value.size() - run);
+    out.push_back('"');
+}
+
+void JsonWriter::beginObject() {
+    element();
+    out.push_back('{');
+    separate = false;
+}
+
+void JsonWriter::key(string_view name) {
+    string(name);
+    out.push_back(':');
+    separate = false;
+}
+
+void JsonWriter::endObject() {
+    out.push_back('}');
+    separate = true;
+}
+
+void JsonWriter::beginArray() {
+    element();
+    out.push_back('[');
+    separate = false;
+}
+
+void JsonWriter::endArray() {
+    out.push_back(']');
+    separate = true;
+}
+
+template<typename T>
+void JsonWriter::writeElement(const T& value) {
+    if constexpr (is_same_v<T, int>) {
+        integer(value);
+    }
+    else if constexpr (is_same_v<T, bool>) {
+        boolean(value);
+    }
+    else if constexpr (is_same_v<T, int64_t>) {
+        if (value >= numeric_limits<int>::min() && value <= numeric_limits<int>::max()) {
+            integer(static_cast<int>(value));
+        }
+        else {
+            number(static_cast<double>(value));
+        }
+    }
+    else if constexpr (is_floating_point_v<T>) {
+        number(value);
+    }
+    else if constexpr (is_same_v<T, std::string>) {
+        string(value);
+    }
+    else {
+        write(value);
+    }
+}
+
+template<typename S>
+void JsonWriter::writeSequence(const S& sequence) {
+    beginArray();
+    for (const auto& item : sequence) {
+        writeElement(item);
+    }
+    endArray();
+}
+
+namespace {
+    // Вызов fn(TypeTag<T>) для типа элементов, поддерживаемого записью
+    template<typename T>
+    struct TypeTag {
+        using type = T;
+    };
+
+    template<typename F>
+    void withElementType(const PersistentValue& value, F&& fn) {
+        if (value.hasElementType<PersistentValue>()) fn(TypeTag<PersistentValue>());
+        else if (value.hasElementType<int>()) fn(TypeTag<int>());
+        else if (value.hasElementType<double>()) fn(TypeTag<double>());
+        else if (value.hasElementType<std::string>()) fn(TypeTag<std::string>());
+        else if (value.hasElementType<int64_t>()) fn(TypeTag<int64_t>());
+        else if (value.hasElementType<float>()) fn(TypeTag<float>());
+        else if (value.hasElementType<bool>()) fn(TypeTag<bool>());
+        else throw runtime_error("Unsupported element type for JSON");
+    }
+}
+
+void JsonWriter::write(const PersistentValue& value) {
+    switch (value.type()) {
+    case ValueType::NULL_VALUE:
+        null();
+        break;
+    case ValueType::INT:
+        integer(value.asInt());
+        break;
+    case ValueType::DOUBLE:
+        number(value.asDouble());
+        break;
+    case ValueType::BOOL:
+        boolean(value.asBool());
+        break;
+    case ValueType::STRING:
+        string(value.asStringView());
+        break;
+    case ValueType::VECTOR:
+        withElementType(value, [&](auto tag) {
+            using T = typename decltype(tag)::type;
+            writeSequence(value.vectorRef<T>());
+        });
+        break;
+    case ValueType::LIST:
+        withElementType(value, [&](auto tag) {
+            using T = typename decltype(tag)::type;
+            writeSequence(value.listRef<T>());
+        });
+        break;
+    case ValueType::MAP:
+        if (!value.hasKeyType<std::string>()) {
+            throw runtime_error("JSON object keys must be strings");
+        }
+        withElementType(value, [&](auto tag) {
+            using V = typename decltype(tag)::type;
+            beginObject();
+            for (const auto& entry : value.mapRef<std::string, V>()) {
+                key(entry.first);
+                writeElement(entry.second);
+            }
+            endObject();
+        });
+        break;
+    }
+}
@@ -0,0 +1,160 @@
+#include "persistent_mapped.hpp"
+
+#include <ostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// -----------------------------------------
+// ---------- Отображаемый файл ------------
+// -----------------------------------------
+#ifdef _WIN32
+MappedFile::MappedFile(const string& path) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw runtime_error("Cannot open " + path);
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        throw runtime_error("Not a mapped snapshot: " + path);
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        throw runtime_error("Cannot map " + path);
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        throw runtime_error("Cannot map " + path);
+    }
+    base = static_cast<const char*>(view);
+    length = static_cast<size_t>(fileSize.QuadPart);
+    fileHandle = file;
+    mappingHandle = mapping;
+}
+
+MappedFile::~MappedFile() {
+    UnmapViewOfFile(base);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+}
+#else
+MappedFile::MappedFile(const string& path) {
+    descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) {
+        throw runtime_error("Cannot open " + path);
+    }
+    struct stat info;
+    if (::fstat(descriptor, &info) != 0 || info.st_size == 0) {
+        ::close(descriptor);
+        throw runtime_error("Not a mapped snapshot: " + path);
+    }
+    // Разделяемое отображение: страницы общие для всех процессов
+    void* view = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, descriptor, 0);
+    if (view == MAP_FAILED) {
+        ::close(descriptor);
+        throw runtime_error("Cannot map " + path);
+    }
+    base = static_cast<const char*>(view);
+    length = static_cast<size_t>(info.st_size);
+}
+
+MappedFile::~MappedFile() {
+    ::munmap(const_cast<char*>(base), length);
+    ::close(descriptor);
+}
+#endif
+
+// -----------------------------------------
+// ---------- Буфер записи снимка ----------
+// -----------------------------------------
+void MappedOutput::write(const void* bytes, size_t count) {
+    stream.write(static_cast<const char*>(bytes), static_cast<streamsize>(count));
+    if (!stream) {
+        throw runtime_error("Snapshot write failed");
+    }
+    pos += count;
+}
+
+void MappedOutput::align() {
+    static const char zeros[persistent_mapped_detail::ALIGNMENT] = {};
+    size_t padding = (persistent_mapped_detail::ALIGNMENT - pos % persistent_mapped_detail::ALIGNMENT) %
+        persistent_mapped_detail::ALIGNMENT;
+    write(zeros, padding);
+}
+
+// -----------------------------------------
+// ------------- Запись снимка -------------
+// -----------------------------------------
+void MappedSnapshotWriter::begin(MappedOutput& out, uint32_t kind, uint32_t keyTag, uint32_t valueTag,
+    uint64_t size, uint64_t shift, uint64_t hashProbe) {
+    MappedHeader header = {};
+    memcpy(header.magic, persistent_mapped_detail::HEADER_MAGIC, sizeof(header.magic));
+    header.version = persistent_mapped_detail::FORMAT_VERSION;
+    header.kind = kind;
+    header.keyTag = keyTag;
+    header.valueTag = valueTag;
+    header.size = size;
+    header.shift = shift;
+    header.hashProbe = hashProbe;
+    out.write(&header, sizeof(header));
+}
+
+void MappedSnapshotWriter::finish(MappedOutput& out, uint64_t root) {
+    MappedTrailer trailer = {};
+    trailer.root = root;
+    memcpy(trailer.magic, persistent_mapped_detail::TRAILER_MAGIC, sizeof(trailer.magic));
+    out.align();
+    out.write(&trailer, sizeof(trailer));
+}
+
+// -----------------------------------------
+// --------- Общая часть представлений -----
+// -----------------------------------------
+MappedViewBase::MappedViewBase(shared_ptr<const MappedFile> mapped, uint32_t kind,
+    uint32_t keyTag, uint32_t valueTag, uint64_t hashProbe)
+    : file(std::move(mapped)), header(), root(0) {
+    if (file->size() < sizeof(MappedHeader) + sizeof(MappedTrailer)) {
+        throw runtime_error("Not a mapped snapshot");
+    }
+    memcpy(&header, file->data(), sizeof(header));
+    MappedTrailer trailer;
+    memcpy(&trailer, file->data() + file->size() - sizeof(trailer), sizeof(trailer));
+
+    if (memcmp(header.magic, persistent_mapped_detail::HEADER_MAGIC, sizeof(header.magic)) != 0 ||
+        memcmp(trailer.magic, persistent_mapped_detail::TRAILER_MAGIC, sizeof(trailer.magic)) != 0) {
+        throw runtime_error("Not a mapped snapshot");
+    }
+    // Другая версия формата или порядок байт
+    if (header.version != persistent_mapped_detail::FORMAT_VERSION) {
+        throw runtime_error("Unsupported mapped snapshot format version");
+    }
+    if (header.kind != kind || header.keyTag != keyTag || header.valueTag != valueTag) {
+        throw runtime_error("Mapped snapshot type mismatch");
+    }
+    // Поиск по массиву повторяет хеширование при записи
+    if (header.hashProbe != hashProbe) {
+        throw runtime_error("Mapped snapshot was written with an incompatible std::hash");
+    }
+    if (header.shift % 5 != 0 || header.shift >= 64) {
+        throw runtime_error("Corrupted mapped snapshot");
+    }
+    root = trailer.root;
+    file->range(root, sizeof(uint64_t));
+}
@@ -0,0 +1,334 @@
+#include "persistent_oplog.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+    constexpr char LOG_MAGIC[6] = { 'P', 'D', 'S', 'L', 'O', 'G' }; // Сигнатура журнала
+    constexpr uint16_t LOG_VERSION = 1;
+    constexpr size_t LOG_HEADER_SIZE = sizeof(LOG_MAGIC) + sizeof(LOG_VERSION);
+    constexpr size_t FRAME_HEADER_SIZE = 8; // Длина (4 байта) и контрольная сумма (4 байта)
+    constexpr size_t SCAN_CHUNK = 1 << 20; // Файл журнала читается блоками по 1 МБ
+
+    // Контрольная сумма записи (FNV-1a)
+    uint32_t checksum(const char* data, size_t size) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= static_cast<uint8_t>(data[i]);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    void writeU32(char* data, uint32_t value) {
+        for (size_t i = 0; i < 4; ++i) {
+            data[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+    }
+
+    uint32_t readU32(const char* data) {
+        uint32_t value = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+        }
+        return value;
+    }
+
+    void checkHeader(const char* data) {
+        if (memcmp(data, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0) {
+            throw runtime_error("Not an operation log");
+        }
+        persistent_snapshot_detail::Cursor version(data + sizeof(LOG_MAGIC), data + LOG_HEADER_SIZE);
+        if (version.fixed(sizeof(LOG_VERSION)) != LOG_VERSION) {
+            throw runtime_error("Unsupported operation log format version");
+        }
+    }
+
+    // Разбор целых кадров из [data, data + size); возвращает длину
+    // разобранной части. corrupt - кадр с неверной суммой (дальше
+    // читать нельзя); иначе остаток - начало неполного кадра
+    size_t scanFrames(const char* data, size_t size,
+        const function<void(const OperationLogBase::Record&)>& visit, bool& corrupt) {
+        size_t pos = 0;
+        corrupt = false;
+        while (size - pos >= FRAME_HEADER_SIZE) {
+            uint32_t length = readU32(data + pos);
+            uint32_t sum = readU32(data + pos + 4);
+            if (size - pos - FRAME_HEADER_SIZE < length) {
+                break;
+            }
+            const char* payload = data + pos + FRAME_HEADER_SIZE;
+            if (checksum(payload, length) != sum) {
+                corrupt = true;
+                break;
+            }
+
+            persistent_snapshot_detail::Cursor in(payload, payload + length);
+            OperationLogBase::Record record{ 0, LogOp::SET, in, string_view() };
+            record.lsn = in.varint();
+            record.op = static_cast<LogOp>(in.byte());
+            record.args = in.take(in.varint());
+            record.nested = string_view(in.position(), static_cast<size_t>(payload + length - in.position()));
+            visit(record);
+
+            pos += FRAME_HEADER_SIZE + length;
+        }
+        return pos;
+    }
+
+    string logHeader() {
+        string header(LOG_MAGIC, sizeof(LOG_MAGIC));
+        persistent_snapshot_detail::putFixed(header, LOG_VERSION, sizeof(LOG_VERSION));
+        return header;
+    }
+
+    // Снимок без узлов - для записей без вложенных структур
+    const string& emptySnapshot() {
+        static const string bytes = [] {
+            ostringstream out;
+            SnapshotWriter writer(out);
+            writer.flush();
+            return out.str();
+        }();
+        return bytes;
+    }
+}
+
+// -----------------------------------------
+// ------ Открытие и закрытие журнала ------
+// -----------------------------------------
+OperationLogBase::OperationLogBase(const string& path, OperationLogOptions options)
+    : filePath(path), settings(options) {
+    size_t valid = scanFile(path, [this](const Record& record) {
+        appended = record.lsn;
+    });
+    bool fresh = valid == 0;
+    // Отрезаем оборванную запись, чтобы дописывать после целых
+    if (!fresh && valid < filesystem::file_size(path)) {
+        filesystem::resize_file(path, valid);
+    }
+    durable = appended;
+
+#ifdef _WIN32
+    int flags = _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY | (fresh ? _O_TRUNC : 0);
+    descriptor = ::_open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+    int flags = O_WRONLY | O_CREAT | O_APPEND | (fresh ? O_TRUNC : 0);
+    descriptor = ::open(path.c_str(), flags, 0644);
+#endif
+    if (descriptor < 0) {
+        throw runtime_error("Cannot open " + path);
+    }
+    if (fresh) {
+        size_t offset = 0;
+        writeAll(logHeader(), offset);
+        syncFile();
+    }
+}
+
+OperationLogBase::~OperationLogBase() {
+    try {
+        sync();
+    }
+    catch (...) {
+        // Ошибку записи из деструктора сообщить некому
+    }
+#ifdef _WIN32
+    ::_close(descriptor);
+#else
+    ::close(descriptor);
+#endif
+}
+
+// -----------------------------------------
+// ---------- Платформенная запись ---------
+// -----------------------------------------
+// Запись bytes начиная с offset; offset продвигается по мере записи,
+// поэтому после ошибки известно, какая часть уже в файле
+void OperationLogBase::writeAll(const string& bytes, size_t& offset) {
+    while (offset < bytes.size()) {
+        const char* data = bytes.data() + offset;
+        size_t left = bytes.size() - offset;
+#ifdef _WIN32
+        int written = ::_write(descriptor, data, static_cast<unsigned>(left));
+#else
+        ssize_t written = ::write(descriptor, data, left);
+#endif
+        if (written < 0) {
+#ifndef _WIN32
+            if (errno == EINTR) {
+                continue;
+            }
+#endif
+            throw runtime_error("Log write failed: " + filePath);
+        }
+        offset += static_cast<size_t>(written);
+    }
+}
+
+void OperationLogBase::syncFile() {
+    if (!settings.fsync) {
+        return;
+    }
+#ifdef _WIN32
+    int result = ::_commit(descriptor);
+#else
+    int result = ::fsync(descriptor);
+#endif
+    if (result != 0) {
+        throw runtime_error("Log sync failed: " + filePath);
+    }
+}
+
+// -----------------------------------------
+// ------------ Добавление записи ----------
+// -----------------------------------------
+// Кадр: длина, контрольная сумма, полезная нагрузка
+// (LSN, код операции, аргументы, мини-снимок вложенных узлов).
+// Кадр собирается сразу в буфере группы, длина и сумма дописываются
+// в зарезервированный заголовок
+uint64_t OperationLogBase::appendRecord(LogOp op, const string& args, const string& nested) {
+    lock_guard<std::mutex> lock(mutex);
+    uint64_t lsn = appended + 1;
+    size_t frame = pending.size();
+    pending.append(FRAME_HEADER_SIZE, '\0');
+    persistent_snapshot_detail::putVarint(pending, lsn);
+    pending.push_back(static_cast<char>(op));
+    persistent_snapshot_detail::putVarint(pending, args.size());
+    pending.append(args);
+    pending.append(nested);
+
+    const char* payload = pending.data() + frame + FRAME_HEADER_SIZE;
+    size_t length = pending.size() - frame - FRAME_HEADER_SIZE;
+    writeU32(&pending[frame], static_cast<uint32_t>(length));
+    writeU32(&pending[frame + 4], checksum(payload, length));
+    appended = lsn;
+    return lsn;
+}
+
+// -----------------------------------------
+// ---------- Групповая фиксация -----------
+// -----------------------------------------
+// Первый пришедший поток становится лидером: забирает все накопленные
+// записи, пишет и синхронизирует их одним вызовом без блокировки.
+// Остальные ждут; их записи либо уже вошли в группу лидера, либо
+// войдут в следующую. При ошибке в очередь возвращается только та
+// часть группы, которая не дошла до файла: повтор дописывает ее
+// следом, и записи не дублируются.
+void OperationLogBase::commit(uint64_t lsn) {
+    unique_lock<std::mutex> lock(mutex);
+    if (lsn > appended) {
+        throw out_of_range("LSN was not appended");
+    }
+    while (durable < lsn) {
+        if (leaderActive) {
+            flushed.wait(lock);
+            continue;
+        }
+        leaderActive = true;
+        string batch;
+        batch.swap(pending);
+        uint64_t target = appended;
+        size_t written = 0;
+        lock.unlock();
+        try {
+            writeAll(batch, written);
+            syncFile();
+        }
+        catch (...) {
+            lock.lock();
+            pending.insert(0, batch, written, string::npos);
+            leaderActive = false;
+            flushed.notify_all();
+            throw;
+        }
+        lock.lock();
+        durable = target;
+        ++syncCount;
+        leaderActive = false;
+        flushed.notify_all();
+    }
+}
+
+uint64_t OperationLogBase::lastLsn() const {
+    lock_guard<std::mutex> lock(mutex);
+    return appended;
+}
+
+uint64_t OperationLogBase::durableLsn() const {
+    lock_guard<std::mutex> lock(mutex);
+    return durable;
+}
+
+size_t OperationLogBase::syncs() const {
+    lock_guard<std::mutex> lock(mutex);
+    return syncCount;
+}
+
+// -----------------------------------------
+// ------------- Чтение журнала ------------
+// -----------------------------------------
+size_t OperationLogBase::scan(const string& bytes, const function<void(const Record&)>& visit) {
+    if (bytes.size() < LOG_HEADER_SIZE) {
+        throw runtime_error("Not an operation log");
+    }
+    checkHeader(bytes.data());
+    bool corrupt = false;
+    return LOG_HEADER_SIZE + scanFrames(bytes.data() + LOG_HEADER_SIZE, bytes.size() - LOG_HEADER_SIZE,
+        visit, corrupt);
+}
+
+// Файл читается блоками: в памяти только блок и неполный кадр на его
+// границе, поэтому журнал любой длины проходится с постоянной памятью
+size_t OperationLogBase::scanFile(const string& path, const function<void(const Record&)>& visit) {
+    ifstream in(path, ios::binary);
+    string buffer(LOG_HEADER_SIZE, '\0');
+    if (!in || !in.read(&buffer[0], static_cast<streamsize>(LOG_HEADER_SIZE))) {
+        return 0;
+    }
+    checkHeader(buffer.data());
+
+    size_t valid = LOG_HEADER_SIZE;
+    buffer.clear();
+    bool end = false;
+    while (true) {
+        bool corrupt = false;
+        size_t used = scanFrames(buffer.data(), buffer.size(), visit, corrupt);
+        valid += used;
+        if (corrupt || end) {
+            return valid;
+        }
+        // Неполный кадр переносится в начало, блок дочитывается за ним
+        buffer.erase(0, used);
+        size_t kept = buffer.size();
+        buffer.resize(kept + SCAN_CHUNK);
+        in.read(&buffer[kept], static_cast<streamsize>(SCAN_CHUNK));
+        size_t got = static_cast<size_t>(in.gcount());
+        buffer.resize(kept + got);
+        end = got < SCAN_CHUNK;
+    }
+}
+
+// Записи без вложенных структур (обычный случай) читаются через
+// один пустой reader потока, без разбора снимка на каждую запись
+SnapshotReader& OperationLogBase::nestedReader(const Record& record, optional<SnapshotReader>& storage) {
+    if (record.nested.empty()) {
+        thread_local SnapshotReader empty(emptySnapshot());
+        return empty;
+    }
+    return storage.emplace(string(record.nested));
+}
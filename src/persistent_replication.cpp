@@ -0,0 +1,51 @@
+#include "persistent_replication.hpp"
+
+#include <stdexcept>
+
+using namespace std;
+
+// -----------------------------------------
+// ------------ Канал в потоке -------------
+// -----------------------------------------
+void StreamChannel::send(const string& message) {
+    string frame;
+    persistent_snapshot_detail::putFixed(frame, message.size(), 4);
+    frame += message;
+    out.write(frame.data(), static_cast<streamsize>(frame.size()));
+    out.flush();
+    if (!out) {
+        throw runtime_error("Replication stream write failed");
+    }
+}
+
+string StreamChannel::receive() {
+    char header[4];
+    if (!in.read(header, sizeof(header))) {
+        throw runtime_error("Replication stream closed");
+    }
+    persistent_snapshot_detail::Cursor length(header, header + sizeof(header));
+    string message(static_cast<size_t>(length.fixed(4)), '\0');
+    if (!in.read(&message[0], static_cast<streamsize>(message.size()))) {
+        throw runtime_error("Replication stream closed");
+    }
+    return message;
+}
+
+// -----------------------------------------
+// --------- Канал внутри процесса ---------
+// -----------------------------------------
+void ReplicationPipe::End::send(const string& message) {
+    {
+        lock_guard<mutex> lock(outgoing.mutex);
+        outgoing.messages.push_back(message);
+    }
+    outgoing.ready.notify_one();
+}
+
+string ReplicationPipe::End::receive() {
+    unique_lock<mutex> lock(incoming.mutex);
+    incoming.ready.wait(lock, [this] { return !incoming.messages.empty(); });
+    string message = std::move(incoming.messages.front());
+    incoming.messages.pop_front();
+    return message;
+}
@@ -1,276 +1,380 @@
-#include "persistent_value.hpp"
-#include "persistent_vector.hpp"
-#include "persistent_list.hpp"
-#include "persistent_map.hpp"
-
-#include <stdexcept>
-#include <sstream>
-#include <typeinfo>
-#include <iostream>
-
-using namespace std;
-
-// -----------------------------------------
-// -------------- Конструкторы -------------
-// -----------------------------------------
-template<typename T>
-PersistentValue::PersistentValue(const PersistentVector<T>& vector)
-    : data(make_shared<VectorHolder>(make_shared<PersistentVector<T>>(vector))) {
-}
-
-template<typename T>
-PersistentValue::PersistentValue(const PersistentList<T>& list)
-    : data(make_shared<ListHolder>(make_shared<PersistentList<T>>(list))) {
-}
-
-template<typename K, typename V>
-PersistentValue::PersistentValue(const PersistentMap<K, V>& map)
-    : data(make_shared<MapHolder>(make_shared<PersistentMap<K, V>>(map))) {
-}
-
-template<typename T>
-PersistentValue::PersistentValue(shared_ptr<PersistentVector<T>> vector)
-    : data(make_shared<VectorHolder>(vector)) {
-}
-
-template<typename T>
-PersistentValue::PersistentValue(shared_ptr<PersistentList<T>> list)
-    : data(make_shared<ListHolder>(list)) {
-}
-
-template<typename K, typename V>
-PersistentValue::PersistentValue(shared_ptr<PersistentMap<K, V>> map)
-    : data(make_shared<MapHolder>(map)) {
-}
-
-template PersistentValue::PersistentValue(const PersistentVector<int>&);
-template PersistentValue::PersistentValue(const PersistentVector<double>&);
-template PersistentValue::PersistentValue(const PersistentVector<string>&);
-template PersistentValue::PersistentValue(const PersistentVector<PersistentValue>&);
-
-template PersistentValue::PersistentValue(const PersistentList<int>&);
-template PersistentValue::PersistentValue(const PersistentList<double>&);
-template PersistentValue::PersistentValue(const PersistentList<string>&);
-template PersistentValue::PersistentValue(const PersistentList<PersistentValue>&);
-
-template PersistentValue::PersistentValue(const PersistentMap<string, int>&);
-template PersistentValue::PersistentValue(const PersistentMap<string, double>&);
-template PersistentValue::PersistentValue(const PersistentMap<string, string>&);
-template PersistentValue::PersistentValue(const PersistentMap<string, PersistentValue>&);
-
-// -----------------------------------------
-// ---- Получение значений с проверкой -----
-// -----------------------------------------
-template<typename T>
-shared_ptr<PersistentVector<T>> PersistentValue::asVector() const {
-    if (!isVector()) {
-        throw runtime_error("Not a vector");
-    }
-    auto holder = std::get<shared_ptr<VectorHolder>>(data);
-    auto ptr = holder->get<T>();
-    if (!ptr) {
-        throw runtime_error("Vector type mismatch");
-    }
-    return ptr;
-}
-
-template<typename T>
-shared_ptr<PersistentList<T>> PersistentValue::asList() const {
-    if (!isList()) {
-        throw runtime_error("Not a list");
-    }
-    auto holder = std::get<shared_ptr<ListHolder>>(data);
-    auto ptr = holder->get<T>();
-    if (!ptr) {
-        throw runtime_error("List type mismatch");
-    }
-    return ptr;
-}
-
-template<typename K, typename V>
-shared_ptr<PersistentMap<K, V>> PersistentValue::asMap() const {
-    if (!isMap()) {
-        throw runtime_error("Not a map");
-    }
-    auto holder = std::get<shared_ptr<MapHolder>>(data);
-    auto ptr = holder->get<K, V>();
-    if (!ptr) {
-        throw runtime_error("Map type mismatch");
-    }
-    return ptr;
-}
-
-template shared_ptr<PersistentVector<int>> PersistentValue::asVector<int>() const;
-template shared_ptr<PersistentVector<double>> PersistentValue::asVector<double>() const;
-template shared_ptr<PersistentVector<string>> PersistentValue::asVector<string>() const;
-template shared_ptr<PersistentVector<PersistentValue>> PersistentValue::asVector<PersistentValue>() const;
-
-template shared_ptr<PersistentList<int>> PersistentValue::asList<int>() const;
-template shared_ptr<PersistentList<double>> PersistentValue::asList<double>() const;
-template shared_ptr<PersistentList<string>> PersistentValue::asList<string>() const;
-template shared_ptr<PersistentList<PersistentValue>> PersistentValue::asList<PersistentValue>() const;
-
-template shared_ptr<PersistentMap<string, int>> PersistentValue::asMap<string, int>() const;
-template shared_ptr<PersistentMap<string, double>> PersistentValue::asMap<string, double>() const;
-template shared_ptr<PersistentMap<string, string>> PersistentValue::asMap<string, string>() const;
-template shared_ptr<PersistentMap<string, PersistentValue>> PersistentValue::asMap<string, PersistentValue>() const;
-
-// -----------------------------------------
-// -- Реализация вспомогательных методов ---
-// -----------------------------------------
-type_index PersistentValue::getElementType() const {
-    if (isVector()) {
-        auto holder = std::get<shared_ptr<VectorHolder>>(data);
-        return holder->getElementType();
-    }
-    if (isList()) {
-        auto holder = std::get<shared_ptr<ListHolder>>(data);
-        return holder->getElementType();
-    }
-    throw runtime_error("Not a collection type");
-}
-
-type_index PersistentValue::getKeyType() const {
-    if (isMap()) {
-        auto holder = std::get<shared_ptr<MapHolder>>(data);
-        return holder->getKeyType();
-    }
-    throw runtime_error("Not a map");
-}
-
-type_index PersistentValue::getValueType() const {
-    if (isMap()) {
-        auto holder = std::get<shared_ptr<MapHolder>>(data);
-        return holder->getValueType();
-    }
-    throw runtime_error("Not a map");
-}
-
-PersistentValue PersistentValue::clone() const {
-    if (isInt()) return PersistentValue(asInt());
-    if (isDouble()) return PersistentValue(asDouble());
-    if (isBool()) return PersistentValue(asBool());
-    if (isString()) return PersistentValue(asString());
-
-    if (isVector()) {
-        throw runtime_error("Vector clone not implemented");
-    }
-    if (isList()) {
-        throw runtime_error("List clone not implemented");
-    }
-    if (isMap()) {
-        throw runtime_error("Map clone not implemented");
-    }
-
-    return PersistentValue();
-}
-
-string PersistentValue::toString() const {
-    ostringstream oss;
-
-    if (isNull()) {
-        oss << "null";
-    }
-    else if (isInt()) {
-        oss << asInt();
-    }
-    else if (isDouble()) {
-        oss << asDouble();
-    }
-    else if (isBool()) {
-        oss << (asBool() ? "true" : "false");
-    }
-    else if (isString()) {
-        oss << '"' << asString() << '"';
-    }
-    else if (isVector()) {
-        oss << "[Vector<" << getElementType().name() << ">]";
-    }
-    else if (isList()) {
-        oss << "[List<" << getElementType().name() << ">]";
-    }
-    else if (isMap()) {
-        oss << "[Map<" << getKeyType().name() << ", " << getValueType().name() << ">]";
-    }
-
-    return oss.str();
-}
-
-// -----------------------------------------
-// ------------ Проверки типов -------------
-// -----------------------------------------
-
-PersistentValue::PersistentValue() : data(monostate{}) {}
-
-PersistentValue::PersistentValue(int value) : data(value) {}
-
-PersistentValue::PersistentValue(double value) : data(value) {}
-
-PersistentValue::PersistentValue(bool value) : data(value) {}
-
-PersistentValue::PersistentValue(const string& value) : data(value) {}
-
-PersistentValue::PersistentValue(const char* value) : data(string(value)) {}
-
-ValueType PersistentValue::type() const {
-    return static_cast<ValueType>(data.index());
-}
-
-bool PersistentValue::isNull() const { return data.index() == 0; }
-bool PersistentValue::isInt() const { return data.index() == 1; }
-bool PersistentValue::isDouble() const { return data.index() == 2; }
-bool PersistentValue::isBool() const { return data.index() == 3; }
-bool PersistentValue::isString() const { return data.index() == 4; }
-bool PersistentValue::isVector() const { return data.index() == 5; }
-bool PersistentValue::isList() const { return data.index() == 6; }
-bool PersistentValue::isMap() const { return data.index() == 7; }
-
-int PersistentValue::asInt() const {
-    if (!isInt()) throw runtime_error("Not an integer");
-    return std::get<int>(data);
-}
-
-double PersistentValue::asDouble() const {
-    if (!isDouble()) throw runtime_error("Not a double");
-    return std::get<double>(data);
-}
-
-bool PersistentValue::asBool() const {
-    if (!isBool()) throw runtime_error("Not a boolean");
-    return std::get<bool>(data);
-}
-
-string PersistentValue::asString() const {
-    if (!isString()) throw runtime_error("Not a string");
-    return std::get<string>(data);
-}
-
-// -----------------------------------------
-// --------------- Сравнение ---------------
-// -----------------------------------------
-bool PersistentValue::operator==(const PersistentValue& other) const {
-    if (type() != other.type()) return false;
-
-    switch (type()) {
-    case ValueType::NULL_VALUE: return true;
-    case ValueType::INT: return asInt() == other.asInt();
-    case ValueType::DOUBLE: return asDouble() == other.asDouble();
-    case ValueType::BOOL: return asBool() == other.asBool();
-    case ValueType::STRING: return asString() == other.asString();
-        // Для структур сравниваем указатели
-    case ValueType::VECTOR:
-        return std::get<shared_ptr<VectorHolder>>(data) ==
-            std::get<shared_ptr<VectorHolder>>(other.data);
-    case ValueType::LIST:
-        return std::get<shared_ptr<ListHolder>>(data) ==
-            std::get<shared_ptr<ListHolder>>(other.data);
-    case ValueType::MAP:
-        return std::get<shared_ptr<MapHolder>>(data) ==
-            std::get<shared_ptr<MapHolder>>(other.data);
-    }
-    return false;
-}
-
-bool PersistentValue::operator!=(const PersistentValue& other) const {
-    return !(*this == other);
-}
\ No newline at end of file
+#include "persistent_value.hpp"
+#include "persistent_json.hpp"
+
+#include <stdexcept>
+#include <iostream>
+
+using namespace std;
+
+// -----------------------------------------
+// -- Реализация вспомогательных методов ---
+// -----------------------------------------
+type_index PersistentValue::getElementType() const {
+    if (isVector() || isList()) {
+        return structure()->structureType->elementType;
+    }
+    throw runtime_error("Not a collection type");
+}
+
+type_index PersistentValue::getKeyType() const {
+    if (isMap()) {
+        return structure()->structureType->keyType;
+    }
+    throw runtime_error("Not a map");
+}
+
+type_index PersistentValue::getValueType() const {
+    if (isMap()) {
+        return structure()->structureType->elementType;
+    }
+    throw runtime_error("Not a map");
+}
+
+PersistentValue PersistentValue::clone() const {
+    return *this;
+}
+
+PersistentValue PersistentValue::deepCopy() const {
+    if (isString()) return PersistentValue(string(asString()));
+    if (isVector() || isList() || isMap()) {
+        return structure()->structureType->deepCopy(structure());
+    }
+    return *this;
+}
+
+// -----------------------------------------
+// -------- Вложенные изменения по пути ----
+// -----------------------------------------
+PersistentValue PersistentValue::setIn(const ValuePath& path, PersistentValue value) const {
+    return updateIn(path, 0, [&value](const PersistentValue&) { return std::move(value); });
+}
+
+PersistentValue PersistentValue::updateIn(const ValuePath& path,
+    const function<PersistentValue(const PersistentValue&)>& fn) const {
+    return updateIn(path, 0, fn);
+}
+
+// Один проход: спуск по пути, на обратном ходе каждый уровень
+// копирует путь своей структуры к измененному потомку
+PersistentValue PersistentValue::updateIn(const ValuePath& path, size_t depth,
+    const function<PersistentValue(const PersistentValue&)>& fn) const {
+    if (depth == path.size()) {
+        return fn(*this);
+    }
+    const PathStep& step = path[depth];
+    bool changed = false;
+
+    if (step.isIndex()) {
+        const auto& vector = vectorRef<PersistentValue>();
+        size_t index = step.index();
+        if (index > vector.size()) {
+            throw out_of_range("Path index out of range");
+        }
+        if (index == vector.size()) {
+            return PersistentValue(vector.append(PersistentValue().updateIn(path, depth + 1, fn)));
+        }
+        auto updated = vector.update(index, [&](const PersistentValue& child) -> optional<PersistentValue> {
+            PersistentValue next = child.updateIn(path, depth + 1, fn);
+            if (next.identical(child)) {
+                return nullopt;
+            }
+            changed = true;
+            return next;
+        });
+        return changed ? PersistentValue(std::move(updated)) : *this;
+    }
+
+    // Отсутствующий промежуточный уровень - пустой массив
+    static const PersistentMap<string, PersistentValue> EMPTY;
+    const auto& map = isNull() ? EMPTY : mapRef<string, PersistentValue>();
+    auto updated = map.update(step.key(), [&](const PersistentValue* child) -> optional<PersistentValue> {
+        PersistentValue next = (child ? *child : PersistentValue()).updateIn(path, depth + 1, fn);
+        if (child && next.identical(*child)) {
+            return nullopt;
+        }
+        changed = true;
+        return next;
+    });
+    return changed ? PersistentValue(std::move(updated)) : *this;
+}
+
+optional<PersistentValue> PersistentValue::getIn(const ValuePath& path) const {
+    const PersistentValue* current = this;
+    optional<PersistentValue> found;
+    for (const PathStep& step : path) {
+        if (step.isIndex()) {
+            if (!current->isVector()) {
+                return nullopt;
+            }
+            const auto& vector = current->vectorRef<PersistentValue>();
+            if (step.index() >= vector.size()) {
+                return nullopt;
+            }
+            current = &vector.get(step.index());
+        }
+        else {
+            if (!current->isMap()) {
+                return nullopt;
+            }
+            found = current->mapRef<string, PersistentValue>().get(step.key());
+            if (!found) {
+                return nullopt;
+            }
+            current = &*found;
+        }
+    }
+    return *current;
+}
+
+// JSON (persistent_json.hpp)
+string PersistentValue::toString() const {
+    string text;
+    JsonWriter(text).write(*this);
+    return text;
+}
+
+// -----------------------------------------
+// ------------ Проверки типов -------------
+// -----------------------------------------
+
+PersistentValue::PersistentValue() : tag(ValueType::NULL_VALUE), bits(0) {}
+
+PersistentValue::PersistentValue(int value) : tag(ValueType::INT), bits(0) {
+    intValue = value;
+}
+
+PersistentValue::PersistentValue(double value) : tag(ValueType::DOUBLE), doubleValue(value) {}
+
+PersistentValue::PersistentValue(bool value) : tag(ValueType::BOOL), bits(0) {
+    boolValue = value;
+}
+
+PersistentValue::PersistentValue(const string& value) : tag(ValueType::STRING), box(new StringBox(value)) {}
+
+PersistentValue::PersistentValue(string&& value) : tag(ValueType::STRING), box(new StringBox(std::move(value))) {}
+
+PersistentValue::PersistentValue(string_view value) : tag(ValueType::STRING), box(new StringBox(string(value))) {}
+
+PersistentValue::PersistentValue(const char* value) : tag(ValueType::STRING), box(new StringBox(value)) {}
+
+// -----------------------------------------
+// ---------- Счетчик ссылок коробки -------
+// -----------------------------------------
+void PersistentValue::retain() const {
+    if (boxed()) {
+        box->refs.fetch_add(1, memory_order_relaxed);
+    }
+}
+
+void PersistentValue::releaseBox(ValueType kind, const Box* box) {
+    if (box->refs.fetch_sub(1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    if (kind == ValueType::STRING) {
+        delete static_cast<const StringBox*>(box);
+    }
+    else {
+        auto holder = static_cast<const StructureBox*>(box);
+        holder->structureType->destroy(holder);
+    }
+}
+
+void PersistentValue::release() {
+    if (boxed()) {
+        releaseBox(tag, box);
+    }
+    tag = ValueType::NULL_VALUE;
+    bits = 0;
+}
+
+PersistentValue::PersistentValue(const PersistentValue& other) : tag(other.tag), bits(other.bits) {
+    retain();
+}
+
+PersistentValue::PersistentValue(PersistentValue&& other) noexcept : tag(other.tag), bits(other.bits) {
+    other.tag = ValueType::NULL_VALUE;
+    other.bits = 0;
+}
+
+PersistentValue& PersistentValue::operator=(const PersistentValue& other) {
+    if (this != &other) {
+        other.retain();
+        release();
+        tag = other.tag;
+        bits = other.bits;
+    }
+    return *this;
+}
+
+PersistentValue& PersistentValue::operator=(PersistentValue&& other) noexcept {
+    if (this != &other) {
+        release();
+        tag = other.tag;
+        bits = other.bits;
+        other.tag = ValueType::NULL_VALUE;
+        other.bits = 0;
+    }
+    return *this;
+}
+
+PersistentValue::~PersistentValue() {
+    release();
+}
+
+ValueType PersistentValue::type() const {
+    return tag;
+}
+
+bool PersistentValue::isNull() const { return tag == ValueType::NULL_VALUE; }
+bool PersistentValue::isInt() const { return tag == ValueType::INT; }
+bool PersistentValue::isDouble() const { return tag == ValueType::DOUBLE; }
+bool PersistentValue::isBool() const { return tag == ValueType::BOOL; }
+bool PersistentValue::isString() const { return tag == ValueType::STRING; }
+bool PersistentValue::isVector() const { return tag == ValueType::VECTOR; }
+bool PersistentValue::isList() const { return tag == ValueType::LIST; }
+bool PersistentValue::isMap() const { return tag == ValueType::MAP; }
+
+int PersistentValue::asInt() const {
+    if (!isInt()) throw runtime_error("Not an integer");
+    return intValue;
+}
+
+double PersistentValue::asDouble() const {
+    if (!isDouble()) throw runtime_error("Not a double");
+    return doubleValue;
+}
+
+bool PersistentValue::asBool() const {
+    if (!isBool()) throw runtime_error("Not a boolean");
+    return boolValue;
+}
+
+const string& PersistentValue::asString() const {
+    if (!isString()) throw runtime_error("Not a string");
+    return static_cast<const StringBox*>(box)->value;
+}
+
+string_view PersistentValue::asStringView() const {
+    return asString();
+}
+
+// -----------------------------------------
+// --------------- Сравнение ---------------
+// -----------------------------------------
+bool PersistentValue::operator==(const PersistentValue& other) const {
+    if (type() != other.type()) return false;
+
+    switch (type()) {
+    case ValueType::NULL_VALUE: return true;
+    case ValueType::INT: return asInt() == other.asInt();
+    case ValueType::DOUBLE: return asDouble() == other.asDouble();
+    case ValueType::BOOL: return asBool() == other.asBool();
+    case ValueType::STRING: {
+        auto left = static_cast<const StringBox*>(box);
+        auto right = static_cast<const StringBox*>(other.box);
+        if (left == right) return true;
+        // Разные коробки одного пула - разные строки
+        if (left->pool != 0 && left->pool == right->pool) return false;
+        return left->value == right->value;
+    }
+        // Для структур - та же коробка или равное содержимое того же типа
+    case ValueType::VECTOR:
+    case ValueType::LIST:
+    case ValueType::MAP: {
+        const StructureBox* left = structure();
+        const StructureBox* right = other.structure();
+        if (left == right) return true;
+        return left->structureType == right->structureType &&
+            left->structureType->equals(left, right);
+    }
+    }
+    return false;
+}
+
+bool PersistentValue::operator!=(const PersistentValue& other) const {
+    return !(*this == other);
+}
+
+// -----------------------------------------
+// --------------- Хеширование -------------
+// -----------------------------------------
+size_t PersistentValue::hash() const {
+    size_t value = 0;
+    switch (type()) {
+    case ValueType::NULL_VALUE: break;
+    case ValueType::INT: value = std::hash<int>()(intValue); break;
+    case ValueType::DOUBLE: value = std::hash<double>()(doubleValue); break;
+    case ValueType::BOOL: value = std::hash<bool>()(boolValue); break;
+    case ValueType::STRING: value = std::hash<string>()(static_cast<const StringBox*>(box)->value); break;
+    case ValueType::VECTOR:
+    case ValueType::LIST:
+    case ValueType::MAP:
+        value = structure()->structureType->hash(structure());
+        break;
+    }
+    return persistent_hash_detail::combine(static_cast<size_t>(type()), value);
+}
+
+// -----------------------------------------
+// ---------- Интернирование строк ---------
+// -----------------------------------------
+StringPool::StringPool() {
+    static atomic<uint32_t> nextId{ 1 };
+    id = nextId.fetch_add(1, memory_order_relaxed);
+}
+
+StringPool::~StringPool() {
+    for (const auto& entry : entries) {
+        PersistentValue::releaseBox(ValueType::STRING, entry.second);
+    }
+}
+
+StringPool& StringPool::global() {
+    static StringPool pool;
+    return pool;
+}
+
+PersistentValue StringPool::intern(string_view text) {
+    PersistentValue result;
+    lock_guard<std::mutex> lock(mutex);
+    auto found = entries.find(text);
+    const StringBox* box;
+    if (found != entries.end()) {
+        box = found->second;
+        box->refs.fetch_add(1, memory_order_relaxed);
+    }
+    else {
+        // Одна ссылка у пула, вторая - у результата
+        auto created = new StringBox(string(text));
+        created->pool = id;
+        created->refs.store(2, memory_order_relaxed);
+        entries.emplace(string_view(created->value), created);
+        box = created;
+    }
+    result.tag = ValueType::STRING;
+    result.box = box;
+    return result;
+}
+
+size_t StringPool::prune() {
+    lock_guard<std::mutex> lock(mutex);
+    size_t removed = 0;
+    for (auto it = entries.begin(); it != entries.end();) {
+        // Новые ссылки появляются только через intern под этой блокировкой
+        if (it->second->refs.load(memory_order_acquire) == 1) {
+            const StringBox* box = it->second;
+            it = entries.erase(it);
+            PersistentValue::releaseBox(ValueType::STRING, box);
+            ++removed;
+        }
+        else {
+            ++it;
+        }
+    }
+    return removed;
+}
+
+size_t StringPool::size() const {
+    lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}